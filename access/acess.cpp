@@ -23,6 +23,11 @@ int syscall_io_uring_enter(int ring_fd, unsigned int to_submit,
                          min_complete, flags, NULL, 0);
 }
 
+int syscall_io_uring_register(int ring_fd, unsigned int opcode,
+                              void *arg, unsigned int nr_args){
+    return (int) syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
 int IOHandler::_setup_uring(){
     struct io_uring_params p;
     void* sq_ptr = NULL;
@@ -68,12 +73,12 @@ int IOHandler::_setup_uring(){
         }
     }
 
-    sq_ring.head = (unsigned*) sq_ptr + p.sq_off.head;
-    sq_ring.tail = (unsigned*) sq_ptr + p.sq_off.tail;
-    sq_ring.ring_mask = (unsigned*) sq_ptr + p.sq_off.ring_mask;
-    sq_ring.ring_entries = (unsigned*) sq_ptr + p.sq_off.ring_entries;
-    sq_ring.flags = (unsigned*) sq_ptr + p.sq_off.flags;
-    sq_ring.array = (unsigned*) sq_ptr + p.sq_off.array;
+    sq_ring.head = (unsigned*) ((char*) sq_ptr + p.sq_off.head);
+    sq_ring.tail = (unsigned*) ((char*) sq_ptr + p.sq_off.tail);
+    sq_ring.ring_mask = (unsigned*) ((char*) sq_ptr + p.sq_off.ring_mask);
+    sq_ring.ring_entries = (unsigned*) ((char*) sq_ptr + p.sq_off.ring_entries);
+    sq_ring.flags = (unsigned*) ((char*) sq_ptr + p.sq_off.flags);
+    sq_ring.array = (unsigned*) ((char*) sq_ptr + p.sq_off.array);
 
     sqes = (io_uring_sqe*) mmap(NULL, p.sq_entries*sizeof(struct io_uring_sqe),
                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQES);
@@ -84,11 +89,11 @@ int IOHandler::_setup_uring(){
         throw AccessFailure(INIT, std::string(err_buff));
     }
 
-    cq_ring.head = (unsigned*) cq_ptr + p.cq_off.head;
-    cq_ring.tail = (unsigned*) cq_ptr + p.cq_off.tail;
-    cq_ring.ring_mask = (unsigned*) cq_ptr + p.cq_off.ring_mask;
-    cq_ring.ring_entries = (unsigned*) cq_ptr + p.cq_off.ring_entries;
-    cq_ring.cqes = (io_uring_cqe*) cq_ptr + p.cq_off.cqes;
+    cq_ring.head = (unsigned*) ((char*) cq_ptr + p.cq_off.head);
+    cq_ring.tail = (unsigned*) ((char*) cq_ptr + p.cq_off.tail);
+    cq_ring.ring_mask = (unsigned*) ((char*) cq_ptr + p.cq_off.ring_mask);
+    cq_ring.ring_entries = (unsigned*) ((char*) cq_ptr + p.cq_off.ring_entries);
+    cq_ring.cqes = (io_uring_cqe*) ((char*) cq_ptr + p.cq_off.cqes);
 
     return 0;
 }
@@ -97,11 +102,15 @@ IOHandler::IOHandler(u_int16_t queue_depth){
     _setup_uring();
 }
 
+IOHandler::~IOHandler(){
+    close(this->ring_fd);
+}
+
 int IOHandler::enque_access_request(int fd, const io_request_t* request){
     unsigned index      = 0;
     unsigned tail       = 0;
     unsigned next_tail  = 0;
-    char* err_buff = new char[256];
+    char err_buff[256];
 
     next_tail = tail = *sq_ring.tail;
     next_tail++;
@@ -120,6 +129,8 @@ int IOHandler::enque_access_request(int fd, const io_request_t* request){
     tail            = next_tail;
 
     if(*sq_ring.tail != tail){
+        // the sqe must be visible to the kernel before the new tail is.
+        write_barrier();
         *sq_ring.tail = tail;
         write_barrier();
     }
@@ -153,4 +164,20 @@ completed_io_t* IOHandler::get_completed_request(){
     *cq_ring.head = head;
     write_barrier();
     return ret;
-}
\ No newline at end of file
+}
+
+bool IOHandler::has_completed_requests(){
+    unsigned head = *cq_ring.head;
+    read_barrier();
+    return head != *cq_ring.tail;
+}
+
+int IOHandler::register_eventfd(int event_fd){
+    char err_buff[256];
+    if(syscall_io_uring_register(this->ring_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) < 0){
+        memset(err_buff, '\0', 256);
+        strerror_r(errno, err_buff, 255);
+        throw AccessFailure(INIT, std::string(err_buff));
+    }
+    return 0;
+}
@@ -1,13 +1,171 @@
+#include <stddef.h>
+#include <pthread.h>
 #include <b_storage.h>
+#include <crc32c.h>
+#include <trace.h>
+
+static checksum_mode_t checksum_mode   = CHECKSUM_ALWAYS;
+static u_int32_t checksum_sample_every = PAGE_CHECKSUM_SAMPLE;
+static u_int64_t checksum_loads;
+static page_checksum_stats_t checksum_stats;
+
+typedef struct page_frame{
+    char               buffer[PAGE_SIZE];
+    page_t             page;
+    page_content_t     content;
+    page_ptr_t        *ptrs[MAX_DEGREE];
+    db_entry_t        *db_entries[MAX_TUPLES_COUNT];
+    struct page_frame *prev;
+    struct page_frame *next;    // in the free list or the scope's list
+    u_int32_t          scoped;
+}page_frame_t;
+
+typedef struct{
+    page_frame_t *chunk;
+    u_int32_t     chunk_used;
+    page_frame_t *free_frames;
+    page_frame_t *scope_frames; // live frames of the current operation
+    u_int32_t     scope_depth;
+    u_int32_t     registered;   // for the thread exit destructor
+    page_arena_stats_t stats;
+}page_arena_t;
+
+static __thread page_arena_t page_arena;
+
+// free frames of threads that exited, for the next thread that needs some.
+static pthread_mutex_t spare_latch = PTHREAD_MUTEX_INITIALIZER;
+static page_frame_t *spare_frames;
+static pthread_key_t page_arena_key;
+static pthread_once_t page_arena_once = PTHREAD_ONCE_INIT;
+
+static void init_frame(page_frame_t *frame){
+    frame->page.page_buffer = frame->buffer;
+    frame->page.page_content = &frame->content;
+    frame->content.ptrs = frame->ptrs;
+    frame->content.db_entries = frame->db_entries;
+}
+// Frames still in use (a page the thread never freed, or one another
+// thread frees later) stay where they are; only the free ones are handed
+// over, so no chunk is ever freed.
+static void page_arena_exit(void *arg){
+    page_arena_t *arena = (page_arena_t*) arg;
+    page_frame_t *spare = arena->free_frames;
+    while(arena->chunk != NULL && arena->chunk_used < PAGE_ARENA_CHUNK_FRAMES){
+        page_frame_t *frame = &arena->chunk[arena->chunk_used++];
+        init_frame(frame);
+        frame->next = spare;
+        spare = frame;
+    }
+    if(spare == NULL)
+        return;
+    page_frame_t *last = spare;
+    while(last->next != NULL)
+        last = last->next;
+    pthread_mutex_lock(&spare_latch);
+    last->next = spare_frames;
+    spare_frames = spare;
+    pthread_mutex_unlock(&spare_latch);
+    arena->free_frames = NULL;
+}
+static void make_page_arena_key(){
+    pthread_key_create(&page_arena_key, page_arena_exit);
+}
+// up to a chunk's worth of frames left by threads that exited.
+static page_frame_t *adopt_spare_frames(page_arena_t *arena){
+    pthread_mutex_lock(&spare_latch);
+    page_frame_t *first = spare_frames, *last = first;
+    for(u_int32_t n = 1; last != NULL && last->next != NULL && n < PAGE_ARENA_CHUNK_FRAMES; n++)
+        last = last->next;
+    if(last != NULL){
+        spare_frames = last->next;
+        last->next = NULL;
+    }
+    pthread_mutex_unlock(&spare_latch);
+    for(page_frame_t *frame = first; frame != NULL; frame = frame->next)
+        arena->stats.frames_adopted++;
+    return first;
+}
+
+static page_frame_t *alloc_frame(){
+    page_arena_t *arena = &page_arena;
+    if(!arena->registered){
+        pthread_once(&page_arena_once, make_page_arena_key);
+        pthread_setspecific(page_arena_key, arena);
+        arena->registered = 1;
+    }
+    if(arena->free_frames == NULL && (arena->chunk == NULL || arena->chunk_used == PAGE_ARENA_CHUNK_FRAMES))
+        arena->free_frames = adopt_spare_frames(arena);
+    page_frame_t *frame = arena->free_frames;
+    if(frame != NULL){
+        arena->free_frames = frame->next;
+        arena->stats.frames_reused++;
+    }
+    else{
+        if(arena->chunk == NULL || arena->chunk_used == PAGE_ARENA_CHUNK_FRAMES){
+            if((arena->chunk = malloc(PAGE_ARENA_CHUNK_FRAMES * sizeof(page_frame_t))) == NULL){
+                perror("malloc");
+                return NULL;
+            }
+            arena->chunk_used = 0;
+            arena->stats.heap_allocations++;
+        }
+        frame = &arena->chunk[arena->chunk_used++];
+        init_frame(frame);
+    }
+    arena->stats.frames_allocated++;
+    frame->prev = NULL;
+    frame->next = NULL;
+    frame->scoped = (arena->scope_depth > 0);
+    if(frame->scoped){
+        frame->next = arena->scope_frames;
+        if(frame->next != NULL)
+            frame->next->prev = frame;
+        arena->scope_frames = frame;
+    }
+    return frame;
+}
+static void release_frame(page_frame_t *frame){
+    page_arena_t *arena = &page_arena;
+    if(frame->scoped){
+        if(frame->prev != NULL)
+            frame->prev->next = frame->next;
+        else
+            arena->scope_frames = frame->next;
+        if(frame->next != NULL)
+            frame->next->prev = frame->prev;
+    }
+    frame->next = arena->free_frames;
+    arena->free_frames = frame;
+}
+static page_frame_t *frame_of(page_t *page){
+    return (page_frame_t*)((char*) page - offsetof(page_frame_t, page));
+}
+static void page_arena_begin(){
+    page_arena.scope_depth++;
+}
+static void page_arena_end(){
+    page_arena_t *arena = &page_arena;
+    if(--arena->scope_depth > 0)
+        return;
+    while(arena->scope_frames != NULL){
+        page_frame_t *frame = arena->scope_frames;
+        arena->scope_frames = frame->next;
+        frame->scoped = 0;
+        frame->next = arena->free_frames;
+        arena->free_frames = frame;
+        arena->stats.frames_reclaimed++;
+    }
+}
+void get_page_arena_stats(page_arena_stats_t *stats){
+    *stats = page_arena.stats;
+}
 
 int write_block(const void *buff, size_t buff_size, int fd, off_t offset){
     int to_write = buff_size;
     int written  = 0;
     int pos      = 0;
-    if(offset != -1)
-        lseek(fd, offset, SEEK_SET);
-    
-    while(to_write != 0 && (written = write(fd, buff+pos, to_write)) != 0){
+    // pwrite: the recovery's redo threads share the file.
+    while(to_write != 0 && (written = (offset != -1) ? pwrite(fd, buff+pos, to_write, offset+pos) : write(fd, buff+pos, to_write)) != 0){
         if(written == -1){
             if(errno == EAGAIN) continue;
             perror("write");
@@ -22,10 +180,7 @@ int read_block(void *buff, size_t buff_size, int fd, off_t offset){
     int to_read     = buff_size;
     int have_read   = 0;
     int pos         = 0;
-    if(offset != -1)
-        lseek(fd, offset, SEEK_SET);
-    
-    while(to_read != 0 && (have_read = read(fd, buff+pos, to_read)) != 0){
+    while(to_read != 0 && (have_read = (offset != -1) ? pread(fd, buff+pos, to_read, offset+pos) : read(fd, buff+pos, to_read)) != 0){
         if(have_read == -1){
             if(errno == EAGAIN) continue;
             perror("read");
@@ -38,20 +193,59 @@ int read_block(void *buff, size_t buff_size, int fd, off_t offset){
     return buff_size - to_read;
 }
 
+u_int32_t page_checksum(const char *page){
+    u_int32_t crc = crc32c(0, page, PAGE_CHECKSUM_OFFSET);
+    crc = crc32c(crc, page + PAGE_LSN_OFFSET, PAGE_LSN_SIZE);
+    return crc ? crc : 1;
+}
+void set_page_checksum_mode(checksum_mode_t mode, u_int32_t sample_every){
+    checksum_mode = mode;
+    checksum_sample_every = sample_every ? sample_every : 1;
+}
+void get_page_checksum_stats(page_checksum_stats_t *stats){
+    stats->verified  = __atomic_load_n(&checksum_stats.verified, __ATOMIC_RELAXED);
+    stats->skipped   = __atomic_load_n(&checksum_stats.skipped, __ATOMIC_RELAXED);
+    stats->unstamped = __atomic_load_n(&checksum_stats.unstamped, __ATOMIC_RELAXED);
+    stats->failures  = __atomic_load_n(&checksum_stats.failures, __ATOMIC_RELAXED);
+}
+static void stamp_page(char *page){
+    *(u_int32_t*)(page + PAGE_CHECKSUM_OFFSET) = page_checksum(page);
+}
+static int verify_page(const char *page, page_ptr_t page_location){
+    if(checksum_mode == CHECKSUM_OFF ||
+       (checksum_mode == CHECKSUM_SAMPLED && __atomic_fetch_add(&checksum_loads, 1, __ATOMIC_RELAXED) % checksum_sample_every != 0)){
+        __atomic_fetch_add(&checksum_stats.skipped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    u_int32_t stored = *(const u_int32_t*)(page + PAGE_CHECKSUM_OFFSET);
+    if(stored == 0){
+        __atomic_fetch_add(&checksum_stats.unstamped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    __atomic_fetch_add(&checksum_stats.verified, 1, __ATOMIC_RELAXED);
+    if(page_checksum(page) != stored){
+        __atomic_fetch_add(&checksum_stats.failures, 1, __ATOMIC_RELAXED);
+        printf("load_page: Checksum mismatch on page at location: %d\n", page_location);
+        TRACE(TRACE_ERROR, TRACE_CHECKSUM_FAIL, page_location, 0, 0, 1, stored);
+        return -1;
+    }
+    return 0;
+}
+
 int sync_page(int db_file, page_t *page){
+    stamp_page(page->page_buffer);
     if(write_block(page->page_buffer, page->page_size, db_file, page->page_loc) != page->page_size){
         printf("sync_page: Page Sync Failed: Location: %d\n", page->page_loc);
+        TRACE(TRACE_ERROR, TRACE_IO_FAIL, page->page_loc, 0, 0, errno, 0);
         return -1;
     }
-    if(LOGGING_ENABLED) printf("sync_page: Page Sync success: Location: %d\n", page->page_loc);
+    TRACE(TRACE_DEBUG, TRACE_PAGE_WRITE, page->page_loc, 0, 0, 0, *(page->page_content->count));
     return 0;
 }
+// the pointer arrays are the frame's.
 int parse_page(void *page, size_t page_size, page_content_t *page_content){
-    printf("Parsing page starting at location: %p\n", page);
     page_content->count         = (u_int32_t*) page;
     page_content->is_leaf       = (u_int32_t*) (page+sizeof(u_int32_t));
-    page_content->ptrs          = malloc((MAX_DEGREE)*sizeof(page_ptr_t*));
-    page_content->db_entries    = malloc((MAX_TUPLES_COUNT)*sizeof(db_entry_t*));
 
     //u_int32_t interval      = sizeof(page_ptr_t)+sizeof(db_entry_t);
     u_int32_t interval = (32/8+64+64/8);
@@ -62,85 +256,79 @@ int parse_page(void *page, size_t page_size, page_content_t *page_content){
         page_content->db_entries[start] = (db_entry_t*)(tuple_start+start*interval+(32/8));
     }
     page_content->ptrs[MAX_DEGREE-1] = (page_ptr_t*)(tuple_start+(MAX_DEGREE-1)*interval);
+    page_content->page_lsn = (u_int64_t*)(page + PAGE_LSN_OFFSET);
+    page_content->checksum = (u_int32_t*)(page + PAGE_CHECKSUM_OFFSET);
     return 0;
 }
 
 int add_page(int db_file, size_t page_size, char *buff){
     int64_t ret   = lseek(db_file, 0, SEEK_END);
-    if(LOGGING_ENABLED) printf("add_page: adding a page at %ld\n", ret);
     memset(buff, '\0', page_size);
     if(write_block(buff, page_size, db_file, ret) != page_size){
         printf("ERROR: add_page: Unable to flush data to disk: Offset: %ld\n", ret);
+        TRACE(TRACE_ERROR, TRACE_IO_FAIL, ret, 0, 0, errno, 0);
         return -1;
     }
-    if(LOGGING_ENABLED)printf("add_page: Added a page at %ld\n", ret);
+    TRACE(TRACE_DEBUG, TRACE_PAGE_ADD, ret, 0, 0, 0, 0);
     return ret;
 }
 
 page_t *load_page(int db_file, page_ptr_t page_location){
-    if(LOGGING_ENABLED)printf("load_page: Loading page at location: %d\n", page_location);
-    page_t *page            = malloc(sizeof(page_t));
+    u_int64_t start         = TRACE_ENABLED(TRACE_DEBUG) ? trace_now() : 0;
+    page_frame_t *frame     = alloc_frame();
+    if(!frame)
+        return NULL;
+    page_t *page            = &frame->page;
     page->page_loc          = page_location;
     page->page_size         = PAGE_SIZE;
-    page->page_buffer    = (char*) malloc(PAGE_SIZE*sizeof(char));
-    page->page_content      = malloc(sizeof(page_content_t));
     if(read_block(page->page_buffer, page->page_size, db_file, page->page_loc) != PAGE_SIZE ||
+       verify_page(page->page_buffer, page->page_loc) != 0 ||
        parse_page(page->page_buffer, page->page_size, page->page_content) != 0){
-        free(page->page_buffer);
-        free(page->page_content);
-        free(page);
+        release_frame(frame);
         printf("load_page: Unable to load or parse page\n");
+        TRACE(TRACE_ERROR, TRACE_IO_FAIL, page_location, 0, 0, 1, 0);
         return NULL;
     }
-    if(LOGGING_ENABLED)printf("load_page: Successfully loaded page at location: %d[%d] (has %d keys)\n", page->page_loc, *(page->page_content->is_leaf), *(page->page_content->count));
-    if(LOGGING_ENABLED)printf("Keys:\n\t");
-    if(LOGGING_ENABLED && *(page->page_content->count) > 1){
-        for(int i = 0; i < (int)(*(page->page_content->count)); i++){
-            printf("%s ", (page->page_content->db_entries[i]->user_id));
-        }
-        printf("\n");
-    }
+    TRACE(TRACE_DEBUG, TRACE_PAGE_LOAD, page->page_loc, 0, trace_now() - start, *(page->page_content->is_leaf),
+          *(page->page_content->count));
     return page;
 }
 
 page_t *get_new_page(int db_file, u_int32_t page_size){
-    page_t *new_page        = malloc(sizeof(page_t));
-    if(!new_page){
-        perror("malloc");
-        return NULL;
-    }
-    new_page->page_size     = page_size;
-    new_page->page_buffer = malloc(page_size*sizeof(char));
-    if(!new_page->page_buffer){
-        perror("malloc");
+    if(page_size > PAGE_SIZE){
+        printf("ERROR: get_new_page: Pages are at most %d bytes.\n", PAGE_SIZE);
         return NULL;
     }
-    new_page->page_content  = malloc(sizeof(page_content_t));
-    if(!(new_page->page_content)){
-        perror("malloc");
+    page_frame_t *frame     = alloc_frame();
+    if(!frame)
         return NULL;
-    }
+    page_t *new_page        = &frame->page;
+    new_page->page_size     = page_size;
     if((new_page->page_loc = add_page(db_file, page_size, new_page->page_buffer)) == -1 ||
        parse_page(new_page->page_buffer, page_size, new_page->page_content) == -1){
-        free(new_page->page_buffer);
-        free(new_page->page_content);
-        free(new_page);
+        release_frame(frame);
         printf("ERROR: get_new_page: Failed allocate a new page.\n");
         return NULL;
     }
     *(new_page->page_content->is_leaf) = 1;
     *(new_page->page_content->count)   = 0;
     sync_page(db_file, new_page);
-    if(LOGGING_ENABLED) printf("Successfully allocated a new page: Loc: %d\n", new_page->page_loc);
     return new_page;
 }
 
+// NULL, with `page` untouched, if the child could not be loaded.
 page_t *btree_split(page_t *page, u_int32_t index, int db_file){
     // page at 'index' is guarenteed to be full i.e., count == MAX_TUPLES_COUNT
     int64_t tuples_to_copy = MIN_TUPLES_COUNT;
-    page_t *right_page = get_new_page(db_file, page->page_size);
     page_t *left_page  = load_page(db_file, *(page->page_content->ptrs[index]));
-    if(LOGGING_ENABLED) printf("btree_split: Got a request for page at index: %d split: tuple present: %d\n", index, *(left_page->page_content->count));
+    if(left_page == NULL)
+        return NULL;
+    page_t *right_page = get_new_page(db_file, page->page_size);
+    if(right_page == NULL){
+        free_page(db_file, left_page, 0);
+        return NULL;
+    }
+    TRACE(TRACE_INFO, TRACE_SPLIT, left_page->page_loc, 0, 0, 0, index);
     *(right_page->page_content->count) = tuples_to_copy;
     *(left_page->page_content->count)  = MIN_TUPLES_COUNT; // one node will be shifted up to parent.
     *(right_page->page_content->is_leaf) = *(left_page->page_content->is_leaf);
@@ -175,24 +363,18 @@ int free_page(int db_file, page_t *page, u_int32_t do_write){
         return 0;
     }
     if(do_write){
+        stamp_page(page->page_buffer);
         if(write_block(page->page_buffer, page->page_size, db_file, page->page_loc) != page->page_size){
             printf("Failed to write page at offset: %d\n", page->page_loc);
+            TRACE(TRACE_ERROR, TRACE_IO_FAIL, page->page_loc, 0, 0, errno, 0);
             return -1;
         }
-        else{
-            if(LOGGING_ENABLED)printf("Page sync success. Page offset %d\n", page->page_loc);
-        }
+        TRACE(TRACE_DEBUG, TRACE_PAGE_WRITE, page->page_loc, 0, 0, 0, *(page->page_content->count));
     }
-    free(page->page_buffer);
-    free(page->page_content->db_entries);
-    free(page->page_content->ptrs);
-    free(page->page_content);
-    free(page);
-    page = NULL;
+    release_frame(frame_of(page));
     return 0;
 }
-int btree_insert(int db_file, size_t page_size, const db_entry_t *db_entry){
-    if(LOGGING_ENABLED)printf("btree_insert: Got insert request: Username: %s\n", db_entry->user_id);
+int btree_insert_worker(int db_file, size_t page_size, const db_entry_t *db_entry){
     page_t *header = NULL;
     page_t *parent = NULL;
     page_t *child  = NULL;
@@ -202,34 +384,44 @@ int btree_insert(int db_file, size_t page_size, const db_entry_t *db_entry){
         return -1;
     }
     if(*(header->page_content->count) == 0){
-        if(LOGGING_ENABLED)printf("No entries in tree. Creating first node.\n");
         page_t *new_page = get_new_page(db_file, page_size);
+        if(new_page == NULL)
+            return -1;
+        TRACE(TRACE_INFO, TRACE_NEW_ROOT, new_page->page_loc, 0, 0, 0, 0);
         *(header->page_content->ptrs[0]) = new_page->page_loc;
         *(header->page_content->count) += 1;
         free_page(db_file, header, 1);
         free_page(db_file, new_page, 1);
-        header = load_page(db_file, 0);
+        if((header = load_page(db_file, 0)) == NULL)
+            return -1;
     }
-    parent = load_page(db_file, *(header->page_content->ptrs[0]));
+    // an arena scope: pages left behind on an error are taken back by
+    // btree_insert().
+    if((parent = load_page(db_file, *(header->page_content->ptrs[0]))) == NULL)
+        return -1;
     
     if(*(parent->page_content->count) == MAX_TUPLES_COUNT){     // top page is full
         page_t *tmp = get_new_page(db_file,PAGE_SIZE);
+        if(tmp == NULL)
+            return -1;
         *(tmp->page_content->count)     = 0;
         *(tmp->page_content->is_leaf)   = 0;
         *(tmp->page_content->ptrs[0])   = *(header->page_content->ptrs[0]);
         *(header->page_content->ptrs[0])= tmp->page_loc;
+        TRACE(TRACE_INFO, TRACE_NEW_ROOT, tmp->page_loc, 0, 0, 0, 0);
 
         free_page(db_file, parent, 1);
         sync_page(db_file, tmp);
         parent = tmp;
-        btree_split(parent, 0, db_file);
+        // the header still points at the old root on disk.
+        if(btree_split(parent, 0, db_file) == NULL)
+            return -1;
     }
     while(1){
         int index = 0;
-        while(index < *(parent->page_content->count) && strncmp(db_entry->user_id, parent->page_content->db_entries[index]->user_id, sizeof(db_entry->user_id)) > 0){
-            if(LOGGING_ENABLED) printf("Stepping forward as %s is smaller than %s\n", parent->page_content->db_entries[index]->user_id, db_entry->user_id);
+        while(index < *(parent->page_content->count) && strncmp(db_entry->user_id, parent->page_content->db_entries[index]->user_id, sizeof(db_entry->user_id)) > 0)
             index++;
-        }
+        TRACE(TRACE_DEBUG, TRACE_SEARCH, parent->page_loc, trace_key_hash(db_entry->user_id, USERID_LENGTH), 0, 0, index);
         if(!(*(parent->page_content->is_leaf))){
             child = load_page(db_file, *(parent->page_content->ptrs[index]));
             if(child == NULL)
@@ -238,17 +430,19 @@ int btree_insert(int db_file, size_t page_size, const db_entry_t *db_entry){
             free_page(db_file, child, 1);
             child = NULL;
             if(tuples_in_child == MAX_TUPLES_COUNT){
-                btree_split(parent, index, db_file);
+                if(btree_split(parent, index, db_file) == NULL)
+                    return -1;
                 while(index < *(parent->page_content->count) && strncmp(db_entry->user_id, parent->page_content->db_entries[index]->user_id, sizeof(db_entry->user_id)) > 0)
                     index++;
             }
             page_ptr_t loc = *(parent->page_content->ptrs[index]);
             free_page(db_file, parent, 1);
-            parent = load_page(db_file, loc);
+            if((parent = load_page(db_file, loc)) == NULL)
+                return -1;
             continue;
         }
         // shift the nodes and insert the element -- Leaf is guarenteed to have space.
-        if(LOGGING_ENABLED) printf("Leaf Node: %d inserting at index: %d\n", parent->page_loc, index);
+        TRACE(TRACE_DEBUG, TRACE_INSERT_LEAF, parent->page_loc, trace_key_hash(db_entry->user_id, USERID_LENGTH), 0, 0, index);
         for(int i = *(parent->page_content->count)-1; i >= index; i--){
             *(parent->page_content->db_entries[i+1]) = *(parent->page_content->db_entries[i]);
         }
@@ -261,12 +455,27 @@ int btree_insert(int db_file, size_t page_size, const db_entry_t *db_entry){
     return 0;
 }
 
+int btree_insert(int db_file, size_t page_size, const db_entry_t *db_entry){
+    u_int64_t start = TRACE_ENABLED(TRACE_INFO) ? trace_now() : 0;
+    page_arena_begin();
+    int retcode = btree_insert_worker(db_file, page_size, db_entry);
+    page_arena_end();
+    TRACE(TRACE_INFO, TRACE_INSERT, 0, trace_key_hash(db_entry->user_id, USERID_LENGTH), trace_now() - start, retcode != 0, 0);
+    return retcode;
+}
+
+// -1, with `page` untouched, if a child could not be loaded.
 int btree_merge(int db_file, page_t *page, int index){
     page_t *left_page  = load_page(db_file, *(page->page_content->ptrs[index]));
     page_t *right_page = load_page(db_file, *(page->page_content->ptrs[index+1]));
-    if(LOGGING_ENABLED) printf("btree_merge: merging:%s <-> %s <-> %s\n", (left_page->page_content->db_entries[*(left_page->page_content->count)-1]->user_id),
-                                                                          (page->page_content->db_entries[index]->user_id),
-                                                                          (right_page->page_content->db_entries[0]->user_id));
+    if(left_page == NULL || right_page == NULL){
+        if(left_page != NULL)
+            free_page(db_file, left_page, 0);
+        if(right_page != NULL)
+            free_page(db_file, right_page, 0);
+        return -1;
+    }
+    TRACE(TRACE_INFO, TRACE_MERGE, page->page_loc, 0, 0, 0, index);
     //move down the key at the index
     *(left_page->page_content->db_entries[*(left_page->page_content->count)]) = *(page->page_content->db_entries[index]);
     *(left_page->page_content->count) += 1;
@@ -276,14 +485,11 @@ int btree_merge(int db_file, page_t *page, int index){
     for(int i = index+2; i <= (int)(*(page->page_content->count)); i++)
         *(page->page_content->ptrs[i-1]) = *(page->page_content->ptrs[i]);
     *(page->page_content->count) -= 1;
-    if(LOGGING_ENABLED) printf("btree_merge: parent node modification complete\n");
     // copy over all the elements from right child to left child
     for(int i = 0; i < (int)(*(right_page->page_content->count)); i++)
         *(left_page->page_content->db_entries[*(left_page->page_content->count)+i]) = *(right_page->page_content->db_entries[i]);
-    if(LOGGING_ENABLED) printf("btree_merge: moved all keys from right to left\n");
     for(int i = 0; i <= (int)(*(right_page->page_content->count)); i++)
         *(left_page->page_content->ptrs[*(left_page->page_content->count)+i]) = *(right_page->page_content->ptrs[i]);
-    if(LOGGING_ENABLED) printf("btree_merge: moved all ptrs from right to left\n");
     // delete right child
     *(left_page->page_content->count) += *(right_page->page_content->count);
     free_page(db_file, left_page, 1);
@@ -291,30 +497,43 @@ int btree_merge(int db_file, page_t *page, int index){
     return 0;
 }
 
+// -1 if the child has no key to spare, -2 if a page could not be loaded.
 int get_successor(int db_file, page_ptr_t page_offset, db_entry_t *db_entry){
     page_t *page = load_page(db_file, page_offset);
+    if(page == NULL)
+        return -2;
     int64_t count = *(page->page_content->count);
-    if(count <= MIN_TUPLES_COUNT)
+    if(count <= MIN_TUPLES_COUNT){
+        free_page(db_file, page, 0);
         return -1;
+    }
     *db_entry = *(page->page_content->db_entries[0]);
-    btree_delete(db_file, page, db_entry->user_id, sizeof(db_entry->user_id));
-    return 0;
+    return btree_delete(db_file, page, db_entry->user_id, sizeof(db_entry->user_id)) < 0 ? -2 : 0;
 }
 int get_predecessor(int db_file, page_ptr_t page_offset, db_entry_t *db_entry){
     page_t *page = load_page(db_file, page_offset);
+    if(page == NULL)
+        return -2;
     int64_t count = *(page->page_content->count);
     if(count <= MIN_TUPLES_COUNT){
         free_page(db_file, page, 0);
         return -1;
     }
     *db_entry = *(page->page_content->db_entries[count-1]);
-    btree_delete(db_file, page, db_entry->user_id, sizeof(db_entry->user_id));
-    return 0;
+    return btree_delete(db_file, page, db_entry->user_id, sizeof(db_entry->user_id)) < 0 ? -2 : 0;
 }
 
+// -1 if the sibling has no key to spare, -2 if a page could not be loaded.
 int borrow_from_right(int db_file, page_t *parent, int index){
     page_t *left = load_page(db_file, *(parent->page_content->ptrs[index]));
     page_t *right = load_page(db_file, *(parent->page_content->ptrs[index+1]));
+    if(left == NULL || right == NULL){
+        if(left != NULL)
+            free_page(db_file, left, 0);
+        if(right != NULL)
+            free_page(db_file, right, 0);
+        return -2;
+    }
 
     if(*(right->page_content->count) <= MIN_TUPLES_COUNT){
         free_page(db_file, left, 0);
@@ -343,14 +562,18 @@ int borrow_from_right(int db_file, page_t *parent, int index){
 }
 
 int borrow_from_left(int db_file, page_t *parent, int index){
-    if(LOGGING_ENABLED) printf("borrow_from_left: parent Loc: %d, Index: %d\n", parent->page_loc, index);
     page_t *left = load_page(db_file, *(parent->page_content->ptrs[index-1]));
     page_t *right = load_page(db_file, *(parent->page_content->ptrs[index]));
-    if(LOGGING_ENABLED) printf("Left has %d keys.\n", *(left->page_content->count));
+    if(left == NULL || right == NULL){
+        if(left != NULL)
+            free_page(db_file, left, 0);
+        if(right != NULL)
+            free_page(db_file, right, 0);
+        return -2;
+    }
     if(*(left->page_content->count) <= MIN_TUPLES_COUNT){
         free_page(db_file, left, 0);
         free_page(db_file, right, 0);
-        if(LOGGING_ENABLED) printf("Left doesn't have enough keys\n. Exiting ...");
         return -1;
     }
     // shift the tuples in right by one place
@@ -358,7 +581,6 @@ int borrow_from_left(int db_file, page_t *parent, int index){
         *(right->page_content->ptrs[i+1]) = *(right->page_content->ptrs[i]);
     for(int i = *(right->page_content->count) - 1; i >= 0; i--)
         *(right->page_content->db_entries[i+1]) = *(right->page_content->db_entries[i]);
-    printf("borrow_from_left: Made space in right(at index) page.\n");
     // Move the key at `index` from parent to right
     *(right->page_content->db_entries[0]) = *(parent->page_content->db_entries[index]);
     // Move the right most key from the left to the parent
@@ -368,105 +590,97 @@ int borrow_from_left(int db_file, page_t *parent, int index){
     // decrease only the count of right as incrasing the count of left is alread taken care of
     *(left->page_content->count) -= 1;
     *(right->page_content->count) += 1;
-    printf("borrow_from_left: Changes complete.\n");
     free_page(db_file, left, 1);
     free_page(db_file, right, 1);
     sync_page(db_file, parent);
     return 0;
 }
+// -1 if the key is not there or a page could not be loaded: the caller's
+// load_page() of `page` too. A failure below the root may leave the pages
+// already rebalanced on the way down written; the log repairs that.
 int64_t btree_delete(int db_file, page_t *page, const char *key, size_t key_length){
-    if(LOGGING_ENABLED) printf("btree_delete: page_loc: %d, key: %s, first_entry: %s\n", page->page_loc, key, (page->page_content->db_entries[0]->user_id));
     int index = 0;
+    int64_t retcode = 0;
+    if(page == NULL)
+        return -1;
     if(*(page->page_content->count) == 0){
-        printf("Node empty nothing to delete.\nThis happens when the tree is empty!\n");
+        // the tree is empty.
+        TRACE(TRACE_INFO, TRACE_DELETE_MISS, page->page_loc, trace_key_hash(key, key_length), 0, 2, 0);
         return -2;
     }
-    while(index < (int)(*page->page_content->count) && strncmp(key, (page->page_content->db_entries[index]->user_id), key_length) > 0){
-        if(LOGGING_ENABLED)printf("Stepping forward as %s is less than %s\n", (page->page_content->db_entries[index]->user_id), key);
+    while(index < (int)(*page->page_content->count) && strncmp(key, (page->page_content->db_entries[index]->user_id), key_length) > 0)
         index++;
-    }
-    if(*(page->page_content->is_leaf) && strncmp(key, (page->page_content->db_entries[index]->user_id), key_length) != 0){
-        if(LOGGING_ENABLED) printf("Key not found!\n");
+    TRACE(TRACE_DEBUG, TRACE_SEARCH, page->page_loc, trace_key_hash(key, key_length), 0, 0, index);
+    if(*(page->page_content->is_leaf) && (index == (int)(*page->page_content->count) || strncmp(key, (page->page_content->db_entries[index]->user_id), key_length) != 0)){
+        TRACE(TRACE_INFO, TRACE_DELETE_MISS, page->page_loc, trace_key_hash(key, key_length), 0, 1, index);
         return -1;
     }
     if(index != (int)(*page->page_content->count) && strncmp(key, (page->page_content->db_entries[index]->user_id), key_length) == 0){
-        if(LOGGING_ENABLED) printf("Got a match: Page: %d, Index: %d, Is Leaf: %d\n", page->page_loc, index, *(page->page_content->is_leaf));
         if(*(page->page_content->is_leaf)){
             // just delete it.
-            printf("Deleting entry at index: %d\n", index);
             for(int i = index; i < (int)(*(page->page_content->count)-1); i++){
                 *(page->page_content->db_entries[i]) = *(page->page_content->db_entries[i+1]);
             }
             *(page->page_content->count) -= 1;
-            printf("After deleting, page has %d keys\n", *(page->page_content->count));
+            TRACE(TRACE_DEBUG, TRACE_DELETE_ENTRY, page->page_loc, trace_key_hash(key, key_length), 0, 0, *(page->page_content->count));
         }
         else{
-            db_entry_t *db_entry = malloc(76);
-            if(get_predecessor(db_file, *(page->page_content->ptrs[index]), db_entry) != -1 || get_successor(db_file, *(page->page_content->ptrs[index+1]), db_entry) != -1)
-                *(page->page_content->db_entries[index]) = *db_entry;
-            else{
-                btree_merge(db_file, page, index);
-                btree_delete(db_file, load_page(db_file, *(page->page_content->ptrs[index])), key, key_length);
+            db_entry_t db_entry;
+            int found = get_predecessor(db_file, *(page->page_content->ptrs[index]), &db_entry);
+            if(found == -1)
+                found = get_successor(db_file, *(page->page_content->ptrs[index+1]), &db_entry);
+            if(found == 0)
+                *(page->page_content->db_entries[index]) = db_entry;
+            else if(found == -1){
+                if(btree_merge(db_file, page, index) != 0)
+                    return -1;
+                retcode = btree_delete(db_file, load_page(db_file, *(page->page_content->ptrs[index])), key, key_length);
                 //*(page->page_content->count) -= 1; <-- Reducing the count of parent will be taken care of during btreee merge
             }
-            free(db_entry);
+            else{
+                return -1;
+            }
         }
     }
     else{
         // try borrowing from left or right sibling
         // if borrowing doesn't work, merge and call delete on the index node.
         page_t *child = load_page(db_file, *(page->page_content->ptrs[index]));
+        if(child == NULL)
+            return -1;
         int child_entry_count = *(child->page_content->count);
         free_page(db_file, child, 0);
-        if(LOGGING_ENABLED) printf("btree_delete: child has %d keys.\n", child_entry_count);
         if(child_entry_count > MIN_TUPLES_COUNT)
         {
-            btree_delete(db_file, load_page(db_file, *(page->page_content->ptrs[index])), key, key_length);
+            retcode = btree_delete(db_file, load_page(db_file, *(page->page_content->ptrs[index])), key, key_length);
         }
         else{
             int has_enough = 0;
+            int borrowed   = -1;
             if(!has_enough && (index-1 >= 0)){
-                if(LOGGING_ENABLED) printf("btree_delete: left sibling present. Will try to borrow from left\n");
-                if((borrow_from_left(db_file, page, index) != -1)){
-                    printf("btree_delete: borrowed from left.\n");
-                    has_enough = 1;
-                }
-                else{
-                    printf("btree_delete: Couldn't borrow from left.\n");
-                }
+                if((borrowed = borrow_from_left(db_file, page, index)) == -2)
+                    return -1;
+                has_enough = (borrowed == 0);
+                TRACE(TRACE_INFO, TRACE_BORROW_LEFT, page->page_loc, 0, 0, !has_enough, index);
             }
             if(!has_enough && index+1 <= (int)(*(page->page_content->count))){
-                if(LOGGING_ENABLED) printf("btree_delete: right sibling present. Will try to borrow from right\n");
-                if((borrow_from_right(db_file, page, index) != -1)){
-                    printf("btree_delete: borrowed from right.\n");
-                    has_enough = 1;
-                }
-                else{
-                    printf("btree_delete: Couldn't borrow from right.\n");
-                }
+                if((borrowed = borrow_from_right(db_file, page, index)) == -2)
+                    return -1;
+                has_enough = (borrowed == 0);
+                TRACE(TRACE_INFO, TRACE_BORROW_RIGHT, page->page_loc, 0, 0, !has_enough, index);
             }
             if(!has_enough && index+1 <= (int)(*(page->page_content->count))){
-                if(LOGGING_ENABLED) printf("btree_delete: right sibling present. Will try to merge right with me\n");
-                if((btree_merge(db_file, page, index) != -1)){
-                    printf("btree_delete: merged right with me.\n");
-                    has_enough = 1;
-                }
-                else{
-                    printf("btree_delete: Couldn't merge right with me.\n");
-                }
+                if(btree_merge(db_file, page, index) != 0)
+                    return -1;
+                has_enough = 1;
             }
             if(!has_enough && (index-1 >= 0)){
                 index -= 1;
-                if(LOGGING_ENABLED) printf("btree_delete: left sibling present. Will try to merge with left\n");
-                if((btree_merge(db_file, page, index) != -1)){
-                    printf("btree_delete: merged with left.\n");
-                    has_enough = 1;
-                }
-                else{
-                    printf("btree_delete: Couldn't merge with left.\n");
-                }
+                if(btree_merge(db_file, page, index) != 0)
+                    return -1;
+                has_enough = 1;
             }
-            btree_delete(db_file, load_page(db_file, *(page->page_content->ptrs[index])), key, key_length);
+            retcode = btree_delete(db_file, load_page(db_file, *(page->page_content->ptrs[index])), key, key_length);
             // if((index-1 >= 0 && (borrow_from_left(db_file, page, index) != 1)) ||
             // (index+1 <= (int)(*(page->page_content->count)) && borrow_from_right(db_file, page, index) != -1) ||
             // (index+1 <= (int)(*(page->page_content->count)) && btree_merge(db_file, page, index) != -1))
@@ -478,56 +692,116 @@ int64_t btree_delete(int db_file, page_t *page, const char *key, size_t key_leng
             // }
         }
     }
-    if(LOGGING_ENABLED) printf("btree_delete: Page[%d]: Tuples present: %d\n", page->page_loc, *(page->page_content->count));
     if(*(page->page_content->count) == 0){
-        if(LOGGING_ENABLED) printf("btree_delete: requesting root page delete\n");
+        TRACE(TRACE_INFO, TRACE_ROOT_SHRINK, page->page_loc, 0, 0, 0, *(page->page_content->ptrs[index]));
         int ret = *(page->page_content->ptrs[index]);
         free_page(db_file, page, 1);
         return ret;
     }
     free_page(db_file, page, 1);
-    return 0;
+    return retcode < 0 ? -1 : 0;
 }
 
 int btree_delete_start(int db_file, const char *key, size_t key_length){
-    if(LOGGING_ENABLED)printf("Got a request to delete key: %s\n", key);
+    u_int64_t start = TRACE_ENABLED(TRACE_INFO) ? trace_now() : 0;
     page_t *header = NULL;
     int64_t parent_loc = -1;
 
-    header = load_page(db_file, 0);
-    parent_loc = btree_delete(db_file, load_page(db_file, *(header->page_content->ptrs[0])), key, key_length);
-    if(parent_loc > 0){
-        *(header->page_content->ptrs[0]) = parent_loc;
+    page_arena_begin();
+    if((header = load_page(db_file, 0)) != NULL){
+        parent_loc = btree_delete(db_file, load_page(db_file, *(header->page_content->ptrs[0])), key, key_length);
+        if(parent_loc > 0){
+            *(header->page_content->ptrs[0]) = parent_loc;
+        }
+        free_page(db_file, header, 1);
     }
-    if(LOGGING_ENABLED) printf("btree_delete_start: freeing header\n");
-    free_page(db_file, header, 1);
+    page_arena_end();
+    TRACE(TRACE_INFO, TRACE_DELETE, 0, trace_key_hash(key, key_length), trace_now() - start, parent_loc < 0, 0);
     return parent_loc;
 }
 int btree_find_worker(int db_file, page_ptr_t page_loc, const char *key, size_t key_length, tuple_info_t *tuple_info){
     int index = 0;
 
     page_t *page = load_page(db_file, page_loc);
+    if(page == NULL)
+        return -1;
     while(index < *(page->page_content->count) && strncmp(key, page->page_content->db_entries[index]->user_id, key_length) > 0)
         index++;
-    if(index == *(page->page_content->count) && *(page->page_content->is_leaf))
-        return -1;
-    if(index <= *(page->page_content->count) && strncmp(key, page->page_content->db_entries[index]->user_id, key_length) == 0){
+    if(index < *(page->page_content->count) && strncmp(key, page->page_content->db_entries[index]->user_id, key_length) == 0){
         tuple_info->index = index;
         tuple_info->page = page;
         return 0;
     }
+    if(*(page->page_content->is_leaf)){
+        free_page(db_file, page, 0);
+        return -1;
+    }
     page_ptr_t search = *(page->page_content->ptrs[index]);
     free_page(db_file, page, 0);
     return btree_find_worker(db_file, search, key, key_length, tuple_info);
 }
 int btree_find(int db_file, const char *key, size_t key_length, tuple_info_t *tuple_info){
+    u_int64_t start = TRACE_ENABLED(TRACE_INFO) ? trace_now() : 0;
     page_t *header = load_page(db_file, 0);
     int retcode = -1;
+    if(header != NULL){
+        if(*(header->page_content->count) > 0)
+            retcode = btree_find_worker(db_file, *(header->page_content->ptrs[0]), key, key_length, tuple_info);
+        free_page(db_file, header, 0);
+    }
+    TRACE(TRACE_INFO, TRACE_FIND, retcode == 0 ? tuple_info->page->page_loc : 0, trace_key_hash(key, key_length),
+          trace_now() - start, retcode != 0, retcode == 0 ? tuple_info->index : 0);
+    return retcode;
+}
+// in key order; 1 if the visitor stopped the scan, -1 if a page failed to
+// load. With a cursor that has `resume` set, every level starts where the
+// last scan left it and the entry it stopped on is skipped.
+int btree_scan_worker(int db_file, page_ptr_t page_loc, u_int32_t level, btree_cursor_t *cursor,
+                      btree_visitor_t visit, void *ctx){
+    if(level >= BTREE_SCAN_MAX_DEPTH)
+        return -1;
+    page_t *page = load_page(db_file, page_loc);
+    if(page == NULL)
+        return -1;
+    int retcode = 0;
+    u_int32_t count = *(page->page_content->count);
+    u_int32_t index = 0;
+    if(cursor != NULL && cursor->resume){
+        index = cursor->path[level];
+        if(level == cursor->depth){
+            index++;
+            cursor->resume = 0;
+        }
+    }
+    for(; index <= count && retcode == 0; index++){
+        if(cursor != NULL)
+            cursor->path[level] = index;
+        if(!*(page->page_content->is_leaf))
+            retcode = btree_scan_worker(db_file, *(page->page_content->ptrs[index]), level + 1, cursor, visit, ctx);
+        if(retcode == 0 && index < count && visit(ctx, page->page_content->db_entries[index]) != 0){
+            retcode = 1;
+            if(cursor != NULL){
+                cursor->depth = level;
+                cursor->resume = 1;
+            }
+        }
+    }
+    free_page(db_file, page, 0);
+    return retcode;
+}
+int btree_scan_from(int db_file, btree_cursor_t *cursor, btree_visitor_t visit, void *ctx){
+    page_t *header = load_page(db_file, 0);
+    if(header == NULL)
+        return -1;
+    int retcode = 0;
     if(*(header->page_content->count) > 0)
-        retcode = btree_find_worker(db_file, *(header->page_content->ptrs[0]), key, key_length, tuple_info);
+        retcode = btree_scan_worker(db_file, *(header->page_content->ptrs[0]), 0, cursor, visit, ctx);
     free_page(db_file, header, 0);
     return retcode;
 }
+int btree_scan(int db_file, btree_visitor_t visit, void *ctx){
+    return btree_scan_from(db_file, NULL, visit, ctx) < 0 ? -1 : 0;
+}
 int init_db_storage(int db_file, size_t page_size){
     struct stat stat_buf;
     if(fstat(db_file, &stat_buf) != 0){
@@ -0,0 +1,160 @@
+/*
+* What the page arena saves: heap allocations of b-tree operations.
+*
+* usage: page_arena_bench [accounts] [operations] [dir]
+*
+* Loads a b-tree, then runs lookups, deposits (lookup and write back) and
+* inserts of new accounts, reporting for each the pages loaded and the
+* heap allocations per operation; once the first round has warmed up the
+* thread's arena the second round must not allocate at all. Then deletes
+* accounts and reports the frames btree_delete() left behind, which the
+* arena took back at the end of each delete. Last, short lived threads run
+* lookups one after another: each one after the first must get by on the
+* frames its predecessors left when they exited.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <thread>
+extern "C"{
+#include "b_storage.h"
+}
+
+using namespace std;
+
+#define THREADS     8
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%08u", account);
+}
+
+static double seconds_since(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static page_arena_stats_t arena_stats(){
+    page_arena_stats_t stats;
+    get_page_arena_stats(&stats);
+    return stats;
+}
+
+typedef struct{
+    const char *name;
+    double ns;
+    double frames;
+    double allocations;
+}round_t;
+
+// lookups, deposits and inserts of `count` accounts from `next_new` on.
+static vector<round_t> run_round(int db_file, uint32_t accounts, uint32_t count, uint32_t next_new, uint64_t seed){
+    mt19937_64 rng(seed);
+    uniform_int_distribution<uint32_t> pick(0, accounts - 1);
+    vector<uint32_t> sample(count);
+    for(auto& account: sample)
+        account = pick(rng);
+    char user_id[USERID_LENGTH];
+    tuple_info_t info;
+    vector<round_t> rounds;
+    for(int kind = 0; kind < 3; kind++){
+        page_arena_stats_t before = arena_stats();
+        auto start = chrono::steady_clock::now();
+        for(uint32_t i = 0; i < count; i++){
+            if(kind == 2){
+                db_entry_t entry;
+                memset(&entry, 0, sizeof(entry));
+                account_name(next_new + i, entry.user_id);
+                btree_insert(db_file, PAGE_SIZE, &entry);
+                continue;
+            }
+            account_name(sample[i], user_id);
+            if(btree_find(db_file, user_id, USERID_LENGTH, &info) != 0)
+                continue;
+            if(kind == 1)
+                info.page->page_content->db_entries[info.index]->balance += 10;
+            free_page(db_file, info.page, kind == 1);
+        }
+        double ns = seconds_since(start) * 1e9 / count;
+        page_arena_stats_t after = arena_stats();
+        const char *names[] = {"lookup", "deposit", "insert"};
+        rounds.push_back({names[kind], ns, (double) (after.frames_allocated - before.frames_allocated) / count,
+                          (double) (after.heap_allocations - before.heap_allocations) / count});
+    }
+    return rounds;
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts = (argc > 1) ? atoi(argv[1]) : 100000;
+    uint32_t count    = (argc > 2) ? atoi(argv[2]) : 100000;
+    string   dir      = (argc > 3) ? argv[3] : ".";
+    string db_path = dir + "/page_arena_bench.db";
+    if(accounts < 1)
+        accounts = 1;
+    if(count < 1)
+        count = 1;
+
+    unlink(db_path.c_str());
+    int db_file = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0){
+        cerr << "cannot create " << db_path << endl;
+        return 1;
+    }
+    db_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, entry.user_id);
+        btree_insert(db_file, PAGE_SIZE, &entry);
+    }
+    page_arena_stats_t loaded = arena_stats();
+    cout << "loading " << accounts << " accounts: " << loaded.frames_allocated << " frames from "
+         << loaded.heap_allocations << " heap allocations (" << PAGE_ARENA_CHUNK_FRAMES << " frames each)" << endl << endl;
+
+    int rc = 0;
+    cout << setw(10) << "round" << setw(10) << "op" << setw(12) << "ns/op" << setw(14) << "frames/op"
+         << setw(14) << "mallocs/op" << endl;
+    for(int round = 0; round < 2; round++){
+        vector<round_t> rounds = run_round(db_file, accounts, count, accounts + round * count, round + 1);
+        for(auto& r: rounds){
+            cout << setw(10) << (round ? "steady" : "first") << setw(10) << r.name << fixed << setprecision(0)
+                 << setw(12) << r.ns << setprecision(2) << setw(14) << r.frames << setprecision(4) << setw(14)
+                 << r.allocations << endl;
+            if(round == 1 && r.allocations != 0)
+                rc = 1;
+        }
+    }
+    cout << "steady state without heap allocations: " << (rc ? "NO" : "yes") << endl;
+
+    uint32_t deletes = min(accounts, (uint32_t) 1000);
+    page_arena_stats_t before = arena_stats();
+    for(uint32_t i = 0; i < deletes; i++){
+        account_name(i * (accounts / deletes), entry.user_id);
+        btree_delete_start(db_file, entry.user_id, USERID_LENGTH);
+    }
+    page_arena_stats_t after = arena_stats();
+    cout << deletes << " deletes: " << after.frames_allocated - before.frames_allocated << " frames, "
+         << after.frames_reclaimed - before.frames_reclaimed << " of them left behind and reclaimed, "
+         << after.heap_allocations - before.heap_allocations << " heap allocations" << endl;
+
+    uint64_t thread_allocations = 0, adopted = 0;
+    for(int t = 0; t < THREADS; t++){
+        page_arena_stats_t stats;
+        thread([&](){
+            run_round(db_file, accounts, 1000, accounts + 2 * count + t * 1000, t + 3);
+            stats = arena_stats();
+        }).join();
+        if(t > 0)
+            thread_allocations += stats.heap_allocations;
+        adopted += stats.frames_adopted;
+    }
+    cout << THREADS << " threads one after another: " << adopted << " frames taken over from exited threads, "
+         << thread_allocations << " heap allocations after the first" << endl;
+    rc |= thread_allocations != 0;
+    close(db_file);
+    unlink(db_path.c_str());
+    return rc;
+}
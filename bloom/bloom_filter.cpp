@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "bloom_filter.h"
+
+using namespace std;
+
+static_assert(sizeof(bloom_file_header_t) <= PAGE_SIZE, "the header does not fit its page");
+
+static uint64_t fmix(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t bloom_hash(const char *user_id){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(int i = 0; i < USERID_LENGTH && user_id[i] != '\0'; i++)
+        h = (h ^ (unsigned char) user_id[i]) * 0x100000001b3ULL;
+    return fmix(h);
+}
+
+// the block of a hash, and one bit for each of its words out of 6 bits of
+// a second hash each.
+static inline uint64_t* probe(uint64_t *blocks, uint64_t block_count, uint64_t hash, uint64_t *bits){
+    uint64_t *block = blocks + (((hash >> 32) * block_count) >> 32) * BLOOM_BLOCK_WORDS;
+    uint64_t second = fmix(hash ^ 0x9e3779b97f4a7c15ULL);
+    for(int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+        bits[i] = 1ULL << ((second >> (6 * i)) & 63);
+    return block;
+}
+
+static uint64_t blocks_for(uint64_t keys, uint32_t bits_per_key){
+    uint64_t blocks = (keys * bits_per_key + BLOOM_BLOCK_SIZE * 8 - 1) / (BLOOM_BLOCK_SIZE * 8);
+    uint64_t pages = max((uint64_t) 1, (blocks + BLOOM_BLOCKS_PER_PAGE - 1) / BLOOM_BLOCKS_PER_PAGE);
+    return pages * BLOOM_BLOCKS_PER_PAGE;
+}
+
+// one batch of the rebuild's scan: up to `left` more keys.
+typedef struct{
+    vector<uint64_t> *hashes;
+    uint32_t          left;
+}scan_batch_t;
+
+static int collect_batch(void *ctx, const db_entry_t *entry){
+    scan_batch_t *batch = (scan_batch_t*) ctx;
+    batch->hashes->push_back(bloom_hash(entry->user_id));
+    return --batch->left == 0;
+}
+
+static uint64_t* make_blocks(uint64_t block_count, const vector<uint64_t>& hashes){
+    uint64_t *blocks = (uint64_t*) aligned_alloc(PAGE_SIZE, block_count * BLOOM_BLOCK_SIZE);
+    if(blocks == NULL)
+        return NULL;
+    memset(blocks, 0, block_count * BLOOM_BLOCK_SIZE);
+    uint64_t bits[BLOOM_BLOCK_WORDS];
+    for(uint64_t hash: hashes){
+        uint64_t *block = probe(blocks, block_count, hash, bits);
+        for(int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+            block[i] |= bits[i];
+    }
+    return blocks;
+}
+
+BloomFilter::BloomFilter(const char *path, int db_file, uint64_t expected_keys, uint32_t bits_per_key,
+                         uint32_t maintain_interval_ms){
+    this->db_file = db_file;
+    this->expected_keys = expected_keys;
+    this->bits_per_key = max(bits_per_key, (uint32_t) 1);
+    this->maintain_interval_ms = maintain_interval_ms;
+    blocks = NULL;
+    block_count = 0;
+    clean_on_disk = false;
+    keys = 0;
+    deleted = 0;
+    generation = 0;
+    lookups = negatives = false_positives = 0;
+    rebuilds = rebuilds_abandoned = flushes = 0;
+    stopping = false;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        throw BloomFilterFailure(string("open ") + path + ": " + strerror(errno));
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        throw BloomFilterFailure(string("fstat: ") + strerror(errno));
+    }
+    if(st.st_size >= PAGE_SIZE){
+        vector<char> page(PAGE_SIZE);
+        bloom_file_header_t header;
+        if(read_block(page.data(), PAGE_SIZE, fd, 0) != PAGE_SIZE
+           || (memcpy(&header, page.data(), sizeof(header)), header.magic != BLOOM_FILTER_MAGIC)){
+            close(fd);
+            throw BloomFilterFailure(string(path) + " is not a bloom filter");
+        }
+        uint64_t pages = header.blocks / BLOOM_BLOCKS_PER_PAGE;
+        if(header.clean && header.blocks % BLOOM_BLOCKS_PER_PAGE == 0 && pages > 0
+           && (uint64_t) st.st_size == (pages + 1) * (PAGE_SIZE)){
+            blocks = (uint64_t*) aligned_alloc(PAGE_SIZE, pages * (PAGE_SIZE));
+            bool whole = (blocks != NULL);
+            for(uint64_t p = 0; whole && p < pages; p++){
+                whole = (read_block((char*) blocks + p * (PAGE_SIZE), PAGE_SIZE, fd, (p + 1) * (PAGE_SIZE))
+                         == PAGE_SIZE);
+            }
+            if(whole){
+                block_count = header.blocks;
+                keys = header.keys;
+                deleted = header.deleted;
+                dirty_pages.assign(pages, 0);
+                clean_on_disk = true;
+            }
+            else{
+                free(blocks);
+                blocks = NULL;
+            }
+        }
+    }
+    if(blocks == NULL){
+        // new, or not flushed when it was last used.
+        vector<uint64_t> hashes;
+        uint64_t *built = NULL;
+        uint64_t built_count = 0;
+        if(_scan(hashes) == 0){
+            built_count = blocks_for(max(expected_keys, hashes.size() + hashes.size() / 2), this->bits_per_key);
+            built = make_blocks(built_count, hashes);
+        }
+        if(built == NULL){
+            close(fd);
+            throw BloomFilterFailure(string("building ") + path + " from the b-tree");
+        }
+        unique_lock<shared_mutex> guard(latch);
+        _install(built, built_count, hashes);
+    }
+    if(maintain_interval_ms > 0)
+        maintainer = thread(&BloomFilter::_run_maintainer, this);
+}
+
+BloomFilter::~BloomFilter(){
+    {
+        lock_guard<mutex> guard(maintainer_latch);
+        stopping = true;
+    }
+    maintainer_cond.notify_one();
+    if(maintainer.joinable())
+        maintainer.join();
+    {
+        unique_lock<shared_mutex> guard(latch);
+        _flush();
+    }
+    close(fd);
+    free(blocks);
+}
+
+int BloomFilter::_collect(void *ctx, const db_entry_t *entry){
+    ((vector<uint64_t>*) ctx)->push_back(bloom_hash(entry->user_id));
+    return 0;
+}
+
+int BloomFilter::_scan(vector<uint64_t>& hashes){
+    hashes.clear();
+    return btree_scan(db_file, _collect, &hashes);
+}
+
+// latch held exclusive; takes over `new_blocks` and writes all of it.
+void BloomFilter::_install(uint64_t *new_blocks, uint64_t new_block_count, const vector<uint64_t>& hashes){
+    free(blocks);
+    blocks = new_blocks;
+    block_count = new_block_count;
+    keys = hashes.size();
+    deleted = 0;
+    dirty_pages.assign(block_count / BLOOM_BLOCKS_PER_PAGE, 1);
+    if(ftruncate(fd, (dirty_pages.size() + 1) * (PAGE_SIZE)) != 0)
+        printf("BloomFilter: Failed to resize the filter file.\n");
+    _write_header(false);
+    _flush();
+}
+
+// latch held exclusive.
+int BloomFilter::_write_header(bool clean){
+    vector<char> page(PAGE_SIZE, 0);
+    bloom_file_header_t header = {BLOOM_FILTER_MAGIC, 1, block_count, bits_per_key, clean, keys, deleted};
+    memcpy(page.data(), &header, sizeof(header));
+    if(write_block(page.data(), PAGE_SIZE, fd, 0) != PAGE_SIZE)
+        return -1;
+    clean_on_disk = clean;
+    return 0;
+}
+
+// latch held exclusive.
+int BloomFilter::_flush(){
+    if(clean_on_disk)
+        return 0;
+    for(size_t p = 0; p < dirty_pages.size(); p++){
+        if(!dirty_pages[p])
+            continue;
+        if(write_block((char*) blocks + p * (PAGE_SIZE), PAGE_SIZE, fd, (p + 1) * (PAGE_SIZE)) != PAGE_SIZE)
+            return -1;
+        dirty_pages[p] = 0;
+    }
+    flushes++;
+    return _write_header(true);
+}
+
+bool BloomFilter::may_contain(const char *user_id){
+    uint64_t hash = bloom_hash(user_id), bits[BLOOM_BLOCK_WORDS];
+    __atomic_fetch_add(&lookups, 1, __ATOMIC_RELAXED);
+    shared_lock<shared_mutex> guard(latch);
+    const uint64_t *block = probe(blocks, block_count, hash, bits);
+    for(int i = 0; i < BLOOM_BLOCK_WORDS; i++){
+        if((block[i] & bits[i]) == 0){
+            __atomic_fetch_add(&negatives, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    }
+    return true;
+}
+
+void BloomFilter::add(const char *user_id){
+    uint64_t hash = bloom_hash(user_id), bits[BLOOM_BLOCK_WORDS];
+    unique_lock<shared_mutex> guard(latch);
+    uint64_t *block = probe(blocks, block_count, hash, bits);
+    for(int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+        block[i] |= bits[i];
+    dirty_pages[(block - blocks) / BLOOM_BLOCK_WORDS / BLOOM_BLOCKS_PER_PAGE] = 1;
+    keys++;
+    if(clean_on_disk)
+        _write_header(false);
+}
+
+void BloomFilter::remove(const char *user_id){
+    (void) user_id;
+    unique_lock<shared_mutex> guard(latch);
+    deleted++;
+    if(clean_on_disk)
+        _write_header(false);
+}
+
+void BloomFilter::false_positive(){
+    __atomic_fetch_add(&false_positives, 1, __ATOMIC_RELAXED);
+}
+
+void BloomFilter::begin_write(){
+    storage_latch.lock();
+}
+
+void BloomFilter::end_write(){
+    storage_latch.unlock();
+}
+
+void BloomFilter::begin_change(){
+    begin_write();
+    __atomic_fetch_add(&generation, 1, __ATOMIC_SEQ_CST);
+}
+
+void BloomFilter::end_change(){
+    __atomic_fetch_add(&generation, 1, __ATOMIC_SEQ_CST);
+    end_write();
+}
+
+bool BloomFilter::needs_rebuild(){
+    shared_lock<shared_mutex> guard(latch);
+    uint64_t capacity = block_count * BLOOM_BLOCK_SIZE * 8 / bits_per_key;
+    return keys > capacity || deleted * BLOOM_REBUILD_DELETED > keys;
+}
+
+int BloomFilter::rebuild(){
+    lock_guard<mutex> rebuilding(rebuild_latch);
+    vector<uint64_t> hashes;
+    uint64_t start = 0;
+    scan_batch_t batch = {&hashes, 0};
+    btree_cursor_t cursor;
+    memset(&cursor, 0, sizeof(cursor));
+    for(int more = 1, first = 1; more; first = 0){
+        // the latch is given up between batches, so a write waits for one
+        // batch at most. A change in between makes the scan worthless, and
+        // the cursor with it.
+        lock_guard<mutex> scanning(storage_latch);
+        uint64_t now = __atomic_load_n(&generation, __ATOMIC_SEQ_CST);
+        if(first)
+            start = now;
+        else if(now != start){
+            __atomic_fetch_add(&rebuilds_abandoned, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+        batch.left = BLOOM_SCAN_BATCH;
+        if((more = btree_scan_from(db_file, &cursor, collect_batch, &batch)) < 0)
+            return -1;
+    }
+    uint64_t new_block_count = blocks_for(max(expected_keys, hashes.size() + hashes.size() / 2), bits_per_key);
+    uint64_t *new_blocks = make_blocks(new_block_count, hashes);
+    if(new_blocks == NULL)
+        return -1;
+
+    unique_lock<shared_mutex> guard(latch);
+    if(__atomic_load_n(&generation, __ATOMIC_SEQ_CST) != start){
+        // a key was added to or removed from the old filter after the scan.
+        free(new_blocks);
+        __atomic_fetch_add(&rebuilds_abandoned, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+    _install(new_blocks, new_block_count, hashes);
+    rebuilds++;
+    return 0;
+}
+
+int BloomFilter::flush(){
+    unique_lock<shared_mutex> guard(latch);
+    return _flush();
+}
+
+void BloomFilter::_run_maintainer(){
+    unique_lock<mutex> guard(maintainer_latch);
+    while(!stopping){
+        maintainer_cond.wait_for(guard, chrono::milliseconds(maintain_interval_ms));
+        if(stopping)
+            break;
+        guard.unlock();
+        flush();
+        if(needs_rebuild())
+            rebuild();
+        guard.lock();
+    }
+}
+
+bloom_stats_t BloomFilter::get_stats(){
+    shared_lock<shared_mutex> guard(latch);
+    bloom_stats_t stats;
+    stats.keys = keys;
+    stats.deleted = deleted;
+    stats.blocks = block_count;
+    stats.lookups = __atomic_load_n(&lookups, __ATOMIC_RELAXED);
+    stats.negatives = __atomic_load_n(&negatives, __ATOMIC_RELAXED);
+    stats.false_positives = __atomic_load_n(&false_positives, __ATOMIC_RELAXED);
+    stats.rebuilds = rebuilds;
+    stats.rebuilds_abandoned = __atomic_load_n(&rebuilds_abandoned, __ATOMIC_RELAXED);
+    stats.flushes = flushes;
+    return stats;
+}
@@ -0,0 +1,212 @@
+/*
+* Lookups of accounts that do not exist: BloomFilter against btree_find().
+*
+* usage: bloom_filter_bench [accounts] [lookups] [dir]
+*
+* Loads a b-tree and builds the filter from it, then
+*   - looks up missing accounts through btree_find() and through the
+*     filter, and measures the filter's false positive rate,
+*   - runs CREATEs of new accounts and DEPOSITs to missing ones through
+*     RequestExecutor with and without the filter,
+*   - deletes 7/8 of the accounts through the executor while the background
+*     thread is running, waits for it to rebuild the filter and checks the
+*     rate went back down and that no remaining account is ruled out,
+*   - reopens the filter from its file.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include "executor.h"
+
+using namespace std;
+
+#define MAINTAIN_INTERVAL_MS    50
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%08u", account);
+}
+
+// not an account: a different prefix.
+static void missing_name(uint32_t n, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "nobody%08u", n);
+}
+
+static double seconds_since(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t btree_page_loads(){
+    page_checksum_stats_t stats;
+    get_page_checksum_stats(&stats);
+    return stats.verified + stats.skipped + stats.unstamped;
+}
+
+static double false_positive_rate(BloomFilter *filter, uint32_t first, uint32_t count){
+    char user_id[USERID_LENGTH];
+    uint32_t positives = 0;
+    for(uint32_t i = 0; i < count; i++){
+        missing_name(first + i, user_id);
+        positives += filter->may_contain(user_id);
+    }
+    return 100.0 * positives / count;
+}
+
+static vector<request_data_t> make_stream(uint32_t first_new, uint32_t count){
+    vector<request_data_t> stream(count);
+    for(uint32_t i = 0; i < count; i++){
+        memset(&stream[i], 0, sizeof(request_data_t));
+        if(i % 2 == 0){
+            stream[i].req = CREATE;
+            account_name(first_new + i, stream[i].userid);
+        }
+        else{
+            stream[i].req = DEPOSIT;
+            missing_name(first_new + i, stream[i].userid);
+            stream[i].amount = 10;
+        }
+    }
+    return stream;
+}
+
+static double run_stream(RequestExecutor *executor, vector<request_data_t>& stream){
+    vector<request_result_t> results(stream.size());
+    auto start = chrono::steady_clock::now();
+    for(size_t i = 0; i < stream.size(); i++)
+        executor->execute(&stream[i], 1, &results[i]);
+    return seconds_since(start) * 1e6 / stream.size();
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts = (argc > 1) ? atoi(argv[1]) : 200000;
+    uint32_t lookups  = (argc > 2) ? atoi(argv[2]) : 200000;
+    string   dir      = (argc > 3) ? argv[3] : ".";
+    string db_path = dir + "/bloom_filter_bench.db";
+    string filter_path = dir + "/bloom_filter_bench.bloom";
+    if(accounts < 2)
+        accounts = 2;
+    if(lookups < 2)
+        lookups = 2;
+
+    unlink(db_path.c_str());
+    unlink(filter_path.c_str());
+    int db_file = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0){
+        cerr << "cannot create " << db_path << endl;
+        return 1;
+    }
+    db_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, entry.user_id);
+        btree_insert(db_file, PAGE_SIZE, &entry);
+    }
+
+    int rc = 0;
+    char user_id[USERID_LENGTH];
+    {
+        auto start = chrono::steady_clock::now();
+        BloomFilter filter(filter_path.c_str(), db_file, accounts, BLOOM_BITS_PER_KEY, MAINTAIN_INTERVAL_MS);
+        cout << "built from " << accounts << " accounts in " << fixed << setprecision(1) << seconds_since(start) * 1e3
+             << " ms, " << filter.get_stats().blocks * BLOOM_BLOCK_SIZE / 1024 << " KiB" << endl << endl;
+
+        uint64_t loads = btree_page_loads();
+        tuple_info_t info;
+        start = chrono::steady_clock::now();
+        for(uint32_t i = 0; i < lookups; i++){
+            missing_name(i, user_id);
+            if(btree_find(db_file, user_id, USERID_LENGTH, &info) == 0){
+                free_page(db_file, info.page, 0);
+                rc = 1;
+            }
+        }
+        double btree_ns = seconds_since(start) * 1e9 / lookups;
+        double btree_pages = (double) (btree_page_loads() - loads) / lookups;
+        start = chrono::steady_clock::now();
+        double rate = false_positive_rate(&filter, 0, lookups);
+        double filter_ns = seconds_since(start) * 1e9 / lookups;
+        cout << "missing account    " << setw(12) << "ns/lookup" << setw(14) << "pages/lookup" << endl;
+        cout << "  btree_find       " << setw(12) << btree_ns << setw(14) << setprecision(2) << btree_pages << endl;
+        cout << "  bloom filter     " << setw(12) << setprecision(1) << filter_ns << setw(14) << "0" << "   ("
+             << setprecision(2) << rate << "% false positives)" << endl << endl;
+
+        bool seen = true;
+        for(uint32_t i = 0; i < accounts && seen; i++){
+            account_name(i, user_id);
+            seen = filter.may_contain(user_id);
+        }
+        rc |= !seen;
+
+        // CREATE of new accounts and DEPOSIT to missing ones.
+        vector<request_data_t> stream = make_stream(accounts, lookups);
+        RequestExecutor plain(db_file);
+        double plain_us = run_stream(&plain, stream);
+        // that run went past the filter.
+        if(filter.rebuild() != 0){
+            cerr << "rebuilding the filter failed" << endl;
+            rc = 1;
+        }
+        stream = make_stream(accounts + lookups, lookups);
+        RequestExecutor filtered(db_file, NULL, &filter);
+        double filtered_us = run_stream(&filtered, stream);
+        executor_stats_t plain_stats = plain.get_stats(), filtered_stats = filtered.get_stats();
+        cout << "create/deposit to missing: " << setprecision(2) << plain_us << " us/request, " << plain_stats.traversals
+             << " traversals without the filter; " << filtered_us << " us/request, " << filtered_stats.traversals
+             << " traversals with it" << endl;
+
+        // most accounts go; the background thread has to notice.
+        vector<request_data_t> deletes;
+        for(uint32_t i = 0; i < accounts + 2 * lookups; i++){
+            if(i % 8 == 7)
+                continue;
+            deletes.emplace_back();
+            memset(&deletes.back(), 0, sizeof(request_data_t));
+            deletes.back().req = DELETE;
+            account_name(i, deletes.back().userid);
+        }
+        vector<request_result_t> results(deletes.size());
+        uint64_t rebuilds = filter.get_stats().rebuilds;
+        filtered.execute(deletes.data(), deletes.size(), results.data());
+        size_t deleted = 0;
+        for(auto& result: results)
+            deleted += (result.status == REQUEST_OK);
+        double stale_rate = false_positive_rate(&filter, lookups, lookups);
+        for(int waited = 0; waited < 100 && filter.needs_rebuild(); waited++)
+            this_thread::sleep_for(chrono::milliseconds(MAINTAIN_INTERVAL_MS));
+        bloom_stats_t stats = filter.get_stats();
+        double rebuilt_rate = false_positive_rate(&filter, lookups, lookups);
+        seen = true;
+        for(uint32_t i = 7; i < accounts && seen; i += 8){
+            account_name(i, user_id);
+            seen = filter.may_contain(user_id);
+        }
+        rc |= !seen || stats.rebuilds == rebuilds;
+        cout << "after deleting " << deleted << " accounts: " << stats.rebuilds - rebuilds << " rebuilds ("
+             << stats.rebuilds_abandoned << " abandoned), false positives " << stale_rate << "% before, "
+             << rebuilt_rate << "% after; every account still passes: " << (seen ? "yes" : "NO") << endl;
+
+        // whatever the background thread got to, the reopened filter must
+        // hold no deletes.
+        rc |= filter.rebuild() != 0 || filter.flush() != 0;
+    }
+    {
+        auto start = chrono::steady_clock::now();
+        BloomFilter reopened(filter_path.c_str(), db_file, accounts);
+        bloom_stats_t stats = reopened.get_stats();
+        account_name(7, user_id);
+        bool loaded = reopened.may_contain(user_id) && stats.deleted == 0;
+        rc |= !loaded;
+        cout << "reopened in " << setprecision(1) << seconds_since(start) * 1e3 << " ms with " << stats.keys
+             << " keys: " << (loaded ? "yes" : "NO") << endl;
+    }
+    close(db_file);
+    unlink(db_path.c_str());
+    unlink(filter_path.c_str());
+    return rc;
+}
@@ -1,17 +1,120 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
 #include "buffer_pool.h"
 #include "access.h"
 
+/*---------------------- Buffer Pool implemetations --------------------------*/
+
+BufferPool::BufferPool(uint64_t pool_size, bool prefault){
+    this->frame_count = pool_size / FRAME_SIZE;
+    this->arena       = new FrameArena(this->frame_count, prefault);
+    this->frames      = new PageFrame[this->frame_count];
+    this->stats       = new PoolStats(this->frame_count);
+    for(uint64_t i = 0; i < this->frame_count; i++){
+        frames[i].location = NULL;
+        frames[i].buffer   = arena->get_frame(i);
+        frames[i].pin_count  = 0;
+        frames[i].ref_bit    = false;
+        frames[i].is_dirty   = false;
+        frames[i].io_pending = false;
+        frames[i].in_scan_ring = false;
+        frames[i].page_pin.clear();
+        frames[i].header_latch.clear();
+        pthread_mutex_init(&frames[i].page_latch, NULL);
+    }
+}
+
+BufferPool::~BufferPool(){
+    for(uint64_t i = 0; i < this->frame_count; i++)
+        pthread_mutex_destroy(&frames[i].page_latch);
+    delete[] this->frames;
+    delete this->stats;
+    delete this->arena;
+}
+
+/*---------------------- Request implemetations -----------------------------*/
+
+Request::Request(page_request_t request_type, page_loc_t location, PageFrame** frame, page_access_t mode){
+    this->request_type = request_type;
+    this->access_mode  = mode;
+    this->location     = location;
+    this->frame        = frame;
+    this->is_complete  = false;
+    this->retcode      = 0;
+    pthread_mutex_init(&this->beacon_lock, NULL);
+    pthread_cond_init(&this->beacon, NULL);
+}
+
+Request::~Request(){
+    pthread_cond_destroy(&this->beacon);
+    pthread_mutex_destroy(&this->beacon_lock);
+}
+
+void Request::wait(){
+    pthread_mutex_lock(&this->beacon_lock);
+    while(!this->is_complete)
+        pthread_cond_wait(&this->beacon, &this->beacon_lock);
+    pthread_mutex_unlock(&this->beacon_lock);
+}
+
+void Request::complete(int retcode){
+    pthread_mutex_lock(&this->beacon_lock);
+    this->retcode     = retcode;
+    this->is_complete = true;
+    pthread_cond_signal(&this->beacon);
+    pthread_mutex_unlock(&this->beacon_lock);
+}
+
+/*---------------------- State implemetations --------------------------------*/
+
 IdleState::IdleState(Context* cxt){
     this->cxt = cxt;
+    this->is_run_complete = false;
+}
+
+IdleState::~IdleState(){}
+
+// ends a WriteBackState: false if the victim could not be written.
+static bool finish_write_back(Context* cxt){
+    PoolStats* stats = cxt->loop->get_replacement_algo()->get_pool()->get_stats();
+    bool io_ok = (cxt->io_retcode == FRAME_SIZE);
+    if(io_ok){
+        stats->write_latency.record(stats_now_ns() - cxt->io_start_ns);
+        stats->add(STAT_DIRTY_WRITEBACKS);
+    }
+    else{
+        stats->add(STAT_WRITE_ERRORS);
+        cxt->victim->is_dirty = true;
+    }
+    cxt->loop->get_replacement_algo()->unpin(cxt->victim, false);
+    cxt->victim = NULL;
+    return io_ok;
 }
+
 void IdleState::run(){
-    if(cxt->req->request_type == READ){
-        next_state = new ReadState(cxt);
+    if(cxt->victim != NULL && !finish_write_back(cxt)){
+        cxt->frame = NULL;
+        next_state = new CompleteState(cxt);
+    }
+    else if(cxt->req->request_type == PAGE_READ){
+        replacement_algo_ret_t ret = cxt->loop->get_replacement_algo()->get_page(cxt->req->location, cxt->req->access_mode);
+        cxt->frame = ret.page_frame;
+        if(ret.flushing_required){
+            cxt->victim = ret.page_frame;
+            cxt->frame  = NULL;
+            next_state  = new WriteBackState(cxt);
+        }
+        else if(ret.page_frame == NULL || ret.is_resident)
+            next_state = new CompleteState(cxt);
+        else
+            next_state = new ReadState(cxt);
     }
     else{
+        cxt->frame = *(cxt->req->frame);
         next_state = new WriteState(cxt);
     }
-    cxt->is_ready = false;
     is_run_complete = true;
 }
 
@@ -22,87 +125,322 @@ bool IdleState::is_blocking(){
 State* IdleState::get_next_state(){
     if(is_run_complete)
         return next_state;
+    return NULL;
 }
 
 ReadState::ReadState(Context* cxt){
     this->cxt = cxt;
+    this->is_run_complete = false;
 }
 
+ReadState::~ReadState(){}
+
 void ReadState::run(){
-    // enque_read_request
-    cxt->is_ready = false;
+    io_request_t request;
+    cxt->io_vec.iov_base = cxt->frame->buffer;
+    cxt->io_vec.iov_len  = FRAME_SIZE;
+    request.type      = ACCESS_IO_READ;
+    request.io_vec    = &cxt->io_vec;
+    request.user_data = cxt;
+    request.fd        = cxt->frame->loc.fd;
+    request.offset    = cxt->frame->loc.offset;
+    request.req_count = 1;
+    cxt->io_start_ns  = stats_now_ns();
+    cxt->read_issued  = true;
+    try{
+        cxt->loop->get_io_handler()->enque_access_request(request.fd, &request);
+        cxt->is_ready = false;
+    }
+    catch(AccessFailure& failure){
+        cxt->io_retcode = -1;
+    }
+    is_run_complete = true;
 }
 
 bool ReadState::is_blocking(){
-    return true;
+    // a failed submission never completes, so don't wait for it.
+    return !cxt->is_ready;
 }
 
 State* ReadState::get_next_state(){
-    if(is_run_complete){
-        
+    if(is_run_complete)
+        return new CompleteState(cxt);
+    return NULL;
+}
+
+WriteState::WriteState(Context* cxt){
+    this->cxt = cxt;
+    this->is_run_complete = false;
+}
+
+WriteState::~WriteState(){}
+
+void WriteState::run(){
+    io_request_t request;
+    // cleared before the write is issued: a store that races with the write
+    // marks the frame dirty again instead of being lost.
+    cxt->frame->is_dirty = false;
+    cxt->io_vec.iov_base = cxt->frame->buffer;
+    cxt->io_vec.iov_len  = FRAME_SIZE;
+    request.type      = ACCESS_IO_WRITE;
+    request.io_vec    = &cxt->io_vec;
+    request.user_data = cxt;
+    request.fd        = cxt->frame->loc.fd;
+    request.offset    = cxt->frame->loc.offset;
+    request.req_count = 1;
+    cxt->io_start_ns  = stats_now_ns();
+    try{
+        cxt->loop->get_io_handler()->enque_access_request(request.fd, &request);
+        cxt->is_ready = false;
+    }
+    catch(AccessFailure& failure){
+        cxt->io_retcode = -1;
+    }
+    is_run_complete = true;
+}
+
+bool WriteState::is_blocking(){
+    return !cxt->is_ready;
+}
+
+State* WriteState::get_next_state(){
+    if(is_run_complete)
+        return new CompleteState(cxt);
+    return NULL;
+}
+
+WriteBackState::WriteBackState(Context* cxt){
+    this->cxt = cxt;
+    this->is_run_complete = false;
+}
+
+WriteBackState::~WriteBackState(){}
+
+void WriteBackState::run(){
+    io_request_t request;
+    // see WriteState::run().
+    cxt->victim->is_dirty = false;
+    cxt->io_vec.iov_base = cxt->victim->buffer;
+    cxt->io_vec.iov_len  = FRAME_SIZE;
+    request.type      = ACCESS_IO_WRITE;
+    request.io_vec    = &cxt->io_vec;
+    request.user_data = cxt;
+    request.fd        = cxt->victim->loc.fd;
+    request.offset    = cxt->victim->loc.offset;
+    request.req_count = 1;
+    cxt->io_start_ns  = stats_now_ns();
+    try{
+        cxt->loop->get_io_handler()->enque_access_request(request.fd, &request);
+        cxt->is_ready = false;
+    }
+    catch(AccessFailure& failure){
+        cxt->io_retcode = -1;
+    }
+    is_run_complete = true;
+}
+
+bool WriteBackState::is_blocking(){
+    return !cxt->is_ready;
+}
+
+State* WriteBackState::get_next_state(){
+    // the write is finished by the IdleState, which then asks again.
+    if(is_run_complete)
+        return new IdleState(cxt);
+    return NULL;
+}
+
+CompleteState::CompleteState(Context* cxt){
+    this->cxt = cxt;
+}
+
+CompleteState::~CompleteState(){}
+
+void CompleteState::run(){
+    bool io_ok = (cxt->io_retcode == FRAME_SIZE);
+    PoolStats* stats = cxt->loop->get_replacement_algo()->get_pool()->get_stats();
+    if(cxt->frame == NULL){
+        cxt->req->complete(-1);
+        return;
+    }
+    if(cxt->req->request_type == PAGE_READ){
+        // only the context that issued the read may finish it. A hit may
+        // land on a frame another context is still reading in; the loop
+        // can't wait for that read (it completes it), so the requesting
+        // thread does, with wait_for_load().
+        if(cxt->read_issued){
+            stats->read_latency.record(stats_now_ns() - cxt->io_start_ns);
+            if(!io_ok)
+                stats->add(STAT_READ_ERRORS);
+            cxt->loop->get_replacement_algo()->finish_load(cxt->frame, io_ok);
+        }
+        if(!io_ok){
+            cxt->req->complete(-1);
+            return;
+        }
+        *(cxt->req->frame) = cxt->frame;
+    }
+    else{
+        stats->write_latency.record(stats_now_ns() - cxt->io_start_ns);
+        if(io_ok){
+            stats->add(STAT_DIRTY_WRITEBACKS);
+        }
+        else{
+            stats->add(STAT_WRITE_ERRORS);
+            cxt->frame->is_dirty = true;
+        }
+    }
+    cxt->req->complete(io_ok ? 0 : -1);
+}
+
+bool CompleteState::is_blocking(){
+    return false;
+}
+
+State* CompleteState::get_next_state(){
+    return NULL;
+}
+
+/*---------------------- Context implemetations ------------------------------*/
+
+Context::Context(Request* req, EventLoop* loop){
+    this->req           = req;
+    this->loop          = loop;
+    this->frame         = NULL;
+    this->victim        = NULL;
+    this->io_retcode    = FRAME_SIZE;
+    this->io_start_ns   = 0;
+    this->read_issued   = false;
+    this->is_ready      = true;
+    this->current_state = new IdleState(this);
+}
+
+void Context::run(){
+    while(current_state != NULL){
+        current_state->run();
+        bool blocking = current_state->is_blocking();
+        State* next_state = current_state->get_next_state();
+        delete current_state;
+        current_state = next_state;
+        if(blocking)
+            return;
     }
 }
 
 /*---------------------- Event Loop implemetations ---------------------------*/
 
 int EventLoop::req_to_context(){
-    pthread_mutex_lock(this->request_queue_lock);
-    while(!request_queue.empty()){
-        context_queue.push(new Context(request_queue.front()));
-        request_queue.pop();
+    Request* req = NULL;
+    int moved = 0;
+    while(request_queue.pop(&req)){
+        context_queue.push(new Context(req, this));
+        moved++;
+    }
+    ready_contexts += moved;
+    return moved;
+}
+
+int EventLoop::reap_completions(){
+    completed_io_t* completed = NULL;
+    int reaped = 0;
+    while((completed = io_handler->get_completed_request()) != NULL){
+        Context* cxt = (Context*) completed->user_data;
+        cxt->io_retcode = completed->retcode;
+        cxt->is_ready = true;
+        ready_contexts++;
+        reaped++;
+        delete completed;
     }
-    pthread_mutex_unlock(this->request_queue_lock);
+    return reaped;
 }
 
-bool EventLoop::check_request_q_empty_locked(){
-    bool ret = false;
-    pthread_mutex_lock(this->request_queue_lock);
-    ret = request_queue.empty();
-    pthread_mutex_unlock(this->request_queue_lock);
-    return ret;
+void EventLoop::run_with_context(Context* cxt){
+    cxt->run();
+    if(cxt->current_state == NULL){
+        // the request has been completed, the requesting thread owns it.
+        delete cxt;
+        return;
+    }
+    if(cxt->is_ready)
+        ready_contexts++;
+    context_queue.push(cxt);
+}
+
+void EventLoop::park(){
+    uint64_t count = 0;
+    is_parked.store(true);
+    // re-check after announcing that we are parked: a producer that pushed
+    // before this point is seen here, one that pushes after it sees is_parked.
+    // The fence pairs with the one in enque_request(): without both, the
+    // store of is_parked and the load of the ring (and the producer's push
+    // and load of is_parked) may each be reordered, and both sides miss.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(stop_flag || !request_queue.empty() || io_handler->has_completed_requests()){
+        is_parked.store(false);
+        return;
+    }
+    while(read(wake_fd, &count, sizeof(count)) < 0 && errno == EINTR);
+    is_parked.store(false);
+}
+
+void EventLoop::wake_up(){
+    uint64_t one = 1;
+    while(write(wake_fd, &one, sizeof(one)) < 0 && errno == EINTR);
 }
 
-EventLoop::EventLoop(ReplacementAlgo* rpl_algo){
+EventLoop::EventLoop(ReplacementAlgo* rpl_algo, IOHandler* io_handler, uint32_t queue_size)
+    : request_queue(queue_size){
+    char err_buff[256];
     this->replacement_algo = rpl_algo;
-    pthread_mutex_init(this->request_queue_lock, NULL);
+    this->io_handler       = io_handler;
+    this->ready_contexts   = 0;
+    this->is_parked        = false;
+    this->stop_flag        = false;
+    if((this->wake_fd = eventfd(0, EFD_CLOEXEC)) < 0){
+        memset(err_buff, '\0', 256);
+        strerror_r(errno, err_buff, 255);
+        throw AccessFailure(INIT, std::string(err_buff));
+    }
+    this->io_handler->register_eventfd(this->wake_fd);
+}
+
+EventLoop::~EventLoop(){
+    close(this->wake_fd);
 }
 
 int EventLoop::enque_request(Request* req){
-    // TODO: add a lock around this.
-    pthread_mutex_lock(this->request_queue_lock);
-    this->request_queue.push(req);
-    pthread_mutex_unlock(this->request_queue_lock);
+    if(!this->request_queue.push(req))
+        return -1;
+    // see park().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(is_parked.load() && is_parked.exchange(false))
+        wake_up();
+    return 0;
 }
 
 void EventLoop::start(){
     while(stop_flag != true){
-        // TODO: suround this check with request_queue_lock else it
-        // might lead to deadlocks. 
-        if(check_request_q_empty_locked() && request_queue.empty()){
-            // going to sleep.
-            pthread_mutex_lock(this->loop_wake_up_lock);
-            // check if calling check_request_q_empty_locked while holding the
-            // loop lock may lead to deadlock.
-            while(!check_request_q_empty_locked()){
-                pthread_cond_wait(this->loop_wake_up_cond, this->loop_wake_up_lock);
-            }
-            pthread_mutex_unlock(this->loop_wake_up_lock);
+        req_to_context();
+        reap_completions();
+        replacement_algo->get_pool()->get_stats()->set_queue_depth(context_queue.size());
+        if(ready_contexts == 0){
+            // nothing to do until a new request or an IO completion arrives.
+            park();
+            continue;
         }
-        // Does checking request_queue.empty require a lock ?
-        // Probably not, we will take care of the new request in the next iteration.
-        // The above check guarentees that there will be atleast one item
-        // in the request queue.
-        if(!request_queue.empty()){
-            req_to_context();
-        }
-        // checking the context_queue for being empty is not required as the
-        // previous checks ensure that the queue is not empty or if it was empty
-        // in the beginning, it must have been filled by req_to_context.
+        // contexts waiting on IO are moved to the back of the queue; since
+        // ready_contexts > 0 we are guaranteed to find a ready one.
         Context* cxt = context_queue.front(); context_queue.pop();
+        if(!cxt->is_ready){
+            context_queue.push(cxt);
+            continue;
+        }
+        ready_contexts--;
         run_with_context(cxt);
     }
 }
 
 void EventLoop::stop(){
     stop_flag = true;
-}
\ No newline at end of file
+    wake_up();
+}
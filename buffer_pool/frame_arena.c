@@ -0,0 +1,58 @@
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+#include "frame_arena.h"
+
+static uint64_t round_up(uint64_t size, uint64_t align){
+    return (size + align - 1) & ~(align - 1);
+}
+
+FrameArena::FrameArena(uint64_t frame_count, bool prefault){
+    char err_buff[256];
+    void *ptr = MAP_FAILED;
+
+    if(frame_count == 0)
+        throw ArenaFailure("FrameArena: frame count must be non zero");
+    this->frame_count = frame_count;
+    this->mapped_size = round_up(frame_count * FRAME_SIZE, HUGE_PAGE_SIZE);
+
+    // 1. explicit huge pages. MAP_POPULATE does the pre-faulting for us.
+    ptr = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (prefault ? MAP_POPULATE : 0), -1, 0);
+    if(ptr != MAP_FAILED){
+        base    = (char*) ptr;
+        backing = ARENA_HUGETLB;
+        return;
+    }
+
+    // 2. over-reserve by one huge page so the arena can start on a 2 MiB
+    //    boundary, which THP needs to back it with huge pages.
+    ptr = mmap(NULL, mapped_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(ptr == MAP_FAILED){
+        memset(err_buff, '\0', 256);
+        strerror_r(errno, err_buff, 255);
+        throw ArenaFailure(std::string(err_buff));
+    }
+    uint64_t start = round_up((uint64_t) ptr, HUGE_PAGE_SIZE);
+    uint64_t head  = start - (uint64_t) ptr;
+    if(head)
+        munmap(ptr, head);
+    if(HUGE_PAGE_SIZE - head)
+        munmap((char*) start + mapped_size, HUGE_PAGE_SIZE - head);
+    base    = (char*) start;
+    backing = (madvise(base, mapped_size, MADV_HUGEPAGE) == 0) ? ARENA_THP : ARENA_NORMAL;
+    if(prefault)
+        _prefault();
+}
+
+void FrameArena::_prefault(){
+    // one write per 4 KiB page; with THP the first write of each 2 MiB
+    // region faults in the whole huge page and the rest are cheap.
+    for(uint64_t off = 0; off < mapped_size; off += FRAME_SIZE)
+        ((volatile char*) base)[off] = 0;
+}
+
+FrameArena::~FrameArena(){
+    munmap(base, mapped_size);
+}
@@ -0,0 +1,91 @@
+#include <sched.h>
+#include <string.h>
+#include "partitioned_pool.h"
+#include "access.h"
+
+BufferPoolShard::BufferPoolShard(uint64_t pool_size, bool prefault, uint32_t scan_ring_frames){
+    replacement_algo_args_t args = {scan_ring_frames};
+    this->pool             = new BufferPool(pool_size, prefault);
+    this->replacement_algo = new ReplacementAlgo(this->pool, &args);
+    this->io_handler       = new IOHandler(SHARD_IO_QUEUE_DEPTH);
+    this->event_loop       = new EventLoop(this->replacement_algo, this->io_handler);
+    pthread_create(&this->loop_thread, NULL, BufferPoolShard::_run_loop, this);
+}
+
+BufferPoolShard::~BufferPoolShard(){
+    event_loop->stop();
+    pthread_join(this->loop_thread, NULL);
+    delete event_loop;
+    delete io_handler;
+    delete replacement_algo;
+    delete pool;
+}
+
+void* BufferPoolShard::_run_loop(void* shard){
+    ((BufferPoolShard*) shard)->event_loop->start();
+    return NULL;
+}
+
+PageFrame* BufferPoolShard::fetch_page(const page_loc_t& loc, page_access_t mode){
+    PageFrame* frame = replacement_algo->pin_if_resident(loc, mode);
+    if(frame == NULL){
+        Request req(PAGE_READ, loc, &frame, mode);
+        while(event_loop->enque_request(&req) != 0)
+            sched_yield();
+        req.wait();
+        if(req.retcode != 0)
+            return NULL;
+    }
+    // a hit, here or on the event loop, may land on a frame that another
+    // request is still reading in.
+    if(!replacement_algo->wait_for_load(frame, loc))
+        return NULL;
+    return frame;
+}
+
+void BufferPoolShard::release_page(PageFrame* frame, bool dirty){
+    replacement_algo->unpin(frame, dirty);
+}
+
+int BufferPoolShard::flush_page(PageFrame* frame){
+    Request req(PAGE_WRITE, frame->loc, &frame);
+    while(event_loop->enque_request(&req) != 0)
+        sched_yield();
+    req.wait();
+    return req.retcode;
+}
+
+PartitionedBufferPool::PartitionedBufferPool(uint32_t shard_count, uint64_t pool_size, bool prefault,
+                                             uint32_t scan_ring_frames){
+    if(shard_count == 0)
+        shard_count = 1;
+    for(uint32_t i = 0; i < shard_count; i++)
+        shards.push_back(new BufferPoolShard(pool_size / shard_count, prefault, scan_ring_frames));
+}
+
+PartitionedBufferPool::~PartitionedBufferPool(){
+    for(auto shard: shards)
+        delete shard;
+}
+
+PageFrame* PartitionedBufferPool::fetch_page(const page_loc_t& loc, page_access_t mode){
+    return shards[shard_of(loc)]->fetch_page(loc, mode);
+}
+
+void PartitionedBufferPool::release_page(PageFrame* frame, bool dirty){
+    shards[shard_of(frame->loc)]->release_page(frame, dirty);
+}
+
+int PartitionedBufferPool::flush_page(PageFrame* frame){
+    return shards[shard_of(frame->loc)]->flush_page(frame);
+}
+
+void PartitionedBufferPool::stats_snapshot(pool_stats_snapshot_t* out){
+    pool_stats_snapshot_t* shard_snap = new pool_stats_snapshot_t;
+    memset(out, 0, sizeof(pool_stats_snapshot_t));
+    for(auto shard: shards){
+        shard->stats_snapshot(shard_snap);
+        stats_snapshot_merge(out, shard_snap);
+    }
+    delete shard_snap;
+}
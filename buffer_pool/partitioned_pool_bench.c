@@ -0,0 +1,151 @@
+/*
+* Hit and miss throughput of the PartitionedBufferPool as the number of shards
+* and client threads grows.
+*
+* usage: partitioned_pool_bench [pages] [ops_per_thread] [max_shards] [max_threads]
+*
+* hit:  the pool holds the whole file and is warmed up before measuring.
+* miss: the pool holds 1/8th of the file, uniform random access.
+*
+* scan resistance: a hot set of 1/8th of the file is warmed up in a pool of
+* 1/4th of the file, then the whole file is scanned once, then the hot set is
+* looked up again. Reports the hit ratio of that last pass for a scan issued
+* with ACCESS_NORMAL and with ACCESS_SCAN.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "partitioned_pool.h"
+
+using namespace std;
+
+typedef struct{
+    PartitionedBufferPool* pool;
+    int      fd;
+    uint64_t pages;
+    uint64_t ops;
+    uint64_t seed;
+    uint64_t failed;
+}bench_worker_t;
+
+static void* bench_worker(void* arg){
+    bench_worker_t* worker = (bench_worker_t*) arg;
+    mt19937_64 rng(worker->seed);
+    uniform_int_distribution<uint64_t> dist(0, worker->pages - 1);
+    for(uint64_t i = 0; i < worker->ops; i++){
+        page_loc_t loc = {worker->fd, dist(rng) * FRAME_SIZE};
+        PageFrame* frame = worker->pool->fetch_page(loc);
+        if(frame == NULL){
+            worker->failed++;
+            continue;
+        }
+        worker->pool->release_page(frame, false);
+    }
+    return NULL;
+}
+
+static double run_bench(PartitionedBufferPool* pool, int fd, uint64_t pages,
+                        uint32_t threads, uint64_t ops){
+    vector<pthread_t> tids(threads);
+    vector<bench_worker_t> workers(threads);
+    auto start = chrono::steady_clock::now();
+    for(uint32_t t = 0; t < threads; t++){
+        workers[t] = {pool, fd, pages, ops, 0x9e3779b97f4a7c15ULL * (t + 1), 0};
+        pthread_create(&tids[t], NULL, bench_worker, &workers[t]);
+    }
+    uint64_t failed = 0;
+    for(uint32_t t = 0; t < threads; t++){
+        pthread_join(tids[t], NULL);
+        failed += workers[t].failed;
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(failed)
+        cerr << "warning: " << failed << " fetches failed" << endl;
+    return (double)(threads * ops) / secs;
+}
+
+static double hot_hit_ratio_after_scan(int fd, uint64_t pages, page_access_t scan_mode){
+    PartitionedBufferPool* pool = new PartitionedBufferPool(1, (pages / 4) * FRAME_SIZE);
+    uint64_t hot_pages = pages / 8;
+    pool_stats_snapshot_t before, after;
+    for(int pass = 0; pass < 2; pass++){
+        for(uint64_t p = 0; p < hot_pages; p++){
+            page_loc_t loc = {fd, p * FRAME_SIZE};
+            PageFrame* frame = pool->fetch_page(loc);
+            if(frame) pool->release_page(frame, false);
+        }
+    }
+    for(uint64_t p = 0; p < pages; p++){
+        page_loc_t loc = {fd, p * FRAME_SIZE};
+        PageFrame* frame = pool->fetch_page(loc, scan_mode);
+        if(frame) pool->release_page(frame, false);
+    }
+    pool->stats_snapshot(&before);
+    for(uint64_t p = 0; p < hot_pages; p++){
+        page_loc_t loc = {fd, p * FRAME_SIZE};
+        PageFrame* frame = pool->fetch_page(loc);
+        if(frame) pool->release_page(frame, false);
+    }
+    pool->stats_snapshot(&after);
+    delete pool;
+    return (double)(after.counters[STAT_HITS] - before.counters[STAT_HITS]) / hot_pages;
+}
+
+int main(int argc, char** argv){
+    uint64_t pages       = (argc > 1) ? strtoull(argv[1], NULL, 10) : 16384;
+    uint64_t ops         = (argc > 2) ? strtoull(argv[2], NULL, 10) : 200000;
+    uint32_t max_shards  = (argc > 3) ? atoi(argv[3]) : 8;
+    uint32_t max_threads = (argc > 4) ? atoi(argv[4]) : 8;
+
+    char path[] = "/tmp/sbase_pool_benchXXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0){
+        perror("mkstemp");
+        return 1;
+    }
+    unlink(path);
+    char page[FRAME_SIZE] = {0};
+    for(uint64_t i = 0; i < pages; i++){
+        if(pwrite(fd, page, FRAME_SIZE, i * FRAME_SIZE) != FRAME_SIZE){
+            perror("pwrite");
+            return 1;
+        }
+    }
+
+    cout << "pages: " << pages << " ops/thread: " << ops << endl;
+    cout << setw(8) << "shards" << setw(9) << "threads"
+         << setw(16) << "hit ops/s" << setw(16) << "miss ops/s"
+         << setw(14) << "read p50 ns" << setw(14) << "read p99 ns" << endl;
+    pool_stats_snapshot_t stats;
+    for(uint32_t shards = 1; shards <= max_shards; shards *= 2){
+        for(uint32_t threads = 1; threads <= max_threads; threads *= 2){
+            // every shard gets some slack so hash skew doesn't cause misses.
+            PartitionedBufferPool* hit_pool = new PartitionedBufferPool(shards, (pages + pages / 4 + 64 * shards) * FRAME_SIZE);
+            run_bench(hit_pool, fd, pages, 1, pages * 4);
+            double hit_rate = run_bench(hit_pool, fd, pages, threads, ops);
+            delete hit_pool;
+
+            PartitionedBufferPool* miss_pool = new PartitionedBufferPool(shards, (pages / 8 + shards) * FRAME_SIZE);
+            double miss_rate = run_bench(miss_pool, fd, pages, threads, ops / 8);
+            miss_pool->stats_snapshot(&stats);
+            delete miss_pool;
+
+            cout << setw(8) << shards << setw(9) << threads << fixed << setprecision(0)
+                 << setw(16) << hit_rate << setw(16) << miss_rate
+                 << setw(14) << histogram_percentile(&stats.read_latency, 50)
+                 << setw(14) << histogram_percentile(&stats.read_latency, 99) << endl;
+        }
+    }
+    cout << "last miss run: " << stats_snapshot_to_json(&stats) << endl;
+    cout << "hot set hit ratio after a full scan: normal="
+         << setprecision(3) << hot_hit_ratio_after_scan(fd, pages, ACCESS_NORMAL)
+         << " scan ring=" << hot_hit_ratio_after_scan(fd, pages, ACCESS_SCAN) << endl;
+    close(fd);
+    return 0;
+}
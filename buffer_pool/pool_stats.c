@@ -0,0 +1,185 @@
+#include <time.h>
+#include <string.h>
+#include <stdio.h>
+#include "pool_stats.h"
+
+static const char* counter_names[STAT_COUNTER_COUNT] = {
+    "hits", "misses", "evictions", "dirty_writebacks",
+    "pin_waits", "read_errors", "write_errors", "scan_reads"
+};
+
+uint64_t stats_now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------- Latency Histogram -----------------------------------*/
+
+LatencyHistogram::LatencyHistogram(){
+    for(int i = 0; i < HIST_BUCKETS; i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+uint32_t LatencyHistogram::bucket_of(uint64_t value){
+    if(value < HIST_SUB_BUCKETS)
+        return value;
+    uint32_t msb   = 63 - __builtin_clzll(value);
+    uint32_t shift = msb - HIST_SUB_BUCKET_BITS;
+    return ((shift + 1) << HIST_SUB_BUCKET_BITS) | ((value >> shift) & (HIST_SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::bucket_floor(uint32_t bucket){
+    if(bucket < HIST_SUB_BUCKETS)
+        return bucket;
+    uint32_t shift = (bucket >> HIST_SUB_BUCKET_BITS) - 1;
+    uint64_t sub   = bucket & (HIST_SUB_BUCKETS - 1);
+    return (HIST_SUB_BUCKETS | sub) << shift;
+}
+
+void LatencyHistogram::record(uint64_t value){
+    buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t cur = max.load(std::memory_order_relaxed);
+    while(value > cur && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::snapshot(histogram_snapshot_t* out){
+    for(int i = 0; i < HIST_BUCKETS; i++)
+        out->buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    out->count = count.load(std::memory_order_relaxed);
+    out->sum   = sum.load(std::memory_order_relaxed);
+    out->max   = max.load(std::memory_order_relaxed);
+}
+
+uint64_t histogram_percentile(const histogram_snapshot_t* hist, double percentile){
+    uint64_t total = 0;
+    for(int i = 0; i < HIST_BUCKETS; i++)
+        total += hist->buckets[i];
+    if(total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total);
+    if(rank >= total)
+        rank = total - 1;
+    uint64_t seen = 0;
+    for(int i = 0; i < HIST_BUCKETS; i++){
+        seen += hist->buckets[i];
+        if(seen > rank)
+            return LatencyHistogram::bucket_floor(i);
+    }
+    return hist->max;
+}
+
+/*---------------------- Pool Stats ------------------------------------------*/
+
+PoolStats::PoolStats(uint64_t frames){
+    for(int s = 0; s < STATS_STRIPES; s++)
+        for(int c = 0; c < STAT_COUNTER_COUNT; c++)
+            stripes[s].counters[c].store(0, std::memory_order_relaxed);
+    queue_depth.store(0, std::memory_order_relaxed);
+    max_queue_depth.store(0, std::memory_order_relaxed);
+    this->frames = frames;
+}
+
+uint32_t PoolStats::_my_stripe(){
+    static std::atomic<uint32_t> next_stripe(0);
+    static thread_local uint32_t stripe = next_stripe.fetch_add(1) % STATS_STRIPES;
+    return stripe;
+}
+
+void PoolStats::snapshot(pool_stats_snapshot_t* out){
+    memset(out->counters, 0, sizeof(out->counters));
+    for(int s = 0; s < STATS_STRIPES; s++)
+        for(int c = 0; c < STAT_COUNTER_COUNT; c++)
+            out->counters[c] += stripes[s].counters[c].load(std::memory_order_relaxed);
+    out->queue_depth     = queue_depth.load(std::memory_order_relaxed);
+    out->max_queue_depth = max_queue_depth.load(std::memory_order_relaxed);
+    out->frames          = frames;
+    read_latency.snapshot(&out->read_latency);
+    write_latency.snapshot(&out->write_latency);
+}
+
+/*---------------------- Snapshot helpers ------------------------------------*/
+
+static void histogram_merge(histogram_snapshot_t* into, const histogram_snapshot_t* from){
+    for(int i = 0; i < HIST_BUCKETS; i++)
+        into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    into->sum   += from->sum;
+    if(from->max > into->max)
+        into->max = from->max;
+}
+
+void stats_snapshot_merge(pool_stats_snapshot_t* into, const pool_stats_snapshot_t* from){
+    for(int c = 0; c < STAT_COUNTER_COUNT; c++)
+        into->counters[c] += from->counters[c];
+    into->queue_depth += from->queue_depth;
+    if(from->max_queue_depth > into->max_queue_depth)
+        into->max_queue_depth = from->max_queue_depth;
+    into->frames += from->frames;
+    histogram_merge(&into->read_latency, &from->read_latency);
+    histogram_merge(&into->write_latency, &from->write_latency);
+}
+
+static double hit_ratio(const pool_stats_snapshot_t* snap){
+    uint64_t accesses = snap->counters[STAT_HITS] + snap->counters[STAT_MISSES];
+    return accesses ? (double) snap->counters[STAT_HITS] / accesses : 0.0;
+}
+
+static std::string histogram_to_text(const char* name, const histogram_snapshot_t* hist){
+    char line[256];
+    snprintf(line, sizeof(line),
+             "%s_ns: count=%lu mean=%lu p50=%lu p90=%lu p99=%lu p999=%lu max=%lu\n",
+             name, hist->count, hist->count ? hist->sum / hist->count : 0,
+             histogram_percentile(hist, 50), histogram_percentile(hist, 90),
+             histogram_percentile(hist, 99), histogram_percentile(hist, 99.9), hist->max);
+    return std::string(line);
+}
+
+static std::string histogram_to_json(const char* name, const histogram_snapshot_t* hist){
+    char obj[256];
+    snprintf(obj, sizeof(obj),
+             "\"%s_ns\":{\"count\":%lu,\"mean\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu}",
+             name, hist->count, hist->count ? hist->sum / hist->count : 0,
+             histogram_percentile(hist, 50), histogram_percentile(hist, 90),
+             histogram_percentile(hist, 99), histogram_percentile(hist, 99.9), hist->max);
+    return std::string(obj);
+}
+
+std::string stats_snapshot_to_text(const pool_stats_snapshot_t* snap){
+    std::string out;
+    char line[128];
+    snprintf(line, sizeof(line), "frames: %lu\nhit_ratio: %.4f\n", snap->frames, hit_ratio(snap));
+    out += line;
+    for(int c = 0; c < STAT_COUNTER_COUNT; c++){
+        snprintf(line, sizeof(line), "%s: %lu\n", counter_names[c], snap->counters[c]);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "queue_depth: %lu\nmax_queue_depth: %lu\n",
+             snap->queue_depth, snap->max_queue_depth);
+    out += line;
+    out += histogram_to_text("read_latency", &snap->read_latency);
+    out += histogram_to_text("write_latency", &snap->write_latency);
+    return out;
+}
+
+std::string stats_snapshot_to_json(const pool_stats_snapshot_t* snap){
+    std::string out = "{";
+    char field[128];
+    snprintf(field, sizeof(field), "\"frames\":%lu,\"hit_ratio\":%.4f", snap->frames, hit_ratio(snap));
+    out += field;
+    for(int c = 0; c < STAT_COUNTER_COUNT; c++){
+        snprintf(field, sizeof(field), ",\"%s\":%lu", counter_names[c], snap->counters[c]);
+        out += field;
+    }
+    snprintf(field, sizeof(field), ",\"queue_depth\":%lu,\"max_queue_depth\":%lu,",
+             snap->queue_depth, snap->max_queue_depth);
+    out += field;
+    out += histogram_to_json("read_latency", &snap->read_latency) + ",";
+    out += histogram_to_json("write_latency", &snap->write_latency) + "}";
+    return out;
+}
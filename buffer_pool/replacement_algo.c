@@ -0,0 +1,182 @@
+#include <unistd.h>
+#include <errno.h>
+#include "buffer_pool.h"
+
+static int write_frame(PageFrame* frame){
+    uint64_t written = 0;
+    while(written < FRAME_SIZE){
+        ssize_t ret = pwrite(frame->loc.fd, frame->buffer + written,
+                             FRAME_SIZE - written, frame->loc.offset + written);
+        if(ret < 0){
+            if(errno == EINTR || errno == EAGAIN) continue;
+            return -1;
+        }
+        written += ret;
+    }
+    return 0;
+}
+
+ReplacementAlgo::ReplacementAlgo(BufferPool* pool, void* args){
+    replacement_algo_args_t* algo_args = (replacement_algo_args_t*) args;
+    uint64_t frame_count = pool->get_frame_count();
+    this->pagePool    = pool;
+    this->clock_hand  = 0;
+    this->frames_used = 0;
+    this->scan_hand   = 0;
+    this->scan_frames = algo_args ? algo_args->scan_ring_frames : DEFAULT_SCAN_RING_FRAMES;
+    // the ring never takes more than a quarter of the pool.
+    if(this->scan_frames > frame_count / 4)
+        this->scan_frames = frame_count / 4;
+    this->clock_frames = frame_count - this->scan_frames;
+    for(uint64_t i = this->clock_frames; i < frame_count; i++)
+        pool->get_frame(i)->in_scan_ring = true;
+    this->page_table.reserve(this->clock_frames);
+    this->scan_table.reserve(this->scan_frames);
+    pthread_mutex_init(&this->latch, NULL);
+}
+
+ReplacementAlgo::~ReplacementAlgo(){
+    pthread_mutex_destroy(&this->latch);
+}
+
+PageFrame* ReplacementAlgo::_find_victim(){
+    if(frames_used < clock_frames)
+        return pagePool->get_frame(frames_used++);
+    // two full turns: the first may only clear reference bits.
+    for(uint64_t step = 0; step < 2 * clock_frames; step++){
+        PageFrame* frame = pagePool->get_frame(clock_hand);
+        clock_hand = (clock_hand + 1) % clock_frames;
+        if(frame->pin_count.load() != 0)
+            continue;
+        if(frame->ref_bit.load(std::memory_order_relaxed)){
+            frame->ref_bit.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        return frame;
+    }
+    return NULL;
+}
+
+PageFrame* ReplacementAlgo::_find_scan_victim(){
+    // plain round robin: a scan never comes back to a page it has passed.
+    for(uint64_t step = 0; step < scan_frames; step++){
+        PageFrame* frame = pagePool->get_frame(clock_frames + scan_hand);
+        scan_hand = (scan_hand + 1) % scan_frames;
+        if(frame->pin_count.load() == 0)
+            return frame;
+    }
+    return NULL;
+}
+
+// latch held. Both tables in every mode: a page is in at most one frame.
+PageFrame* ReplacementAlgo::_lookup(const page_loc_t& loc, page_access_t mode){
+    auto entry = page_table.find(loc);
+    if(entry == page_table.end() && (entry = scan_table.find(loc)) == scan_table.end())
+        return NULL;
+    PageFrame* frame = entry->second;
+    frame->pin_count++;
+    if(mode == ACCESS_NORMAL && !frame->in_scan_ring)
+        frame->ref_bit.store(true, std::memory_order_relaxed);
+    return frame;
+}
+
+PageFrame* ReplacementAlgo::pin_if_resident(const page_loc_t& loc, page_access_t mode){
+    pthread_mutex_lock(&this->latch);
+    PageFrame* frame = _lookup(loc, mode);
+    pthread_mutex_unlock(&this->latch);
+    if(frame != NULL)
+        pagePool->get_stats()->add(STAT_HITS);
+    return frame;
+}
+
+replacement_algo_ret_t ReplacementAlgo::get_page(const page_loc_t& loc, page_access_t mode){
+    replacement_algo_ret_t ret = {false, false, NULL};
+    pthread_mutex_lock(&this->latch);
+    if((ret.page_frame = _lookup(loc, mode)) != NULL){
+        ret.is_resident = true;
+        pthread_mutex_unlock(&this->latch);
+        pagePool->get_stats()->add(STAT_HITS);
+        return ret;
+    }
+    PoolStats* stats = pagePool->get_stats();
+    bool scan = (mode == ACCESS_SCAN && scan_frames > 0);
+    PageFrame* frame = scan ? _find_scan_victim() : _find_victim();
+    if(frame != NULL && frame->location != NULL && frame->is_dirty){
+        // written back by the caller, without the latch; the miss is counted
+        // when it asks again.
+        frame->pin_count++;
+        pthread_mutex_unlock(&this->latch);
+        ret.flushing_required = true;
+        ret.page_frame = frame;
+        return ret;
+    }
+    stats->add(STAT_MISSES);
+    if(scan)
+        stats->add(STAT_SCAN_READS);
+    if(frame == NULL){
+        // every frame is pinned.
+        pthread_mutex_unlock(&this->latch);
+        stats->add(STAT_PIN_WAITS);
+        return ret;
+    }
+    auto& table = frame->in_scan_ring ? scan_table : page_table;
+    if(frame->location != NULL){
+        table.erase(frame->loc);
+        stats->add(STAT_EVICTIONS);
+    }
+    frame->loc      = loc;
+    frame->location = &frame->loc;
+    frame->pin_count++;
+    frame->ref_bit.store(false, std::memory_order_relaxed);
+    pthread_mutex_lock(&frame->page_latch);
+    frame->io_pending = true;
+    table[loc] = frame;
+    pthread_mutex_unlock(&this->latch);
+    ret.page_frame = frame;
+    return ret;
+}
+
+void ReplacementAlgo::finish_load(PageFrame* frame, bool success){
+    if(!success){
+        pthread_mutex_lock(&this->latch);
+        (frame->in_scan_ring ? scan_table : page_table).erase(frame->loc);
+        frame->location = NULL;
+        frame->pin_count--;
+        pthread_mutex_unlock(&this->latch);
+    }
+    frame->io_pending = false;
+    pthread_mutex_unlock(&frame->page_latch);
+}
+
+bool ReplacementAlgo::wait_for_load(PageFrame* frame, const page_loc_t& loc){
+    if(frame->io_pending){
+        pagePool->get_stats()->add(STAT_PIN_WAITS);
+        pthread_mutex_lock(&frame->page_latch);
+        pthread_mutex_unlock(&frame->page_latch);
+    }
+    if(frame->location == NULL || !(frame->loc == loc)){
+        unpin(frame, false);
+        return false;
+    }
+    return true;
+}
+
+void ReplacementAlgo::unpin(PageFrame* frame, bool dirty){
+    if(dirty && frame->in_scan_ring){
+        // write through while still pinned, see the Scan Ring note.
+        PoolStats* stats = pagePool->get_stats();
+        uint64_t start = stats_now_ns();
+        if(write_frame(frame) == 0){
+            stats->write_latency.record(stats_now_ns() - start);
+            stats->add(STAT_DIRTY_WRITEBACKS);
+        }
+        else{
+            stats->add(STAT_WRITE_ERRORS);
+            frame->is_dirty = true;
+        }
+    }
+    else if(dirty){
+        frame->is_dirty = true;
+    }
+    frame->pin_count--;
+}
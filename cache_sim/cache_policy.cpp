@@ -0,0 +1,209 @@
+#include <cstdio>
+#include "cache_policy.h"
+
+using namespace std;
+
+LruPolicy::LruPolicy(uint32_t capacity){
+    this->capacity = capacity;
+    index.reserve(capacity * 2);
+}
+
+bool LruPolicy::access(uint32_t page_no){
+    auto it = index.find(page_no);
+    if(it != index.end()){
+        lru.splice(lru.begin(), lru, it->second);
+        return true;
+    }
+    if(lru.size() == capacity){
+        index.erase(lru.back());
+        lru.pop_back();
+    }
+    lru.push_front(page_no);
+    index[page_no] = lru.begin();
+    return false;
+}
+
+ClockPolicy::ClockPolicy(uint32_t capacity){
+    this->capacity = capacity;
+    hand = 0;
+    frames.reserve(capacity);
+    index.reserve(capacity * 2);
+}
+
+bool ClockPolicy::access(uint32_t page_no){
+    auto it = index.find(page_no);
+    if(it != index.end()){
+        frames[it->second].ref_bit = true;
+        return true;
+    }
+    if(frames.size() < capacity){
+        index[page_no] = frames.size();
+        frames.push_back({page_no, false});
+        return false;
+    }
+    while(frames[hand].ref_bit){
+        frames[hand].ref_bit = false;
+        hand = (hand + 1) % capacity;
+    }
+    index.erase(frames[hand].page_no);
+    frames[hand] = {page_no, false};
+    index[page_no] = hand;
+    hand = (hand + 1) % capacity;
+    return false;
+}
+
+ArcPolicy::ArcPolicy(uint32_t capacity){
+    this->capacity = capacity;
+    target_t1 = 0;
+    index.reserve(capacity * 4);
+}
+
+void ArcPolicy::_move_to(uint32_t page_no, arc_entry_t *entry, arc_list_t to){
+    lists[entry->list].erase(entry->pos);
+    lists[to].push_front(page_no);
+    entry->list = to;
+    entry->pos  = lists[to].begin();
+}
+
+void ArcPolicy::_drop_lru(arc_list_t from){
+    index.erase(lists[from].back());
+    lists[from].pop_back();
+}
+
+// REPLACE(x, p): demotes the LRU page of T1 or T2 to its ghost list.
+void ArcPolicy::_replace(bool in_b2){
+    size_t t1 = lists[ARC_T1].size();
+    arc_list_t from, ghost;
+    if(t1 > 0 && (t1 > target_t1 || (in_b2 && t1 == target_t1))){
+        from  = ARC_T1;
+        ghost = ARC_B1;
+    }
+    else{
+        from  = ARC_T2;
+        ghost = ARC_B2;
+    }
+    uint32_t victim = lists[from].back();
+    _move_to(victim, &index[victim], ghost);
+}
+
+bool ArcPolicy::access(uint32_t page_no){
+    auto it = index.find(page_no);
+    if(it != index.end()){
+        arc_entry_t *entry = &it->second;
+        size_t b1 = lists[ARC_B1].size(), b2 = lists[ARC_B2].size();
+        switch(entry->list){
+            case ARC_T1:
+            case ARC_T2:
+                _move_to(page_no, entry, ARC_T2);
+                return true;
+            case ARC_B1:
+                target_t1 = min<uint64_t>(capacity, target_t1 + max<size_t>(b2 / b1, 1));
+                _replace(false);
+                _move_to(page_no, entry, ARC_T2);
+                return false;
+            case ARC_B2:
+                target_t1 -= min<uint64_t>(target_t1, max<size_t>(b1 / b2, 1));
+                _replace(true);
+                _move_to(page_no, entry, ARC_T2);
+                return false;
+        }
+    }
+    // not in any list.
+    size_t l1 = lists[ARC_T1].size() + lists[ARC_B1].size();
+    size_t total = l1 + lists[ARC_T2].size() + lists[ARC_B2].size();
+    if(l1 == capacity){
+        if(lists[ARC_T1].size() < capacity){
+            _drop_lru(ARC_B1);
+            _replace(false);
+        }
+        else{
+            _drop_lru(ARC_T1);
+        }
+    }
+    else if(l1 < capacity && total >= capacity){
+        if(total == 2 * (size_t) capacity)
+            _drop_lru(ARC_B2);
+        _replace(false);
+    }
+    lists[ARC_T1].push_front(page_no);
+    index[page_no] = {ARC_T1, lists[ARC_T1].begin()};
+    return false;
+}
+
+TwoQPolicy::TwoQPolicy(uint32_t capacity){
+    this->capacity = capacity;
+    kin  = capacity / 4 ? capacity / 4 : 1;
+    kout = capacity / 2 ? capacity / 2 : 1;
+    index.reserve(capacity * 2);
+}
+
+// frees one frame: from A1in while it is over its share, else from Am.
+void TwoQPolicy::_reclaim(){
+    if(lists[TWOQ_A1IN].size() > kin || lists[TWOQ_AM].empty()){
+        uint32_t victim = lists[TWOQ_A1IN].back();
+        lists[TWOQ_A1IN].pop_back();
+        lists[TWOQ_A1OUT].push_front(victim);
+        index[victim] = {TWOQ_A1OUT, lists[TWOQ_A1OUT].begin()};
+        if(lists[TWOQ_A1OUT].size() > kout){
+            index.erase(lists[TWOQ_A1OUT].back());
+            lists[TWOQ_A1OUT].pop_back();
+        }
+    }
+    else{
+        index.erase(lists[TWOQ_AM].back());
+        lists[TWOQ_AM].pop_back();
+    }
+}
+
+bool TwoQPolicy::access(uint32_t page_no){
+    auto it = index.find(page_no);
+    if(it != index.end()){
+        twoq_entry_t *entry = &it->second;
+        if(entry->list == TWOQ_AM){
+            lists[TWOQ_AM].splice(lists[TWOQ_AM].begin(), lists[TWOQ_AM], entry->pos);
+            return true;
+        }
+        if(entry->list == TWOQ_A1IN)
+            return true;
+        // A1out: a second reference within the ghost window goes to Am.
+        lists[TWOQ_A1OUT].erase(entry->pos);
+        if(lists[TWOQ_A1IN].size() + lists[TWOQ_AM].size() >= capacity)
+            _reclaim();
+        lists[TWOQ_AM].push_front(page_no);
+        *entry = {TWOQ_AM, lists[TWOQ_AM].begin()};
+        return false;
+    }
+    if(lists[TWOQ_A1IN].size() + lists[TWOQ_AM].size() >= capacity)
+        _reclaim();
+    lists[TWOQ_A1IN].push_front(page_no);
+    index[page_no] = {TWOQ_A1IN, lists[TWOQ_A1IN].begin()};
+    return false;
+}
+
+static uint32_t hir_blocks(uint32_t capacity, double hir_share){
+    uint32_t hir = (uint32_t) (capacity * hir_share);
+    if(hir < 1)
+        hir = 1;
+    if(hir >= capacity)
+        hir = capacity - 1;
+    return hir;
+}
+
+LirsPolicy::LirsPolicy(uint32_t capacity, double hir_share, bool adaptive, bool admission):
+    lirs(capacity - hir_blocks(capacity, hir_share), hir_blocks(capacity, hir_share), adaptive){
+    this->hir_share = hir_share;
+    lirs.set_admission(admission);
+}
+
+bool LirsPolicy::access(uint32_t page_no){
+    uint64_t hits = lirs.page_hits;
+    lirs.get_page(page_no);
+    return lirs.page_hits != hits;
+}
+
+string LirsPolicy::name(){
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s%sLIRS-%g%%", lirs.admission ? "t" : "",
+             lirs.adaptive ? "a" : "", hir_share * 100);
+    return buf;
+}
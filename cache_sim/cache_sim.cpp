@@ -0,0 +1,197 @@
+/*
+* Replays page access traces against the replacement policies and reports,
+* for every cache size, the hit ratio and the time per access of each one.
+*
+* usage: cache_sim [-t trace_file] [-w workload] [-n accesses] [-p pages]
+*                  [-c sizes] [-l hir_shares] [-P policies] [-s seed]
+*   -t  replay a recorded trace (see trace_load()) instead of a synthetic one
+*   -w  zipf[:theta] | uniform | scan[:hot_ratio] | loop | shift
+*                                                            (default zipf:0.99)
+*   -n  accesses in a synthetic trace                        (default 1000000)
+*   -p  distinct pages in a synthetic trace                  (default 100000)
+*   -c  comma separated cache sizes, in pages          (default 1%,5%,10% of -p)
+*   -l  comma separated HIR shares for LIRS, each one is its own column
+*                                                            (default 0.01)
+*   -P  comma separated subset of lru,clock,arc,2q,lirs,alirs,tlirs
+*       (alirs is LIRS with adaptive sizing, tlirs is LIRS behind TinyLFU)
+*                                                (default lru,clock,arc,2q,lirs)
+*   -s  seed for the synthetic trace                         (default 1)
+*
+* For scan, a tenth of the pages is hot; for loop, -p is the loop length.
+* shift alternates four phases: zipf:0.99, scan, zipf:0.99 and loop.
+* The output is one line per cache size with hit ratio and ns/access for
+* each policy, so it can be pasted into a spreadsheet or gnuplot.
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "access_trace.h"
+#include "cache_policy.h"
+
+using namespace std;
+
+static vector<string> split_list(const char *arg){
+    vector<string> items;
+    stringstream ss(arg);
+    string item;
+    while(getline(ss, item, ','))
+        if(!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+static CachePolicy *make_policy(const string& kind, uint32_t cache_size, double hir_share){
+    if(kind == "lru")
+        return new LruPolicy(cache_size);
+    if(kind == "clock")
+        return new ClockPolicy(cache_size);
+    if(kind == "arc")
+        return new ArcPolicy(cache_size);
+    if(kind == "2q")
+        return new TwoQPolicy(cache_size);
+    if(kind == "lirs")
+        return new LirsPolicy(cache_size, hir_share);
+    if(kind == "alirs")
+        return new LirsPolicy(cache_size, hir_share, true);
+    if(kind == "tlirs")
+        return new LirsPolicy(cache_size, hir_share, false, true);
+    return NULL;
+}
+
+static int make_trace(access_trace_t *trace, const char *workload, uint64_t accesses,
+                      uint32_t pages, uint64_t seed){
+    const char *param = strchr(workload, ':');
+    size_t len = param ? (size_t) (param - workload) : strlen(workload);
+    if(!strncmp(workload, "zipf", len))
+        trace_zipf(trace, accesses, pages, param ? atof(param + 1) : 0.99, seed);
+    else if(!strncmp(workload, "uniform", len))
+        trace_uniform(trace, accesses, pages, seed);
+    else if(!strncmp(workload, "scan", len))
+        trace_scan_hotset(trace, accesses, pages / 10 ? pages / 10 : 1, pages,
+                          param ? atof(param + 1) : 0.7, seed);
+    else if(!strncmp(workload, "loop", len))
+        trace_loop(trace, accesses, pages);
+    else if(!strncmp(workload, "shift", len)){
+        uint64_t phase = accesses / 4;
+        trace_zipf(trace, phase, pages, 0.99, seed);
+        trace_scan_hotset(trace, phase, pages / 10 ? pages / 10 : 1, pages, 0.7, seed + 1);
+        trace_zipf(trace, phase, pages, 0.99, seed + 2);
+        trace_loop(trace, accesses - 3 * phase, pages / 20 ? pages / 20 : 1);
+    }
+    else
+        return -1;
+    return 0;
+}
+
+int main(int argc, char **argv){
+    const char *trace_file = NULL;
+    const char *workload   = "zipf:0.99";
+    const char *sizes_arg  = NULL;
+    const char *shares_arg = "0.01";
+    const char *policy_arg = "lru,clock,arc,2q,lirs";
+    uint64_t accesses = 1000000;
+    uint32_t pages    = 100000;
+    uint64_t seed     = 1;
+    int opt;
+    while((opt = getopt(argc, argv, "t:w:n:p:c:l:P:s:")) != -1){
+        switch(opt){
+            case 't': trace_file = optarg; break;
+            case 'w': workload   = optarg; break;
+            case 'n': accesses   = strtoull(optarg, NULL, 10); break;
+            case 'p': pages      = strtoul(optarg, NULL, 10); break;
+            case 'c': sizes_arg  = optarg; break;
+            case 'l': shares_arg = optarg; break;
+            case 'P': policy_arg = optarg; break;
+            case 's': seed       = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "usage: %s [-t trace_file] [-w workload] [-n accesses] [-p pages]"
+                                " [-c sizes] [-l hir_shares] [-P policies] [-s seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    access_trace_t trace;
+    if(trace_file){
+        int64_t distinct = trace_load(&trace, trace_file);
+        if(distinct < 0){
+            perror(trace_file);
+            return 1;
+        }
+        pages = distinct;
+        printf("# trace %s: %zu accesses, %u pages\n", trace_file, trace.size(), pages);
+    }
+    else{
+        if(make_trace(&trace, workload, accesses, pages, seed) < 0){
+            fprintf(stderr, "unknown workload: %s\n", workload);
+            return 2;
+        }
+        printf("# workload %s: %zu accesses, %u pages, seed %lu\n", workload, trace.size(), pages, seed);
+    }
+    if(trace.empty())
+        return 0;
+
+    vector<uint32_t> sizes;
+    if(sizes_arg){
+        for(auto& s: split_list(sizes_arg))
+            sizes.push_back(strtoul(s.c_str(), NULL, 10));
+    }
+    else{
+        sizes.push_back(pages / 100);
+        sizes.push_back(pages / 20);
+        sizes.push_back(pages / 10);
+    }
+    vector<double> shares;
+    for(auto& s: split_list(shares_arg))
+        shares.push_back(atof(s.c_str()));
+
+    // one column per (policy, hir share); the share only matters for LIRS.
+    vector<pair<string, double>> columns;
+    for(auto& kind: split_list(policy_arg)){
+        if(!make_policy(kind, 2, 0.5)){
+            fprintf(stderr, "unknown policy: %s\n", kind.c_str());
+            return 2;
+        }
+        if(kind == "lirs" || kind == "alirs" || kind == "tlirs")
+            for(auto share: shares)
+                columns.push_back({kind, share});
+        else
+            columns.push_back({kind, 0});
+    }
+
+    bool header = false;
+    for(auto cache_size: sizes){
+        if(cache_size < 2){
+            fprintf(stderr, "skipping cache size %u, need at least 2 pages\n", cache_size);
+            continue;
+        }
+        vector<string> names;
+        string results;
+        for(auto& column: columns){
+            unique_ptr<CachePolicy> policy(make_policy(column.first, cache_size, column.second));
+            uint64_t hits = 0;
+            auto start = chrono::steady_clock::now();
+            for(auto page: trace)
+                hits += policy->access(page);
+            double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+            char buf[64];
+            snprintf(buf, sizeof(buf), " %10.4f %8.1f", (double) hits / trace.size(), ns / trace.size());
+            results += buf;
+            names.push_back(policy->name());
+        }
+        if(!header){
+            printf("%10s", "cache");
+            for(auto& name: names)
+                printf(" %10s %8s", name.c_str(), "ns/acc");
+            printf("\n");
+            header = true;
+        }
+        printf("%10u%s\n", cache_size, results.c_str());
+    }
+    return 0;
+}
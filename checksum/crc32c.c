@@ -0,0 +1,133 @@
+#include <pthread.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42   1
+#else
+#define CRC32C_HAVE_SSE42   0
+#endif
+
+#define CRC32C_POLY     0x82f63b78
+// bytes per stream of the three way interleaved hardware loop.
+#define CRC32C_STREAM   1360
+
+static uint32_t slice_table[8][256];
+// shift_table[k][b]: the register after CRC32C_STREAM zero bytes, starting
+// from b << 8k. The register is linear in its start, so one lookup per byte
+// moves a stream's crc past the two streams that follow it.
+static uint32_t shift_table[4][256];
+static int use_hardware;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+// crc32c without the inversions: the raw register.
+static uint32_t sw_raw(uint32_t crc, const unsigned char *p, size_t length){
+    while(length > 0 && ((uintptr_t) p & 7) != 0){
+        crc = slice_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        length--;
+    }
+    while(length >= 8){
+        uint64_t word = *(const uint64_t*) p ^ crc;
+        crc = slice_table[7][word & 0xff] ^ slice_table[6][(word >> 8) & 0xff] ^
+              slice_table[5][(word >> 16) & 0xff] ^ slice_table[4][(word >> 24) & 0xff] ^
+              slice_table[3][(word >> 32) & 0xff] ^ slice_table[2][(word >> 40) & 0xff] ^
+              slice_table[1][(word >> 48) & 0xff] ^ slice_table[0][word >> 56];
+        p += 8;
+        length -= 8;
+    }
+    while(length-- > 0)
+        crc = slice_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static uint32_t shift(uint32_t crc){
+    return shift_table[0][crc & 0xff] ^ shift_table[1][(crc >> 8) & 0xff] ^
+           shift_table[2][(crc >> 16) & 0xff] ^ shift_table[3][crc >> 24];
+}
+
+#if CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t hw_raw(uint32_t crc, const unsigned char *p, size_t length){
+    while(length > 0 && ((uintptr_t) p & 7) != 0){
+        crc = _mm_crc32_u8(crc, *p++);
+        length--;
+    }
+    while(length >= 3 * CRC32C_STREAM){
+        uint64_t a = crc, b = 0, c = 0;
+        const uint64_t *pa = (const uint64_t*) p;
+        const uint64_t *pb = (const uint64_t*) (p + CRC32C_STREAM);
+        const uint64_t *pc = (const uint64_t*) (p + 2 * CRC32C_STREAM);
+        for(int i = 0; i < CRC32C_STREAM / 8; i++){
+            a = _mm_crc32_u64(a, pa[i]);
+            b = _mm_crc32_u64(b, pb[i]);
+            c = _mm_crc32_u64(c, pc[i]);
+        }
+        crc = shift(shift((uint32_t) a) ^ (uint32_t) b) ^ (uint32_t) c;
+        p += 3 * CRC32C_STREAM;
+        length -= 3 * CRC32C_STREAM;
+    }
+    uint64_t crc64 = crc;
+    while(length >= 8){
+        crc64 = _mm_crc32_u64(crc64, *(const uint64_t*) p);
+        p += 8;
+        length -= 8;
+    }
+    crc = (uint32_t) crc64;
+    while(length-- > 0)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+static void crc32c_init(void){
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t c = i;
+        for(int bit = 0; bit < 8; bit++)
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        slice_table[0][i] = c;
+    }
+    for(uint32_t i = 0; i < 256; i++){
+        for(int k = 1; k < 8; k++)
+            slice_table[k][i] = slice_table[0][slice_table[k - 1][i] & 0xff] ^ (slice_table[k - 1][i] >> 8);
+    }
+    uint32_t basis[32];
+    for(int bit = 0; bit < 32; bit++){
+        uint32_t c = 1u << bit;
+        for(int i = 0; i < CRC32C_STREAM; i++)
+            c = slice_table[0][c & 0xff] ^ (c >> 8);
+        basis[bit] = c;
+    }
+    for(int k = 0; k < 4; k++){
+        for(uint32_t b = 0; b < 256; b++){
+            uint32_t c = 0;
+            for(int bit = 0; bit < 8; bit++){
+                if(b & (1u << bit))
+                    c ^= basis[8 * k + bit];
+            }
+            shift_table[k][b] = c;
+        }
+    }
+#if CRC32C_HAVE_SSE42
+    __builtin_cpu_init();
+    use_hardware = __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+
+uint32_t crc32c_software(uint32_t crc, const void *data, size_t length){
+    pthread_once(&crc32c_once, crc32c_init);
+    return ~sw_raw(~crc, (const unsigned char*) data, length);
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length){
+    pthread_once(&crc32c_once, crc32c_init);
+#if CRC32C_HAVE_SSE42
+    if(use_hardware)
+        return ~hw_raw(~crc, (const unsigned char*) data, length);
+#endif
+    return ~sw_raw(~crc, (const unsigned char*) data, length);
+}
+
+int crc32c_hardware(void){
+    pthread_once(&crc32c_once, crc32c_init);
+    return use_hardware;
+}
@@ -0,0 +1,133 @@
+/*
+* What page checksums cost, and that they catch a torn page.
+*
+* usage: page_checksum_bench [accounts] [loads] [dir]
+*
+* 1. CRC32C of a 4 KiB page: the crc32 instruction against the table
+*    driven fallback.
+* 2. load_page() of random pages of a database in the page cache with
+*    verification off, sampled and always.
+* 3. The second half of a page is overwritten with its old contents behind
+*    b_storage's back, like a write torn by a crash; the next load_page() of
+*    it has to fail and count a failure, and a lookup, an insert and a
+*    delete of a key on it have to fail instead of crashing.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+extern "C"{
+#include "b_storage.h"
+}
+#include "crc32c.h"
+
+using namespace std;
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%06u", account);
+}
+
+static double crc_rate(uint32_t (*crc)(uint32_t, const void*, size_t), const vector<char>& page, uint64_t rounds){
+    uint32_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for(uint64_t i = 0; i < rounds; i++)
+        sink += crc(sink, page.data(), page.size());
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(sink == 42)
+        cout << "";
+    return rounds * page.size() / seconds / 1e9;
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts = (argc > 1) ? atoi(argv[1]) : 20000;
+    uint64_t loads    = (argc > 2) ? atoll(argv[2]) : 1000000;
+    string   dir      = (argc > 3) ? argv[3] : ".";
+    string db_path = dir + "/page_checksum_bench.db";
+
+    vector<char> page(PAGE_SIZE);
+    mt19937_64 rng(7);
+    for(auto& c: page)
+        c = rng();
+    cout << "crc32c of a 4 KiB page (" << (crc32c_hardware() ? "crc32 instruction" : "no SSE4.2") << ")" << endl;
+    cout << "  crc32c          " << fixed << setprecision(2) << crc_rate(crc32c, page, 200000) << " GB/s" << endl;
+    cout << "  table fallback  " << crc_rate(crc32c_software, page, 50000) << " GB/s" << endl;
+
+    unlink(db_path.c_str());
+    int db_file = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0){
+        cerr << "cannot create " << db_path << endl;
+        return 1;
+    }
+    db_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, entry.user_id);
+        btree_insert(db_file, PAGE_SIZE, &entry);
+    }
+    struct stat st;
+    fstat(db_file, &st);
+    uint32_t pages = st.st_size / (PAGE_SIZE);
+    uniform_int_distribution<uint32_t> pick(1, pages - 1);
+
+    cout << endl << setw(10) << "verify" << setw(14) << "loads/s" << setw(12) << "ns/load" << setw(12) << "verified" << endl;
+    int rc = 0;
+    struct{
+        const char *name;
+        checksum_mode_t mode;
+    }modes[] = {{"off", CHECKSUM_OFF}, {"sampled", CHECKSUM_SAMPLED}, {"always", CHECKSUM_ALWAYS}};
+    for(auto& m: modes){
+        set_page_checksum_mode(m.mode, PAGE_CHECKSUM_SAMPLE);
+        page_checksum_stats_t before, after;
+        get_page_checksum_stats(&before);
+        auto start = chrono::steady_clock::now();
+        for(uint64_t i = 0; i < loads; i++){
+            page_t *p = load_page(db_file, (page_ptr_t) pick(rng) * PAGE_SIZE);
+            if(p == NULL)
+                rc = 1;
+            else
+                free_page(db_file, p, 0);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        get_page_checksum_stats(&after);
+        cout << setw(10) << m.name << setw(14) << setprecision(0) << loads / seconds
+             << setw(12) << seconds * 1e9 / loads << setw(12) << after.verified - before.verified << endl;
+    }
+
+    // a torn write: the first half is new, the second half still old.
+    set_page_checksum_mode(CHECKSUM_ALWAYS, 1);
+    page_ptr_t victim = (page_ptr_t) pick(rng) * PAGE_SIZE;
+    vector<char> old(PAGE_SIZE);
+    read_block(old.data(), PAGE_SIZE, db_file, victim);
+    page_t *p = load_page(db_file, victim);
+    db_entry_t on_victim = *(p->page_content->db_entries[0]);
+    p->page_content->db_entries[0]->balance += 1;
+    free_page(db_file, p, 1);
+    write_block(old.data() + (PAGE_SIZE) / 2, (PAGE_SIZE) / 2, db_file, victim + (PAGE_SIZE) / 2);
+    page_checksum_stats_t before, after;
+    get_page_checksum_stats(&before);
+    p = load_page(db_file, victim);
+    get_page_checksum_stats(&after);
+    bool caught = p == NULL && after.failures == before.failures + 1;
+    cout << endl << "torn page " << (caught ? "detected" : "NOT detected") << endl;
+    if(!caught)
+        rc = 1;
+    if(p != NULL)
+        free_page(db_file, p, 0);
+    tuple_info_t info;
+    int found    = btree_find(db_file, on_victim.user_id, USERID_LENGTH, &info);
+    int inserted = btree_insert(db_file, PAGE_SIZE, &on_victim);
+    int deleted  = btree_delete_start(db_file, on_victim.user_id, USERID_LENGTH);
+    bool failed = found == -1 && inserted == -1 && deleted == -1;
+    cout << "find, insert and delete through it " << (failed ? "failed" : "did NOT fail") << endl;
+    if(!failed)
+        rc = 1;
+
+    close(db_file);
+    unlink(db_path.c_str());
+    return rc;
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cstring>
+#include "executor.h"
+
+using namespace std;
+
+RequestExecutor::RequestExecutor(int db_file, BalanceIndex *index, BloomFilter *filter){
+    this->db_file = db_file;
+    this->index = index;
+    this->filter = filter;
+    stats = {};
+}
+
+static int find_on_page(page_t *page, const char *key){
+    page_content_t *content = page->page_content;
+    for(uint32_t i = 0; i < *(content->count); i++){
+        if(strncmp(key, content->db_entries[i]->user_id, USERID_LENGTH) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// writes the page back if it was changed; on failure the requests applied
+// to it fail.
+static void release_page(int db_file, page_t *page, const vector<uint32_t>& applied,
+                         request_result_t *results, executor_stats_t *stats, BloomFilter *filter){
+    if(applied.empty()){
+        free_page(db_file, page, 0);
+        return;
+    }
+    if(filter != NULL)
+        filter->begin_write();
+    int written = free_page(db_file, page, 1);
+    if(filter != NULL)
+        filter->end_write();
+    if(written != 0){
+        for(uint32_t i: applied)
+            results[i].status = REQUEST_FAILED;
+        return;
+    }
+    stats->page_writes++;
+}
+
+void RequestExecutor::_apply_deltas(const request_data_t *requests, size_t begin, size_t end,
+                                    request_result_t *results){
+    order.clear();
+    for(size_t i = begin; i < end; i++)
+        order.push_back(i);
+    stable_sort(order.begin(), order.end(), [requests](uint32_t a, uint32_t b){
+        return strncmp(requests[a].userid, requests[b].userid, USERID_LENGTH) < 0;
+    });
+
+    page_t *page = NULL;
+    vector<uint32_t> applied;   // requests applied to `page`
+    size_t group = 0;
+    while(group < order.size()){
+        const char *key = requests[order[group]].userid;
+        size_t group_end = group + 1;
+        while(group_end < order.size() && strncmp(key, requests[order[group_end]].userid, USERID_LENGTH) == 0)
+            group_end++;
+
+        int at = (page != NULL) ? find_on_page(page, key) : -1;
+        if(at >= 0){
+            stats.page_hits++;
+        }
+        else{
+            if(page != NULL){
+                release_page(db_file, page, applied, results, &stats, filter);
+                page = NULL;
+                applied.clear();
+            }
+            tuple_info_t info;
+            if(filter != NULL && !filter->may_contain(key)){
+                stats.filtered++;
+            }
+            else{
+                stats.traversals++;
+                if(btree_find(db_file, key, USERID_LENGTH, &info) == 0){
+                    page = info.page;
+                    at = info.index;
+                }
+                else if(filter != NULL){
+                    filter->false_positive();
+                }
+            }
+        }
+
+        for(size_t r = group; r < group_end; r++){
+            const request_data_t *request = &requests[order[r]];
+            request_result_t *result = &results[order[r]];
+            if(at < 0){
+                result->status = REQUEST_NOT_FOUND;
+                continue;
+            }
+            db_entry_t *entry = page->page_content->db_entries[at];
+            if(request->req == WITHDRAW && entry->balance < request->amount){
+                result->status = REQUEST_INSUFFICIENT;
+            }
+            else{
+                if(request->req == DEPOSIT)
+                    entry->balance += request->amount;
+                else
+                    entry->balance -= request->amount;
+                result->status = REQUEST_OK;
+                applied.push_back(order[r]);
+            }
+            result->balance = entry->balance;
+        }
+        if(index != NULL && at >= 0)
+            index->update(key, page->page_content->db_entries[at]->balance);
+        group = group_end;
+    }
+    if(page != NULL)
+        release_page(db_file, page, applied, results, &stats, filter);
+}
+
+void RequestExecutor::_create(const request_data_t *request, request_result_t *result){
+    tuple_info_t info;
+    if(filter != NULL && !filter->may_contain(request->userid)){
+        stats.filtered++;
+    }
+    else{
+        stats.traversals++;
+        if(btree_find(db_file, request->userid, USERID_LENGTH, &info) == 0){
+            free_page(db_file, info.page, 0);
+            result->status = REQUEST_EXISTS;
+            return;
+        }
+        if(filter != NULL)
+            filter->false_positive();
+    }
+    db_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.user_id, request->userid, USERID_LENGTH);
+    memcpy(entry.passwd, request->passwd, PASSWD_LENGTH);
+    entry.balance = 0;
+    if(filter != NULL){
+        filter->begin_change();
+        filter->add(request->userid);
+    }
+    result->status = (btree_insert(db_file, PAGE_SIZE, &entry) == 0) ? REQUEST_OK : REQUEST_FAILED;
+    if(filter != NULL)
+        filter->end_change();
+    if(index != NULL && result->status == REQUEST_OK)
+        index->update(request->userid, 0);
+}
+
+void RequestExecutor::_delete(const request_data_t *request, request_result_t *result){
+    tuple_info_t info;
+    if(filter != NULL && !filter->may_contain(request->userid)){
+        stats.filtered++;
+        result->status = REQUEST_NOT_FOUND;
+        return;
+    }
+    stats.traversals++;
+    if(btree_find(db_file, request->userid, USERID_LENGTH, &info) != 0){
+        if(filter != NULL)
+            filter->false_positive();
+        result->status = REQUEST_NOT_FOUND;
+        return;
+    }
+    free_page(db_file, info.page, 0);
+    if(filter != NULL)
+        filter->begin_change();
+    result->status = (btree_delete_start(db_file, request->userid, USERID_LENGTH) >= 0) ? REQUEST_OK : REQUEST_FAILED;
+    if(filter != NULL){
+        if(result->status == REQUEST_OK)
+            filter->remove(request->userid);
+        filter->end_change();
+    }
+    if(index != NULL && result->status == REQUEST_OK)
+        index->remove(request->userid);
+}
+
+static int sum_entry(void *ctx, const db_entry_t *entry){
+    request_result_t *result = (request_result_t*) ctx;
+    result->balance += entry->balance;
+    result->accounts++;
+    return 0;
+}
+
+void RequestExecutor::_show(request_result_t *result){
+    result->status = (btree_scan(db_file, sum_entry, result) == 0) ? REQUEST_OK : REQUEST_FAILED;
+}
+
+size_t RequestExecutor::execute(const request_data_t *requests, size_t count, request_result_t *results){
+    stats.batches++;
+    size_t run = 0;     // start of the pending run of deltas
+    size_t executed = count;
+    for(size_t i = 0; i < count; i++){
+        results[i] = {REQUEST_OK, 0, 0};
+        request_t req = requests[i].req;
+        if(req == DEPOSIT || req == WITHDRAW)
+            continue;
+        _apply_deltas(requests, run, i, results);
+        run = i + 1;
+        if(req == STOP){
+            for(size_t j = i + 1; j < count; j++)
+                results[j] = {REQUEST_SKIPPED, 0, 0};
+            executed = i + 1;
+            break;
+        }
+        if(req == CREATE)
+            _create(&requests[i], &results[i]);
+        else if(req == DELETE)
+            _delete(&requests[i], &results[i]);
+        else if(req == SHOWDB)
+            _show(&results[i]);
+        else
+            results[i].status = REQUEST_INVALID;
+    }
+    _apply_deltas(requests, run, executed, results);
+    stats.requests += executed;
+    return executed;
+}
+
+executor_stats_t RequestExecutor::get_stats(){
+    return stats;
+}
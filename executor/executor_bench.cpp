@@ -0,0 +1,143 @@
+/*
+* Throughput of RequestExecutor as the batch size grows.
+*
+* usage: executor_bench [accounts] [requests] [max_batch] [dir]
+*
+* The request stream looks like a peak hour: four deposits to every
+* withdrawal, and four requests in five go to the hottest tenth of the
+* accounts. Batch size 1 is a traversal and a page write per request, what
+* executing the requests one by one costs. Every run starts from a copy of
+* the same database; the results and the final balances are checked
+* against executing the stream one request at a time in memory.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include "executor.h"
+
+using namespace std;
+
+#define INITIAL_BALANCE     100
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%06u", account);
+}
+
+static bool copy_file(const string& from, const string& to){
+    int in = open(from.c_str(), O_RDONLY);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = in >= 0 && out >= 0;
+    vector<char> buf(1 << 20);
+    ssize_t got;
+    while(ok && (got = read(in, buf.data(), buf.size())) > 0)
+        ok = write(out, buf.data(), got) == got;
+    if(in >= 0)
+        close(in);
+    if(out >= 0)
+        close(out);
+    return ok;
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts  = (argc > 1) ? atoi(argv[1]) : 20000;
+    uint32_t count     = (argc > 2) ? atoi(argv[2]) : 200000;
+    uint32_t max_batch = (argc > 3) ? atoi(argv[3]) : 4096;
+    string   dir       = (argc > 4) ? argv[4] : ".";
+    string db_path   = dir + "/executor_bench.db";
+    string copy_path = db_path + ".copy";
+    if(accounts < 10)
+        accounts = 10;
+
+    // the database, filled through the executor itself.
+    unlink(db_path.c_str());
+    int db_file = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0){
+        cerr << "cannot create " << db_path << endl;
+        return 1;
+    }
+    {
+        RequestExecutor executor(db_file);
+        vector<request_data_t> setup(2 * accounts);
+        vector<request_result_t> results(setup.size());
+        for(uint32_t i = 0; i < accounts; i++){
+            memset(&setup[2 * i], 0, 2 * sizeof(request_data_t));
+            setup[2 * i].req = CREATE;
+            account_name(i, setup[2 * i].userid);
+            setup[2 * i + 1].req = DEPOSIT;
+            account_name(i, setup[2 * i + 1].userid);
+            setup[2 * i + 1].amount = INITIAL_BALANCE;
+        }
+        executor.execute(setup.data(), setup.size(), results.data());
+    }
+    close(db_file);
+
+    // the stream and what executing it one by one gives.
+    mt19937_64 rng(42);
+    uniform_int_distribution<uint32_t> hot(0, accounts / 10 - 1), any(0, accounts - 1);
+    uniform_int_distribution<uint32_t> percent(0, 99), amount(1, 50);
+    vector<request_data_t> stream(count);
+    vector<request_result_t> expected(count);
+    vector<amount_t> balances(accounts, INITIAL_BALANCE);
+    for(uint32_t i = 0; i < count; i++){
+        uint32_t account = (percent(rng) < 80) ? hot(rng) : any(rng);
+        memset(&stream[i], 0, sizeof(stream[i]));
+        stream[i].req = (percent(rng) < 80) ? DEPOSIT : WITHDRAW;
+        account_name(account, stream[i].userid);
+        stream[i].amount = amount(rng);
+        expected[i] = {REQUEST_OK, 0, 0};
+        if(stream[i].req == DEPOSIT)
+            balances[account] += stream[i].amount;
+        else if(balances[account] >= stream[i].amount)
+            balances[account] -= stream[i].amount;
+        else
+            expected[i].status = REQUEST_INSUFFICIENT;
+        expected[i].balance = balances[account];
+    }
+    amount_t total = 0;
+    for(amount_t balance: balances)
+        total += balance;
+
+    cout << setw(8) << "batch" << setw(13) << "requests/s" << setw(18) << "traversals/req"
+         << setw(18) << "page writes/req" << setw(6) << "ok" << endl;
+    int rc = 0;
+    for(uint32_t batch = 1; batch <= max_batch; batch *= 4){
+        if(!copy_file(db_path, copy_path)){
+            cerr << "cannot copy " << db_path << endl;
+            return 1;
+        }
+        db_file = open(copy_path.c_str(), O_RDWR);
+        RequestExecutor executor(db_file);
+        vector<request_result_t> results(count);
+        auto start = chrono::steady_clock::now();
+        for(uint32_t at = 0; at < count; at += batch)
+            executor.execute(&stream[at], min(batch, count - at), &results[at]);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        bool ok = true;
+        for(uint32_t i = 0; i < count && ok; i++)
+            ok = results[i].status == expected[i].status && results[i].balance == expected[i].balance;
+        request_data_t show;
+        request_result_t shown;
+        memset(&show, 0, sizeof(show));
+        show.req = SHOWDB;
+        executor.execute(&show, 1, &shown);
+        ok = ok && shown.status == REQUEST_OK && shown.accounts == accounts && shown.balance == total;
+        close(db_file);
+        if(!ok)
+            rc = 1;
+
+        executor_stats_t stats = executor.get_stats();
+        cout << setw(8) << batch << setw(13) << fixed << setprecision(0) << count / seconds
+             << setw(18) << setprecision(3) << (double) stats.traversals / count
+             << setw(18) << (double) stats.page_writes / count << setw(6) << (ok ? "yes" : "NO") << endl;
+    }
+    unlink(db_path.c_str());
+    unlink(copy_path.c_str());
+    return rc;
+}
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "hash_index.h"
+
+using namespace std;
+
+static_assert(sizeof(hash_bucket_t) <= PAGE_CHECKSUM_OFFSET, "a bucket overlaps the page trailer");
+static_assert(sizeof(hash_file_header_t) <= PAGE_CHECKSUM_OFFSET, "the header overlaps the page trailer");
+
+static uint64_t hash_user_id(const char *user_id){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(int i = 0; i < USERID_LENGTH && user_id[i] != '\0'; i++)
+        h = (h ^ (unsigned char) user_id[i]) * 0x100000001b3ULL;
+    // FNV-1a leaves the low bits weak; the directory uses exactly those.
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static int find_in_bucket(const hash_bucket_t *bucket, const char *user_id){
+    for(uint32_t i = 0; i < bucket->count; i++){
+        if(strncmp(bucket->entries[i].user_id, user_id, USERID_LENGTH) == 0)
+            return i;
+    }
+    return -1;
+}
+
+HashIndex::HashIndex(const char *path){
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        throw HashIndexFailure(string("open ") + path + ": " + strerror(errno));
+    page = (char*) aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+    stats = {};
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        free(page);
+        throw HashIndexFailure(string("fstat: ") + strerror(errno));
+    }
+    if(st.st_size == 0){
+        memset(page, 0, PAGE_SIZE);
+        stats.buckets = 1;
+        if(_write(PAGE_SIZE, page) != 0 || _write_header() != 0){
+            close(fd);
+            free(page);
+            throw HashIndexFailure("initializing the index");
+        }
+        global_depth = 0;
+        directory.assign(1, PAGE_SIZE);
+        return;
+    }
+    hash_file_header_t header;
+    if(read_block(page, PAGE_SIZE, fd, 0) != PAGE_SIZE || (memcpy(&header, page, sizeof(header)), header.magic != HASH_INDEX_MAGIC)){
+        close(fd);
+        free(page);
+        throw HashIndexFailure(string(path) + " is not a hash index");
+    }
+    // every bucket knows which slots are its own. The header's count lags
+    // a split cut short by a crash (see _split()), the file size doesn't.
+    typedef struct{
+        page_ptr_t page_loc;
+        uint32_t   local_depth;
+        uint64_t   pattern;
+        uint32_t   count;
+    }bucket_info_t;
+    vector<bucket_info_t> buckets;
+    uint64_t bucket_count = st.st_size / (PAGE_SIZE) - 1;
+    global_depth = 0;
+    for(uint64_t b = 1; b <= bucket_count; b++){
+        hash_bucket_t *bucket = _read(b * PAGE_SIZE);
+        if(bucket == NULL || bucket->local_depth > HASH_MAX_DEPTH || *(u_int32_t*)(page + PAGE_CHECKSUM_OFFSET) == 0){
+            close(fd);
+            free(page);
+            throw HashIndexFailure("bucket " + to_string(b) + " is unreadable");
+        }
+        buckets.push_back({(page_ptr_t) (b * PAGE_SIZE), bucket->local_depth, bucket->pattern, bucket->count});
+        global_depth = max(global_depth, bucket->local_depth);
+    }
+    // shallow buckets first: the old half of a cut short split still claims
+    // the new half's slots, which then go to the new half.
+    stable_sort(buckets.begin(), buckets.end(), [](const bucket_info_t& a, const bucket_info_t& b){
+        return a.local_depth < b.local_depth;
+    });
+    directory.assign((size_t) 1 << global_depth, 0);
+    for(auto& bucket: buckets){
+        for(uint64_t slot = bucket.pattern; slot < directory.size(); slot += (uint64_t) 1 << bucket.local_depth)
+            directory[slot] = bucket.page_loc;
+    }
+    for(auto& bucket: buckets){
+        bool whole = true;
+        for(uint64_t slot = bucket.pattern; slot < directory.size() && whole; slot += (uint64_t) 1 << bucket.local_depth)
+            whole = (directory[slot] == bucket.page_loc);
+        if(!whole && _finish_split(bucket.page_loc, &bucket.count) != 0){
+            close(fd);
+            free(page);
+            throw HashIndexFailure("bucket at " + to_string(bucket.page_loc) + " overlaps another one");
+        }
+        stats.entries += bucket.count;
+    }
+    for(size_t slot = 0; slot < directory.size(); slot++){
+        if(directory[slot] == 0){
+            close(fd);
+            free(page);
+            throw HashIndexFailure("no bucket for directory slot " + to_string(slot));
+        }
+    }
+    stats.buckets = bucket_count;
+    if(bucket_count != header.buckets)
+        _write_header();
+}
+
+HashIndex::~HashIndex(){
+    _write_header();
+    close(fd);
+    free(page);
+}
+
+hash_bucket_t* HashIndex::_read(page_ptr_t page_loc){
+    if(read_block(page, PAGE_SIZE, fd, page_loc) != PAGE_SIZE)
+        return NULL;
+    stats.page_reads++;
+    u_int32_t stored = *(u_int32_t*)(page + PAGE_CHECKSUM_OFFSET);
+    if(stored != 0 && page_checksum(page) != stored){
+        printf("HashIndex: Checksum mismatch on bucket at location: %d\n", page_loc);
+        return NULL;
+    }
+    return (hash_bucket_t*) page;
+}
+
+int HashIndex::_write(page_ptr_t page_loc, char *buffer){
+    *(u_int32_t*)(buffer + PAGE_CHECKSUM_OFFSET) = page_checksum(buffer);
+    if(write_block(buffer, PAGE_SIZE, fd, page_loc) != PAGE_SIZE)
+        return -1;
+    stats.page_writes++;
+    return 0;
+}
+
+int HashIndex::_write_header(){
+    vector<char> buffer(PAGE_SIZE, 0);
+    hash_file_header_t header = {HASH_INDEX_MAGIC, 1, stats.buckets};
+    memcpy(buffer.data(), &header, sizeof(header));
+    return _write(0, buffer.data());
+}
+
+// reads the account's bucket into `page`; the index of the account in it,
+// -1 if it is not there, -2 if the bucket could not be read.
+int HashIndex::_find(const char *user_id, uint64_t hash, page_ptr_t *page_loc){
+    *page_loc = directory[hash & (directory.size() - 1)];
+    hash_bucket_t *bucket = _read(*page_loc);
+    if(bucket == NULL)
+        return -2;
+    return find_in_bucket(bucket, user_id);
+}
+
+// The old half of a split whose new half was written but which was not
+// rewritten itself: drops the entries that went to the new half, as
+// _split() would have. -1 if the bucket is not such a half.
+int HashIndex::_finish_split(page_ptr_t page_loc, uint32_t *count){
+    hash_bucket_t *bucket = _read(page_loc);
+    if(bucket == NULL)
+        return -1;
+    uint32_t depth = bucket->local_depth;
+    uint64_t mask = ((uint64_t) 2 << depth) - 1;
+    for(uint64_t slot = bucket->pattern; slot < directory.size(); slot += (uint64_t) 1 << depth){
+        bool own = ((slot & mask) == bucket->pattern);
+        if(own != (directory[slot] == page_loc))
+            return -1;
+    }
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < bucket->count; i++){
+        if(!(hash_user_id(bucket->entries[i].user_id) & ((uint64_t) 1 << depth)))
+            bucket->entries[kept++] = bucket->entries[i];
+    }
+    bucket->count = kept;
+    bucket->local_depth = depth + 1;
+    *count = kept;
+    return _write(page_loc, page);
+}
+
+// the full bucket is in `page`.
+int HashIndex::_split(page_ptr_t page_loc){
+    hash_bucket_t *bucket = (hash_bucket_t*) page;
+    uint32_t depth = bucket->local_depth;
+    if(depth >= HASH_MAX_DEPTH || (stats.buckets + 2) * (PAGE_SIZE) > UINT32_MAX)
+        return -1;
+    if(depth == global_depth){
+        size_t size = directory.size();
+        directory.resize(2 * size);
+        for(size_t slot = 0; slot < size; slot++)
+            directory[size + slot] = directory[slot];
+        global_depth++;
+        stats.doublings++;
+    }
+    vector<char> buffer(PAGE_SIZE, 0);
+    hash_bucket_t *sibling = (hash_bucket_t*) buffer.data();
+    sibling->local_depth = depth + 1;
+    sibling->pattern = bucket->pattern | ((uint64_t) 1 << depth);
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < bucket->count; i++){
+        if(hash_user_id(bucket->entries[i].user_id) & ((uint64_t) 1 << depth))
+            sibling->entries[sibling->count++] = bucket->entries[i];
+        else
+            bucket->entries[kept++] = bucket->entries[i];
+    }
+    bucket->count = kept;
+    bucket->local_depth = depth + 1;
+    page_ptr_t sibling_loc = (stats.buckets + 1) * (PAGE_SIZE);
+    // the new bucket first: until the old one is rewritten the entries are
+    // still all there. If that never happens, open finds the new bucket by
+    // the file size and the old one claiming its slots, and finishes the
+    // split.
+    if(_write(sibling_loc, buffer.data()) != 0 || _write(page_loc, page) != 0)
+        return -1;
+    stats.buckets++;
+    stats.splits++;
+    for(uint64_t slot = sibling->pattern; slot < directory.size(); slot += (uint64_t) 1 << (depth + 1))
+        directory[slot] = sibling_loc;
+    return _write_header();
+}
+
+int HashIndex::find(const char *user_id, db_entry_t *entry){
+    page_ptr_t page_loc;
+    int index = _find(user_id, hash_user_id(user_id), &page_loc);
+    if(index < 0)
+        return -1;
+    *entry = ((hash_bucket_t*) page)->entries[index];
+    return 0;
+}
+
+int HashIndex::insert(const db_entry_t *entry){
+    uint64_t hash = hash_user_id(entry->user_id);
+    for(;;){
+        page_ptr_t page_loc;
+        int index = _find(entry->user_id, hash, &page_loc);
+        if(index != -1)
+            return -1;
+        hash_bucket_t *bucket = (hash_bucket_t*) page;
+        if(bucket->count < HASH_BUCKET_CAPACITY){
+            bucket->entries[bucket->count++] = *entry;
+            if(_write(page_loc, page) != 0)
+                return -1;
+            stats.entries++;
+            return 0;
+        }
+        // all of it may land on one side; then split again.
+        if(_split(page_loc) != 0)
+            return -1;
+    }
+}
+
+int HashIndex::update(const db_entry_t *entry){
+    page_ptr_t page_loc;
+    int index = _find(entry->user_id, hash_user_id(entry->user_id), &page_loc);
+    if(index < 0)
+        return -1;
+    ((hash_bucket_t*) page)->entries[index] = *entry;
+    return _write(page_loc, page);
+}
+
+// buckets are not merged back.
+int HashIndex::remove(const char *user_id){
+    page_ptr_t page_loc;
+    int index = _find(user_id, hash_user_id(user_id), &page_loc);
+    if(index < 0)
+        return -1;
+    hash_bucket_t *bucket = (hash_bucket_t*) page;
+    bucket->entries[index] = bucket->entries[--bucket->count];
+    if(_write(page_loc, page) != 0)
+        return -1;
+    stats.entries--;
+    return 0;
+}
+
+hash_index_stats_t HashIndex::get_stats(){
+    hash_index_stats_t snapshot = stats;
+    snapshot.global_depth = global_depth;
+    return snapshot;
+}
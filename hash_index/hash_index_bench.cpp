@@ -0,0 +1,170 @@
+/*
+* Exact-match lookups: HashIndex against btree_find().
+*
+* usage: hash_index_bench [accounts] [lookups] [dir]
+*
+* Loads the same accounts into a b-tree and into a hash index, then
+*   - looks up random accounts both ways, reporting the time and the pages
+*     read per lookup (the b-tree's from the page checksum counters, which
+*     count every load_page()),
+*   - runs random deposits both ways (find, change, write back),
+*   - checks both agree on every account looked up, and that an unknown
+*     account is a miss in both.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include "hash_index.h"
+
+using namespace std;
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%08u", account);
+}
+
+static double seconds_since(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t btree_page_loads(){
+    page_checksum_stats_t stats;
+    get_page_checksum_stats(&stats);
+    return stats.verified + stats.skipped + stats.unstamped;
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts = (argc > 1) ? atoi(argv[1]) : 10000000;
+    uint32_t lookups  = (argc > 2) ? atoi(argv[2]) : 1000000;
+    string   dir      = (argc > 3) ? argv[3] : ".";
+    string db_path = dir + "/hash_index_bench.db";
+    string index_path = dir + "/hash_index_bench.idx";
+    if(accounts < 1)
+        accounts = 1;
+
+    unlink(db_path.c_str());
+    unlink(index_path.c_str());
+    int db_file = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0){
+        cerr << "cannot create " << db_path << endl;
+        return 1;
+    }
+    int rc = 0;
+    {
+        HashIndex index(index_path.c_str());
+        mt19937_64 rng(1);
+        uniform_int_distribution<uint32_t> amount(0, 1000000);
+        db_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        double btree_load = 0, hash_load = 0;
+        for(uint32_t i = 0; i < accounts; i++){
+            account_name(i, entry.user_id);
+            entry.balance = amount(rng);
+            auto start = chrono::steady_clock::now();
+            btree_insert(db_file, PAGE_SIZE, &entry);
+            btree_load += seconds_since(start);
+            start = chrono::steady_clock::now();
+            if(index.insert(&entry) != 0){
+                cerr << "hash index insert failed at account " << i << endl;
+                return 1;
+            }
+            hash_load += seconds_since(start);
+        }
+        hash_index_stats_t built = index.get_stats();
+        cout << accounts << " accounts loaded: b-tree " << fixed << setprecision(1) << btree_load << " s, hash index "
+             << hash_load << " s (" << built.buckets << " buckets, global depth " << built.global_depth << ", "
+             << built.splits << " splits, " << setprecision(0) << 100.0 * built.entries / (built.buckets * HASH_BUCKET_CAPACITY)
+             << "% full)" << endl << endl;
+
+        uniform_int_distribution<uint32_t> pick(0, accounts - 1);
+        vector<uint32_t> sample(lookups);
+        for(auto& account: sample)
+            account = pick(rng);
+        char user_id[USERID_LENGTH];
+
+        cout << setw(12) << "" << setw(14) << "us/lookup" << setw(14) << "pages/lookup" << setw(14) << "us/deposit" << endl;
+        // lookups
+        uint64_t loads = btree_page_loads();
+        vector<amount_t> found(lookups);
+        tuple_info_t info;
+        auto start = chrono::steady_clock::now();
+        for(uint32_t i = 0; i < lookups; i++){
+            account_name(sample[i], user_id);
+            if(btree_find(db_file, user_id, USERID_LENGTH, &info) != 0){
+                rc = 1;
+                continue;
+            }
+            found[i] = info.page->page_content->db_entries[info.index]->balance;
+            free_page(db_file, info.page, 0);
+        }
+        double btree_us = seconds_since(start) * 1e6 / lookups;
+        double btree_pages = (double) (btree_page_loads() - loads) / lookups;
+        hash_index_stats_t before = index.get_stats();
+        bool agree = true;
+        start = chrono::steady_clock::now();
+        for(uint32_t i = 0; i < lookups; i++){
+            account_name(sample[i], user_id);
+            if(index.find(user_id, &entry) != 0 || entry.balance != found[i])
+                agree = false;
+        }
+        double hash_us = seconds_since(start) * 1e6 / lookups;
+        double hash_pages = (double) (index.get_stats().page_reads - before.page_reads) / lookups;
+
+        // deposits
+        start = chrono::steady_clock::now();
+        for(uint32_t i = 0; i < lookups; i++){
+            account_name(sample[i], user_id);
+            if(btree_find(db_file, user_id, USERID_LENGTH, &info) != 0)
+                continue;
+            info.page->page_content->db_entries[info.index]->balance += 10;
+            free_page(db_file, info.page, 1);
+        }
+        double btree_deposit_us = seconds_since(start) * 1e6 / lookups;
+        start = chrono::steady_clock::now();
+        for(uint32_t i = 0; i < lookups; i++){
+            account_name(sample[i], user_id);
+            if(index.find(user_id, &entry) != 0)
+                continue;
+            entry.balance += 10;
+            index.update(&entry);
+        }
+        double hash_deposit_us = seconds_since(start) * 1e6 / lookups;
+
+        cout << setprecision(2) << setw(12) << "b-tree" << setw(14) << btree_us << setw(14) << btree_pages << setw(14) << btree_deposit_us << endl;
+        cout << setw(12) << "hash index" << setw(14) << hash_us << setw(14) << hash_pages << setw(14) << hash_deposit_us << endl << endl;
+
+        for(uint32_t i = 0; i < lookups && agree; i++){
+            account_name(sample[i], user_id);
+            if(btree_find(db_file, user_id, USERID_LENGTH, &info) != 0 || index.find(user_id, &entry) != 0){
+                agree = false;
+                break;
+            }
+            agree = (entry.balance == info.page->page_content->db_entries[info.index]->balance);
+            free_page(db_file, info.page, 0);
+        }
+        account_name(accounts, user_id);
+        bool misses = (btree_find(db_file, user_id, USERID_LENGTH, &info) != 0 && index.find(user_id, &entry) != 0);
+        rc |= !agree || !misses;
+        cout << "both agree on the accounts looked up: " << (agree ? "yes" : "NO")
+             << "; an unknown account misses in both: " << (misses ? "yes" : "NO") << endl;
+    }
+    {
+        // the directory comes back from the buckets.
+        auto start = chrono::steady_clock::now();
+        HashIndex reopened(index_path.c_str());
+        hash_index_stats_t stats = reopened.get_stats();
+        bool whole = (stats.entries == accounts);
+        rc |= !whole;
+        cout << "reopened in " << setprecision(1) << seconds_since(start) * 1e3 << " ms with " << stats.entries
+             << " accounts: " << (whole ? "yes" : "NO") << endl;
+    }
+    close(db_file);
+    unlink(db_path.c_str());
+    unlink(index_path.c_str());
+    return rc;
+}
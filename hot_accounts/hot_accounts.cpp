@@ -0,0 +1,215 @@
+#include <chrono>
+#include <cstring>
+#include "hot_accounts.h"
+
+using namespace std;
+
+static atomic<uint32_t> next_slot(0);
+static thread_local uint32_t my_slot = next_slot.fetch_add(1) % HOT_SLOTS;
+
+static uint32_t hash_user_id(const char *user_id){
+    uint32_t h = 2166136261u;
+    for(int i = 0; i < USERID_LENGTH && user_id[i] != '\0'; i++)
+        h = (h ^ (unsigned char) user_id[i]) * 16777619u;
+    return h;
+}
+
+HotAccounts::HotAccounts(hot_loader_t loader, hot_writer_t writer, void *ctx, uint32_t merge_interval_ms){
+    this->loader = loader;
+    this->writer = writer;
+    this->ctx = ctx;
+    for(int i = 0; i < HOT_TABLE_SIZE; i++)
+        table[i].store(NULL);
+    accounts = 0;
+    merges.store(0);
+    write_backs = 0;
+    this->merge_interval_ms = merge_interval_ms;
+    stopping = false;
+    if(merge_interval_ms > 0)
+        merger = thread(&HotAccounts::_run_merger, this);
+}
+
+HotAccounts::~HotAccounts(){
+    {
+        lock_guard<mutex> guard(merger_latch);
+        stopping = true;
+    }
+    merger_cond.notify_one();
+    if(merger.joinable())
+        merger.join();
+    merge();
+    for(int i = 0; i < HOT_TABLE_SIZE; i++)
+        delete table[i].load();
+}
+
+// lock free: accounts are only ever added.
+hot_account_t* HotAccounts::_find(const char *user_id){
+    uint32_t at = hash_user_id(user_id);
+    for(int probe = 0; probe < HOT_TABLE_SIZE; probe++){
+        hot_account_t *account = table[(at + probe) & (HOT_TABLE_SIZE - 1)].load(memory_order_acquire);
+        if(account == NULL)
+            return NULL;
+        if(strncmp(account->user_id, user_id, USERID_LENGTH) == 0)
+            return account;
+    }
+    return NULL;
+}
+
+void HotAccounts::_merge(hot_account_t *account){
+    lock_guard<mutex> guard(account->merge_latch);
+    int64_t credit = 0;
+    for(int s = 0; s < HOT_SLOTS; s++){
+        if(account->slots[s].credit.load(memory_order_relaxed) != 0)
+            credit += account->slots[s].credit.exchange(0);
+    }
+    if(credit == 0)
+        return;
+    account->base.fetch_add(credit);
+    account->available.fetch_add(credit);
+    merges.fetch_add(1, memory_order_relaxed);
+}
+
+int HotAccounts::promote(const char *user_id){
+    lock_guard<mutex> guard(latch);
+    if(_find(user_id) != NULL)
+        return 0;
+    if(accounts >= HOT_TABLE_SIZE / 2)
+        return -1;
+    amount_t balance;
+    if(loader(ctx, user_id, &balance) != 0)
+        return -1;
+    hot_account_t *account = new hot_account_t;
+    memset(account->user_id, 0, USERID_LENGTH);
+    memcpy(account->user_id, user_id, strnlen(user_id, USERID_LENGTH));
+    for(int s = 0; s < HOT_SLOTS; s++){
+        account->slots[s].credit.store(0);
+        account->slots[s].deposits.store(0);
+    }
+    account->base.store(balance);
+    account->available.store(balance);
+    account->withdrawals.store(0);
+    account->insufficient.store(0);
+    account->written = balance;
+    uint32_t at = hash_user_id(user_id);
+    while(table[at & (HOT_TABLE_SIZE - 1)].load() != NULL)
+        at++;
+    table[at & (HOT_TABLE_SIZE - 1)].store(account, memory_order_release);
+    accounts++;
+    return 0;
+}
+
+bool HotAccounts::is_hot(const char *user_id){
+    return _find(user_id) != NULL;
+}
+
+hot_status_t HotAccounts::deposit(const char *user_id, amount_t amount){
+    hot_account_t *account = _find(user_id);
+    if(account == NULL)
+        return HOT_NOT_HOT;
+    hot_slot_t *slot = &account->slots[my_slot];
+    slot->credit.fetch_add(amount, memory_order_relaxed);
+    slot->deposits.fetch_add(1, memory_order_relaxed);
+    return HOT_OK;
+}
+
+hot_status_t HotAccounts::reserve(const char *user_id, amount_t amount){
+    hot_account_t *account = _find(user_id);
+    if(account == NULL)
+        return HOT_NOT_HOT;
+    for(int attempt = 0; attempt < 2; attempt++){
+        int64_t have = account->available.load();
+        while(have >= (int64_t) amount){
+            if(account->available.compare_exchange_weak(have, have - amount))
+                return HOT_OK;
+        }
+        // the deposits not merged yet may cover it.
+        if(attempt == 0)
+            _merge(account);
+    }
+    account->insufficient.fetch_add(1, memory_order_relaxed);
+    return HOT_INSUFFICIENT;
+}
+
+hot_status_t HotAccounts::commit_reservation(const char *user_id, amount_t amount){
+    hot_account_t *account = _find(user_id);
+    if(account == NULL)
+        return HOT_NOT_HOT;
+    account->base.fetch_sub(amount);
+    account->withdrawals.fetch_add(1, memory_order_relaxed);
+    return HOT_OK;
+}
+
+hot_status_t HotAccounts::cancel_reservation(const char *user_id, amount_t amount){
+    hot_account_t *account = _find(user_id);
+    if(account == NULL)
+        return HOT_NOT_HOT;
+    account->available.fetch_add(amount);
+    return HOT_OK;
+}
+
+hot_status_t HotAccounts::withdraw(const char *user_id, amount_t amount){
+    hot_status_t status = reserve(user_id, amount);
+    if(status != HOT_OK)
+        return status;
+    return commit_reservation(user_id, amount);
+}
+
+hot_status_t HotAccounts::read(const char *user_id, amount_t *balance){
+    hot_account_t *account = _find(user_id);
+    if(account == NULL)
+        return HOT_NOT_HOT;
+    _merge(account);
+    *balance = account->base.load();
+    return HOT_OK;
+}
+
+int HotAccounts::merge(){
+    lock_guard<mutex> guard(latch);
+    int rc = 0;
+    for(int i = 0; i < HOT_TABLE_SIZE; i++){
+        hot_account_t *account = table[i].load();
+        if(account == NULL)
+            continue;
+        _merge(account);
+        int64_t balance = account->base.load();
+        if(balance == account->written)
+            continue;
+        if(writer(ctx, account->user_id, balance) != 0){
+            rc = -1;
+            continue;
+        }
+        account->written = balance;
+        write_backs++;
+    }
+    return rc;
+}
+
+void HotAccounts::_run_merger(){
+    unique_lock<mutex> guard(merger_latch);
+    while(!stopping){
+        merger_cond.wait_for(guard, chrono::milliseconds(merge_interval_ms));
+        if(stopping)
+            break;
+        guard.unlock();
+        merge();
+        guard.lock();
+    }
+}
+
+hot_stats_t HotAccounts::get_stats(){
+    lock_guard<mutex> guard(latch);
+    hot_stats_t stats = {};
+    stats.accounts = accounts;
+    for(int i = 0; i < HOT_TABLE_SIZE; i++){
+        hot_account_t *account = table[i].load();
+        if(account == NULL)
+            continue;
+        for(int s = 0; s < HOT_SLOTS; s++)
+            stats.deposits += account->slots[s].deposits.load(memory_order_relaxed);
+        stats.withdrawals += account->withdrawals.load(memory_order_relaxed);
+        stats.insufficient += account->insufficient.load(memory_order_relaxed);
+    }
+    stats.merges = merges.load();
+    stats.write_backs = write_backs;
+    return stats;
+}
@@ -0,0 +1,136 @@
+/*
+* One hot merchant account: deposits per second as threads are added.
+*
+* usage: hot_accounts_bench [ops_per_thread] [max_threads]
+*
+* latch: the balance of the db_entry_t behind a mutex, the way any
+*        exclusive lock on the account works.
+* hot:   the account promoted into HotAccounts.
+*
+* Nine operations in ten are deposits, the rest withdrawals, and the
+* account starts empty, so withdrawals regularly depend on deposits that
+* have not been merged yet. Each run checks that the written back balance
+* is the deposits minus the withdrawals that went through.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "hot_accounts.h"
+
+using namespace std;
+
+#define MERCHANT    "merchant"
+
+typedef struct{
+    mutex      latch;
+    db_entry_t entry;           // stands in for the b-tree
+}bench_db_t;
+
+static int load_balance(void *ctx, const char *user_id, amount_t *balance){
+    bench_db_t *db = (bench_db_t*) ctx;
+    if(strncmp(user_id, db->entry.user_id, USERID_LENGTH) != 0)
+        return -1;
+    *balance = db->entry.balance;
+    return 0;
+}
+
+static int write_balance(void *ctx, const char *user_id, amount_t balance){
+    (void) user_id;
+    bench_db_t *db = (bench_db_t*) ctx;
+    lock_guard<mutex> guard(db->latch);
+    db->entry.balance = balance;
+    return 0;
+}
+
+typedef struct{
+    uint64_t deposited;
+    uint64_t withdrawn;
+}bench_result_t;
+
+static void latch_worker(bench_db_t *db, uint64_t ops, uint32_t id, bench_result_t *result){
+    mt19937_64 rng(id + 1);
+    uniform_int_distribution<uint32_t> percent(0, 99), amount(1, 100);
+    *result = {0, 0};
+    for(uint64_t i = 0; i < ops; i++){
+        bool deposit = percent(rng) < 90;
+        amount_t a = amount(rng);
+        lock_guard<mutex> guard(db->latch);
+        if(deposit){
+            db->entry.balance += a;
+            result->deposited += a;
+        }
+        else if(db->entry.balance >= a){
+            db->entry.balance -= a;
+            result->withdrawn += a;
+        }
+    }
+}
+
+static void hot_worker(HotAccounts *hot, uint64_t ops, uint32_t id, bench_result_t *result){
+    mt19937_64 rng(id + 1);
+    uniform_int_distribution<uint32_t> percent(0, 99), amount(1, 100);
+    *result = {0, 0};
+    for(uint64_t i = 0; i < ops; i++){
+        bool deposit = percent(rng) < 90;
+        amount_t a = amount(rng);
+        if(deposit){
+            hot->deposit(MERCHANT, a);
+            result->deposited += a;
+        }
+        else if(hot->withdraw(MERCHANT, a) == HOT_OK){
+            result->withdrawn += a;
+        }
+    }
+}
+
+int main(int argc, char **argv){
+    uint64_t ops         = (argc > 1) ? atoll(argv[1]) : 1000000;
+    uint32_t max_threads = (argc > 2) ? atoi(argv[2]) : 16;
+
+    cout << left << setw(7) << "mode" << right << setw(9) << "threads" << setw(12) << "Mops/s"
+         << setw(10) << "merges" << setw(6) << "ok" << endl;
+    int rc = 0;
+    for(uint32_t threads = 1; threads <= max_threads; threads *= 2){
+        for(int hot_mode = 0; hot_mode <= 1; hot_mode++){
+            bench_db_t db;
+            memset(&db.entry, 0, sizeof(db.entry));
+            strncpy(db.entry.user_id, MERCHANT, USERID_LENGTH);
+            vector<bench_result_t> results(threads);
+            uint64_t merges = 0;
+            double seconds;
+            {
+                HotAccounts hot(load_balance, write_balance, &db);
+                if(hot_mode)
+                    hot.promote(MERCHANT);
+                vector<thread> workers;
+                auto start = chrono::steady_clock::now();
+                for(uint32_t t = 0; t < threads; t++){
+                    if(hot_mode)
+                        workers.emplace_back(hot_worker, &hot, ops, t, &results[t]);
+                    else
+                        workers.emplace_back(latch_worker, &db, ops, t, &results[t]);
+                }
+                for(auto& worker: workers)
+                    worker.join();
+                seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                merges = hot.get_stats().merges;
+            }
+            uint64_t expected = 0;
+            for(auto& result: results)
+                expected += result.deposited - result.withdrawn;
+            bool ok = db.entry.balance == expected;
+            if(!ok)
+                rc = 1;
+            cout << left << setw(7) << (hot_mode ? "hot" : "latch") << right << setw(9) << threads
+                 << setw(12) << fixed << setprecision(2) << threads * ops / seconds / 1e6
+                 << setw(10) << merges << setw(6) << (ok ? "yes" : "NO") << endl;
+        }
+    }
+    return rc;
+}
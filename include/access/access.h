@@ -76,6 +76,8 @@ typedef struct{
 int syscall_io_uring_setup(unsigned entries, struct io_uring_params *p);
 int syscall_io_uring_enter(int ring_fd, unsigned int to_submit,
                                     unsigned int min_complete, unsigned int flags);
+int syscall_io_uring_register(int ring_fd, unsigned int opcode,
+                                    void *arg, unsigned int nr_args);
 class IOHandler{
     private:
     int ring_fd;
@@ -90,5 +92,8 @@ class IOHandler{
     int enque_access_request(int fd, const io_request_t* request);
     completed_io_t* get_completed_request();
     int get_all_completed_requests(std::vector<completed_io_t*>* vec);
+    bool has_completed_requests();
+    // the eventfd is signalled by the kernel every time a completion is posted.
+    int register_eventfd(int event_fd);
 };
 #endif
\ No newline at end of file
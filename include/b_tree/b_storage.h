@@ -1,4 +1,5 @@
 #ifndef __B_STORAGE_H__
+#define __B_STORAGE_H__
 
 #include <stdio.h>
 #include <errno.h>
@@ -11,10 +12,6 @@
 #include <sys/stat.h>
 #include <data_defs.h>
 
-#endif
-
-#define LOGGING_ENABLED         1
-
 #define PAGE_SIZE               4*1024
 #define PAGE_ENTRY_COUNT_SIZE   32/8
 #define IS_LEAF_SIZE            32/8
@@ -29,6 +26,51 @@
 
 #define MAX_TUPLES_COUNT         MAX_DEGREE - 1         // 25 
 #define MIN_TUPLES_COUNT         MIN_DEGREE - 1         // 12
+#define BTREE_SCAN_MAX_DEPTH     16                     // far more than 2^32 keys need
+
+// The tuples end at byte 4040; the page trailer lives in the last bytes.
+// page_lsn is the LSN of the last log record applied to the page.
+#define PAGE_LSN_SIZE           64/8
+#define PAGE_LSN_OFFSET         (PAGE_SIZE - PAGE_LSN_SIZE)
+// CRC32C of the rest of the page, stamped on every page write and checked
+// by load_page(). 0 means the page was never stamped. A page that fails the
+// check is not loaded, and the b-tree operation that needed it returns -1.
+#define PAGE_CHECKSUM_SIZE      32/8
+#define PAGE_CHECKSUM_OFFSET    (PAGE_LSN_OFFSET - PAGE_CHECKSUM_SIZE)
+#define PAGE_CHECKSUM_SAMPLE    16
+
+typedef enum{
+    CHECKSUM_OFF     = 0,
+    CHECKSUM_SAMPLED = 1,       // every sample_every-th load
+    CHECKSUM_ALWAYS  = 2
+} checksum_mode_t;
+
+typedef struct{
+    u_int64_t verified;
+    u_int64_t skipped;          // not sampled, or verification off
+    u_int64_t unstamped;
+    u_int64_t failures;         // load_page() returned NULL
+}page_checksum_stats_t;
+
+// Every page_t comes in one frame with its content view, pointer arrays
+// and buffer. Frames are bumped out of chunks of PAGE_ARENA_CHUNK_FRAMES
+// by a per-thread arena and free_page() puts them on the calling thread's
+// free list, so once a thread has loaded its working set, loading a page
+// allocates nothing. When a thread exits its free frames go to a process
+// wide spare list, which a thread takes from before it allocates a chunk;
+// chunks are never freed, but short lived threads do not add up.
+// btree_insert() and btree_delete_start() are arena scopes: whatever
+// frames the operation loaded and did not free are taken back in one step
+// when it ends.
+#define PAGE_ARENA_CHUNK_FRAMES 32
+
+typedef struct{
+    u_int64_t heap_allocations; // malloc() calls, one per chunk
+    u_int64_t frames_allocated;
+    u_int64_t frames_reused;    // taken from the free list
+    u_int64_t frames_reclaimed; // left behind by an operation
+    u_int64_t frames_adopted;   // from the spare list
+}page_arena_stats_t;
 
 typedef u_int32_t page_ptr_t;
 
@@ -37,6 +79,8 @@ typedef struct{
     u_int32_t *is_leaf;
     page_ptr_t **ptrs;
     db_entry_t **db_entries;
+    u_int64_t *page_lsn;
+    u_int32_t *checksum;
 }page_content_t;
 
 typedef struct{
@@ -51,11 +95,33 @@ typedef struct{
     page_t *page;
 }tuple_info_t;
 
+// non-zero stops the scan.
+typedef int (*btree_visitor_t)(void *ctx, const db_entry_t *entry);
+
+// the path to the entry a scan stopped on; only good as long as no key is
+// inserted or deleted.
+typedef struct{
+    u_int32_t path[BTREE_SCAN_MAX_DEPTH];
+    u_int32_t depth;
+    u_int32_t resume;
+}btree_cursor_t;
+
+page_t *load_page(int db_file, page_ptr_t page_location);
 int free_page(int db_file, page_t *page, u_int32_t do_write);
 int read_block(void *buff, size_t buff_size, int fd, off_t offset);
 int write_block(const void *buff, size_t buff_size, int fd, off_t offset);
 int64_t btree_delete(int db_file, page_t *page, const char *key, size_t key_length);
 int btree_find(int db_file, const char *key, size_t key_length, tuple_info_t *tuple_info);
+int btree_scan(int db_file, btree_visitor_t visit, void *ctx);
+// goes on from where the last call with `cursor` stopped (a zeroed cursor
+// starts at the first key); 0 at the end, 1 if the visitor stopped it.
+int btree_scan_from(int db_file, btree_cursor_t *cursor, btree_visitor_t visit, void *ctx);
 int btree_insert(int db_file, size_t page_size, const db_entry_t *db_entry);
 int init_db_storage(int db_file, size_t page_size);
 int btree_delete_start(int db_file, const char *key, size_t key_length);
+u_int32_t page_checksum(const char *page);
+void set_page_checksum_mode(checksum_mode_t mode, u_int32_t sample_every);
+void get_page_checksum_stats(page_checksum_stats_t *stats);
+// the calling thread's.
+void get_page_arena_stats(page_arena_stats_t *stats);
+#endif
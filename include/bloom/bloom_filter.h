@@ -0,0 +1,158 @@
+/*
+* Blocked bloom filter over the b-tree's keys, so that lookups of accounts
+* that do not exist (CREATE's existence check, mistyped or made up
+* user_ids) are answered without reading a page.
+*
+* The filter is an array of 64 byte blocks, one cache line each. A key
+* hashes to one block and sets one bit in each of its eight 64 bit words,
+* so a lookup touches a single cache line. With BLOOM_BITS_PER_KEY bits per
+* key the false positive rate is about 1%.
+*
+* The file holds a header page followed by the blocks, BLOOM_BLOCKS_PER_PAGE
+* to a page. add() sets bits in memory and marks their page dirty; flush()
+* writes the dirty pages and then the header with `clean` set. The first
+* add() after a flush clears `clean` on disk, so a filter that was not
+* flushed before a crash is rebuilt from the b-tree when it is opened, as
+* is a filter opened for the first time.
+*
+* Bits cannot be taken out: remove() only counts the key as deleted. Once
+* deleted keys are a quarter of the keys in the filter, or it holds more
+* keys than it was sized for, needs_rebuild() says so and rebuild() scans
+* the b-tree into a freshly sized filter and swaps it in. A background
+* thread (none if `maintain_interval_ms` is 0) flushes and rebuilds when
+* needed every `maintain_interval_ms`.
+*
+* b_storage is single threaded: a page being written may be read torn by
+* another thread. So the scan and the owner's b-tree writes take turns on
+* `storage_latch`; the owner brackets every page it writes back (a balance
+* update) with begin_write() and end_write(), and every insert and delete
+* with begin_change() and end_change(), which take it too. The scan holds
+* it for BLOOM_SCAN_BATCH keys at a time and goes on from where it
+* stopped. A change also moves keys the scan has already collected into a
+* filter that is about to be replaced, so a rebuild that a change
+* overlapped is discarded and tried again later. Every key put into the
+* b-tree must go through add() before the insert while the filter is in
+* use.
+*
+* Lookups take the latch shared, add() and the swap exclusive.
+*/
+#ifndef _BLOOM_FILTER_H_
+#define _BLOOM_FILTER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C"{
+#include "b_storage.h"
+}
+
+#define BLOOM_FILTER_MAGIC      0x52544c464d4f4c42ULL      // "BLOMFLTR"
+#define BLOOM_BITS_PER_KEY      10
+#define BLOOM_BLOCK_SIZE        64
+#define BLOOM_BLOCK_WORDS       (BLOOM_BLOCK_SIZE / 8)
+#define BLOOM_BLOCKS_PER_PAGE   ((PAGE_SIZE) / BLOOM_BLOCK_SIZE)
+#define BLOOM_REBUILD_DELETED   4       // rebuild once 1/4 of the keys are deleted
+#define BLOOM_SCAN_BATCH        4096    // keys the rebuild scans per turn on storage_latch
+
+typedef struct{
+    uint64_t magic;
+    uint64_t version;
+    uint64_t blocks;
+    uint32_t bits_per_key;
+    uint32_t clean;             // every page on disk is up to date
+    uint64_t keys;
+    uint64_t deleted;
+}bloom_file_header_t;
+
+typedef struct{
+    uint64_t keys;              // added since the last (re)build
+    uint64_t deleted;
+    uint64_t blocks;
+    uint64_t lookups;
+    uint64_t negatives;         // lookups answered "not there"
+    uint64_t false_positives;   // as reported by the owner
+    uint64_t rebuilds;
+    uint64_t rebuilds_abandoned;
+    uint64_t flushes;
+}bloom_stats_t;
+
+class BloomFilterFailure: public std::exception{
+    public:
+    std::string failure_msg;
+    BloomFilterFailure(std::string msg){
+        failure_msg = msg;
+    }
+    inline const char* what() const noexcept{
+        return failure_msg.c_str();
+    }
+};
+
+class BloomFilter{
+    int fd;
+    int db_file;
+    uint64_t expected_keys;
+    uint32_t bits_per_key;
+    uint64_t *blocks;
+    uint64_t block_count;
+    std::vector<uint8_t> dirty_pages;
+    bool clean_on_disk;
+    uint64_t keys;
+    uint64_t deleted;
+    std::shared_mutex latch;
+
+    // the owner's b-tree writes or the rebuild's scan.
+    std::mutex storage_latch;
+    // begin_change() and end_change() both bump the generation.
+    uint64_t generation;
+    std::mutex rebuild_latch;           // one rebuild at a time
+
+    uint64_t lookups;
+    uint64_t negatives;
+    uint64_t false_positives;
+    uint64_t rebuilds;
+    uint64_t rebuilds_abandoned;
+    uint64_t flushes;
+
+    uint32_t maintain_interval_ms;
+    std::thread maintainer;
+    std::mutex maintainer_latch;
+    std::condition_variable maintainer_cond;
+    bool stopping;
+
+    static int _collect(void *ctx, const db_entry_t *entry);
+    int _scan(std::vector<uint64_t>& hashes);
+    void _install(uint64_t *new_blocks, uint64_t new_block_count, const std::vector<uint64_t>& hashes);
+    int _write_header(bool clean);
+    int _flush();
+    void _run_maintainer();
+    public:
+    // opens or creates the filter of `db_file`'s keys; throws
+    // BloomFilterFailure.
+    BloomFilter(const char *path, int db_file, uint64_t expected_keys, uint32_t bits_per_key = BLOOM_BITS_PER_KEY,
+                uint32_t maintain_interval_ms = 0);
+    ~BloomFilter();
+    BloomFilter(const BloomFilter&) = delete;
+    BloomFilter& operator=(const BloomFilter&) = delete;
+    // false: the account certainly does not exist.
+    bool may_contain(const char *user_id);
+    void add(const char *user_id);
+    void remove(const char *user_id);
+    // may_contain() was true but the account does not exist.
+    void false_positive();
+    void begin_write();
+    void end_write();
+    void begin_change();
+    void end_change();
+    bool needs_rebuild();
+    // 0 when the new filter is in use, 1 if a concurrent change made the
+    // scan useless, -1 on failure.
+    int rebuild();
+    int flush();
+    bloom_stats_t get_stats();
+};
+#endif
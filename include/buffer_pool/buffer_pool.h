@@ -20,6 +20,13 @@
 *       if the context object has no more steps left; signal the waiting thread that it can proceed.
 *    5. Check for IO request that are complete and set the corresponding context to 'ready'.
 *    6. return to step one if there are new requests else to step 3.
+*    7. If there are no new requests and no context is ready, block on the wake up
+*       eventfd. It is registered with the io_uring instance so the kernel signals
+*       it on every IO completion, and enque_request signals it when the loop is
+*       parked. This is the only place the loop ever blocks.
+*
+*    The request queue is a bounded lock-free MPSC ring (see mpsc_ring.h); enqueueing
+*    a request costs one CAS and a write to the eventfd only if the loop is parked.
 *
 * Context Object:
 *    Consits of:
@@ -57,49 +64,167 @@
 
 #include <queue>
 #include <atomic>
+#include <unordered_map>
 #include <pthread.h>
-#include "page.h"
+#include <sys/uio.h>
+#include "mpsc_ring.h"
+#include "frame_arena.h"
+#include "pool_stats.h"
 
 typedef struct {
     int fd;
     uint64_t offset;
 }page_loc_t;
+
+inline bool operator==(const page_loc_t& a, const page_loc_t& b){
+    return a.fd == b.fd && a.offset == b.offset;
+}
+// splitmix64 finalizer over (fd, offset); the high bits pick the shard.
+inline uint64_t page_loc_hash(const page_loc_t& loc){
+    uint64_t x = loc.offset ^ ((uint64_t) loc.fd << 48);
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+struct page_loc_hasher{
+    size_t operator()(const page_loc_t& loc) const{
+        return page_loc_hash(loc);
+    }
+};
+
 class PageFrame{
     public:
-    Page                *page;
-    page_loc_t          *location;
+    char                *buffer;        // FRAME_SIZE bytes inside the pool's FrameArena
+    page_loc_t          *location;      // points at `loc` while a page is mapped, else NULL
+    page_loc_t           loc;
+    std::atomic<uint32_t> pin_count;
+    std::atomic_bool     ref_bit;
+    std::atomic_bool     is_dirty;
+    std::atomic_bool     io_pending;    // set while the page is being read in, page_latch is held
+    bool                 in_scan_ring;  // frame belongs to the scan ring, never to the CLOCK
     std::atomic_flag     page_pin;
     std::atomic_flag     header_latch;
     pthread_mutex_t      page_latch;
 };
 class BufferPool{
+    FrameArena*  arena;
+    PageFrame*   frames;
+    uint64_t     frame_count;
+    PoolStats*   stats;
     public:
-    BufferPool(uint64_t pool_size);
-    PageFrame* read_page(uint64_t page_no, int fd);
-    int write_page(PageDirectory* directory, PageFrame* frame, int fd);
+    // pool_size is in bytes and is rounded down to a whole number of frames.
+    // With prefault set, all the frame memory is faulted in up front.
+    BufferPool(uint64_t pool_size, bool prefault = false);
+    ~BufferPool();
+    inline uint64_t get_frame_count(){
+        return frame_count;
+    }
+    inline PageFrame* get_frame(uint64_t index){
+        return &frames[index];
+    }
+    inline arena_backing_t get_arena_backing(){
+        return arena->get_backing();
+    }
+    inline PoolStats* get_stats(){
+        return stats;
+    }
 };
 
+// flushing_required: page_frame is a dirty victim, pinned but still mapped,
+// that must be written back before asking again.
 typedef struct{
     bool flushing_required;
+    bool is_resident;
     PageFrame* page_frame;
 }replacement_algo_ret_t;
+
+typedef enum{
+    ACCESS_NORMAL = 0,
+    ACCESS_SCAN   = 1
+}page_access_t;
+
+#define DEFAULT_SCAN_RING_FRAMES 16
+typedef struct{
+    uint32_t scan_ring_frames;
+}replacement_algo_args_t;
+/*
+* CLOCK replacement over the frames of one BufferPool. It also owns the page
+* table (page_loc_t -> PageFrame) of that pool; both are protected by `latch`.
+* Frames handed out by it are pinned and must be given back with unpin().
+* A dirty victim is never reused before it has been written back, so a
+* re-fetch of the victim can never read a stale copy from disk. get_page()
+* doesn't write it itself, under the latch: it pins the victim and returns it
+* with flushing_required set, the event loop writes it back through io_uring
+* (WriteBackState), unpins it and asks again.
+*
+* Scan Ring:
+* The last `scan_ring_frames` frames of the pool are kept out of the CLOCK and
+* form a small private ring for ACCESS_SCAN requests. A scan that hits a page
+* of the main table uses it without setting its reference bit; a scan miss
+* reads the page into the next unpinned ring frame instead of evicting from
+* the main table. A sequential scan therefore cycles through the ring and
+* leaves the working set of point lookups alone. A normal request for a page
+* that is in the ring uses the ring frame as it is, so no page is ever in two
+* frames; it stays until the ring comes round to it. Scan frames are meant
+* to be read; a scan frame released dirty is written through right away, so
+* the main table never reads a stale copy from disk.
+*/
 class ReplacementAlgo{
     BufferPool* pagePool;
+    pthread_mutex_t latch;
+    std::unordered_map<page_loc_t, PageFrame*, page_loc_hasher> page_table;
+    std::unordered_map<page_loc_t, PageFrame*, page_loc_hasher> scan_table;
+    uint64_t clock_hand;
+    uint64_t clock_frames;
+    uint64_t frames_used;
+    uint64_t scan_hand;
+    uint64_t scan_frames;
+    PageFrame* _find_victim();
+    PageFrame* _find_scan_victim();
+    PageFrame* _lookup(const page_loc_t& loc, page_access_t mode);
     public:
+    // args is a replacement_algo_args_t*, or NULL for the defaults.
     ReplacementAlgo(BufferPool*, void* args);
-    replacement_algo_ret_t get_page(uint64_t page_no);
+    ~ReplacementAlgo();
+    // hit path: pins and returns the frame if the page is mapped, else NULL.
+    PageFrame* pin_if_resident(const page_loc_t& loc, page_access_t mode = ACCESS_NORMAL);
+    // miss path: maps the page to a (possibly evicted) frame and pins it. If
+    // the page was not resident the frame is returned with io_pending set and
+    // page_latch held; the caller must read the page in and call finish_load().
+    // If the victim is dirty nothing is mapped, see flushing_required.
+    replacement_algo_ret_t get_page(const page_loc_t& loc, page_access_t mode = ACCESS_NORMAL);
+    void finish_load(PageFrame* frame, bool success);
+    // waits for an in flight load of a pinned frame. Returns false, and drops
+    // the pin, if the load failed.
+    bool wait_for_load(PageFrame* frame, const page_loc_t& loc);
+    void unpin(PageFrame* frame, bool dirty);
+    inline BufferPool* get_pool(){
+        return pagePool;
+    }
 };
 typedef enum{
-    READ  = 0,
-    WRITE = 1
-} request_t;
+    PAGE_READ  = 0,
+    PAGE_WRITE = 1
+} page_request_t;
 
 class Request{
     public:
-    request_t        request_type;
+    page_request_t   request_type;
+    page_access_t    access_mode;
+    page_loc_t       location;
     PageFrame**      frame;
-    pthread_cond_t  *beacon;
-    Request(request_t, PageFrame**, pthread_cond_t*);
+    pthread_cond_t   beacon;
+    pthread_mutex_t  beacon_lock;
+    bool             is_complete;
+    int              retcode;
+    // a completed PAGE_READ hands out a pinned frame that may still be being
+    // read in by another request: call ReplacementAlgo::wait_for_load()
+    // before using it.
+    Request(page_request_t, page_loc_t, PageFrame**, page_access_t mode = ACCESS_NORMAL);
+    ~Request();
+    void wait();
+    void complete(int retcode);
 };
 class Context;
 class State{
@@ -146,32 +271,76 @@ class WriteState: public State{
     bool is_blocking();
     State* get_next_state();
 };
+
+// writes back the dirty victim of a miss; the context then starts over.
+class WriteBackState: public State{
+    Context *cxt;
+    bool is_run_complete;
+    public:
+    WriteBackState(Context* cxt);
+    ~WriteBackState();
+    void run();
+    bool is_blocking();
+    State* get_next_state();
+};
+
+class CompleteState: public State{
+    Context *cxt;
+    public:
+    CompleteState(Context* cxt);
+    ~CompleteState();
+    void run();
+    bool is_blocking();
+    State* get_next_state();
+};
+class EventLoop;
 class Context{
     public:
-    Request* req;
-    bool     is_ready;
-    State*   current_state;
+    Request*     req;
+    EventLoop*   loop;
+    PageFrame*   frame;
+    PageFrame*   victim;        // pinned while WriteBackState writes it back
+    struct iovec io_vec;
+    int          io_retcode;
+    uint64_t     io_start_ns;
+    bool         read_issued;   // this context, not another one, read the page in
+    bool         is_ready;
+    State*       current_state;
+    // runs states until a blocking one has been started or the last one is done.
     void run();
-    Context(Request* req);
+    Context(Request* req, EventLoop* loop);
 };
+class IOHandler;
+#define EVENT_LOOP_DEFAULT_QUEUE_SIZE 1024
 class EventLoop{
     std::queue<Context*> context_queue;
-    std::queue<Request*> request_queue;
+    MpscRing<Request*>   request_queue;
     ReplacementAlgo* replacement_algo;
+    IOHandler*       io_handler;
 
-    pthread_mutex_t *request_queue_lock;
-    pthread_cond_t  *loop_wake_up_cond;
-    pthread_mutex_t *loop_wake_up_lock;
-
+    int              wake_fd;
+    uint32_t         ready_contexts;
+    std::atomic_bool is_parked;
     std::atomic_bool stop_flag;
     int req_to_context();
+    int reap_completions();
+    // must push the context back and bump ready_contexts if it is still ready
+    // after running, i.e. it did not stop at a blocking state.
     void run_with_context(Context*);
-    bool check_request_q_empty_locked();
+    void park();
+    void wake_up();
     public:
-    EventLoop(ReplacementAlgo*);
+    EventLoop(ReplacementAlgo*, IOHandler*, uint32_t queue_size = EVENT_LOOP_DEFAULT_QUEUE_SIZE);
     ~EventLoop();
     void start();
     void stop();
+    // returns -1 if the request queue is full.
     int enque_request(Request*);
+    inline ReplacementAlgo* get_replacement_algo(){
+        return replacement_algo;
+    }
+    inline IOHandler* get_io_handler(){
+        return io_handler;
+    }
 };
 #endif
\ No newline at end of file
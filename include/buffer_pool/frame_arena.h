@@ -0,0 +1,65 @@
+/*
+* Frame Arena:
+* One contiguous, page aligned region of memory that backs every frame of a
+* BufferPool. It is reserved once when the pool is created and released when
+* the pool is destroyed; frames are never allocated individually.
+*
+* Backing, in order of preference:
+* 1. ARENA_HUGETLB: explicit 2 MiB huge pages (mmap with MAP_HUGETLB). Needs
+*    huge pages to be reserved in /proc/sys/vm/nr_hugepages.
+* 2. ARENA_THP: normal anonymous mapping aligned to 2 MiB and marked with
+*    madvise(MADV_HUGEPAGE) so transparent huge pages can back it.
+* 3. ARENA_NORMAL: plain 4 KiB pages, if madvise is refused.
+*
+* With `prefault` set every page of the arena is touched at startup so the
+* first access to a frame never takes a page fault.
+*/
+#ifndef _FRAME_ARENA_H_
+#define _FRAME_ARENA_H_
+
+#include <cstdint>
+#include <exception>
+#include <string>
+
+#define FRAME_SIZE          (4*1024)
+#define HUGE_PAGE_SIZE      (2*1024*1024)
+
+typedef enum{
+    ARENA_HUGETLB = 1,
+    ARENA_THP     = 2,
+    ARENA_NORMAL  = 4
+}arena_backing_t;
+
+class ArenaFailure: public std::exception{
+    public:
+    std::string failure_msg;
+    ArenaFailure(std::string msg){
+        failure_msg = msg;
+    }
+    inline const char* what(){
+        return failure_msg.c_str();
+    }
+};
+
+class FrameArena{
+    char*           base;
+    uint64_t        mapped_size;
+    uint64_t        frame_count;
+    arena_backing_t backing;
+    void _prefault();
+    public:
+    FrameArena(uint64_t frame_count, bool prefault);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    inline char* get_frame(uint64_t index){
+        return base + index * FRAME_SIZE;
+    }
+    inline uint64_t get_frame_count(){
+        return frame_count;
+    }
+    inline arena_backing_t get_backing(){
+        return backing;
+    }
+};
+#endif
@@ -0,0 +1,100 @@
+/*
+* Bounded lock-free Multi-Producer Single-Consumer ring.
+*
+* Used by the EventLoop as its request queue: any number of client threads
+* push Requests, only the event loop thread pops them.
+*
+* Every cell carries a sequence number:
+*    seq == pos          -> cell is free for the producer that claims `pos`
+*    seq == pos + 1      -> cell holds the item for position `pos`
+*    seq == pos + size   -> cell was consumed and is free for the next lap
+* A producer claims a position with a single CAS on `tail`, writes the item
+* and then publishes it by storing the sequence number. The consumer owns
+* `head` exclusively and never needs an atomic read-modify-write.
+*
+* The capacity is rounded up to a power of two.
+*/
+#ifndef _MPSC_RING_H_
+#define _MPSC_RING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#define MPSC_CACHE_LINE_SIZE 64
+
+template<typename T>
+class MpscRing{
+    struct cell_t{
+        std::atomic<uint64_t> seq;
+        T                     item;
+    };
+    cell_t   *cells;
+    uint64_t  mask;
+    alignas(MPSC_CACHE_LINE_SIZE) std::atomic<uint64_t> tail;
+    alignas(MPSC_CACHE_LINE_SIZE) uint64_t head;
+
+    public:
+    MpscRing(uint32_t capacity){
+        uint64_t size = 2;
+        while(size < capacity)
+            size <<= 1;
+        mask  = size - 1;
+        cells = new cell_t[size];
+        for(uint64_t i = 0; i < size; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        head = 0;
+    }
+    ~MpscRing(){
+        delete[] cells;
+    }
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Safe to call from any thread. Returns false if the ring is full.
+    bool push(T item){
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while(1){
+            cell_t  *cell = &cells[pos & mask];
+            uint64_t seq  = cell->seq.load(std::memory_order_acquire);
+            int64_t  diff = (int64_t) seq - (int64_t) pos;
+            if(diff == 0){
+                // the cell is free, try to claim it.
+                if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0){
+                // the consumer has not freed this cell yet: ring is full.
+                return false;
+            }
+            else{
+                // another producer claimed it, retry with the new tail.
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cells[pos & mask].item = item;
+        cells[pos & mask].seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Must only be called by the consumer thread.
+    bool pop(T *item){
+        cell_t  *cell = &cells[head & mask];
+        uint64_t seq  = cell->seq.load(std::memory_order_acquire);
+        if(seq != head + 1)
+            return false;
+        *item = cell->item;
+        cell->seq.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    // Must only be called by the consumer thread. An item whose producer has
+    // claimed a cell but not yet published it is not visible here; the
+    // producer's wake up covers that case.
+    bool empty(){
+        return cells[head & mask].seq.load(std::memory_order_acquire) != head + 1;
+    }
+};
+#endif
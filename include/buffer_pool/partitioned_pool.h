@@ -0,0 +1,78 @@
+/*
+* Partitioned Buffer Pool:
+* The pool is split into N independent shards. Every shard has its own frames
+* (BufferPool + FrameArena), page table and CLOCK policy (ReplacementAlgo),
+* io_uring instance (IOHandler) and EventLoop running on its own thread. Shards
+* share nothing, so page management scales with the number of shards.
+*
+* A page is owned by the shard picked by the hash of its page_loc_t.
+*
+* fetch_page():
+*    1. Hit: the page is pinned under the shard's page table latch and returned
+*       on the calling thread; no hand off to the event loop.
+*    2. Miss: a PAGE_READ Request is queued on the shard's event loop and the
+*       caller waits on it. The event loop picks the victim and reads the page
+*       in through io_uring.
+* Sequential scans (SHOWDB, audits) should fetch with ACCESS_SCAN: they then
+* cycle through each shard's small scan ring and never displace the pages
+* point lookups depend on (see ReplacementAlgo).
+*
+* release_page() drops the pin taken by fetch_page() and marks the page dirty
+* if it was modified; dirty pages are written back when they are evicted or
+* with flush_page().
+*/
+#ifndef _PARTITIONED_POOL_H_
+#define _PARTITIONED_POOL_H_
+
+#include <vector>
+#include "buffer_pool.h"
+
+#define SHARD_IO_QUEUE_DEPTH 128
+
+class BufferPoolShard{
+    BufferPool*      pool;
+    ReplacementAlgo* replacement_algo;
+    IOHandler*       io_handler;
+    EventLoop*       event_loop;
+    pthread_t        loop_thread;
+    static void* _run_loop(void* shard);
+    public:
+    BufferPoolShard(uint64_t pool_size, bool prefault, uint32_t scan_ring_frames = DEFAULT_SCAN_RING_FRAMES);
+    ~BufferPoolShard();
+    PageFrame* fetch_page(const page_loc_t& loc, page_access_t mode = ACCESS_NORMAL);
+    void release_page(PageFrame* frame, bool dirty);
+    // writes a pinned frame back to its location.
+    int flush_page(PageFrame* frame);
+    inline BufferPool* get_pool(){
+        return pool;
+    }
+    inline void stats_snapshot(pool_stats_snapshot_t* out){
+        pool->get_stats()->snapshot(out);
+    }
+};
+
+class PartitionedBufferPool{
+    std::vector<BufferPoolShard*> shards;
+    public:
+    // pool_size is the total size in bytes, split evenly across the shards.
+    // scan_ring_frames is per shard.
+    PartitionedBufferPool(uint32_t shard_count, uint64_t pool_size, bool prefault = false,
+                          uint32_t scan_ring_frames = DEFAULT_SCAN_RING_FRAMES);
+    ~PartitionedBufferPool();
+    inline uint32_t shard_of(const page_loc_t& loc){
+        // multiply-shift on the high bits instead of a modulo.
+        return (uint32_t) (((page_loc_hash(loc) >> 32) * shards.size()) >> 32);
+    }
+    inline BufferPoolShard* get_shard(uint32_t index){
+        return shards[index];
+    }
+    inline uint32_t get_shard_count(){
+        return shards.size();
+    }
+    PageFrame* fetch_page(const page_loc_t& loc, page_access_t mode = ACCESS_NORMAL);
+    void release_page(PageFrame* frame, bool dirty);
+    int flush_page(PageFrame* frame);
+    // totals over all shards; use get_shard()->stats_snapshot() for one shard.
+    void stats_snapshot(pool_stats_snapshot_t* out);
+};
+#endif
@@ -0,0 +1,106 @@
+/*
+* Buffer Pool Statistics:
+* Every BufferPool (i.e. every shard of a PartitionedBufferPool) owns one
+* PoolStats object.
+*
+* Counters are striped: each thread adds to its own cache line aligned stripe
+* with a relaxed increment, so the hit path never bounces a shared counter
+* between cores. Reading the stats sums the stripes; the result is a
+* snapshot that is exact for each counter but not across counters.
+*
+* Latency histograms are HDR style log-linear histograms: values below
+* 2^HIST_SUB_BUCKET_BITS nanoseconds get a bucket each, above that every
+* power of two is split into 2^HIST_SUB_BUCKET_BITS buckets, which bounds the
+* relative error of a reported percentile to ~6%. They are only updated on
+* the IO path.
+*
+* Snapshots can be merged (to get the totals of a partitioned pool) and
+* dumped as text or JSON.
+*/
+#ifndef _POOL_STATS_H_
+#define _POOL_STATS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define STATS_CACHE_LINE_SIZE   64
+#define STATS_STRIPES           16
+#define HIST_SUB_BUCKET_BITS    4
+#define HIST_SUB_BUCKETS        (1 << HIST_SUB_BUCKET_BITS)
+#define HIST_BUCKETS            ((64 - HIST_SUB_BUCKET_BITS + 1) * HIST_SUB_BUCKETS)
+
+typedef enum{
+    STAT_HITS             = 0,
+    STAT_MISSES           = 1,
+    STAT_EVICTIONS        = 2,
+    STAT_DIRTY_WRITEBACKS = 3,
+    STAT_PIN_WAITS        = 4,
+    STAT_READ_ERRORS      = 5,
+    STAT_WRITE_ERRORS     = 6,
+    STAT_SCAN_READS       = 7,
+    STAT_COUNTER_COUNT    = 8
+}pool_counter_t;
+
+uint64_t stats_now_ns();
+
+typedef struct{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+}histogram_snapshot_t;
+
+uint64_t histogram_percentile(const histogram_snapshot_t* hist, double percentile);
+
+class LatencyHistogram{
+    std::atomic<uint64_t> buckets[HIST_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+    public:
+    LatencyHistogram();
+    static uint32_t bucket_of(uint64_t value);
+    static uint64_t bucket_floor(uint32_t bucket);
+    void record(uint64_t value);
+    void snapshot(histogram_snapshot_t* out);
+};
+
+typedef struct{
+    uint64_t counters[STAT_COUNTER_COUNT];
+    uint64_t queue_depth;
+    uint64_t max_queue_depth;
+    uint64_t frames;
+    histogram_snapshot_t read_latency;
+    histogram_snapshot_t write_latency;
+}pool_stats_snapshot_t;
+
+void stats_snapshot_merge(pool_stats_snapshot_t* into, const pool_stats_snapshot_t* from);
+std::string stats_snapshot_to_text(const pool_stats_snapshot_t* snap);
+std::string stats_snapshot_to_json(const pool_stats_snapshot_t* snap);
+
+class PoolStats{
+    struct alignas(STATS_CACHE_LINE_SIZE) stripe_t{
+        std::atomic<uint64_t> counters[STAT_COUNTER_COUNT];
+    };
+    stripe_t stripes[STATS_STRIPES];
+    alignas(STATS_CACHE_LINE_SIZE) std::atomic<uint64_t> queue_depth;
+    std::atomic<uint64_t> max_queue_depth;
+    uint64_t frames;
+    static uint32_t _my_stripe();
+    public:
+    LatencyHistogram read_latency;
+    LatencyHistogram write_latency;
+    PoolStats(uint64_t frames);
+    inline void add(pool_counter_t counter, uint64_t value = 1){
+        stripes[_my_stripe()].counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+    // only called by the event loop thread.
+    inline void set_queue_depth(uint64_t depth){
+        queue_depth.store(depth, std::memory_order_relaxed);
+        if(depth > max_queue_depth.load(std::memory_order_relaxed))
+            max_queue_depth.store(depth, std::memory_order_relaxed);
+    }
+    void snapshot(pool_stats_snapshot_t* out);
+};
+#endif
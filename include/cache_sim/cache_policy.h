@@ -0,0 +1,132 @@
+/*
+* Replacement policies for trace driven simulation.
+*
+* Every policy implements CachePolicy::access(): it is told which page is
+* referenced next and answers whether the page was resident, evicting as it
+* sees fit. Only page numbers are tracked; there are no frames or data.
+*
+* 1. LruPolicy:   least recently used.
+* 2. ClockPolicy: one reference bit per frame, second chance (what the
+*                 BufferPool uses).
+* 3. ArcPolicy:   Megiddo & Modha's ARC: recency (T1) and frequency (T2)
+*                 lists plus their ghosts (B1, B2), with the target size of
+*                 T1 adapted on ghost hits.
+* 4. TwoQPolicy:  Johnson & Shasha's full 2Q: a FIFO for first references
+*                 (A1in, 25% of the cache), a ghost FIFO of pages evicted
+*                 from it (A1out, 50% of the cache) and an LRU (Am) for pages
+*                 re-referenced while in A1out.
+* 5. LirsPolicy:  the LIRS from lirs/, with a configurable HIR share, or
+*                 adaptive sizing that starts from that share, optionally
+*                 behind the TinyLFU admission filter.
+*
+* LIRS uses its own flat hash index; the others use std::unordered_map, so
+* their ns/access is an upper bound for a tuned implementation.
+*/
+#ifndef _CACHE_POLICY_H_
+#define _CACHE_POLICY_H_
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lirs.h"
+
+class CachePolicy{
+    public:
+    virtual ~CachePolicy(){}
+    // returns true on a hit.
+    virtual bool access(uint32_t page_no) = 0;
+    virtual std::string name() = 0;
+};
+
+class LruPolicy: public CachePolicy{
+    uint32_t capacity;
+    std::list<uint32_t> lru;        // front is the most recent
+    std::unordered_map<uint32_t, std::list<uint32_t>::iterator> index;
+    public:
+    LruPolicy(uint32_t capacity);
+    bool access(uint32_t page_no);
+    std::string name(){
+        return "LRU";
+    }
+};
+
+class ClockPolicy: public CachePolicy{
+    struct frame_t{
+        uint32_t page_no;
+        bool     ref_bit;
+    };
+    uint32_t capacity;
+    uint32_t hand;
+    std::vector<frame_t> frames;
+    std::unordered_map<uint32_t, uint32_t> index;   // page -> frame
+    public:
+    ClockPolicy(uint32_t capacity);
+    bool access(uint32_t page_no);
+    std::string name(){
+        return "CLOCK";
+    }
+};
+
+class ArcPolicy: public CachePolicy{
+    typedef enum {
+        ARC_T1 = 0,
+        ARC_T2 = 1,
+        ARC_B1 = 2,
+        ARC_B2 = 3
+    }arc_list_t;
+    struct arc_entry_t{
+        arc_list_t list;
+        std::list<uint32_t>::iterator pos;
+    };
+    uint32_t capacity;
+    uint32_t target_t1;             // p in the paper
+    std::list<uint32_t> lists[4];   // front is the most recent
+    std::unordered_map<uint32_t, arc_entry_t> index;
+    void _move_to(uint32_t page_no, arc_entry_t *entry, arc_list_t to);
+    void _drop_lru(arc_list_t from);
+    void _replace(bool in_b2);
+    public:
+    ArcPolicy(uint32_t capacity);
+    bool access(uint32_t page_no);
+    std::string name(){
+        return "ARC";
+    }
+};
+
+class TwoQPolicy: public CachePolicy{
+    typedef enum {
+        TWOQ_A1IN  = 0,
+        TWOQ_A1OUT = 1,
+        TWOQ_AM    = 2
+    }twoq_list_t;
+    struct twoq_entry_t{
+        twoq_list_t list;
+        std::list<uint32_t>::iterator pos;
+    };
+    uint32_t capacity;
+    uint32_t kin;
+    uint32_t kout;
+    std::list<uint32_t> lists[3];   // front is the newest
+    std::unordered_map<uint32_t, twoq_entry_t> index;
+    void _reclaim();
+    public:
+    TwoQPolicy(uint32_t capacity);
+    bool access(uint32_t page_no);
+    std::string name(){
+        return "2Q";
+    }
+};
+
+class LirsPolicy: public CachePolicy{
+    LIRS lirs;
+    double hir_share;
+    public:
+    // hir_share is the fraction of the cache given to resident HIR blocks,
+    // at least one block.
+    LirsPolicy(uint32_t capacity, double hir_share, bool adaptive = false, bool admission = false);
+    bool access(uint32_t page_no);
+    std::string name();
+};
+#endif
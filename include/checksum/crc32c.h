@@ -0,0 +1,32 @@
+/*
+* CRC32C (Castagnoli), the checksum of the log records and of the pages.
+*
+* crc32c() continues `crc` over `data`: crc32c(crc32c(0, a), b) is the
+* checksum of a followed by b, and 0 starts a new one. On x86-64 CPUs with
+* SSE4.2 it uses the crc32 instruction, eight bytes at a time in three
+* independent streams so the instruction's latency is hidden; that checks a
+* 4 KiB page in well under a microsecond. Elsewhere it falls back to a
+* table driven version that takes eight bytes per step (slicing-by-8). The
+* choice is made once, on the first call.
+*
+* Usable from C (b_storage) and C++.
+*/
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+uint32_t crc32c_software(uint32_t crc, const void *data, size_t length);
+// 1 if crc32c() uses the crc32 instruction.
+int crc32c_hardware(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
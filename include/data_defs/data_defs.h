@@ -1,8 +1,7 @@
 #ifndef __DATA_DEFS_H__
+#define __DATA_DEFS_H__
 
 #include <sys/types.h>
-
-#endif
 #define USERID_LENGTH  48
 #define PASSWD_LENGTH  16
 
@@ -30,4 +29,5 @@ typedef struct{
     char user_id[USERID_LENGTH];
     char passwd[PASSWD_LENGTH];
     amount_t  balance;
-} db_entry_t;
\ No newline at end of file
+} db_entry_t;
+#endif
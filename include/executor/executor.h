@@ -0,0 +1,94 @@
+/*
+* Batched execution of client requests (request_data_t) against the b-tree.
+*
+* execute() takes a batch of requests and fills one result per request.
+* The batch is cut into runs of DEPOSIT and WITHDRAW requests; every other
+* request ends a run and is executed by itself, in batch order. Within a
+* run the requests are sorted by account (stable, so each account still
+* sees its requests in batch order) and executed account by account:
+*
+*   - an account's requests are applied one after the other to its entry,
+*     a withdrawal that would overdraw the account fails on its own;
+*   - the page holding an account is kept after its requests are done.
+*     Accounts come in key order, so the next one is usually on the same
+*     page, which is searched before the tree is traversed again. A page is
+*     written back once, when the run moves off it.
+*
+* A run of N requests on A accounts spread over P pages thus costs about P
+* traversals and P page writes instead of N of each.
+*
+* CREATE opens an account with a zero balance (passwd from the request),
+* DELETE removes one, SHOWDB reports the number of accounts and the sum of
+* all balances. STOP ends the batch: it succeeds and nothing after it is
+* executed.
+*
+* Given a BalanceIndex, the executor keeps it up to date: one update() per
+* account of a run, and on CREATE and DELETE.
+*
+* Given a BloomFilter, an account the filter rules out is not looked up:
+* its deposits and withdrawals and a DELETE of it fail with NOT_FOUND, and
+* CREATE inserts it without the existence check. CREATE and DELETE keep
+* the filter up to date, and every page write goes through the filter's
+* storage latch so that its rebuild never scans a page being written.
+*
+* Like b_storage, an executor is single threaded. Pages are written in
+* place and not synced; LoggedStore is the durable path for the deltas.
+*/
+#ifndef _EXECUTOR_H_
+#define _EXECUTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+extern "C"{
+#include "b_storage.h"
+}
+#include "balance_index.h"
+#include "bloom_filter.h"
+
+typedef enum{
+    REQUEST_OK           = 0,
+    REQUEST_NOT_FOUND    = 1,
+    REQUEST_EXISTS       = 2,
+    REQUEST_INSUFFICIENT = 3,   // the withdrawal would overdraw the account
+    REQUEST_INVALID      = 4,
+    REQUEST_FAILED       = 5,   // the storage failed
+    REQUEST_SKIPPED      = 6    // after a STOP
+} request_status_t;
+
+typedef struct{
+    request_status_t status;
+    // DEPOSIT/WITHDRAW: the balance afterwards. SHOWDB: the sum of all
+    // balances, `accounts` the number of accounts.
+    amount_t balance;
+    uint64_t accounts;
+}request_result_t;
+
+typedef struct{
+    uint64_t batches;
+    uint64_t requests;
+    uint64_t traversals;        // btree_find() calls
+    uint64_t page_hits;         // accounts found on the page at hand
+    uint64_t filtered;          // lookups the bloom filter answered
+    uint64_t page_writes;
+}executor_stats_t;
+
+class RequestExecutor{
+    int db_file;
+    BalanceIndex *index;
+    BloomFilter *filter;
+    executor_stats_t stats;
+    std::vector<uint32_t> order;
+
+    void _apply_deltas(const request_data_t *requests, size_t begin, size_t end, request_result_t *results);
+    void _create(const request_data_t *request, request_result_t *result);
+    void _delete(const request_data_t *request, request_result_t *result);
+    void _show(request_result_t *result);
+    public:
+    RequestExecutor(int db_file, BalanceIndex *index = NULL, BloomFilter *filter = NULL);
+    // returns how many requests were executed: `count`, or up to and
+    // including the first STOP.
+    size_t execute(const request_data_t *requests, size_t count, request_result_t *results);
+    executor_stats_t get_stats();
+};
+#endif
@@ -0,0 +1,107 @@
+/*
+* Extendible hash index on user_id: an access method for exact-match
+* lookups next to the b-tree.
+*
+* The file uses the b-tree's page format: PAGE_SIZE pages holding
+* db_entry_t tuples, with the page trailer (checksum, page_lsn) written and
+* verified through page_checksum(). Page 0 is the file header; every other
+* page is a bucket:
+*
+*   count | local_depth | pattern | entries[HASH_BUCKET_CAPACITY] | trailer
+*
+* The directory lives in memory only: 2^global_depth slots, slot i pointing
+* at the bucket whose `pattern` equals the low local_depth bits of i. A
+* bucket records its own depth and pattern, so open rebuilds the directory
+* by reading every bucket once and nothing has to be kept consistent on
+* disk besides the buckets themselves. A split cut short by a crash is
+* finished on open; a directory slot left without a bucket fails it.
+*
+* A lookup hashes the user_id, takes the directory slot of the low
+* global_depth bits and reads that one bucket page; an update reads and
+* writes it. A full bucket is split: its entries are divided by hash bit
+* local_depth between it and a new bucket appended to the file, both get
+* local_depth + 1, and the directory doubles first if the bucket was
+* already at the global depth.
+*
+* Like b_storage, an index is single threaded. Pages are written in place
+* and not synced.
+*/
+#ifndef _HASH_INDEX_H_
+#define _HASH_INDEX_H_
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+extern "C"{
+#include "b_storage.h"
+}
+
+#define HASH_INDEX_MAGIC        0x5844494853414842ULL      // "BHASHIDX"
+#define HASH_MAX_DEPTH          26          // a 256 MiB directory
+#define HASH_BUCKET_HEADER_SIZE 16
+#define HASH_BUCKET_CAPACITY    ((PAGE_CHECKSUM_OFFSET - HASH_BUCKET_HEADER_SIZE) / (int) sizeof(db_entry_t))   // 56
+
+typedef struct{
+    uint32_t   count;
+    uint32_t   local_depth;
+    uint64_t   pattern;             // low local_depth bits of its hashes
+    db_entry_t entries[HASH_BUCKET_CAPACITY];
+}hash_bucket_t;
+
+typedef struct{
+    uint64_t magic;
+    uint64_t version;
+    uint64_t buckets;
+}hash_file_header_t;
+
+typedef struct{
+    uint64_t entries;
+    uint64_t buckets;
+    uint32_t global_depth;
+    uint64_t page_reads;
+    uint64_t page_writes;
+    uint64_t splits;
+    uint64_t doublings;
+}hash_index_stats_t;
+
+class HashIndexFailure: public std::exception{
+    public:
+    std::string failure_msg;
+    HashIndexFailure(std::string msg){
+        failure_msg = msg;
+    }
+    inline const char* what() const noexcept{
+        return failure_msg.c_str();
+    }
+};
+
+class HashIndex{
+    int fd;
+    uint32_t global_depth;
+    std::vector<page_ptr_t> directory;
+    hash_index_stats_t stats;
+    char *page;                     // the bucket at hand
+
+    hash_bucket_t* _read(page_ptr_t page_loc);
+    int _write(page_ptr_t page_loc, char *buffer);
+    int _find(const char *user_id, uint64_t hash, page_ptr_t *page_loc);
+    int _split(page_ptr_t page_loc);
+    int _finish_split(page_ptr_t page_loc, uint32_t *count);
+    int _write_header();
+    public:
+    // opens or creates the index file; throws HashIndexFailure.
+    HashIndex(const char *path);
+    ~HashIndex();
+    HashIndex(const HashIndex&) = delete;
+    HashIndex& operator=(const HashIndex&) = delete;
+    // -1 if there is no such account.
+    int find(const char *user_id, db_entry_t *entry);
+    // -1 if the account exists already.
+    int insert(const db_entry_t *entry);
+    // replaces the account's entry; -1 if there is no such account.
+    int update(const db_entry_t *entry);
+    int remove(const char *user_id);
+    hash_index_stats_t get_stats();
+};
+#endif
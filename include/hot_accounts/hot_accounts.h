@@ -0,0 +1,126 @@
+/*
+* Commutative balance updates for hot accounts.
+*
+* A handful of merchant accounts take most of the DEPOSIT traffic. With an
+* exclusive lock (or a latch) on their db_entry_t every deposit waits for
+* the one before it. Deposits commute, so a hot account does without:
+*
+*   - deposit() adds the amount to one of HOT_SLOTS per-thread delta slots,
+*     each on a cache line of its own. Threads take slots round robin, so
+*     concurrent depositors never write the same line.
+*   - The slots are merged into the account's `base` balance on read(), when
+*     a withdrawal runs short, and by a background thread every
+*     `merge_interval_ms` (none if 0; merge() then has to be called).
+*   - Withdrawals go through escrow: `available` is what may still be taken
+*     out, the merged balance minus the reservations outstanding. reserve()
+*     takes the amount out of `available` with a compare-and-swap, or
+*     merges the slots once and tries again, or fails; commit_reservation()
+*     then takes it off `base`, cancel_reservation() gives it back to
+*     `available`. Merging adds to `base` before `available`, so the balance
+*     never drops below what is reserved and never goes negative.
+*     withdraw() is reserve() and commit_reservation() in one.
+*
+* An account becomes hot with promote(), which reads its balance through
+* `loader`. merge() writes every balance that changed since the last
+* write back through `writer`; both wrap b_storage (btree_find() and a page
+* write), so the caller has to keep them from running concurrently with
+* its own b-tree accesses. A hot account's entry in the b-tree lags its
+* balance until then: DEPOSIT and WITHDRAW for it have to come here.
+*
+* Not durable: HOT_OK only means the amount is in memory. Nothing is
+* logged, so a crash loses every deposit and withdrawal made since the
+* last write back (the last `merge_interval_ms` or so); a caller that
+* needs one on disk has to wait for merge() to return 0. The write back goes
+* to the page directly, not through LoggedStore and the write-ahead log:
+* it leaves page_lsn alone, so recovery could redo logged updates on top
+* of it. A database run with LoggedStore must not have hot accounts.
+*/
+#ifndef _HOT_ACCOUNTS_H_
+#define _HOT_ACCOUNTS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "data_defs.h"
+
+#define HOT_SLOTS               64
+#define HOT_TABLE_SIZE          1024        // power of 2; at most half full
+#define HOT_MERGE_INTERVAL_MS   10
+
+// 0 and the balance if found, -1 if the account does not exist.
+typedef int (*hot_loader_t)(void *ctx, const char *user_id, amount_t *balance);
+typedef int (*hot_writer_t)(void *ctx, const char *user_id, amount_t balance);
+
+typedef enum{
+    HOT_OK           = 0,   // applied in memory, see "Not durable" above
+    HOT_NOT_HOT      = 1,   // not promoted: take the normal path
+    HOT_INSUFFICIENT = 2
+} hot_status_t;
+
+struct alignas(64) hot_slot_t{
+    std::atomic<int64_t>  credit;       // not merged yet
+    std::atomic<uint64_t> deposits;
+};
+
+struct hot_account_t{
+    char        user_id[USERID_LENGTH];
+    hot_slot_t  slots[HOT_SLOTS];
+    alignas(64) std::atomic<int64_t> base;
+    std::atomic<int64_t> available;
+    std::atomic<uint64_t> withdrawals;
+    std::atomic<uint64_t> insufficient;
+    std::mutex  merge_latch;
+    int64_t     written;                // balance last written back
+};
+
+typedef struct{
+    uint64_t accounts;
+    uint64_t deposits;
+    uint64_t withdrawals;
+    uint64_t insufficient;
+    uint64_t merges;
+    uint64_t write_backs;
+}hot_stats_t;
+
+class HotAccounts{
+    hot_loader_t loader;
+    hot_writer_t writer;
+    void *ctx;
+    std::atomic<hot_account_t*> table[HOT_TABLE_SIZE];
+    std::mutex latch;                   // promote() and merge()
+    uint64_t accounts;
+    std::atomic<uint64_t> merges;
+    uint64_t write_backs;
+    uint32_t merge_interval_ms;
+    std::mutex merger_latch;
+    std::condition_variable merger_cond;
+    bool stopping;
+    std::thread merger;
+
+    hot_account_t* _find(const char *user_id);
+    void _merge(hot_account_t *account);
+    void _run_merger();
+    public:
+    HotAccounts(hot_loader_t loader, hot_writer_t writer, void *ctx,
+                uint32_t merge_interval_ms = HOT_MERGE_INTERVAL_MS);
+    // stops the merger and writes every balance back.
+    ~HotAccounts();
+    HotAccounts(const HotAccounts&) = delete;
+    HotAccounts& operator=(const HotAccounts&) = delete;
+    // -1 if the account does not exist or the table is full.
+    int promote(const char *user_id);
+    bool is_hot(const char *user_id);
+    hot_status_t deposit(const char *user_id, amount_t amount);
+    hot_status_t withdraw(const char *user_id, amount_t amount);
+    hot_status_t reserve(const char *user_id, amount_t amount);
+    hot_status_t commit_reservation(const char *user_id, amount_t amount);
+    hot_status_t cancel_reservation(const char *user_id, amount_t amount);
+    hot_status_t read(const char *user_id, amount_t *balance);
+    // merges every account and writes back the balances that changed;
+    // -1 if a write back failed.
+    int merge();
+    hot_stats_t get_stats();
+};
+#endif
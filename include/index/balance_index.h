@@ -0,0 +1,68 @@
+/*
+* Secondary index on db_entry_t.balance.
+*
+* An ordered set of (balance, user_id) pairs, plus each account's indexed
+* balance so that an update can find the pair it replaces. "Accounts with a
+* balance between X and Y" is a lower_bound() and a walk, "the top N
+* balances" a walk from the end: O(log n + answers) where the b-tree, keyed
+* on user_id, has to visit every page.
+*
+* The index is kept up to date by whoever changes balances: build() fills
+* it from the b-tree once, RequestExecutor (given the index) calls update()
+* after each account's DEPOSITs and WITHDRAWs of a run and on CREATE, and
+* remove() on DELETE. Ties are ordered by user_id.
+*
+* Queries take the latch shared, updates exclusive, so reports may run on
+* other threads while the executor works.
+*/
+#ifndef _BALANCE_INDEX_H_
+#define _BALANCE_INDEX_H_
+
+#include <cstddef>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+extern "C"{
+#include "b_storage.h"
+}
+
+typedef struct{
+    char     user_id[USERID_LENGTH];
+    amount_t balance;
+}balance_entry_t;
+
+typedef struct{
+    uint64_t accounts;
+    uint64_t updates;
+    uint64_t queries;
+}balance_index_stats_t;
+
+class BalanceIndex{
+    typedef std::pair<amount_t, std::string> index_key_t;
+    std::set<index_key_t> ordered;
+    std::unordered_map<std::string, amount_t> balances;
+    std::shared_mutex latch;
+    uint64_t updates;
+    uint64_t queries;
+
+    static void _fill(const index_key_t& key, balance_entry_t *entry);
+    static int _add_entry(void *ctx, const db_entry_t *entry);
+    public:
+    BalanceIndex();
+    // replaces the contents with every account of the b-tree; -1 if a page
+    // could not be read.
+    int build(int db_file);
+    // sets the account's balance, adding the account if it is new.
+    void update(const char *user_id, amount_t balance);
+    void remove(const char *user_id);
+    // balances in [low, high], lowest first, at most `limit` of them.
+    // Returns how many were put in `out`.
+    size_t range(amount_t low, amount_t high, size_t limit, std::vector<balance_entry_t>& out);
+    // the n highest balances, highest first.
+    size_t top(size_t n, std::vector<balance_entry_t>& out);
+    balance_index_stats_t get_stats();
+};
+#endif
@@ -0,0 +1,41 @@
+/*
+* Page access traces for evaluating replacement policies.
+*
+* A trace is a vector of page numbers. Synthetic traces are generated from a
+* seed so that every policy replays exactly the same sequence:
+* 1. uniform:     every page in [0, pages) equally likely.
+* 2. zipf:        page i is accessed with probability ~ 1/(i+1)^theta.
+* 3. scan_hotset: random accesses to a small hot set mixed with a sequential
+*                 scan over a much larger cold range.
+* 4. loop:        0, 1, ..., pages-1, 0, 1, ... (the LRU worst case when the
+*                 loop is larger than the cache).
+* 5. one_hit:     zipf over [0, pages) with a share of accesses replaced by
+*                 pages above that range that are never accessed again, like
+*                 the accounts a batch job touches once.
+*
+* Recorded traces are read by trace_load(): a text file with one access per
+* line whose first field is the page (or block) number, in decimal or 0x
+* hex. Empty lines and lines starting with '#' are skipped. Page numbers are
+* renumbered densely in order of first appearance, which no policy can tell
+* apart from the original numbering.
+*/
+#ifndef _ACCESS_TRACE_H_
+#define _ACCESS_TRACE_H_
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+typedef std::vector<uint32_t> access_trace_t;
+
+void trace_uniform(access_trace_t* trace, uint64_t count, uint32_t pages, uint64_t seed);
+void trace_zipf(access_trace_t* trace, uint64_t count, uint32_t pages, double theta, uint64_t seed);
+// hot_ratio is the fraction of accesses that go to the hot set.
+void trace_scan_hotset(access_trace_t* trace, uint64_t count, uint32_t hot_pages,
+                       uint32_t scan_pages, double hot_ratio, uint64_t seed);
+void trace_loop(access_trace_t* trace, uint64_t count, uint32_t pages);
+void trace_one_hit(access_trace_t* trace, uint64_t count, uint32_t pages, double theta,
+                   double one_hit_ratio, uint64_t seed);
+// returns the number of distinct pages, or -1 if the file can not be read.
+int64_t trace_load(access_trace_t* trace, const char* path);
+#endif
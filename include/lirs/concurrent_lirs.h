@@ -0,0 +1,86 @@
+/*
+* LIRS that can be shared by many threads without serialising the hits.
+*
+* The exact LIRS stays single threaded behind `latch`; what is taken off the
+* latch is the hit path:
+* 1. Residency is answered by resident_set_t, an open addressing set of the
+*    resident page numbers that readers probe with plain atomic loads. Only
+*    the latch holder inserts or erases; an erased key becomes a tombstone
+*    so concurrent probes never lose their chain.
+* 2. A hit is not applied to the LIRS stack right away. It is pushed to one
+*    of HIT_BUFFER_STRIPES MpscRings (one per thread, modulo the stripe
+*    count) and replayed in order into LIRS::touch() later. A thread whose
+*    ring is full drains all the rings if it gets the latch with try_lock;
+*    if it does not, the hit is dropped, so a hit never waits on the latch.
+*    The push itself is a CAS loop on the ring's tail: the hit path is
+*    lock-free, not wait-free, and a producer may retry while others win.
+* 3. A miss takes the latch, replays every pending hit first and then runs
+*    LIRS::get_page(), which decides authoritatively whether it was a hit.
+*
+* The replay lag is at most HIT_BUFFER_SIZE hits per stripe, which moves the
+* hit ratio by much less than the difference between LIRS and CLOCK. A page
+* evicted while a thread is probing the set may still be reported as a hit;
+* a page made resident while it is probing may be reported by the slow path.
+*/
+#ifndef _CONCURRENT_LIRS_H_
+#define _CONCURRENT_LIRS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include "lirs.h"
+#include "mpsc_ring.h"
+
+#define HIT_BUFFER_STRIPES      16
+#define HIT_BUFFER_SIZE         64
+
+class resident_set_t{
+    static const int64_t EMPTY     = -1;
+    static const int64_t TOMBSTONE = -2;
+    std::atomic<int64_t> *slots;
+    uint64_t mask;
+    uint32_t shift;
+    uint64_t used;          // live keys plus tombstones, latch holder only
+    uint64_t live;
+    inline uint64_t _home(int64_t key){
+        return ((uint64_t) key * 0x9e3779b97f4a7c15ULL) >> shift;
+    }
+    void _rebuild();
+    public:
+    resident_set_t(uint64_t max_keys);
+    ~resident_set_t();
+    resident_set_t(const resident_set_t&) = delete;
+    resident_set_t& operator=(const resident_set_t&) = delete;
+    // safe from any thread.
+    bool contains(int64_t key);
+    // latch holder only.
+    void insert(int64_t key);
+    void erase(int64_t key);
+};
+
+class ConcurrentLIRS{
+    struct alignas(MPSC_CACHE_LINE_SIZE) hit_buffer_t{
+        MpscRing<uint32_t> ring;
+        hit_buffer_t(): ring(HIT_BUFFER_SIZE){}
+    };
+    LIRS lirs;
+    std::mutex latch;
+    resident_set_t resident;
+    hit_buffer_t hit_buffers[HIT_BUFFER_STRIPES];
+    std::atomic<uint64_t> dropped_hits;
+
+    static uint32_t _my_stripe();
+    void _drain_hits();
+    bool _access_locked(uint32_t page_no);
+    public:
+    ConcurrentLIRS(uint32_t lir_blk_sz, uint32_t hir_blk_sz);
+    ConcurrentLIRS(const ConcurrentLIRS&) = delete;
+    ConcurrentLIRS& operator=(const ConcurrentLIRS&) = delete;
+    // returns true if page_no was resident. Safe from any thread.
+    bool access(uint32_t page_no);
+    // hits that were counted but never replayed because their ring was full.
+    uint64_t get_dropped_hits(){
+        return dropped_hits.load(std::memory_order_relaxed);
+    }
+};
+#endif
@@ -0,0 +1,334 @@
+/*
+* LIRS replacement policy.
+*
+* Data structures:
+* 1. The LIRS stack (lirs_queue): LIR blocks and the resident HIR blocks
+*    whose recency is smaller than that of the bottom LIR block.
+*    push_front() puts a block on the top, back() is the bottom.
+* 2. The HIR queue (hir_queue): all resident HIR blocks in FIFO order. front()
+*    is the next block to be evicted.
+* 3. The ghosts (ghost_table_t): the non-resident HIR blocks of the stack.
+*
+* Both queues are intrusive doubly linked lists: a page_entry_t carries its
+* own links for the stack (prev/next) and for the HIR queue (hir_prev/
+* hir_next), so moving a block costs a few pointer writes and never walks a
+* list.
+*
+* Every access stamps the block with a clock that only grows, and the stack
+* is ordered by that stamp. A non-resident block is in the stack exactly when
+* its stamp is larger than that of the bottom LIR block, so a ghost needs no
+* stack link and no entry: it is a 24 bit fingerprint of the page number and
+* the 40 bit stamp of its last access, packed into one word of a set
+* associative table. Ghosts below the bottom LIR are pruned implicitly, and
+* the table holds at most ghost_factor * cache size of them; a full set drops
+* a pruned ghost or, failing that, the oldest one. A fingerprint collision
+* only makes a cold miss look like a stack hit.
+*
+* Entries exist for resident blocks only. They come from a slab
+* (page_entry_slab_t) sized to the cache and are recycled through a free
+* list. page_entries is an open addressing hash table (linear probing with
+* backward shift deletion) from page number to entry. The policy's memory is
+* proportional to the cache size, whatever the number of distinct pages, and
+* once warm an access costs O(1) and does no allocation.
+*
+* Adaptive sizing: with `adaptive` set, the split between LIR blocks and
+* resident HIR blocks moves at runtime. Each split of ADAPT_HIR_PERCENT
+* within the HIR bounds is simulated by a miniature: a fixed split LIRS of
+* 1/sampling of the cache size that sees the 1/sampling of the pages whose
+* hash falls below `sample_below`. A miniature's hit ratio follows that of
+* the full cache with its split, and as all of them see the same accesses
+* they compare the splits on the current workload, however much a shift
+* moves the hit ratio itself. Every ADAPT_EPOCH_SAMPLES sampled accesses
+* their hits are added to scores that halve each epoch, and lir_target goes
+* to the split with the best score once it beats the current one by
+* ADAPT_MARGIN. The miniatures cost the number of splits / sampling extra
+* accesses per access. The target is realised lazily: a HIR block promoted
+* to LIR skips the demotion of the bottom LIR block to grow the LIR set, or
+* demotes a second one to shrink it; without promotions, a cold miss comes
+* in as LIR or demotes the bottom LIR block. The HIR set stays within
+* [hir_min, hir_max], 1% and 50% of the cache by default.
+*
+* Admission: set_admission(true) puts a TinyLFU sketch (tiny_lfu.h) in
+* front of the cold misses. A missed page that has no ghost in the stack is
+* admitted only if the sketch rates it above the HIR queue front, which it
+* would evict. A rejected page is not cached (get_page() returns NULL), but
+* it leaves a ghost, so a second access soon after is a stack hit and gets
+* in as LIR like any block with a small IRR.
+*/
+#ifndef _LIRS_H_
+#define _LIRS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <vector>
+#include "tiny_lfu.h"
+
+#define ADAPT_HIR_PERCENT       {1, 2, 5, 10, 20, 30, 50}
+#define ADAPT_MIN_SAMPLING      16
+#define ADAPT_MINI_PAGES        1024    // miniature size once the cache is large
+#define ADAPT_EPOCH_SAMPLES     4096
+#define ADAPT_MARGIN            0.003   // relative score a new split has to win by
+
+#define GHOST_WAYS              8
+#define GHOST_DEFAULT_FACTOR    2
+
+class LIRS_bad_algo: public std::exception{
+    private:
+    char *msg;
+
+    public:
+    LIRS_bad_algo(char *msg){
+        this->msg = msg;
+    }
+    char* what(){
+        return msg;
+    }
+};
+
+typedef enum {
+    LIR = 1,
+    HIR = 2,
+    INVALID = 4
+}block_type;
+
+typedef enum {
+    NOT_IN_QUEUE = 0,
+    HIR_QUEUE  = 1,
+    LIRS_QUEUE = 2
+} lirs_location_t;
+
+struct page_entry_t{
+    block_type blk_type = INVALID;
+    int64_t page_num = -1;
+    page_entry_t* next = NULL;
+    page_entry_t* prev = NULL;
+    page_entry_t* hir_next = NULL;
+    page_entry_t* hir_prev = NULL;
+
+    uint8_t location = NOT_IN_QUEUE;
+    bool in_memory = false;
+    uint64_t stamp = 0;             // LIRS::access_clock at the last access
+
+    page_entry_t(){}
+    void reset(int64_t page_no){
+        page_num  = page_no;
+        next = prev = hir_next = hir_prev = NULL;
+        location  = NOT_IN_QUEUE;
+        in_memory = false;
+        blk_type  = INVALID;
+    }
+};
+
+template<page_entry_t* page_entry_t::*NEXT, page_entry_t* page_entry_t::*PREV>
+class intrusive_queue_t{
+    private:
+    page_entry_t head;
+    page_entry_t tail;
+
+    public:
+    intrusive_queue_t(){
+        head.*NEXT = &tail;
+        tail.*PREV = &head;
+    }
+    intrusive_queue_t(const intrusive_queue_t&) = delete;
+    intrusive_queue_t& operator=(const intrusive_queue_t&) = delete;
+
+    inline bool empty(){
+        return head.*NEXT == &tail;
+    }
+
+    inline void push_front(page_entry_t *page){
+        page_entry_t *prev = tail.*PREV;
+        prev->*NEXT = page;
+        page->*PREV = prev;
+        page->*NEXT = &tail;
+        tail.*PREV  = page;
+    }
+
+    inline void push_back(page_entry_t *page){
+        page_entry_t *next = head.*NEXT;
+        head.*NEXT  = page;
+        page->*PREV = &head;
+        page->*NEXT = next;
+        next->*PREV = page;
+    }
+
+    inline void remove(page_entry_t *page){
+        page_entry_t *prev = page->*PREV;
+        prev->*NEXT = page->*NEXT;
+        (page->*NEXT)->*PREV = prev;
+        page->*NEXT = page->*PREV = NULL;
+    }
+
+    inline page_entry_t *back(){
+        return head.*NEXT;
+    }
+
+    inline page_entry_t *front(){
+        return tail.*PREV;
+    }
+    inline page_entry_t *pop_back(){
+        page_entry_t *ret = back();
+        remove(ret);
+        return ret;
+    }
+    inline page_entry_t *pop_front(){
+        page_entry_t *ret = front();
+        remove(ret);
+        return ret;
+    }
+    // walks from front (top) to back (bottom).
+    template<typename F>
+    void for_each(F fn){
+        for(page_entry_t *e = tail.*PREV; e != &head; e = e->*PREV)
+            fn(e);
+    }
+};
+
+// the LIRS stack: front() is the top, back() is the bottom.
+typedef intrusive_queue_t<&page_entry_t::next, &page_entry_t::prev> lirs_queue_t;
+// the resident HIR queue: push_back() enqueues, front() is the oldest.
+typedef intrusive_queue_t<&page_entry_t::hir_next, &page_entry_t::hir_prev> hir_queue_t;
+
+class page_entry_slab_t{
+    std::vector<page_entry_t*> chunks;
+    page_entry_t *free_list;
+    size_t chunk_size;
+    size_t in_use;
+    void _grow();
+    public:
+    page_entry_slab_t(size_t initial);
+    ~page_entry_slab_t();
+    page_entry_t *alloc(int64_t page_no);
+    void release(page_entry_t *entry);
+    inline size_t get_in_use(){
+        return in_use;
+    }
+    inline size_t get_capacity(){
+        return chunks.size() * chunk_size;
+    }
+};
+
+class page_index_t{
+    struct slot_t{
+        int64_t       key;
+        page_entry_t *entry;   // NULL marks an empty slot
+    };
+    slot_t  *slots;
+    uint64_t mask;
+    uint32_t shift;
+    uint64_t count;
+    inline uint64_t _home(int64_t key){
+        // fibonacci hashing: the high bits of the product are the best mixed.
+        return ((uint64_t) key * 0x9e3779b97f4a7c15ULL) >> shift;
+    }
+    void _resize(uint64_t capacity);
+    public:
+    page_index_t(uint64_t expected);
+    ~page_index_t();
+    page_entry_t *find(int64_t key);
+    void insert(int64_t key, page_entry_t *entry);
+    void erase(int64_t key);
+    inline uint64_t size(){
+        return count;
+    }
+    inline uint64_t get_capacity(){
+        return mask + 1;
+    }
+};
+
+class ghost_table_t{
+    static const uint32_t STAMP_BITS = 40;
+    static const uint64_t STAMP_MASK = (1ULL << STAMP_BITS) - 1;
+    uint64_t *slots;        // fingerprint << STAMP_BITS | stamp, 0 is empty
+    uint64_t set_mask;
+    uint64_t count;
+    inline uint64_t _hash(int64_t key){
+        uint64_t z = (uint64_t) key + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    public:
+    ghost_table_t(uint64_t capacity);
+    ~ghost_table_t();
+    ghost_table_t(const ghost_table_t&) = delete;
+    ghost_table_t& operator=(const ghost_table_t&) = delete;
+    // ghosts whose stamp is at most `pruned` are below the stack.
+    void insert(int64_t key, uint64_t stamp, uint64_t pruned);
+    // removes the ghost of key. Returns true if there was one and its stamp
+    // is larger than `bottom`, the stamp of the bottom LIR block. Stamps are
+    // compared modulo 2^40: a ghost older than 2^40 accesses may be judged
+    // wrongly, which only costs a hit.
+    bool take(int64_t key, uint64_t bottom);
+    inline uint64_t size(){
+        return count;
+    }
+    inline uint64_t get_capacity(){
+        return (set_mask + 1) * GHOST_WAYS;
+    }
+};
+
+class LIRS{
+    public:
+    uint32_t lir_blk_sz = 0;
+    uint32_t hir_blk_sz = 0;
+    uint32_t lir_left = 0;
+    uint32_t hir_left = 0;
+    uint64_t page_hits = 0;
+    int64_t  last_evicted = -1;     // page made non-resident by the last get_page()
+    bool     adaptive = false;
+    uint32_t lir_target = 0;
+    uint32_t hir_min = 1;
+    uint32_t hir_max = 1;
+    uint64_t epoch_accesses = 0;
+    uint32_t sampling = 1;
+    uint32_t sample_below = 0;      // a page is sampled if its hash is below
+    std::vector<LIRS*> minis;       // one per split tried
+    std::vector<uint32_t> mini_hir; // HIR blocks of the full cache for each
+    std::vector<uint64_t> mini_epoch_hits;
+    std::vector<double> mini_scores;
+    size_t mini_current = 0;        // the split lir_target is at
+    uint64_t access_clock = 0;
+    FrequencySketch *admission = NULL;
+    uint64_t rejected = 0;          // misses the admission filter kept out
+    lirs_queue_t lirs_queue;
+    hir_queue_t  hir_queue;
+    page_entry_slab_t slab;
+    page_index_t page_entries;
+    ghost_table_t ghosts;
+
+    private:
+    page_entry_t *_new_entry(int64_t page_no);
+    void _drop_entry(page_entry_t *page);
+    void _prune_stack();
+    void _demote_bottom_lir();
+    void _rebalance_on_promotion();
+    void _make_minis();
+    void _sample(uint32_t page_no);
+    void _adapt();
+    page_entry_t* access_lir(page_entry_t* page);
+    page_entry_t* access_resident_hir(page_entry_t* page);
+    page_entry_t* access_non_resident_hir(page_entry_t* page, bool in_stack);
+    page_entry_t *_get_page(uint32_t page_no);
+
+    public:
+    // ghost_factor bounds the non-resident blocks to that many times the
+    // cache size.
+    LIRS(uint32_t lir_blk_sz, uint32_t hir_blk_sz, bool adaptive = false,
+         uint32_t ghost_factor = GHOST_DEFAULT_FACTOR);
+    ~LIRS();
+    LIRS(const LIRS&) = delete;
+    LIRS& operator=(const LIRS&) = delete;
+    page_entry_t *get_page(uint32_t page_no);
+    // replays a hit that was recorded earlier: reorders the page if it is
+    // still resident, does nothing otherwise. Never evicts.
+    bool touch(uint32_t page_no);
+    // bounds of the HIR set in adaptive mode; hir_min is at least 1.
+    void set_hir_bounds(uint32_t hir_min, uint32_t hir_max);
+    void set_admission(bool enabled);
+    // bytes held by the entries, the index and the ghosts.
+    size_t metadata_bytes();
+};
+#endif
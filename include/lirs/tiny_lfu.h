@@ -0,0 +1,59 @@
+/*
+* TinyLFU admission filter (Einziger, Friedman & Manes).
+*
+* FrequencySketch estimates how often a page was accessed recently:
+* 1. The doorkeeper is a bloom filter (two probes) that absorbs the first
+*    access of every page, so one-hit wonders never reach the counters.
+* 2. The counters are a count-min sketch of 4 bit counters, 16 to a word,
+*    with SKETCH_DEPTH rows addressed by double hashing. An access that the
+*    doorkeeper already knows increments the smallest of its counters only
+*    (conservative update).
+* 3. Every sample_size (SKETCH_SAMPLE_FACTOR * cache size) recorded accesses
+*    all counters are halved and the doorkeeper is cleared, so the sketch
+*    follows the workload instead of its whole history.
+*
+* estimate() is the sketch minimum plus one if the doorkeeper has the page.
+* admit() lets a missed page replace the victim only if its estimate is
+* higher. Memory is about 18 bytes per cached page.
+*/
+#ifndef _TINY_LFU_H_
+#define _TINY_LFU_H_
+
+#include <cstdint>
+
+#define SKETCH_DEPTH            4
+#define SKETCH_SAMPLE_FACTOR    10
+#define SKETCH_COUNTER_MAX      15
+
+class FrequencySketch{
+    uint64_t *counters;         // 16 x 4 bit counters per word
+    uint64_t  counter_mask;     // number of counters - 1
+    uint64_t *doorkeeper;
+    uint64_t  door_mask;        // number of doorkeeper bits - 1
+    uint64_t  additions;
+    uint64_t  sample_size;
+    inline uint64_t _hash(int64_t key){
+        uint64_t z = (uint64_t) key + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    inline uint32_t _counter(uint64_t idx){
+        return (counters[idx >> 4] >> ((idx & 15) << 2)) & 0xf;
+    }
+    bool _door_contains(uint64_t h);
+    void _door_put(uint64_t h);
+    void _age();
+    public:
+    FrequencySketch(uint64_t capacity);
+    ~FrequencySketch();
+    FrequencySketch(const FrequencySketch&) = delete;
+    FrequencySketch& operator=(const FrequencySketch&) = delete;
+    void record(int64_t key);
+    uint32_t estimate(int64_t key);
+    inline bool admit(int64_t candidate, int64_t victim){
+        return estimate(candidate) > estimate(victim);
+    }
+    size_t memory_bytes();
+};
+#endif
@@ -0,0 +1,277 @@
+/*
+* Multi granularity lock manager (see docs/lock_manager.md).
+*
+* Resources form the hierarchy database -> file -> page -> tuple. A lock
+* on a node implicitly locks its whole subtree, so before locking a node a
+* transaction must hold an intention lock on its parent: IS for IS and S,
+* IX for IX, SIX and X. lock() refuses (LOCK_ILLEGAL) a request whose parent
+* is not locked accordingly; lock_path() takes the intention locks on the
+* way down and then the requested lock. A request that a lock already held
+* on an ancestor covers (S or SIX for reads, X for everything) returns
+* LOCK_COVERED without touching the lock table.
+*
+* Modes and compatibility:
+*            IS   IX   S    SIX  X
+*     IS     y    y    y    y    -
+*     IX     y    y    -    -    -
+*     S      y    -    y    -    -
+*     SIX    y    -    -    -    -
+*     X      -    -    -    -    -
+* Asking for a new mode on a node already locked converts the lock to the
+* supremum of both (S + IX = SIX, ...). Conversions wait ahead of new
+* requests; new requests are granted in FIFO order.
+*
+* The lock table is split into shards by the hash of the resource. Every
+* shard has its own latch and hash table of locks (each with its wait
+* queue), so requests on different resources rarely meet on a latch. The
+* caller's thread does all the work: an uncontended lock or unlock takes one
+* shard latch and never hands off to another thread. A request that has to
+* wait queues up, drops the shard latch and sleeps on its transaction's
+* condition variable until the release that grants it, or an abort, wakes
+* it. Nobody takes a shard latch while holding a transaction's wait latch,
+* so a thread can wake any transaction that has a request in the shard it
+* has latched.
+*
+* Deadlocks are handled by the policy given to the constructor:
+* - DEADLOCK_DETECT: a background thread latches all shards every
+*   `detect_interval_ms`, builds the waits-for graph and aborts one waiting
+*   transaction of every cycle (the youngest, or the one holding the fewest
+*   locks).
+* - DEADLOCK_WAIT_DIE: an older transaction may wait for younger ones; a
+*   younger one that would wait for an older one aborts instead.
+* - DEADLOCK_WOUND_WAIT: an older transaction aborts ("wounds") the younger
+*   ones it would wait for; a younger one waits for older ones.
+* - DEADLOCK_IGNORE: requests wait for as long as it takes.
+* Transaction ids are the timestamps: the lower the id, the older. A
+* transaction restarted after an abort should keep its id so that it gets
+* older and eventually goes through. An aborted transaction gets
+* LOCK_ABORTED from the request it was waiting on (or its next one) and
+* must call release_all().
+*
+* Every Transaction keeps the locks it holds (`held`) and, for every
+* ancestor, how many locks it holds below it (`below`). Only the
+* transaction's own thread touches them, so they need no latch, and
+* lock_path() skips the intention locks already held without visiting a
+* shard. When a lock makes the count exceed the escalation threshold for a
+* file or a page, the manager tries to convert the transaction's lock on
+* that node (the nearest one if both) to S if it held IS, X otherwise, and
+* drops the finer locks underneath. Databases are never escalated to: that
+* would shut out every other transaction. The attempt never waits; if
+* another transaction is in the way the fine locks are kept and escalation
+* is retried every `threshold` locks further.
+*
+* Transactions follow two phase locking: the first unlock() moves them to
+* SHRINKING, after which lock() returns LOCK_ILLEGAL; shrinking transactions
+* are never chosen to abort. release_all() drops every lock, children before
+* parents.
+*/
+#ifndef _LOCK_MANAGER_H_
+#define _LOCK_MANAGER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define LOCK_ESCALATION_THRESHOLD   1000
+#define LOCK_DEFAULT_SHARDS         64
+#define DEADLOCK_DETECT_INTERVAL_MS 5
+
+typedef enum {
+    LOCK_NL  = 0,
+    LOCK_IS  = 1,
+    LOCK_IX  = 2,
+    LOCK_S   = 3,
+    LOCK_SIX = 4,
+    LOCK_X   = 5,
+    LOCK_MODE_COUNT = 6
+} lock_mode_t;
+
+typedef enum {
+    LEVEL_DATABASE = 0,
+    LEVEL_FILE     = 1,
+    LEVEL_PAGE     = 2,
+    LEVEL_TUPLE    = 3
+} lock_level_t;
+
+typedef enum {
+    LOCK_GRANTED = 0,
+    LOCK_COVERED = 1,       // a lock on an ancestor already covers it
+    LOCK_ILLEGAL = 2,       // protocol violation, nothing was changed
+    LOCK_ABORTED = 3        // the transaction has to abort
+} lock_status_t;
+
+typedef enum {
+    TXN_GROWING   = 0,
+    TXN_SHRINKING = 1,
+    TXN_ABORTED   = 2
+} txn_phase_t;
+
+typedef enum {
+    DEADLOCK_DETECT     = 0,
+    DEADLOCK_WAIT_DIE   = 1,
+    DEADLOCK_WOUND_WAIT = 2,
+    DEADLOCK_IGNORE     = 3
+} deadlock_policy_t;
+
+// which transaction of a waits-for cycle DEADLOCK_DETECT aborts.
+typedef enum {
+    VICTIM_YOUNGEST     = 0,
+    VICTIM_FEWEST_LOCKS = 1     // the least work lost; the youngest on ties
+} victim_policy_t;
+
+typedef struct{
+    deadlock_policy_t policy;
+    uint32_t          detect_interval_ms;
+    victim_policy_t   victim;
+}deadlock_config_t;
+
+// Components below `level` are ignored and kept at 0.
+struct resource_id_t{
+    uint32_t     db;
+    uint32_t     file;
+    uint32_t     page;
+    uint32_t     tuple;
+    lock_level_t level;
+
+    static resource_id_t database(uint32_t db);
+    static resource_id_t file_of(uint32_t db, uint32_t file);
+    static resource_id_t page_of(uint32_t db, uint32_t file, uint32_t page);
+    static resource_id_t tuple_of(uint32_t db, uint32_t file, uint32_t page, uint32_t tuple);
+    // the parent of a database is itself.
+    resource_id_t parent() const;
+    resource_id_t ancestor(lock_level_t at) const;
+    bool is_ancestor_of(const resource_id_t& other) const;
+    bool operator<(const resource_id_t& other) const;
+    bool operator==(const resource_id_t& other) const;
+    uint64_t hash() const;
+};
+struct resource_id_hasher{
+    size_t operator()(const resource_id_t& res) const{
+        return res.hash();
+    }
+};
+
+const char *lock_mode_name(lock_mode_t mode);
+bool lock_compatible(lock_mode_t held, lock_mode_t requested);
+lock_mode_t lock_supremum(lock_mode_t a, lock_mode_t b);
+// mode required on the parent before `mode` can be taken on a child.
+lock_mode_t lock_parent_mode(lock_mode_t mode);
+// true if holding `held` on an ancestor makes `mode` on a descendant moot.
+bool lock_covers(lock_mode_t held, lock_mode_t mode);
+
+class LockManager;
+
+// Owned by the transaction's thread; must outlive its locks.
+class Transaction{
+    friend class LockManager;
+    uint64_t txn_id;
+    std::atomic<txn_phase_t> phase;
+    std::mutex wait_latch;              // taken last, guards `signalled`
+    bool signalled;
+    std::condition_variable cond;
+    std::map<resource_id_t, lock_mode_t> held;
+    std::map<resource_id_t, uint32_t> below;
+    public:
+    Transaction(uint64_t txn_id);
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+    uint64_t get_id(){
+        return txn_id;
+    }
+    txn_phase_t get_phase(){
+        return phase.load();
+    }
+    // read it from the transaction's thread only.
+    size_t get_lock_count(){
+        return held.size();
+    }
+};
+
+typedef struct{
+    uint64_t granted;
+    uint64_t waited;        // requests that had to sleep
+    uint64_t escalations;
+    uint64_t escalation_failures;
+    uint64_t deadlocks;     // cycles broken by DEADLOCK_DETECT
+    uint64_t dies;          // DEADLOCK_WAIT_DIE aborts
+    uint64_t wounds;        // DEADLOCK_WOUND_WAIT aborts
+    uint64_t blocked_ns;    // time requests spent waiting, aborted ones too
+    uint64_t live_locks;    // locks in the lock table
+}lock_stats_t;
+
+class LockManager{
+    struct lock_request_t{
+        Transaction *txn;
+        lock_mode_t  mode;          // held if granted, else asked for
+        bool         granted;
+        lock_mode_t  upgrade_to;    // pending conversion of a granted one
+    };
+    struct lock_t{
+        std::list<lock_request_t> queue;   // granted ones first
+        uint32_t granted_count[LOCK_MODE_COUNT] = {0};
+        uint32_t waiting = 0;              // conversions and new requests
+    };
+    struct alignas(64) lock_shard_t{
+        std::mutex latch;
+        std::unordered_map<resource_id_t, lock_t, resource_id_hasher> table;
+        uint64_t granted    = 0;
+        uint64_t waited     = 0;
+        uint64_t blocked_ns = 0;
+        uint32_t waiters    = 0;        // requests asleep right now
+    };
+    typedef std::list<lock_request_t>::iterator request_it;
+    std::vector<lock_shard_t*> shards;
+    uint32_t escalation_threshold;
+    std::atomic<uint64_t> escalations;
+    std::atomic<uint64_t> escalation_failures;
+    deadlock_config_t deadlock;
+    std::atomic<uint64_t> deadlocks;
+    std::atomic<uint64_t> dies;
+    std::atomic<uint64_t> wounds;
+    std::thread detector;
+    std::mutex detector_latch;
+    std::condition_variable detector_cond;
+    bool stopping;
+
+    inline lock_shard_t* _shard_of(const resource_id_t& res){
+        // multiply-shift on the high bits instead of a modulo.
+        return shards[((res.hash() >> 32) * shards.size()) >> 32];
+    }
+    bool _grantable(lock_t *lock, lock_mode_t mode, lock_mode_t current);
+    void _grant_waiters(lock_t *lock);
+    void _blockers(lock_t *lock, request_it req, std::vector<Transaction*>& out);
+    void _wake(Transaction *txn);
+    bool _abort(Transaction *victim);
+    bool _may_wait(lock_t *lock, request_it req, Transaction *txn);
+    void _wait(std::unique_lock<std::mutex>& guard, lock_shard_t *shard, request_it req, Transaction *txn);
+    void _detect_deadlocks();
+    void _run_detector();
+    lock_status_t _acquire(Transaction *txn, const resource_id_t& res, lock_mode_t mode, bool wait);
+    void _release(Transaction *txn, const resource_id_t& res);
+    void _count_below(Transaction *txn, const resource_id_t& res, int delta);
+    void _maybe_escalate(Transaction *txn, const resource_id_t& res);
+    lock_status_t _check(Transaction *txn, const resource_id_t& res, lock_mode_t mode);
+    public:
+    LockManager(uint32_t escalation_threshold = LOCK_ESCALATION_THRESHOLD,
+                uint32_t shard_count = LOCK_DEFAULT_SHARDS,
+                deadlock_config_t deadlock = {DEADLOCK_DETECT, DEADLOCK_DETECT_INTERVAL_MS, VICTIM_YOUNGEST});
+    ~LockManager();
+    LockManager(const LockManager&) = delete;
+    LockManager& operator=(const LockManager&) = delete;
+    // blocks until granted or aborted.
+    lock_status_t lock(Transaction *txn, const resource_id_t& res, lock_mode_t mode);
+    // takes the intention locks from the database down, then `mode` on res.
+    lock_status_t lock_path(Transaction *txn, const resource_id_t& res, lock_mode_t mode);
+    lock_status_t unlock(Transaction *txn, const resource_id_t& res);
+    void release_all(Transaction *txn);
+    // the mode txn holds on res itself, LOCK_NL if none; from txn's thread.
+    lock_mode_t held_mode(Transaction *txn, const resource_id_t& res);
+    lock_stats_t get_stats();
+};
+#endif
@@ -0,0 +1,151 @@
+/*
+* Multi version store for db_entry_t.
+*
+* Every account that has been written since start up has a version chain,
+* newest first. A version carries the timestamp of the transaction that
+* committed it; versions of a transaction still running (or rolled back)
+* carry MVCC_INFLIGHT (MVCC_ABORTED) and are visible to nobody else.
+*
+* Readers:
+*   begin_snapshot() registers the timestamp of the last commit, read()
+*   returns the newest version committed at or before it. Reads take no
+*   transaction locks and never wait for writers, so a dashboard summing
+*   balances sees one consistent state of the database while transfers go
+*   on. end_snapshot() releases the snapshot.
+*
+* Writers hold an X lock on the account (LockManager) so a chain has at most
+* one uncommitted version, at its head:
+*   write()/remove() stage a new version in a write set, read_latest() reads
+*   through it, commit() stamps every version of the set with one commit
+*   timestamp, rollback() unlinks them. Commits are stamped under a latch
+*   and published in timestamp order, so a snapshot never sees half of a
+*   transfer. The caller writes committed values through to the b-tree.
+*
+* An account without a chain is read from the base store through `loader`
+* (btree_find() wrapped by the caller). A snapshot read leaves it at that; a
+* writer seeds the chain with that value at timestamp 0. Chains are created
+* before a writer touches the base store, so a base value that is newer than
+* the chain's is never installed, and an account without one has the same
+* value in every snapshot. Chains are only read under their shard latch.
+*
+* Garbage collection: a background thread (none if `gc_interval_ms` is 0,
+* then collect() has to be called) wakes every `gc_interval_ms` and
+* computes the horizon, the oldest registered snapshot (or the last commit
+* if there is none). The newest version of a chain committed at or before
+* the horizon is the oldest one anybody can still read; everything below it
+* is freed. Rolled back versions are freed once the horizon has moved past
+* their rollback. A chain holding nothing but its seeded base version (or
+* nothing, after a rolled back insert) is dropped, so the store only keeps
+* the accounts that have been written.
+*/
+#ifndef _VERSION_STORE_H_
+#define _VERSION_STORE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "data_defs.h"
+
+#define MVCC_INFLIGHT           UINT64_MAX
+#define MVCC_ABORTED            (UINT64_MAX - 1)
+#define MVCC_SNAPSHOT_SLOTS     256
+#define MVCC_SHARDS             64
+#define MVCC_GC_INTERVAL_MS     10
+
+// 0 and the entry if found, -1 if the account does not exist.
+typedef int (*mvcc_loader_t)(void *ctx, const char *user_id, db_entry_t *entry);
+
+typedef struct mvcc_version{
+    db_entry_t                        entry;
+    std::atomic<uint64_t>             commit_ts;
+    std::atomic<struct mvcc_version*> older;
+    bool                              deleted;
+}mvcc_version_t;
+
+typedef struct{
+    uint64_t ts;
+    uint32_t slot;
+}mvcc_snapshot_t;
+
+// versions staged by one writer transaction and the accounts they belong to.
+typedef struct{
+    std::vector<std::string>     keys;
+    std::vector<mvcc_version_t*> versions;
+}mvcc_write_set_t;
+
+typedef struct{
+    uint64_t last_commit;
+    uint64_t horizon;           // at the last collection
+    uint64_t chains;
+    uint64_t versions;          // live, including the seeded base versions
+    uint64_t created;
+    uint64_t reclaimed;
+    uint64_t gc_runs;
+    uint64_t active_snapshots;
+}mvcc_stats_t;
+
+class VersionStore{
+    struct alignas(64) snapshot_slot_t{
+        std::atomic<uint64_t> ts;       // 0 if free
+    };
+    struct alignas(64) chain_shard_t{
+        std::mutex latch;
+        std::unordered_map<std::string, std::atomic<mvcc_version_t*>*> chains;
+    };
+    mvcc_loader_t loader;
+    void *loader_ctx;
+    snapshot_slot_t slots[MVCC_SNAPSHOT_SLOTS];
+    chain_shard_t shards[MVCC_SHARDS];
+    std::mutex commit_latch;
+    uint64_t clock;
+    std::atomic<uint64_t> last_commit;
+    std::atomic<uint64_t> live_versions;
+    std::atomic<uint64_t> created;
+    // rolled back versions and the last commit when they were unlinked.
+    std::mutex retired_latch;
+    std::vector<std::pair<mvcc_version_t*, uint64_t>> retired;
+    std::mutex gc_latch;                // one collection at a time
+    uint64_t horizon;
+    uint64_t reclaimed;
+    uint64_t gc_runs;
+    uint32_t gc_interval_ms;
+    std::thread collector;
+    std::mutex collector_latch;
+    std::condition_variable collector_cond;
+    bool stopping;
+
+    chain_shard_t* _shard_of(const std::string& key);
+    std::atomic<mvcc_version_t*>* _chain(chain_shard_t *shard, const std::string& key, bool create);
+    mvcc_version_t* _new_version(const db_entry_t *entry, uint64_t commit_ts, mvcc_version_t *older, bool deleted);
+    int _stage(mvcc_write_set_t *ws, const char *user_id, const db_entry_t *entry, bool deleted);
+    uint64_t _horizon();
+    void _run_collector();
+    public:
+    VersionStore(mvcc_loader_t loader, void *loader_ctx, uint32_t gc_interval_ms = MVCC_GC_INTERVAL_MS);
+    ~VersionStore();
+    VersionStore(const VersionStore&) = delete;
+    VersionStore& operator=(const VersionStore&) = delete;
+
+    void begin_snapshot(mvcc_snapshot_t *snapshot);
+    void end_snapshot(mvcc_snapshot_t *snapshot);
+    // 0 and the version visible to snapshot, -1 if there is none.
+    int read(const mvcc_snapshot_t *snapshot, const char *user_id, db_entry_t *entry);
+
+    // the caller holds an X lock on the account for the rest of these.
+    int read_latest(const char *user_id, db_entry_t *entry);
+    int write(mvcc_write_set_t *ws, const db_entry_t *entry);
+    int remove(mvcc_write_set_t *ws, const char *user_id);
+    // returns the commit timestamp; ws is empty again afterwards.
+    uint64_t commit(mvcc_write_set_t *ws);
+    void rollback(mvcc_write_set_t *ws);
+
+    // one collection pass; the background thread calls it too.
+    void collect();
+    mvcc_stats_t get_stats();
+};
+#endif
@@ -0,0 +1,128 @@
+/*
+* Binary tracing: fixed size events in per-thread rings, in place of the
+* printf logging of b_storage.
+*
+* An event is 32 bytes: when, which operation, the page and a hash of the
+* key involved, a latency, a status and one operation specific argument.
+* Every thread writes its events into its own ring of TRACE_RING_EVENTS,
+* overwriting the oldest, with plain stores and one release store of the
+* ring's head: no lock, no shared cache line, no system call. The ring is
+* registered on the thread's first event. When the thread exits its ring
+* is kept, so a dump still has the events of threads that are gone, until
+* a new thread takes it over.
+*
+* Filtering happens twice, both before any argument is evaluated:
+*   - at compile time, trace points above TRACE_COMPILED_LEVEL are not
+*     compiled in (-DTRACE_COMPILED_LEVEL=TRACE_ERROR leaves only errors);
+*   - at run time, trace points above trace_set_level() (TRACE_INFO by
+*     default) cost a load and a branch.
+*
+* trace_dump() writes every ring to a file, and trace_decode turns one into
+* text, merging the threads by time. A dump can be taken while threads are
+* tracing: events overwritten during the copy are left out.
+*
+* Usable from C (b_storage) and C++.
+*/
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define TRACE_FILE_MAGIC        0x3130454341525442ULL      // "BTRACE01"
+#define TRACE_RING_EVENTS       8192                        // a power of two
+
+typedef enum{
+    TRACE_ERROR = 0,
+    TRACE_INFO  = 1,
+    TRACE_DEBUG = 2
+} trace_level_t;
+
+#ifndef TRACE_COMPILED_LEVEL
+#define TRACE_COMPILED_LEVEL    TRACE_DEBUG
+#endif
+
+typedef enum{
+    TRACE_PAGE_LOAD      = 1,   // arg: keys on the page
+    TRACE_PAGE_WRITE     = 2,
+    TRACE_PAGE_ADD       = 3,
+    TRACE_CHECKSUM_FAIL  = 4,
+    TRACE_IO_FAIL        = 5,
+    TRACE_FIND           = 6,   // status: 0 found
+    TRACE_INSERT         = 7,
+    TRACE_INSERT_LEAF    = 8,   // arg: index
+    TRACE_NEW_ROOT       = 9,
+    TRACE_SPLIT          = 10,  // arg: index in the parent
+    TRACE_DELETE         = 11,
+    TRACE_DELETE_ENTRY   = 12,  // arg: keys left on the page
+    TRACE_DELETE_MISS    = 13,
+    TRACE_BORROW_LEFT    = 14,  // arg: index; status: 0 borrowed
+    TRACE_BORROW_RIGHT   = 15,
+    TRACE_MERGE          = 16,
+    TRACE_ROOT_SHRINK    = 17,
+    TRACE_SEARCH         = 18,  // arg: index the key search stopped at
+    TRACE_OP_COUNT
+} trace_op_t;
+
+typedef struct{
+    uint64_t timestamp_ns;      // CLOCK_MONOTONIC
+    uint64_t key_hash;
+    uint32_t page_loc;
+    uint32_t latency_ns;
+    uint8_t  op;
+    uint8_t  level;
+    uint16_t status;
+    uint32_t arg;
+}trace_event_t;
+
+typedef struct{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint64_t rings;
+}trace_file_header_t;
+
+// followed by `count` events, oldest first.
+typedef struct{
+    uint64_t thread_id;
+    uint64_t first;             // sequence number of the first event
+    uint64_t count;
+}trace_ring_header_t;
+
+typedef struct{
+    uint64_t rings;
+    uint64_t events;            // ever emitted
+    uint64_t overwritten;
+}trace_stats_t;
+
+extern int trace_runtime_level;
+
+#define TRACE_ENABLED(level) \
+    ((level) <= TRACE_COMPILED_LEVEL && (int) (level) <= __atomic_load_n(&trace_runtime_level, __ATOMIC_RELAXED))
+
+#define TRACE(level, op, page_loc, key_hash, latency_ns, status, arg) \
+    do{ \
+        if(TRACE_ENABLED(level)) \
+            trace_emit((level), (op), (page_loc), (key_hash), (latency_ns), (status), (arg)); \
+    }while(0)
+
+void trace_emit(trace_level_t level, trace_op_t op, uint32_t page_loc, uint64_t key_hash, uint64_t latency_ns,
+                uint16_t status, uint32_t arg);
+uint64_t trace_now(void);
+uint64_t trace_key_hash(const char *key, size_t length);
+void trace_set_level(trace_level_t level);
+trace_level_t trace_get_level(void);
+// 0 on success, -1 (errno set) if the file could not be written.
+int trace_dump(const char *path);
+void trace_get_stats(trace_stats_t *stats);
+const char *trace_op_name(uint32_t op);
+const char *trace_level_name(uint32_t level);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,121 @@
+/*
+* DEPOSIT and WITHDRAW on the b-tree through the write-ahead log.
+*
+* update() finds the account, appends a WAL_UPDATE record (account, page,
+* delta), applies the delta to the page in memory and stamps the page's
+* page_lsn with the record's LSN. The page then stays in the dirty page
+* table instead of being written back. commit() appends WAL_COMMIT and
+* returns once the log is on disk past it; concurrent committers share one
+* flush (group commit). A balance change thus costs a share of a sequential
+* log write instead of a random page write.
+*
+* Dirty pages are written back lazily: by flush_dirty(), oldest first (by
+* rec_lsn, the LSN of the first change since the page was last written),
+* and by update() once more than `max_dirty_pages` are dirty. The log is
+* always flushed up to a page's page_lsn before the page is written.
+*
+* abort() applies the inverse of the transaction's changes, newest first,
+* each logged as a compensation record (WAL_CLR) that points at the next
+* change still to undo, and appends WAL_ABORT. undo() does the same for a
+* transaction recovery found unfinished, following its records back
+* through the log.
+*
+* checkpoint() is fuzzy: it appends WAL_CHECKPOINT_BEGIN and copies the
+* dirty page table and the active transactions under the latch, without
+* writing anything, then logs the copy as WAL_CHECKPOINT_END and makes the
+* BEGIN the master record. Before that it writes back, in small batches that
+* let writers in between, the pages dirty since before the previous
+* checkpoint. Redo after a crash therefore never starts further back than
+* the checkpoint before last. With `checkpoint_interval_ms` set, a thread
+* takes one every so often.
+*
+* b_storage is single threaded, so everything that touches pages runs under
+* one latch; the log flush of commit() happens outside it. Accounts are
+* still created and deleted in place by btree_insert()/btree_delete_start():
+* call flush_dirty(SIZE_MAX) first so they work on the current pages, and
+* checkpoint() afterwards so that recovery never redoes a change on a page
+* the account has since moved off.
+*/
+#ifndef _LOGGED_STORE_H_
+#define _LOGGED_STORE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "wal.h"
+extern "C"{
+#include "b_storage.h"
+}
+
+#define LOGGED_STORE_MAX_DIRTY          1024
+#define LOGGED_STORE_CHECKPOINT_BATCH   64
+
+typedef struct{
+    page_t *page;
+    lsn_t   rec_lsn;
+}dirty_page_t;
+
+typedef struct{
+    uint64_t updates;
+    uint64_t commits;
+    uint64_t aborts;
+    uint64_t compensations;
+    uint64_t checkpoints;
+    uint64_t page_writes;
+    uint64_t dirty_pages;
+}logged_store_stats_t;
+
+class LoggedStore{
+    struct txn_entry_t{
+        lsn_t last_lsn;
+        // each update with the LSN undo carries on at after undoing it.
+        std::vector<std::pair<lsn_t, wal_update_t>> updates;
+    };
+    int db_file;
+    WriteAheadLog *log;
+    size_t max_dirty_pages;
+    std::mutex latch;
+    std::unordered_map<page_ptr_t, dirty_page_t> dirty;
+    std::unordered_map<uint64_t, txn_entry_t> txns;
+    logged_store_stats_t stats;
+    std::mutex checkpoint_latch;    // one checkpoint at a time
+    lsn_t last_checkpoint;
+    uint32_t checkpoint_interval_ms;
+    std::mutex checkpointer_latch;
+    std::condition_variable checkpointer_cond;
+    bool stopping;
+    std::thread checkpointer;
+
+    page_t* _find(const char *user_id, uint32_t *index, bool *cached);
+    int _update(uint64_t txn_id, const char *user_id, int64_t delta, bool compensate, lsn_t undo_next);
+    int _flush_dirty(size_t max_pages, lsn_t before);
+    void _run_checkpointer();
+    public:
+    LoggedStore(int db_file, WriteAheadLog *log, size_t max_dirty_pages = LOGGED_STORE_MAX_DIRTY,
+                uint32_t checkpoint_interval_ms = 0);
+    // stops the checkpointer and writes every dirty page back.
+    ~LoggedStore();
+    LoggedStore(const LoggedStore&) = delete;
+    LoggedStore& operator=(const LoggedStore&) = delete;
+    // -1 if there is no such account or a withdrawal would overdraw it.
+    int update(uint64_t txn_id, const char *user_id, int64_t delta);
+    // -1 if the log could not be flushed.
+    int commit(uint64_t txn_id);
+    int abort(uint64_t txn_id);
+    // rolls back a transaction left unfinished by a crash; last_lsn is its
+    // newest record.
+    int undo(uint64_t txn_id, lsn_t last_lsn);
+    // DEPOSIT and WITHDRAW, each as a transaction of its own.
+    int apply_request(uint64_t txn_id, const request_data_t *request);
+    int read_balance(const char *user_id, amount_t *balance);
+    // writes back up to max_pages dirty pages, oldest first, and syncs the
+    // database file. Returns how many were written, -1 on failure.
+    int flush_dirty(size_t max_pages);
+    // -1 if the log or a page could not be written.
+    int checkpoint();
+    logged_store_stats_t get_stats();
+};
+#endif
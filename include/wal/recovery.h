@@ -0,0 +1,46 @@
+/*
+* Crash recovery for a database written through LoggedStore, ARIES style.
+*
+* analysis: reads the log from the BEGIN of the last complete checkpoint
+*           (the master record in the log's file header), starting from the
+*           dirty page table and the transactions the checkpoint saved. What
+*           is left at the end of the log are the pages that may miss
+*           changes, each with the LSN of the first change they may miss,
+*           and the losers: transactions with neither COMMIT nor ABORT.
+* redo:     reads the log once more from the smallest of those LSNs and
+*           hands every update and CLR of a dirty page to the redo thread
+*           that owns the page; pages are split between `redo_threads`
+*           threads by number. Each thread loads its pages one by one and
+*           reapplies, in log order, the records newer than the page's
+*           page_lsn, then writes the page back once. Redo repeats history:
+*           losers' changes are reapplied too.
+* undo:     rolls every loser back through LoggedStore::undo(), logging
+*           CLRs, so a crash during recovery does not undo anything twice.
+*
+* Recovery ends with every page written back and a fresh checkpoint, so
+* the next restart starts from there. Since LoggedStore's checkpoints write
+* back the pages dirty since before the previous checkpoint, redo reads at
+* most the log of the last two checkpoint intervals.
+*/
+#ifndef _RECOVERY_H_
+#define _RECOVERY_H_
+
+#include "logged_store.h"
+
+typedef struct{
+    lsn_t    checkpoint_lsn;        // where analysis started
+    lsn_t    redo_lsn;              // where redo started, 0 if nothing was dirty
+    lsn_t    end_lsn;
+    uint64_t records_analysed;
+    uint64_t records_redone;
+    uint64_t records_skipped;       // already on the page
+    uint64_t pages_redone;
+    uint64_t losers;
+    uint64_t analysis_ns;
+    uint64_t redo_ns;
+    uint64_t undo_ns;
+}recovery_stats_t;
+
+// -1 if the log or the database could not be read or written.
+int wal_recover(int db_file, WriteAheadLog *log, uint32_t redo_threads, recovery_stats_t *stats);
+#endif
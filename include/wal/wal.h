@@ -0,0 +1,167 @@
+/*
+* Write-ahead log.
+*
+* The log is one append-only file. A record's LSN is its byte offset in the
+* file, so LSNs grow with every append and a reader can seek straight to
+* one. The file starts with a wal_file_header_t; the first record sits at
+* WAL_FIRST_LSN and LSN 0 means "none".
+*
+* append() copies a record into the in-memory tail of the log and returns
+* its LSN; nothing is written yet. flush(upto) returns once every record
+* before `upto` is on disk. Group commit: the first thread to find the tail
+* unflushed becomes the leader. It takes the whole tail, writes it with one
+* pwrite() and one fdatasync() while the latch is dropped, and wakes
+* everybody it covered. Threads arriving meanwhile keep appending to a fresh
+* tail and wait; the next leader flushes all of them together. N concurrent
+* committers therefore cost about two flushes instead of N.
+*
+* Records carry a checksum. When the log is opened it is scanned from the
+* start, and the first record that is cut short or fails its checksum (a
+* write torn by a crash) ends the log; the file is truncated there.
+*
+* The file header doubles as the master record: set_checkpoint() stores the
+* LSN of the last complete checkpoint there, which is where recovery starts
+* reading (see recovery.h).
+*/
+#ifndef _WAL_H_
+#define _WAL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define WAL_MAGIC           0x4c41575342415345ULL      // "ESABSWAL"
+#define WAL_FIRST_LSN       64
+#define WAL_BUFFER_SIZE     (1 << 20)
+#define WAL_USERID_LENGTH   48
+
+typedef uint64_t lsn_t;
+
+typedef enum{
+    WAL_UPDATE = 1,         // wal_update_t: a delta applied to a balance
+    WAL_COMMIT = 2,
+    WAL_ABORT  = 3,         // written once the transaction is rolled back
+    WAL_CLR    = 4,         // wal_clr_t: a compensation, the undo of an update
+    WAL_CHECKPOINT_BEGIN = 5,
+    WAL_CHECKPOINT_END   = 6    // wal_checkpoint_t, as of the matching BEGIN
+} wal_record_type_t;
+
+typedef struct{
+    uint64_t magic;
+    uint64_t version;
+    lsn_t    checkpoint_lsn;    // BEGIN of the last complete checkpoint, 0 if none
+    char     reserved[WAL_FIRST_LSN - 24];
+}wal_file_header_t;
+
+typedef struct{
+    uint32_t length;        // header and payload
+    uint32_t checksum;      // CRC32C of the record from `lsn` on
+    lsn_t    lsn;
+    lsn_t    prev_lsn;      // previous record of the same transaction
+    uint64_t txn_id;
+    uint32_t type;
+    uint32_t reserved;
+}wal_header_t;
+
+// logical: the account and the change. The page only tells recovery where
+// the account was when the change was made.
+typedef struct{
+    char     user_id[WAL_USERID_LENGTH];
+    uint32_t page;
+    uint32_t reserved;
+    int64_t  delta;
+}wal_update_t;
+
+// redone like an update, never undone itself: undo carries on at undo_next.
+typedef struct{
+    wal_update_t update;
+    lsn_t        undo_next;     // prev_lsn of the update compensated
+}wal_clr_t;
+
+typedef struct{
+    uint32_t page;
+    uint32_t reserved;
+    lsn_t    rec_lsn;
+}wal_dirty_page_t;
+
+typedef struct{
+    uint64_t txn_id;
+    lsn_t    last_lsn;
+}wal_active_txn_t;
+
+// followed by `dirty_pages` wal_dirty_page_t and `active_txns` wal_active_txn_t.
+typedef struct{
+    uint32_t dirty_pages;
+    uint32_t active_txns;
+}wal_checkpoint_t;
+
+typedef struct{
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t flushes;       // fdatasync() calls
+    uint64_t piggybacked;   // flush() calls served by another thread's flush
+    uint64_t flush_ns;
+    lsn_t    checkpoint_lsn;
+    lsn_t    end_lsn;
+    lsn_t    flushed_lsn;
+}wal_stats_t;
+
+// called for every record from the scan's start on; false stops the scan.
+typedef bool (*wal_visitor_t)(void *ctx, const wal_header_t *header, const char *payload);
+
+class WalFailure: public std::exception{
+    public:
+    std::string failure_msg;
+    WalFailure(std::string msg){
+        failure_msg = msg;
+    }
+    inline const char* what() const noexcept{
+        return failure_msg.c_str();
+    }
+};
+
+uint32_t wal_checksum(const void *data, size_t length);
+
+class WriteAheadLog{
+    int fd;
+    std::mutex latch;
+    std::condition_variable flushed;
+    std::vector<char> tail;         // records from tail_lsn on, not yet flushing
+    std::vector<char> flushing_tail;
+    lsn_t tail_lsn;
+    lsn_t end_lsn;
+    lsn_t flushed_lsn;
+    lsn_t checkpoint_lsn;
+    bool flushing;
+    bool failed;
+    wal_stats_t stats;
+    public:
+    // opens or creates the log; throws WalFailure.
+    WriteAheadLog(const char *path);
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    lsn_t append(uint64_t txn_id, wal_record_type_t type, lsn_t prev_lsn,
+                 const void *payload, uint32_t length);
+    // -1 if the log could not be written; the log is unusable after that.
+    int flush(lsn_t upto);
+    inline int flush_all(){
+        return flush(get_end_lsn());
+    }
+    // reads the flushed log from `from`; returns the LSN after the last
+    // record visited.
+    lsn_t scan(lsn_t from, wal_visitor_t visit, void *ctx);
+    // reads the flushed record at `lsn`; -1 if there is none.
+    int read(lsn_t lsn, wal_header_t *header, std::vector<char>& payload);
+    // makes `lsn`, the BEGIN of a checkpoint whose END is flushed already,
+    // the master record.
+    int set_checkpoint(lsn_t lsn);
+    lsn_t get_checkpoint();
+    lsn_t get_end_lsn();
+    lsn_t get_flushed_lsn();
+    wal_stats_t get_stats();
+};
+#endif
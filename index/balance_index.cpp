@@ -0,0 +1,95 @@
+#include <cstring>
+#include <mutex>
+#include "balance_index.h"
+
+using namespace std;
+
+static string user_key(const char *user_id){
+    return string(user_id, strnlen(user_id, USERID_LENGTH));
+}
+
+BalanceIndex::BalanceIndex(){
+    updates = 0;
+    queries = 0;
+}
+
+void BalanceIndex::_fill(const index_key_t& key, balance_entry_t *entry){
+    memset(entry->user_id, 0, USERID_LENGTH);
+    memcpy(entry->user_id, key.second.data(), key.second.size());
+    entry->balance = key.first;
+}
+
+// latch held exclusive.
+int BalanceIndex::_add_entry(void *ctx, const db_entry_t *entry){
+    BalanceIndex *index = (BalanceIndex*) ctx;
+    string user_id = user_key(entry->user_id);
+    index->balances[user_id] = entry->balance;
+    index->ordered.insert({entry->balance, user_id});
+    return 0;
+}
+
+int BalanceIndex::build(int db_file){
+    unique_lock<shared_mutex> guard(latch);
+    ordered.clear();
+    balances.clear();
+    return btree_scan(db_file, _add_entry, this);
+}
+
+void BalanceIndex::update(const char *user_id, amount_t balance){
+    string key = user_key(user_id);
+    unique_lock<shared_mutex> guard(latch);
+    updates++;
+    auto known = balances.find(key);
+    if(known != balances.end()){
+        if(known->second == balance)
+            return;
+        ordered.erase({known->second, key});
+        known->second = balance;
+    }
+    else{
+        balances.emplace(key, balance);
+    }
+    ordered.insert({balance, key});
+}
+
+void BalanceIndex::remove(const char *user_id){
+    string key = user_key(user_id);
+    unique_lock<shared_mutex> guard(latch);
+    auto known = balances.find(key);
+    if(known == balances.end())
+        return;
+    updates++;
+    ordered.erase({known->second, key});
+    balances.erase(known);
+}
+
+size_t BalanceIndex::range(amount_t low, amount_t high, size_t limit, vector<balance_entry_t>& out){
+    out.clear();
+    shared_lock<shared_mutex> guard(latch);
+    __atomic_fetch_add(&queries, 1, __ATOMIC_RELAXED);
+    for(auto it = ordered.lower_bound({low, string()}); it != ordered.end() && it->first <= high && out.size() < limit; it++){
+        out.emplace_back();
+        _fill(*it, &out.back());
+    }
+    return out.size();
+}
+
+size_t BalanceIndex::top(size_t n, vector<balance_entry_t>& out){
+    out.clear();
+    shared_lock<shared_mutex> guard(latch);
+    __atomic_fetch_add(&queries, 1, __ATOMIC_RELAXED);
+    for(auto it = ordered.rbegin(); it != ordered.rend() && out.size() < n; it++){
+        out.emplace_back();
+        _fill(*it, &out.back());
+    }
+    return out.size();
+}
+
+balance_index_stats_t BalanceIndex::get_stats(){
+    shared_lock<shared_mutex> guard(latch);
+    balance_index_stats_t stats;
+    stats.accounts = balances.size();
+    stats.updates = updates;
+    stats.queries = __atomic_load_n(&queries, __ATOMIC_RELAXED);
+    return stats;
+}
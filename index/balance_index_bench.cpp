@@ -0,0 +1,199 @@
+/*
+* Top-N and range reports: BalanceIndex against scanning the b-tree.
+*
+* usage: balance_index_bench [accounts] [requests] [queries] [dir]
+*
+* Builds a database of random balances through RequestExecutor, then
+*   - times "top 100" and "balances in a window" both ways and checks the
+*     answers agree,
+*   - runs a DEPOSIT/WITHDRAW stream through the executor with and without
+*     the index to show what keeping it up to date costs, and checks the
+*     maintained index against one built from scratch afterwards.
+*/
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include "executor.h"
+
+using namespace std;
+
+#define TOP_N           100
+#define WINDOW          1000
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%07u", account);
+}
+
+static int collect(void *ctx, const db_entry_t *entry){
+    vector<balance_entry_t> *all = (vector<balance_entry_t>*) ctx;
+    all->emplace_back();
+    memcpy(all->back().user_id, entry->user_id, USERID_LENGTH);
+    all->back().balance = entry->balance;
+    return 0;
+}
+
+static bool by_balance(const balance_entry_t& a, const balance_entry_t& b){
+    if(a.balance != b.balance)
+        return a.balance < b.balance;
+    return strncmp(a.user_id, b.user_id, USERID_LENGTH) < 0;
+}
+
+static bool same(const vector<balance_entry_t>& a, const vector<balance_entry_t>& b){
+    if(a.size() != b.size())
+        return false;
+    for(size_t i = 0; i < a.size(); i++){
+        if(a[i].balance != b[i].balance || strncmp(a[i].user_id, b[i].user_id, USERID_LENGTH) != 0)
+            return false;
+    }
+    return true;
+}
+
+// what a report has to do without the index.
+static void scan_top(int db_file, size_t n, vector<balance_entry_t>& out){
+    vector<balance_entry_t> all;
+    btree_scan(db_file, collect, &all);
+    n = min(n, all.size());
+    partial_sort(all.begin(), all.begin() + n, all.end(), [](const balance_entry_t& a, const balance_entry_t& b){
+        return by_balance(b, a);
+    });
+    out.assign(all.begin(), all.begin() + n);
+}
+
+static void scan_range(int db_file, amount_t low, amount_t high, vector<balance_entry_t>& out){
+    vector<balance_entry_t> all;
+    btree_scan(db_file, collect, &all);
+    out.clear();
+    for(auto& entry: all){
+        if(entry.balance >= low && entry.balance <= high)
+            out.push_back(entry);
+    }
+    sort(out.begin(), out.end(), by_balance);
+}
+
+static double seconds_since(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static vector<request_data_t> make_stream(uint32_t accounts, uint32_t count, uint64_t seed){
+    mt19937_64 rng(seed);
+    uniform_int_distribution<uint32_t> pick(0, accounts - 1), percent(0, 99), amount(1, 500);
+    vector<request_data_t> stream(count);
+    for(auto& request: stream){
+        memset(&request, 0, sizeof(request));
+        request.req = (percent(rng) < 70) ? DEPOSIT : WITHDRAW;
+        account_name(pick(rng), request.userid);
+        request.amount = amount(rng);
+    }
+    return stream;
+}
+
+static double run_stream(RequestExecutor *executor, vector<request_data_t>& stream){
+    vector<request_result_t> results(stream.size());
+    auto start = chrono::steady_clock::now();
+    for(size_t at = 0; at < stream.size(); at += 256)
+        executor->execute(&stream[at], min((size_t) 256, stream.size() - at), &results[at]);
+    return stream.size() / seconds_since(start);
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts = (argc > 1) ? atoi(argv[1]) : 50000;
+    uint32_t count    = (argc > 2) ? atoi(argv[2]) : 200000;
+    uint32_t queries  = (argc > 3) ? atoi(argv[3]) : 20;
+    string   dir      = (argc > 4) ? argv[4] : ".";
+    string db_path = dir + "/balance_index_bench.db";
+    if(accounts < 2)
+        accounts = 2;
+
+    unlink(db_path.c_str());
+    int db_file = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0){
+        cerr << "cannot create " << db_path << endl;
+        return 1;
+    }
+    {
+        mt19937_64 rng(1);
+        uniform_int_distribution<uint32_t> amount(0, 1000000);
+        RequestExecutor executor(db_file);
+        vector<request_data_t> setup(2 * accounts);
+        vector<request_result_t> results(setup.size());
+        for(uint32_t i = 0; i < accounts; i++){
+            memset(&setup[2 * i], 0, 2 * sizeof(request_data_t));
+            setup[2 * i].req = CREATE;
+            account_name(i, setup[2 * i].userid);
+            setup[2 * i + 1].req = DEPOSIT;
+            account_name(i, setup[2 * i + 1].userid);
+            setup[2 * i + 1].amount = amount(rng);
+        }
+        executor.execute(setup.data(), setup.size(), results.data());
+    }
+
+    int rc = 0;
+    BalanceIndex index;
+    auto start = chrono::steady_clock::now();
+    index.build(db_file);
+    cout << "build from the b-tree: " << fixed << setprecision(1) << seconds_since(start) * 1e3 << " ms for "
+         << index.get_stats().accounts << " accounts" << endl << endl;
+
+    cout << setw(16) << "query" << setw(14) << "scan us" << setw(14) << "index us" << setw(6) << "ok" << endl;
+    vector<balance_entry_t> expected, got;
+    bool ok = true;
+    start = chrono::steady_clock::now();
+    for(uint32_t q = 0; q < queries; q++)
+        scan_top(db_file, TOP_N, expected);
+    double scan_us = seconds_since(start) * 1e6 / queries;
+    start = chrono::steady_clock::now();
+    for(uint32_t q = 0; q < queries; q++)
+        index.top(TOP_N, got);
+    double index_us = seconds_since(start) * 1e6 / queries;
+    ok = same(expected, got);
+    rc |= !ok;
+    cout << setw(16) << "top 100" << setw(14) << scan_us << setw(14) << index_us << setw(6) << (ok ? "yes" : "NO") << endl;
+
+    mt19937_64 rng(2);
+    uniform_int_distribution<amount_t> low(0, 1000000 - WINDOW);
+    vector<amount_t> lows(queries);
+    for(auto& l: lows)
+        l = low(rng);
+    ok = true;
+    double scan_total = 0, index_total = 0;
+    for(uint32_t q = 0; q < queries; q++){
+        start = chrono::steady_clock::now();
+        scan_range(db_file, lows[q], lows[q] + WINDOW, expected);
+        scan_total += seconds_since(start);
+        start = chrono::steady_clock::now();
+        index.range(lows[q], lows[q] + WINDOW, SIZE_MAX, got);
+        index_total += seconds_since(start);
+        ok = ok && same(expected, got);
+    }
+    rc |= !ok;
+    cout << setw(16) << "window of 1000" << setw(14) << scan_total * 1e6 / queries << setw(14)
+         << index_total * 1e6 / queries << setw(6) << (ok ? "yes" : "NO") << endl << endl;
+
+    // what maintenance costs; the index must end up as if built afresh.
+    vector<request_data_t> stream = make_stream(accounts, count, 3);
+    RequestExecutor plain(db_file);
+    double plain_rate = run_stream(&plain, stream);
+    // that run went past the index.
+    index.build(db_file);
+    stream = make_stream(accounts, count, 4);
+    RequestExecutor indexed(db_file, &index);
+    double indexed_rate = run_stream(&indexed, stream);
+    BalanceIndex fresh;
+    fresh.build(db_file);
+    index.range(0, UINT64_MAX, SIZE_MAX, got);
+    fresh.range(0, UINT64_MAX, SIZE_MAX, expected);
+    ok = same(expected, got);
+    rc |= !ok;
+    cout << "requests/s without the index " << setprecision(0) << plain_rate << ", with it " << indexed_rate
+         << "; index matches the b-tree: " << (ok ? "yes" : "NO") << endl;
+    close(db_file);
+    unlink(db_path.c_str());
+    return rc;
+}
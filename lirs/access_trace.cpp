@@ -0,0 +1,112 @@
+#include <cmath>
+#include <random>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "access_trace.h"
+
+using namespace std;
+
+void trace_uniform(access_trace_t* trace, uint64_t count, uint32_t pages, uint64_t seed){
+    mt19937_64 rng(seed);
+    uniform_int_distribution<uint32_t> dist(0, pages - 1);
+    trace->reserve(trace->size() + count);
+    for(uint64_t i = 0; i < count; i++)
+        trace->push_back(dist(rng));
+}
+
+// Gray et al., "Quickly Generating Billion-Record Synthetic Databases".
+void trace_zipf(access_trace_t* trace, uint64_t count, uint32_t pages, double theta, uint64_t seed){
+    mt19937_64 rng(seed);
+    uniform_real_distribution<double> dist(0.0, 1.0);
+    // alpha below is undefined for theta == 1.
+    if(theta == 1.0)
+        theta = 0.9999;
+    double zetan = 0, zeta2 = 1.0 + pow(0.5, theta);
+    for(uint32_t i = 1; i <= pages; i++)
+        zetan += 1.0 / pow((double) i, theta);
+    double alpha = 1.0 / (1.0 - theta);
+    double eta   = (1.0 - pow(2.0 / pages, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    trace->reserve(trace->size() + count);
+    for(uint64_t i = 0; i < count; i++){
+        double u  = dist(rng);
+        double uz = u * zetan;
+        uint32_t page;
+        if(uz < 1.0)
+            page = 0;
+        else if(uz < zeta2)
+            page = 1;
+        else
+            page = (uint32_t) (pages * pow(eta * u - eta + 1.0, alpha));
+        trace->push_back(page < pages ? page : pages - 1);
+    }
+}
+
+void trace_scan_hotset(access_trace_t* trace, uint64_t count, uint32_t hot_pages,
+                       uint32_t scan_pages, double hot_ratio, uint64_t seed){
+    mt19937_64 rng(seed);
+    uniform_int_distribution<uint32_t> hot(0, hot_pages - 1);
+    uniform_real_distribution<double> coin(0.0, 1.0);
+    uint32_t scan_pos = 0;
+    trace->reserve(trace->size() + count);
+    for(uint64_t i = 0; i < count; i++){
+        if(coin(rng) < hot_ratio){
+            trace->push_back(hot(rng));
+        }
+        else{
+            // the scan range sits right after the hot set.
+            trace->push_back(hot_pages + scan_pos);
+            scan_pos = (scan_pos + 1) % scan_pages;
+        }
+    }
+}
+
+void trace_loop(access_trace_t* trace, uint64_t count, uint32_t pages){
+    trace->reserve(trace->size() + count);
+    for(uint64_t i = 0; i < count; i++)
+        trace->push_back(i % pages);
+}
+
+void trace_one_hit(access_trace_t* trace, uint64_t count, uint32_t pages, double theta,
+                   double one_hit_ratio, uint64_t seed){
+    access_trace_t hot;
+    trace_zipf(&hot, count, pages, theta, seed);
+    mt19937_64 rng(seed + 1);
+    uniform_real_distribution<double> dist(0.0, 1.0);
+    uint32_t next_cold = pages;
+    trace->reserve(trace->size() + count);
+    for(uint64_t i = 0; i < count; i++)
+        trace->push_back(dist(rng) < one_hit_ratio ? next_cold++ : hot[i]);
+}
+
+int64_t trace_load(access_trace_t* trace, const char* path){
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL)
+        return -1;
+    unordered_map<uint64_t, uint32_t> ids;
+    char line[256];
+    while(fgets(line, sizeof(line), fp)){
+        if(!strchr(line, '\n')){
+            // only the first field matters, drop the rest of a long line.
+            int c;
+            while((c = fgetc(fp)) != '\n' && c != EOF);
+        }
+        char *p = line;
+        while(*p == ' ' || *p == '\t')
+            p++;
+        if(*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+        char *end;
+        uint64_t page = strtoull(p, &end, 0);
+        if(end == p)
+            continue;
+        auto it = ids.find(page);
+        if(it == ids.end())
+            it = ids.emplace(page, (uint32_t) ids.size()).first;
+        trace->push_back(it->second);
+    }
+    bool failed = ferror(fp);
+    fclose(fp);
+    return failed ? -1 : (int64_t) ids.size();
+}
@@ -0,0 +1,141 @@
+#include <vector>
+#include "concurrent_lirs.h"
+
+using namespace std;
+
+resident_set_t::resident_set_t(uint64_t max_keys){
+    // at most a quarter full with live keys, so a rebuild is needed only
+    // after a capacity/2 worth of erases.
+    uint64_t capacity = 16;
+    shift = 60;
+    while(capacity < max_keys * 4){
+        capacity <<= 1;
+        shift--;
+    }
+    mask  = capacity - 1;
+    slots = new atomic<int64_t>[capacity];
+    for(uint64_t i = 0; i < capacity; i++)
+        slots[i].store(EMPTY, memory_order_relaxed);
+    used = live = 0;
+}
+
+resident_set_t::~resident_set_t(){
+    delete[] slots;
+}
+
+bool resident_set_t::contains(int64_t key){
+    for(uint64_t i = _home(key);; i = (i + 1) & mask){
+        int64_t k = slots[i].load(memory_order_acquire);
+        if(k == key)
+            return true;
+        if(k == EMPTY)
+            return false;
+    }
+}
+
+void resident_set_t::insert(int64_t key){
+    int64_t reuse = -1;
+    uint64_t i = _home(key);
+    for(;; i = (i + 1) & mask){
+        int64_t k = slots[i].load(memory_order_relaxed);
+        if(k == key)
+            return;
+        if(k == TOMBSTONE && reuse < 0)
+            reuse = i;
+        if(k == EMPTY)
+            break;
+    }
+    if(reuse >= 0){
+        slots[reuse].store(key, memory_order_release);
+    }
+    else{
+        slots[i].store(key, memory_order_release);
+        used++;
+    }
+    live++;
+    if(used > (mask + 1) / 4 * 3)
+        _rebuild();
+}
+
+void resident_set_t::erase(int64_t key){
+    for(uint64_t i = _home(key);; i = (i + 1) & mask){
+        int64_t k = slots[i].load(memory_order_relaxed);
+        if(k == key){
+            slots[i].store(TOMBSTONE, memory_order_release);
+            live--;
+            return;
+        }
+        if(k == EMPTY)
+            return;
+    }
+}
+
+// drops the tombstones in place. Readers probing meanwhile may miss a
+// resident key; they fall back to the latched path, which is exact.
+void resident_set_t::_rebuild(){
+    vector<int64_t> keys;
+    keys.reserve(live);
+    for(uint64_t i = 0; i <= mask; i++){
+        int64_t k = slots[i].load(memory_order_relaxed);
+        if(k >= 0)
+            keys.push_back(k);
+        slots[i].store(EMPTY, memory_order_relaxed);
+    }
+    used = live = 0;
+    for(auto key: keys)
+        insert(key);
+}
+
+ConcurrentLIRS::ConcurrentLIRS(uint32_t lir_blk_sz, uint32_t hir_blk_sz):
+    lirs(lir_blk_sz, hir_blk_sz), resident(lir_blk_sz + hir_blk_sz){
+    dropped_hits.store(0, memory_order_relaxed);
+}
+
+uint32_t ConcurrentLIRS::_my_stripe(){
+    static atomic<uint32_t> next_stripe(0);
+    static thread_local uint32_t stripe = next_stripe.fetch_add(1) % HIT_BUFFER_STRIPES;
+    return stripe;
+}
+
+// latch held. Hits whose page has been evicted since are ignored by touch().
+void ConcurrentLIRS::_drain_hits(){
+    uint32_t page_no;
+    for(int s = 0; s < HIT_BUFFER_STRIPES; s++){
+        while(hit_buffers[s].ring.pop(&page_no))
+            lirs.touch(page_no);
+    }
+}
+
+bool ConcurrentLIRS::_access_locked(uint32_t page_no){
+    uint64_t hits = lirs.page_hits;
+    page_entry_t *page = lirs.get_page(page_no);
+    if(lirs.page_hits != hits)
+        return true;
+    // a miss: at most one page left, and page_no is resident unless the
+    // admission filter kept it out.
+    if(lirs.last_evicted >= 0)
+        resident.erase(lirs.last_evicted);
+    if(page != NULL)
+        resident.insert(page_no);
+    return false;
+}
+
+bool ConcurrentLIRS::access(uint32_t page_no){
+    if(resident.contains(page_no)){
+        MpscRing<uint32_t> &ring = hit_buffers[_my_stripe()].ring;
+        if(ring.push(page_no))
+            return true;
+        if(latch.try_lock()){
+            _drain_hits();
+            lirs.touch(page_no);
+            latch.unlock();
+        }
+        else{
+            dropped_hits.fetch_add(1, memory_order_relaxed);
+        }
+        return true;
+    }
+    lock_guard<mutex> guard(latch);
+    _drain_hits();
+    return _access_locked(page_no);
+}
@@ -1,333 +1,486 @@
-#include <iostream>
-#include <unordered_map>
-#include <list>
-#include <random>
 #include <cassert>
+#include <cstring>
+#include "lirs.h"
 
 using namespace std;
 
-int page_hits = 0;
+/*---------------------- Entry slab ------------------------------------------*/
 
-class LIRS_bad_algo: public std::exception{
-    private:
-    char *msg;
+page_entry_slab_t::page_entry_slab_t(size_t initial){
+    chunk_size = initial ? initial : 1024;
+    free_list  = NULL;
+    in_use     = 0;
+    _grow();
+}
 
-    public:
-    LIRS_bad_algo(char *msg){
-        this->msg = msg;
-    }
-    char* what(){
-        return msg;
+page_entry_slab_t::~page_entry_slab_t(){
+    for(auto chunk: chunks)
+        delete[] chunk;
+}
+
+void page_entry_slab_t::_grow(){
+    page_entry_t *chunk = new page_entry_t[chunk_size];
+    chunks.push_back(chunk);
+    for(size_t i = 0; i < chunk_size; i++){
+        chunk[i].next = free_list;
+        free_list = &chunk[i];
     }
-};
-
-typedef enum {
-    LIR = 1,
-    HIR = 2,
-    INVALID = 4
-}block_type;
-
-typedef enum {
-    NOT_IN_QUEUE = 0,
-    HIR_QUEUE  = 1,
-    LIRS_QUEUE = 2
-} lirs_location_t;
-
-struct page_entry_t{
-    block_type blk_type = INVALID;
-    int64_t page_num = -1;
-    page_entry_t* next = NULL;
-    page_entry_t* prev = NULL;
-
-    uint8_t location = NOT_IN_QUEUE;
-    bool in_memory = false;
-
-    page_entry_t(int64_t page_no, page_entry_t* next, page_entry_t *prev){
-        this->page_num = page_no;
-        this->next = next;
-        this->prev = prev;
-        blk_type = INVALID;
+}
+
+page_entry_t *page_entry_slab_t::alloc(int64_t page_no){
+    if(free_list == NULL)
+        _grow();
+    page_entry_t *entry = free_list;
+    free_list = entry->next;
+    entry->reset(page_no);
+    in_use++;
+    return entry;
+}
+
+void page_entry_slab_t::release(page_entry_t *entry){
+    entry->next = free_list;
+    free_list = entry;
+    in_use--;
+}
+
+/*---------------------- Page index ------------------------------------------*/
+
+page_index_t::page_index_t(uint64_t expected){
+    slots = NULL;
+    count = 0;
+    _resize(expected * 2);
+}
+
+page_index_t::~page_index_t(){
+    delete[] slots;
+}
+
+void page_index_t::_resize(uint64_t capacity){
+    uint64_t size = 16;
+    uint32_t bits = 4;
+    while(size < capacity){
+        size <<= 1;
+        bits++;
     }
-};
-
-class lirs_queue_t{
-    private:
-    page_entry_t *head;
-    page_entry_t *tail;
-
-    public:
-    lirs_queue_t(){
-        head = new page_entry_t(-1, NULL, NULL);
-        tail = new page_entry_t(-2, head, NULL);
-        head->next = tail;
+    slot_t  *old      = slots;
+    uint64_t old_size = old ? mask + 1 : 0;
+    slots = new slot_t[size];
+    memset(slots, 0, size * sizeof(slot_t));
+    mask  = size - 1;
+    shift = 64 - bits;
+    count = 0;
+    for(uint64_t i = 0; i < old_size; i++)
+        if(old[i].entry != NULL)
+            insert(old[i].key, old[i].entry);
+    delete[] old;
+}
+
+page_entry_t *page_index_t::find(int64_t key){
+    for(uint64_t pos = _home(key); ; pos = (pos + 1) & mask){
+        if(slots[pos].entry == NULL)
+            return NULL;
+        if(slots[pos].key == key)
+            return slots[pos].entry;
     }
+}
+
+void page_index_t::insert(int64_t key, page_entry_t *entry){
+    // keep the load factor at or below 1/2 so probe sequences stay short.
+    if((count + 1) * 2 > mask + 1)
+        _resize((mask + 1) * 2);
+    uint64_t pos = _home(key);
+    while(slots[pos].entry != NULL && slots[pos].key != key)
+        pos = (pos + 1) & mask;
+    if(slots[pos].entry == NULL)
+        count++;
+    slots[pos].key   = key;
+    slots[pos].entry = entry;
+}
 
-    void push_front(page_entry_t *page){
-        page_entry_t *prev = tail->prev;
-        prev->next = page;
-        page->prev = prev;
-        page->next = tail;
-        tail->prev = page;
+void page_index_t::erase(int64_t key){
+    uint64_t pos = _home(key);
+    while(1){
+        if(slots[pos].entry == NULL)
+            return;
+        if(slots[pos].key == key)
+            break;
+        pos = (pos + 1) & mask;
     }
+    // backward shift: pull later members of the probe run into the hole so
+    // lookups never need tombstones.
+    uint64_t hole = pos;
+    uint64_t next = (hole + 1) & mask;
+    while(slots[next].entry != NULL){
+        uint64_t home = _home(slots[next].key);
+        if(((next - home) & mask) >= ((next - hole) & mask)){
+            slots[hole] = slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    slots[hole].entry = NULL;
+    count--;
+}
+
+/*---------------------- Ghost table -----------------------------------------*/
+
+ghost_table_t::ghost_table_t(uint64_t capacity){
+    uint64_t sets = 1;
+    while(sets * GHOST_WAYS < capacity)
+        sets <<= 1;
+    set_mask = sets - 1;
+    slots = new uint64_t[sets * GHOST_WAYS];
+    memset(slots, 0, sets * GHOST_WAYS * sizeof(uint64_t));
+    count = 0;
+}
 
-    void push_back(page_entry_t *page){
-        page_entry_t *next = head->next;
-        head->next = page;
-        page->prev = head;
-        page->next = next;
-        next->prev = page;
+ghost_table_t::~ghost_table_t(){
+    delete[] slots;
+}
+
+void ghost_table_t::insert(int64_t key, uint64_t stamp, uint64_t pruned){
+    uint64_t h = _hash(key);
+    uint64_t *set = &slots[(h & set_mask) * GHOST_WAYS];
+    // never 0, so an occupied slot is never mistaken for an empty one.
+    uint64_t fp = (h >> 40) | 1;
+    uint64_t word = (fp << STAMP_BITS) | (stamp & STAMP_MASK);
+    pruned &= STAMP_MASK;
+    int victim = 0;
+    for(int i = 0; i < GHOST_WAYS; i++){
+        if(set[i] == 0){
+            set[i] = word;
+            count++;
+            return;
+        }
+        uint64_t s = set[i] & STAMP_MASK;
+        if(s <= pruned){
+            // already below the stack, as good as empty.
+            set[i] = word;
+            return;
+        }
+        if(s < (set[victim] & STAMP_MASK))
+            victim = i;
     }
+    set[victim] = word;
+}
 
-    void remove(page_entry_t *page){
-        if(page == head || page == tail){
-            string *msg = new string("Cannot remove head or tail pointer!");
-            throw(msg[0]);
+bool ghost_table_t::take(int64_t key, uint64_t bottom){
+    uint64_t h = _hash(key);
+    uint64_t *set = &slots[(h & set_mask) * GHOST_WAYS];
+    uint64_t fp = (h >> 40) | 1;
+    for(int i = 0; i < GHOST_WAYS; i++){
+        if(set[i] >> STAMP_BITS == fp){
+            uint64_t stamp = set[i] & STAMP_MASK;
+            set[i] = 0;
+            count--;
+            return stamp > (bottom & STAMP_MASK);
         }
-        page_entry_t *prev = page->prev;
-        prev->next = page->next;
-        page->next->prev = prev;
-        page->next = page->prev = NULL;
     }
+    return false;
+}
+
+/*---------------------- LIRS ------------------------------------------------*/
 
-    page_entry_t *back(){
-        return head->next;
+page_entry_t *LIRS::_new_entry(int64_t page_no){
+    page_entry_t *page = slab.alloc(page_no);
+    page_entries.insert(page_no, page);
+    return page;
+}
+
+void LIRS::_drop_entry(page_entry_t *page){
+    page_entries.erase(page->page_num);
+    slab.release(page);
+}
+
+// the ghosts below the new bottom are pruned by its stamp.
+void LIRS::_prune_stack(){
+    while(!lirs_queue.empty() && lirs_queue.back()->blk_type != LIR){
+        page_entry_t *back = lirs_queue.pop_back();
+        back->location &= ~LIRS_QUEUE;
     }
+    assert(!(lirs_queue.empty()) && "lirs_queue is empty! IN: _prune_stack");
+}
+
+void LIRS::_demote_bottom_lir(){
+    page_entry_t *base_lir = lirs_queue.pop_back();
+    base_lir->blk_type = HIR;
+    base_lir->location |= HIR_QUEUE;
+    base_lir->location &= ~LIRS_QUEUE;
+    hir_queue.push_back(base_lir);
+    _prune_stack();
+}
 
-    page_entry_t *front(){
-        return tail->prev;
+// one miniature LIRS per split of ADAPT_HIR_PERCENT within the HIR bounds,
+// run on 1/sampling of the pages at 1/sampling of the size.
+void LIRS::_make_minis(){
+    for(auto mini: minis)
+        delete mini;
+    minis.clear();
+    mini_hir.clear();
+    mini_current = 0;
+    uint32_t capacity = lir_blk_sz + hir_blk_sz;
+    sampling = capacity / ADAPT_MINI_PAGES > ADAPT_MIN_SAMPLING ? capacity / ADAPT_MINI_PAGES : ADAPT_MIN_SAMPLING;
+    sample_below = (uint32_t) (((uint64_t) 1 << 32) / sampling);
+    uint32_t mini_capacity = capacity / sampling > 2 ? capacity / sampling : 2;
+    for(uint32_t percent: ADAPT_HIR_PERCENT){
+        uint32_t hir = (uint32_t) ((uint64_t) capacity * percent / 100);
+        hir = hir < hir_min ? hir_min : (hir > hir_max ? hir_max : hir);
+        if(!mini_hir.empty() && mini_hir.back() == hir)
+            continue;
+        uint32_t small = (uint32_t) ((uint64_t) mini_capacity * percent / 100);
+        small = small < 1 ? 1 : (small > mini_capacity - 1 ? mini_capacity - 1 : small);
+        minis.push_back(new LIRS(mini_capacity - small, small));
+        mini_hir.push_back(hir);
+        if(hir <= hir_blk_sz)
+            mini_current = minis.size() - 1;
     }
-    page_entry_t *pop_back(){
-        auto ret = back();
-        remove(head->next);
-        return ret;
+    mini_epoch_hits.assign(minis.size(), 0);
+    mini_scores.assign(minis.size(), 0);
+    epoch_accesses = 0;
+}
+
+void LIRS::_sample(uint32_t page_no){
+    // not the index's multiplicative hash: the sampled pages would all
+    // land in one corner of the miniatures' indexes.
+    uint32_t h = page_no;
+    h = (h ^ (h >> 16)) * 0x85ebca6b;
+    h = (h ^ (h >> 13)) * 0xc2b2ae35;
+    if((h ^ (h >> 16)) >= sample_below)
+        return;
+    for(size_t i = 0; i < minis.size(); i++){
+        uint64_t hits = minis[i]->page_hits;
+        minis[i]->get_page(page_no);
+        mini_epoch_hits[i] += minis[i]->page_hits - hits;
     }
-    page_entry_t *pop_front(){
-        auto ret = front();
-        remove(ret);
-        return ret;
+    if(++epoch_accesses == ADAPT_EPOCH_SAMPLES)
+        _adapt();
+}
+
+// end of an epoch: lir_target goes to the split of the best miniature, if
+// it beats the current one by ADAPT_MARGIN.
+void LIRS::_adapt(){
+    size_t best = mini_current;
+    for(size_t i = 0; i < minis.size(); i++){
+        mini_scores[i] = mini_scores[i] / 2 + mini_epoch_hits[i];
+        mini_epoch_hits[i] = 0;
     }
-};
-
-class LIRS{
-    public:
-    uint32_t lir_blk_sz = 0;
-    uint32_t hir_blk_sz = 0;
-    uint32_t lir_left = 0;
-    uint32_t hir_left = 0;
-    list<page_entry_t*> *lirs_queue;
-    list<page_entry_t*> *hir_queue;
-    unordered_map<int, page_entry_t*> page_entries;
-    void _prune_stack(){
-        while(!lirs_queue->empty() && lirs_queue->back()->blk_type != LIR){
-            page_entry_t *back = lirs_queue->back();
-            lirs_queue->pop_back();
-            if(!(back->location&HIR_QUEUE)){
-                page_entries.erase(back->page_num);
-                delete back;
-            }
-            else{
-                back->location &= ~LIRS_QUEUE;
-            }
-        }
-        assert(!(lirs_queue->empty()) && "lirs_queue is empty! IN: _prune_stack");
+    for(size_t i = 0; i < minis.size(); i++){
+        if(mini_scores[i] > mini_scores[best] && mini_scores[i] > mini_scores[mini_current] * (1 + ADAPT_MARGIN))
+            best = i;
     }
+    epoch_accesses = 0;
+    mini_current = best;
+    lir_target = lir_blk_sz + hir_blk_sz - mini_hir[best];
+}
 
-    page_entry_t* access_lir(page_entry_t* page){ // hand traced
-        if(lirs_queue->back() == page){
-            lirs_queue->pop_back();
-            lirs_queue->push_front(page);
-            _prune_stack();
-        }
-        else{
-            lirs_queue->remove(page);
-            lirs_queue->push_front(page);
-        }
-        return page;
+// a HIR block has just become LIR: demote the bottom LIR block to keep the
+// sizes, or, in adaptive mode, move one block towards lir_target.
+void LIRS::_rebalance_on_promotion(){
+    if(adaptive && lir_blk_sz < lir_target && hir_blk_sz > hir_min){
+        lir_blk_sz++;
+        hir_blk_sz--;
+        return;
     }
-    page_entry_t* access_resident_hir(page_entry_t* page){
-        if(page->location&LIRS_QUEUE){ // hand traced
-            page->blk_type = LIR;
-            hir_queue->remove(page);
-            page->location &= ~HIR_QUEUE;
-
-            lirs_queue->remove(page);
-            lirs_queue->push_front(page);
-
-            auto base_lir = lirs_queue->back();
-            lirs_queue->pop_back();
-            base_lir->blk_type = HIR;
-            base_lir->location |= HIR_QUEUE;
-            base_lir->location &= ~LIRS_QUEUE;
-            hir_queue->push_back(base_lir);
-            _prune_stack();
-        }
-        else{ // TODO: trace by hand
-            hir_queue->remove(page);
+    _demote_bottom_lir();
+    if(adaptive && lir_blk_sz > lir_target && hir_blk_sz < hir_max){
+        _demote_bottom_lir();
+        lir_blk_sz--;
+        hir_blk_sz++;
+    }
+}
 
-            lirs_queue->push_front(page);
-            hir_queue->push_back(page);
+page_entry_t* LIRS::access_lir(page_entry_t* page){ // hand traced
+    if(lirs_queue.back() == page){
+        lirs_queue.pop_back();
+        lirs_queue.push_front(page);
+        _prune_stack();
+    }
+    else{
+        lirs_queue.remove(page);
+        lirs_queue.push_front(page);
+    }
+    return page;
+}
 
-            page->location |= LIRS_QUEUE;
-        }
-        return page;
+page_entry_t* LIRS::access_resident_hir(page_entry_t* page){
+    if(page->location&LIRS_QUEUE){ // hand traced
+        page->blk_type = LIR;
+        hir_queue.remove(page);
+        page->location &= ~HIR_QUEUE;
+
+        lirs_queue.remove(page);
+        lirs_queue.push_front(page);
+        _rebalance_on_promotion();
     }
-    page_entry_t* access_non_resident_hir(page_entry_t* page){ // hand traced
-        assert(!hir_queue->empty() && "hir_queue is empty! IN: access_non_resident_hir");
-        auto outgoing = hir_queue->front();
-        hir_queue->pop_front();
-        if(!(outgoing->location&LIRS_QUEUE)){
-            page_entries.erase(outgoing->page_num);
-            delete outgoing;
-        }
-        else{
-            outgoing->location &= ~HIR_QUEUE;
-            outgoing->in_memory = false;
-        }
-        if(page->location&LIRS_QUEUE){
-            lirs_queue->remove(page);
-            lirs_queue->push_front(page);
+    else{ // TODO: trace by hand
+        hir_queue.remove(page);
 
-            page->blk_type = LIR;
-            page->in_memory = true;
-            page->location &= ~HIR_QUEUE;
+        lirs_queue.push_front(page);
+        hir_queue.push_back(page);
+
+        page->location |= LIRS_QUEUE;
+    }
+    return page;
+}
 
-            auto back = lirs_queue->back();
-            lirs_queue->pop_back();
+page_entry_t* LIRS::access_non_resident_hir(page_entry_t* page, bool in_stack){ // hand traced
+    assert(!hir_queue.empty() && "hir_queue is empty! IN: access_non_resident_hir");
+    page_entry_t *outgoing = hir_queue.pop_front();
+    last_evicted = outgoing->page_num;
+    if(outgoing->location&LIRS_QUEUE){
+        // it stays in the stack as a ghost. It is not the bottom, which is LIR.
+        lirs_queue.remove(outgoing);
+        ghosts.insert(outgoing->page_num, outgoing->stamp, lirs_queue.back()->stamp);
+    }
+    _drop_entry(outgoing);
+    if(in_stack){
+        lirs_queue.push_front(page);
 
-            back->blk_type = HIR;
-            back->location &= ~LIRS_QUEUE;
-            back->location |= HIR_QUEUE;
-            hir_queue->push_back(back);
-            _prune_stack();
+        page->blk_type = LIR;
+        page->in_memory = true;
+        page->location &= ~HIR_QUEUE;
+        _rebalance_on_promotion();
+    }
+    else if(adaptive && lir_blk_sz < lir_target && hir_blk_sz > hir_min){
+        // without promotions (a loop) the LIR set grows by misses, as it
+        // does while the cache warms up.
+        lirs_queue.push_front(page);
+        page->blk_type = LIR;
+        page->in_memory = true;
+        page->location |= LIRS_QUEUE;
+        lir_blk_sz++;
+        hir_blk_sz--;
+    }
+    else{
+        lirs_queue.push_front(page);
+        hir_queue.push_back(page);
+        page->in_memory = true;
+        page->location |= HIR_QUEUE;
+        page->location |= LIRS_QUEUE;
+        page->blk_type = HIR;
+        if(adaptive && lir_blk_sz > lir_target && hir_blk_sz < hir_max){
+            _demote_bottom_lir();
+            lir_blk_sz--;
+            hir_blk_sz++;
         }
-        else{
-            lirs_queue->push_front(page);
-            hir_queue->push_back(page);
+    }
+    return page;
+}
+
+page_entry_t *LIRS::_get_page(uint32_t page_no){
+    page_entry_t *page = page_entries.find(page_no);
+    if(page == NULL && (this->hir_left || this->lir_left)){
+        if(this->lir_left){
+            page = _new_entry(page_no);
+            page->location |= LIRS_QUEUE;
             page->in_memory = true;
+            page->blk_type = LIR;
+            lirs_queue.push_front(page);
+            (this->lir_left)--;
+        }
+        else{
+            page = _new_entry(page_no);
             page->location |= HIR_QUEUE;
             page->location |= LIRS_QUEUE;
+            page->in_memory = true;
             page->blk_type = HIR;
+            lirs_queue.push_front(page);
+            hir_queue.push_back(page);
+            (this->hir_left)--;
         }
-        return page;
     }
-    page_entry_t *_get_page(uint32_t page_no){
-        page_entry_t *page = NULL;
-        if(this->page_entries.find(page_no) != this->page_entries.end()){
-            page = this->page_entries[page_no];
-        }
-        if(page == NULL && (this->hir_left || this->lir_left)){
-            if(this->lir_left){
-                page = new page_entry_t(page_no, NULL, NULL);
-                page_entries[page_no] = page;
-                page->location |= LIRS_QUEUE;
-                page->in_memory = true;
-                page->blk_type = LIR;
-                lirs_queue->push_front(page);
-                (this->lir_left)--;
-            }
-            else{
-                page = new page_entry_t(page_no, NULL, NULL);
-                page_entries[page_no] = page;
-                page->location |= HIR_QUEUE;
-                page->location |= LIRS_QUEUE;
-                page->in_memory = true;
-                page->blk_type = HIR;
-                lirs_queue->push_front(page);
-                hir_queue->push_back(page);
-                (this->hir_left)--;
-            }
-        }
-        else if(page == NULL){
-            // HIR non-resident block
-            page = new page_entry_t(page_no, NULL, NULL);
-            page_entries[page_no] = page;
-            access_non_resident_hir(page);
-        }
-        else if(page->blk_type == LIR){
-            // LIR Block
-            page_hits++;
-            return access_lir(page);
+    else if(page == NULL){
+        // HIR non-resident block, in the stack if its ghost is above the bottom
+        bool in_stack = ghosts.take(page_no, lirs_queue.back()->stamp);
+        if(!in_stack && admission && !admission->admit(page_no, hir_queue.front()->page_num)){
+            rejected++;
+            ghosts.insert(page_no, ++access_clock, lirs_queue.back()->stamp);
         }
-        else if(page->in_memory){
-            // resident HIR
-            page_hits++;
-            access_resident_hir(page);
-        }
-        else if(page->blk_type == HIR){
-            access_non_resident_hir(page);
+        else{
+            page = _new_entry(page_no);
+            access_non_resident_hir(page, in_stack);
         }
-        return page;
     }
+    else if(page->blk_type == LIR){
+        // LIR Block
+        page_hits++;
+        access_lir(page);
+    }
+    else{
+        // resident HIR
+        page_hits++;
+        access_resident_hir(page);
+    }
+    // every access puts the block on the top of the stack.
+    if(page != NULL)
+        page->stamp = ++access_clock;
+    if(adaptive)
+        _sample(page_no);
+    return page;
+}
 
+LIRS::LIRS(uint32_t lir_blk_sz, uint32_t hir_blk_sz, bool adaptive, uint32_t ghost_factor)
+    : slab((size_t) lir_blk_sz + hir_blk_sz),
+      page_entries((uint64_t) lir_blk_sz + hir_blk_sz),
+      ghosts((uint64_t) ghost_factor * (lir_blk_sz + hir_blk_sz)){
+    this->lir_blk_sz = lir_blk_sz;
+    this->hir_blk_sz = hir_blk_sz;
+    this->lir_left = lir_blk_sz;
+    this->hir_left = hir_blk_sz;
+    this->adaptive = adaptive;
+    this->lir_target = lir_blk_sz;
+    uint32_t capacity = lir_blk_sz + hir_blk_sz;
+    set_hir_bounds(capacity / 100, capacity / 2);
+}
 
-    public:
-    LIRS(uint32_t lir_blk_sz, uint32_t hir_blk_sz){
-        this->lir_blk_sz = lir_blk_sz;
-        this->hir_blk_sz = hir_blk_sz;
-        this->lir_left = lir_blk_sz;
-        this->hir_left = hir_blk_sz;
-        lirs_queue = new list<page_entry_t*>();
-        hir_queue = new list<page_entry_t*>();
-    }
+void LIRS::set_hir_bounds(uint32_t hir_min, uint32_t hir_max){
+    uint32_t capacity = lir_blk_sz + hir_blk_sz;
+    this->hir_min = hir_min ? hir_min : 1;
+    // the LIR set keeps at least one block.
+    this->hir_max = hir_max < capacity ? hir_max : capacity - 1;
+    if(this->hir_max < this->hir_min)
+        this->hir_max = this->hir_min;
+    if(adaptive)
+        _make_minis();
+}
 
-    ~LIRS(){
-        /*
-        TODO: free the doubly-linked-list from head to tail
-        */
-        while(!lirs_queue->empty()){
-            lirs_queue->pop_front();
-        }
-        delete lirs_queue;
-         while(!hir_queue->empty()){
-            hir_queue->pop_front();
-        }
-        delete hir_queue;
-        for(auto node: page_entries)
-            delete node.second;
-    }
-    page_entry_t *get_page(uint32_t page_no){
-        return _get_page(page_no);
-    }
-};
-
-int main(void){
-    int distribution[]   = {1, 1, 1, 2, 2, 3, 3, 4, 5, 6, 7, 8, 9, 10};
-    int access_pattern[] = {8, 3, 7, 1, 2, 3, 5, 10, 1, 8, 3, 1, 5, 1, 4, 1, 7, 1, 8, 4, 8};
-    int query_count = 100000;
-    random_device dev;
-    mt19937 rng(dev());
-    //uniform_int_distribution<std::mt19937::result_type> dist6(0, (sizeof(distribution)/sizeof(int))-1);
-    uniform_int_distribution<std::mt19937::result_type> dist6(0, 100000);
-    LIRS lirs(950,50);
-    cout << "No. of Queries: " << query_count << endl;
-    for(int i = 0; i < query_count; i++){
-        //int index = dist6(rng);
-        //cout<< "["<< i+1 << "]Index: " << index << endl;
-        int query = dist6(rng);
-        int prev = page_hits;
-        lirs.get_page(query);
-        //cout << "querying: " << query << ((prev != page_hits)? " HIT!" : " MISS!") << endl;
-    }
-    cout << "page_hits: " << page_hits << " : " << (float)(((float)page_hits/(float)query_count)*100) << "%" << endl;
-}
-
-// int main(void){
-//     int access_pattern[] = {8, 3, 7, 1, 2, 3, 5, 10, 1};
-//     LIRS lirs(3,2);
-//     int *nptr = NULL;
-//     for(auto q: access_pattern){
-//         cout << "Accessing: " << q << endl;
-//         lirs.get_page(q);
-//     }
-//     cout << "lirs_queue: ";
-//     for(auto i: *lirs.lirs_queue)
-//         cout << i->page_num << " ";
-//     cout << endl;
-//     cout << "hir_queue: ";
-//     for(auto i: *lirs.hir_queue)
-//         cout << i->page_num << " ";
-//     cout << endl;
-//     for(auto e: lirs.page_entries){
-//         cout << e.first << " " << e.second->in_memory << " " << (e.second->location&HIR_QUEUE) << " " << (e.second->location&LIRS_QUEUE) << " " << (e.second->blk_type) << endl;
-//     }
-// }
\ No newline at end of file
+LIRS::~LIRS(){
+    // every entry lives in the slab, which frees its chunks.
+    delete admission;
+    for(auto mini: minis)
+        delete mini;
+}
+
+void LIRS::set_admission(bool enabled){
+    delete admission;
+    admission = enabled ? new FrequencySketch((uint64_t) lir_blk_sz + hir_blk_sz) : NULL;
+}
+
+page_entry_t *LIRS::get_page(uint32_t page_no){
+    last_evicted = -1;
+    if(admission)
+        admission->record(page_no);
+    return _get_page(page_no);
+}
+
+bool LIRS::touch(uint32_t page_no){
+    if(admission)
+        admission->record(page_no);
+    if(adaptive)
+        _sample(page_no);
+    page_entry_t *page = page_entries.find(page_no);
+    if(page == NULL || !page->in_memory)
+        return false;
+    if(page->blk_type == LIR)
+        access_lir(page);
+    else
+        access_resident_hir(page);
+    page->stamp = ++access_clock;
+    return true;
+}
+
+size_t LIRS::metadata_bytes(){
+    return slab.get_capacity() * sizeof(page_entry_t)
+         + page_entries.get_capacity() * (sizeof(int64_t) + sizeof(page_entry_t*))
+         + ghosts.get_capacity() * sizeof(uint64_t);
+}
@@ -0,0 +1,126 @@
+/*
+* Verifies ConcurrentLIRS against the exact LIRS.
+*
+* Every trace is replayed through LIRS (1% of the cache for resident HIR
+* blocks) and through ConcurrentLIRS of the same size on one thread. The run
+* fails if the hit ratio of ConcurrentLIRS is more than `tolerance` below that
+* of LIRS on any trace. Then the zipf trace is replayed by 1..max_threads
+* threads to compare the throughput of ConcurrentLIRS with that of LIRS
+* behind a mutex; the hit ratio of every threaded run is held to the same
+* tolerance against single threaded LIRS.
+*
+* usage: lirs_trace_compare [cache_size] [accesses] [tolerance] [max_threads]
+*/
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include "lirs.h"
+#include "concurrent_lirs.h"
+#include "access_trace.h"
+
+using namespace std;
+
+typedef struct{
+    string         name;
+    access_trace_t trace;
+}named_trace_t;
+
+static double lirs_hit_ratio(const access_trace_t& trace, uint32_t cache_size){
+    uint32_t hir = cache_size / 100 ? cache_size / 100 : 1;
+    LIRS lirs(cache_size - hir, hir);
+    for(auto page: trace)
+        lirs.get_page(page);
+    return (double) lirs.page_hits / trace.size();
+}
+
+static double concurrent_hit_ratio(const access_trace_t& trace, uint32_t cache_size){
+    uint32_t hir = cache_size / 100 ? cache_size / 100 : 1;
+    ConcurrentLIRS lirs(cache_size - hir, hir);
+    uint64_t hits = 0;
+    for(auto page: trace)
+        hits += lirs.access(page);
+    return (double) hits / trace.size();
+}
+
+template<typename F>
+static double replay_threads(const access_trace_t& trace, uint32_t threads, F access){
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for(uint32_t t = 0; t < threads; t++){
+        workers.push_back(thread([&trace, t, threads, &access](){
+            for(size_t i = t; i < trace.size(); i += threads)
+                access(trace[i]);
+        }));
+    }
+    for(auto& worker: workers)
+        worker.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return trace.size() / secs;
+}
+
+int main(int argc, char** argv){
+    uint32_t cache_size  = (argc > 1) ? atoi(argv[1]) : 1000;
+    uint64_t accesses    = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1000000;
+    double   tolerance   = (argc > 3) ? atof(argv[3]) : 0.01;
+    uint32_t max_threads = (argc > 4) ? atoi(argv[4]) : 8;
+
+    vector<named_trace_t> traces(5);
+    traces[0].name = "zipf-0.99";
+    trace_zipf(&traces[0].trace, accesses, cache_size * 100, 0.99, 1);
+    traces[1].name = "zipf-0.7";
+    trace_zipf(&traces[1].trace, accesses, cache_size * 20, 0.7, 2);
+    traces[2].name = "scan+hotset";
+    trace_scan_hotset(&traces[2].trace, accesses, cache_size / 2, cache_size * 50, 0.7, 3);
+    traces[3].name = "loop";
+    trace_loop(&traces[3].trace, accesses, cache_size + cache_size / 5);
+    traces[4].name = "uniform";
+    trace_uniform(&traces[4].trace, accesses, cache_size * 10, 4);
+
+    int failures = 0;
+    double zipf_ratio = 0;
+    cout << "cache size: " << cache_size << " accesses: " << accesses << endl;
+    cout << setw(14) << "trace" << setw(10) << "LIRS" << setw(12) << "Concurrent" << endl;
+    for(auto& t: traces){
+        double lirs_ratio  = lirs_hit_ratio(t.trace, cache_size);
+        double conc_ratio  = concurrent_hit_ratio(t.trace, cache_size);
+        bool ok = conc_ratio + tolerance >= lirs_ratio;
+        failures += !ok;
+        if(&t == &traces[0])
+            zipf_ratio = lirs_ratio;
+        cout << setw(14) << t.name << fixed << setprecision(4)
+             << setw(10) << lirs_ratio << setw(12) << conc_ratio
+             << (ok ? "" : "  <-- FAIL") << endl;
+    }
+
+    cout << endl << setw(8) << "threads" << setw(18) << "LIRS+mutex ops/s" << setw(20) << "Concurrent ops/s" << setw(14) << "hit ratio" << endl;
+    for(uint32_t threads = 1; threads <= max_threads; threads *= 2){
+        uint32_t hir = cache_size / 100 ? cache_size / 100 : 1;
+        LIRS lirs(cache_size - hir, hir);
+        mutex lirs_latch;
+        double lirs_rate = replay_threads(traces[0].trace, threads, [&](uint32_t page){
+            lock_guard<mutex> guard(lirs_latch);
+            lirs.get_page(page);
+        });
+        ConcurrentLIRS conc(cache_size - hir, hir);
+        atomic<uint64_t> hits(0);
+        double conc_rate = replay_threads(traces[0].trace, threads, [&](uint32_t page){
+            if(conc.access(page))
+                hits.fetch_add(1, memory_order_relaxed);
+        });
+        double conc_ratio = (double) hits.load() / traces[0].trace.size();
+        bool ok = conc_ratio + tolerance >= zipf_ratio;
+        failures += !ok;
+        cout << setw(8) << threads << setprecision(0)
+             << setw(18) << lirs_rate << setw(20) << conc_rate
+             << setprecision(4) << setw(14) << conc_ratio
+             << (ok ? "" : "  <-- FAIL") << endl;
+    }
+    if(failures)
+        cout << failures << " run(s) outside tolerance" << endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include <cstring>
+#include "tiny_lfu.h"
+
+static uint64_t round_pow2(uint64_t n){
+    uint64_t size = 64;
+    while(size < n)
+        size <<= 1;
+    return size;
+}
+
+FrequencySketch::FrequencySketch(uint64_t capacity){
+    if(capacity == 0)
+        capacity = 1;
+    sample_size = SKETCH_SAMPLE_FACTOR * capacity;
+    // 16 counters per cached page, 8 doorkeeper bits per sampled access.
+    uint64_t ncounters = round_pow2(16 * capacity);
+    uint64_t nbits     = round_pow2(8 * sample_size);
+    counter_mask = ncounters - 1;
+    door_mask    = nbits - 1;
+    counters   = new uint64_t[ncounters / 16];
+    doorkeeper = new uint64_t[nbits / 64];
+    memset(counters, 0, ncounters / 16 * sizeof(uint64_t));
+    memset(doorkeeper, 0, nbits / 64 * sizeof(uint64_t));
+    additions = 0;
+}
+
+FrequencySketch::~FrequencySketch(){
+    delete[] counters;
+    delete[] doorkeeper;
+}
+
+bool FrequencySketch::_door_contains(uint64_t h){
+    uint64_t a = h & door_mask, b = (h >> 32) & door_mask;
+    return (doorkeeper[a >> 6] >> (a & 63) & 1) && (doorkeeper[b >> 6] >> (b & 63) & 1);
+}
+
+void FrequencySketch::_door_put(uint64_t h){
+    uint64_t a = h & door_mask, b = (h >> 32) & door_mask;
+    doorkeeper[a >> 6] |= 1ULL << (a & 63);
+    doorkeeper[b >> 6] |= 1ULL << (b & 63);
+}
+
+void FrequencySketch::_age(){
+    for(uint64_t i = 0; i <= counter_mask / 16; i++)
+        counters[i] = (counters[i] >> 1) & 0x7777777777777777ULL;
+    memset(doorkeeper, 0, (door_mask + 1) / 64 * sizeof(uint64_t));
+    additions = 0;
+}
+
+void FrequencySketch::record(int64_t key){
+    uint64_t h = _hash(key);
+    if(++additions >= sample_size)
+        _age();
+    if(!_door_contains(h)){
+        _door_put(h);
+        return;
+    }
+    // the row hashes come from a second mix so they are independent of the
+    // doorkeeper probes.
+    uint64_t g = _hash((int64_t) h);
+    uint64_t step = (g >> 32) | 1;
+    uint64_t idx[SKETCH_DEPTH];
+    uint32_t min = SKETCH_COUNTER_MAX;
+    for(int i = 0; i < SKETCH_DEPTH; i++){
+        idx[i] = (g + i * step) & counter_mask;
+        uint32_t c = _counter(idx[i]);
+        if(c < min)
+            min = c;
+    }
+    if(min == SKETCH_COUNTER_MAX)
+        return;
+    for(int i = 0; i < SKETCH_DEPTH; i++)
+        if(_counter(idx[i]) == min)
+            counters[idx[i] >> 4] += 1ULL << ((idx[i] & 15) << 2);
+}
+
+uint32_t FrequencySketch::estimate(int64_t key){
+    uint64_t h = _hash(key);
+    uint64_t g = _hash((int64_t) h);
+    uint64_t step = (g >> 32) | 1;
+    uint32_t min = SKETCH_COUNTER_MAX;
+    for(int i = 0; i < SKETCH_DEPTH; i++){
+        uint32_t c = _counter((g + i * step) & counter_mask);
+        if(c < min)
+            min = c;
+    }
+    return min + (_door_contains(h) ? 1 : 0);
+}
+
+size_t FrequencySketch::memory_bytes(){
+    return (counter_mask + 1) / 2 + (door_mask + 1) / 8;
+}
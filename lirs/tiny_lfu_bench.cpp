@@ -0,0 +1,88 @@
+/*
+* Measures what the TinyLFU admission filter buys LIRS.
+*
+* Skewed traces (zipf with several skews, zipf mixed with one-hit wonders,
+* and a hot set under a sequential scan) are replayed at a few cache sizes
+* through plain LIRS and through LIRS with set_admission(true), with 1% and
+* with 10% of the cache for resident HIR blocks. Prints the hit ratios, the
+* gain in points, the share of misses the filter kept out and the ns per
+* access. The filter only guards the HIR set, so it gains more when that
+* set is larger.
+*
+* usage: tiny_lfu_bench [accesses] [pages]
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "lirs.h"
+#include "access_trace.h"
+
+using namespace std;
+
+typedef struct{
+    string         name;
+    access_trace_t trace;
+}named_trace_t;
+
+typedef struct{
+    double hit_ratio;
+    double ns_per_access;
+    double rejected;
+}run_result_t;
+
+static run_result_t replay(const access_trace_t& trace, uint32_t cache_size, uint32_t hir_percent,
+                           bool admission){
+    uint32_t hir = cache_size * hir_percent / 100 ? cache_size * hir_percent / 100 : 1;
+    LIRS lirs(cache_size - hir, hir);
+    lirs.set_admission(admission);
+    auto start = chrono::steady_clock::now();
+    for(auto page: trace)
+        lirs.get_page(page);
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    run_result_t result;
+    result.hit_ratio     = (double) lirs.page_hits / trace.size();
+    result.ns_per_access = ns / trace.size();
+    result.rejected      = (double) lirs.rejected / (trace.size() - lirs.page_hits);
+    return result;
+}
+
+int main(int argc, char** argv){
+    uint64_t accesses = (argc > 1) ? strtoull(argv[1], NULL, 10) : 2000000;
+    uint32_t pages    = (argc > 2) ? atoi(argv[2]) : 100000;
+
+    vector<named_trace_t> traces(6);
+    traces[0].name = "zipf-0.7";
+    trace_zipf(&traces[0].trace, accesses, pages, 0.7, 1);
+    traces[1].name = "zipf-0.9";
+    trace_zipf(&traces[1].trace, accesses, pages, 0.9, 2);
+    traces[2].name = "zipf-0.99";
+    trace_zipf(&traces[2].trace, accesses, pages, 0.99, 3);
+    traces[3].name = "zipf-0.9+20%once";
+    trace_one_hit(&traces[3].trace, accesses, pages, 0.9, 0.2, 4);
+    traces[4].name = "zipf-0.9+50%once";
+    trace_one_hit(&traces[4].trace, accesses, pages, 0.9, 0.5, 5);
+    traces[5].name = "scan+hotset";
+    trace_scan_hotset(&traces[5].trace, accesses, pages / 20, pages, 0.7, 6);
+
+    uint32_t sizes[] = {pages / 200, pages / 50, pages / 10};
+    uint32_t hir_percents[] = {1, 10};
+    printf("%-18s %8s %4s %10s %10s %8s %9s %8s %8s\n", "trace", "cache", "hir", "LIRS", "+TinyLFU",
+           "gain", "rejected", "ns/acc", "ns/acc+");
+    for(auto& t: traces){
+        for(auto cache_size: sizes){
+            if(cache_size < 2)
+                continue;
+            for(auto hir_percent: hir_percents){
+                run_result_t plain  = replay(t.trace, cache_size, hir_percent, false);
+                run_result_t filter = replay(t.trace, cache_size, hir_percent, true);
+                printf("%-18s %8u %3u%% %10.4f %10.4f %+8.2f %8.1f%% %8.1f %8.1f\n", t.name.c_str(),
+                       cache_size, hir_percent, plain.hit_ratio, filter.hit_ratio,
+                       (filter.hit_ratio - plain.hit_ratio) * 100, filter.rejected * 100,
+                       plain.ns_per_access, filter.ns_per_access);
+            }
+        }
+    }
+    return 0;
+}
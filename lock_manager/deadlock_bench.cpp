@@ -0,0 +1,129 @@
+/*
+* Transfers between random pairs of accounts, locked in whatever order the
+* pair comes in, so transactions deadlock all the time. Runs the workload
+* under every deadlock policy and reports throughput, aborts, time spent
+* blocked and the worst time a transfer took from its first attempt to its
+* commit. An aborted transfer is retried with the same transaction id.
+* Balances are moved without any other synchronization than the locks; the
+* total is checked at the end.
+*
+* usage: deadlock_bench [threads] [transfers_per_thread] [accounts] [work_us]
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include "lock_manager.h"
+
+using namespace std;
+
+#define ACCOUNTS_PER_PAGE   54
+#define INITIAL_BALANCE     1000
+
+typedef struct{
+    const char        *name;
+    deadlock_config_t config;
+}bench_policy_t;
+
+static resource_id_t account_of(uint32_t account){
+    return resource_id_t::tuple_of(1, 1, account / ACCOUNTS_PER_PAGE, account % ACCOUNTS_PER_PAGE);
+}
+
+static void transfer_worker(LockManager *manager, vector<int64_t> *balances, uint32_t id,
+                            uint64_t transfers, uint32_t work_us, atomic<uint64_t> *next_txn,
+                            uint64_t *aborts, double *worst_ms){
+    mt19937_64 rng(0x9e3779b97f4a7c15ULL * (id + 1));
+    uniform_int_distribution<uint32_t> pick(0, balances->size() - 1);
+    for(uint64_t i = 0; i < transfers; i++){
+        uint32_t from = pick(rng), to = pick(rng);
+        while(to == from)
+            to = pick(rng);
+        uint64_t txn_id = next_txn->fetch_add(1);
+        auto start = chrono::steady_clock::now();
+        for(;;){
+            Transaction txn(txn_id);
+            bool ok = manager->lock_path(&txn, account_of(from), LOCK_X) == LOCK_GRANTED;
+            if(ok){
+                // read the balance before going for the second account.
+                this_thread::sleep_for(chrono::microseconds(work_us));
+                ok = manager->lock_path(&txn, account_of(to), LOCK_X) == LOCK_GRANTED;
+            }
+            if(ok){
+                (*balances)[from] -= 10;
+                (*balances)[to]   += 10;
+            }
+            manager->release_all(&txn);
+            if(ok)
+                break;
+            (*aborts)++;
+            this_thread::yield();
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if(ms > *worst_ms)
+            *worst_ms = ms;
+    }
+}
+
+int main(int argc, char **argv){
+    uint32_t threads   = (argc > 1) ? atoi(argv[1]) : 8;
+    uint64_t transfers = (argc > 2) ? strtoull(argv[2], NULL, 10) : 500;
+    uint32_t accounts  = (argc > 3) ? atoi(argv[3]) : 16;
+    uint32_t work_us   = (argc > 4) ? atoi(argv[4]) : 50;
+    if(accounts < 2)
+        accounts = 2;
+
+    bench_policy_t policies[] = {
+        {"detect/youngest", {DEADLOCK_DETECT, DEADLOCK_DETECT_INTERVAL_MS, VICTIM_YOUNGEST}},
+        {"detect/fewest",   {DEADLOCK_DETECT, DEADLOCK_DETECT_INTERVAL_MS, VICTIM_FEWEST_LOCKS}},
+        {"detect/1ms",      {DEADLOCK_DETECT, 1, VICTIM_YOUNGEST}},
+        {"wait-die",        {DEADLOCK_WAIT_DIE, 0, VICTIM_YOUNGEST}},
+        {"wound-wait",      {DEADLOCK_WOUND_WAIT, 0, VICTIM_YOUNGEST}},
+    };
+
+    cout << "threads: " << threads << " transfers/thread: " << transfers
+         << " accounts: " << accounts << " work: " << work_us << "us" << endl;
+    cout << setw(16) << "policy" << setw(12) << "xfers/s" << setw(9) << "aborts"
+         << setw(11) << "deadlocks" << setw(7) << "dies" << setw(8) << "wounds"
+         << setw(13) << "avg wait ms" << setw(14) << "worst xfer ms" << endl;
+    int rc = 0;
+    for(auto& policy: policies){
+        LockManager manager(LOCK_ESCALATION_THRESHOLD, LOCK_DEFAULT_SHARDS, policy.config);
+        vector<int64_t> balances(accounts, INITIAL_BALANCE);
+        atomic<uint64_t> next_txn(1);
+        vector<uint64_t> aborts(threads, 0);
+        vector<double> worst(threads, 0);
+        vector<thread> workers;
+        auto start = chrono::steady_clock::now();
+        for(uint32_t t = 0; t < threads; t++)
+            workers.emplace_back(transfer_worker, &manager, &balances, t, transfers, work_us,
+                                 &next_txn, &aborts[t], &worst[t]);
+        for(auto& worker: workers)
+            worker.join();
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        lock_stats_t stats = manager.get_stats();
+        uint64_t total_aborts = 0;
+        double worst_ms = 0;
+        for(uint32_t t = 0; t < threads; t++){
+            total_aborts += aborts[t];
+            worst_ms = max(worst_ms, worst[t]);
+        }
+        int64_t total = 0;
+        for(auto balance: balances)
+            total += balance;
+        if(total != (int64_t) accounts * INITIAL_BALANCE || stats.live_locks != 0){
+            cerr << policy.name << ": total " << total << ", live locks " << stats.live_locks << endl;
+            rc = 1;
+        }
+        cout << setw(16) << policy.name << fixed << setprecision(0)
+             << setw(12) << threads * transfers / secs << setw(9) << total_aborts
+             << setw(11) << stats.deadlocks << setw(7) << stats.dies << setw(8) << stats.wounds
+             << setprecision(3) << setw(13) << (stats.waited ? stats.blocked_ns / 1e6 / stats.waited : 0)
+             << setprecision(1) << setw(14) << worst_ms << endl;
+    }
+    return rc;
+}
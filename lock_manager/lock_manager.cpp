@@ -0,0 +1,588 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "lock_manager.h"
+
+using namespace std;
+
+/*---------------------- Modes -----------------------------------------------*/
+
+static const bool compatibility[LOCK_MODE_COUNT][LOCK_MODE_COUNT] = {
+    //           NL     IS     IX     S      SIX    X
+    /* NL  */ {true,  true,  true,  true,  true,  true },
+    /* IS  */ {true,  true,  true,  true,  true,  false},
+    /* IX  */ {true,  true,  true,  false, false, false},
+    /* S   */ {true,  true,  false, true,  false, false},
+    /* SIX */ {true,  true,  false, false, false, false},
+    /* X   */ {true,  false, false, false, false, false},
+};
+
+static const lock_mode_t supremum[LOCK_MODE_COUNT][LOCK_MODE_COUNT] = {
+    //           NL        IS        IX        S         SIX       X
+    /* NL  */ {LOCK_NL,  LOCK_IS,  LOCK_IX,  LOCK_S,   LOCK_SIX, LOCK_X},
+    /* IS  */ {LOCK_IS,  LOCK_IS,  LOCK_IX,  LOCK_S,   LOCK_SIX, LOCK_X},
+    /* IX  */ {LOCK_IX,  LOCK_IX,  LOCK_IX,  LOCK_SIX, LOCK_SIX, LOCK_X},
+    /* S   */ {LOCK_S,   LOCK_S,   LOCK_SIX, LOCK_S,   LOCK_SIX, LOCK_X},
+    /* SIX */ {LOCK_SIX, LOCK_SIX, LOCK_SIX, LOCK_SIX, LOCK_SIX, LOCK_X},
+    /* X   */ {LOCK_X,   LOCK_X,   LOCK_X,   LOCK_X,   LOCK_X,   LOCK_X},
+};
+
+const char *lock_mode_name(lock_mode_t mode){
+    static const char *names[LOCK_MODE_COUNT] = {"NL", "IS", "IX", "S", "SIX", "X"};
+    return names[mode];
+}
+
+bool lock_compatible(lock_mode_t held, lock_mode_t requested){
+    return compatibility[held][requested];
+}
+
+lock_mode_t lock_supremum(lock_mode_t a, lock_mode_t b){
+    return supremum[a][b];
+}
+
+lock_mode_t lock_parent_mode(lock_mode_t mode){
+    return (mode == LOCK_IS || mode == LOCK_S) ? LOCK_IS : LOCK_IX;
+}
+
+bool lock_covers(lock_mode_t held, lock_mode_t mode){
+    if(held == LOCK_X)
+        return true;
+    return (held == LOCK_S || held == LOCK_SIX) && (mode == LOCK_IS || mode == LOCK_S);
+}
+
+/*---------------------- Resources -------------------------------------------*/
+
+resource_id_t resource_id_t::database(uint32_t db){
+    return {db, 0, 0, 0, LEVEL_DATABASE};
+}
+
+resource_id_t resource_id_t::file_of(uint32_t db, uint32_t file){
+    return {db, file, 0, 0, LEVEL_FILE};
+}
+
+resource_id_t resource_id_t::page_of(uint32_t db, uint32_t file, uint32_t page){
+    return {db, file, page, 0, LEVEL_PAGE};
+}
+
+resource_id_t resource_id_t::tuple_of(uint32_t db, uint32_t file, uint32_t page, uint32_t tuple){
+    return {db, file, page, tuple, LEVEL_TUPLE};
+}
+
+resource_id_t resource_id_t::ancestor(lock_level_t at) const{
+    resource_id_t res = *this;
+    if(at < LEVEL_TUPLE)
+        res.tuple = 0;
+    if(at < LEVEL_PAGE)
+        res.page = 0;
+    if(at < LEVEL_FILE)
+        res.file = 0;
+    res.level = at;
+    return res;
+}
+
+resource_id_t resource_id_t::parent() const{
+    return level == LEVEL_DATABASE ? *this : ancestor((lock_level_t) (level - 1));
+}
+
+bool resource_id_t::is_ancestor_of(const resource_id_t& other) const{
+    return level < other.level && other.ancestor(level) == *this;
+}
+
+bool resource_id_t::operator<(const resource_id_t& other) const{
+    if(db != other.db)
+        return db < other.db;
+    if(file != other.file)
+        return file < other.file;
+    if(page != other.page)
+        return page < other.page;
+    if(tuple != other.tuple)
+        return tuple < other.tuple;
+    return level < other.level;
+}
+
+bool resource_id_t::operator==(const resource_id_t& other) const{
+    return db == other.db && file == other.file && page == other.page &&
+           tuple == other.tuple && level == other.level;
+}
+
+// splitmix64 finalizer
+static inline uint64_t mix64(uint64_t x){
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t resource_id_t::hash() const{
+    return mix64((((uint64_t) page << 32) | tuple) ^ mix64((((uint64_t) db << 32) | file) + level));
+}
+
+/*---------------------- Transaction -----------------------------------------*/
+
+Transaction::Transaction(uint64_t txn_id){
+    this->txn_id = txn_id;
+    phase = TXN_GROWING;
+    signalled = false;
+}
+
+/*---------------------- Lock manager ----------------------------------------*/
+
+LockManager::LockManager(uint32_t escalation_threshold, uint32_t shard_count, deadlock_config_t deadlock){
+    this->escalation_threshold = escalation_threshold ? escalation_threshold : 1;
+    if(shard_count == 0)
+        shard_count = 1;
+    for(uint32_t i = 0; i < shard_count; i++)
+        shards.push_back(new lock_shard_t());
+    escalations.store(0);
+    escalation_failures.store(0);
+    if(deadlock.detect_interval_ms == 0)
+        deadlock.detect_interval_ms = 1;
+    this->deadlock = deadlock;
+    deadlocks.store(0);
+    dies.store(0);
+    wounds.store(0);
+    stopping = false;
+    if(deadlock.policy == DEADLOCK_DETECT)
+        detector = thread(&LockManager::_run_detector, this);
+}
+
+LockManager::~LockManager(){
+    {
+        lock_guard<mutex> guard(detector_latch);
+        stopping = true;
+    }
+    detector_cond.notify_one();
+    if(detector.joinable())
+        detector.join();
+    for(auto shard: shards)
+        delete shard;
+}
+
+// can a transaction holding `current` be granted `mode` on lock right now?
+bool LockManager::_grantable(lock_t *lock, lock_mode_t mode, lock_mode_t current){
+    for(int m = LOCK_IS; m < LOCK_MODE_COUNT; m++){
+        uint32_t others = lock->granted_count[m] - (m == current ? 1 : 0);
+        if(others > 0 && !lock_compatible((lock_mode_t) m, mode))
+            return false;
+    }
+    return true;
+}
+
+// pending conversions first, then new requests in FIFO order; stops at the
+// first one that has to keep waiting.
+void LockManager::_grant_waiters(lock_t *lock){
+    if(lock->waiting == 0)
+        return;
+    auto it = lock->queue.begin();
+    for(; it != lock->queue.end() && it->granted; it++){
+        if(it->upgrade_to == LOCK_NL)
+            continue;
+        if(!_grantable(lock, it->upgrade_to, it->mode))
+            return;
+        lock->granted_count[it->mode]--;
+        lock->granted_count[it->upgrade_to]++;
+        it->mode = it->upgrade_to;
+        it->upgrade_to = LOCK_NL;
+        lock->waiting--;
+        _wake(it->txn);
+    }
+    for(; it != lock->queue.end(); it++){
+        if(!_grantable(lock, it->mode, LOCK_NL))
+            return;
+        it->granted = true;
+        lock->granted_count[it->mode]++;
+        lock->waiting--;
+        _wake(it->txn);
+    }
+}
+
+// latch held. The transactions req waits for: the granted ones it conflicts
+// with and, as grants go in queue order, the pending requests ahead of it.
+void LockManager::_blockers(lock_t *lock, request_it req, vector<Transaction*>& out){
+    lock_mode_t want = req->granted ? req->upgrade_to : req->mode;
+    bool ahead = true;
+    for(auto other = lock->queue.begin(); other != lock->queue.end(); other++){
+        if(other == req){
+            ahead = false;
+            continue;
+        }
+        if(other->granted ? !lock_compatible(other->mode, want) || (ahead && other->upgrade_to != LOCK_NL)
+                          : ahead)
+            out.push_back(other->txn);
+    }
+}
+
+// txn's wait latch is only ever taken last, so this is safe under any
+// shard latch.
+void LockManager::_wake(Transaction *txn){
+    lock_guard<mutex> guard(txn->wait_latch);
+    txn->signalled = true;
+    txn->cond.notify_one();
+}
+
+// a latch that keeps victim alive is held: the one of a shard where it has
+// a request. Shrinking transactions are about to release everything anyway.
+bool LockManager::_abort(Transaction *victim){
+    txn_phase_t growing = TXN_GROWING;
+    if(!victim->phase.compare_exchange_strong(growing, TXN_ABORTED))
+        return false;
+    _wake(victim);
+    return true;
+}
+
+// latch held; req has just queued up. Applies the prevention policy: false
+// if txn has to die instead of waiting.
+bool LockManager::_may_wait(lock_t *lock, request_it req, Transaction *txn){
+    if(deadlock.policy != DEADLOCK_WAIT_DIE && deadlock.policy != DEADLOCK_WOUND_WAIT)
+        return true;
+    vector<Transaction*> blockers;
+    _blockers(lock, req, blockers);
+    for(auto other: blockers){
+        if(deadlock.policy == DEADLOCK_WAIT_DIE){
+            if(other->txn_id < txn->txn_id){
+                txn->phase = TXN_ABORTED;
+                dies.fetch_add(1, memory_order_relaxed);
+                return false;
+            }
+        }
+        else if(other->txn_id > txn->txn_id && _abort(other)){
+            wounds.fetch_add(1, memory_order_relaxed);
+        }
+    }
+    return true;
+}
+
+// latch held through guard, and held again on return: req is granted or
+// txn has been aborted.
+void LockManager::_wait(unique_lock<mutex>& guard, lock_shard_t *shard, request_it req, Transaction *txn){
+    auto start = chrono::steady_clock::now();
+    shard->waiters++;
+    while((!req->granted || req->upgrade_to != LOCK_NL) && txn->phase != TXN_ABORTED){
+        guard.unlock();
+        {
+            unique_lock<mutex> sleep(txn->wait_latch);
+            while(!txn->signalled)
+                txn->cond.wait(sleep);
+            txn->signalled = false;
+        }
+        guard.lock();
+    }
+    shard->waiters--;
+    shard->waited++;
+    shard->blocked_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+// txn's own state only. GRANTED means the request may go ahead.
+lock_status_t LockManager::_check(Transaction *txn, const resource_id_t& res, lock_mode_t mode){
+    if(txn->phase == TXN_ABORTED)
+        return LOCK_ABORTED;
+    if(txn->phase != TXN_GROWING || mode == LOCK_NL)
+        return LOCK_ILLEGAL;
+    for(int level = LEVEL_DATABASE; level < res.level; level++){
+        auto it = txn->held.find(res.ancestor((lock_level_t) level));
+        if(it != txn->held.end() && lock_covers(it->second, mode))
+            return LOCK_COVERED;
+    }
+    if(res.level != LEVEL_DATABASE){
+        auto it = txn->held.find(res.parent());
+        lock_mode_t needed = lock_parent_mode(mode);
+        if(it == txn->held.end() || lock_supremum(it->second, needed) != it->second)
+            return LOCK_ILLEGAL;
+    }
+    return LOCK_GRANTED;
+}
+
+void LockManager::_count_below(Transaction *txn, const resource_id_t& res, int delta){
+    for(int level = LEVEL_DATABASE; level < res.level; level++){
+        resource_id_t ancestor = res.ancestor((lock_level_t) level);
+        uint32_t& count = txn->below[ancestor];
+        count += delta;
+        if(count == 0)
+            txn->below.erase(ancestor);
+    }
+}
+
+// Without `wait`, a request that can not be granted at once leaves
+// everything as it was and returns LOCK_ABORTED.
+lock_status_t LockManager::_acquire(Transaction *txn, const resource_id_t& res, lock_mode_t mode, bool wait){
+    auto held = txn->held.find(res);
+    lock_mode_t current = held == txn->held.end() ? LOCK_NL : held->second;
+    lock_mode_t target  = lock_supremum(current, mode);
+    if(target == current)
+        return LOCK_GRANTED;
+    lock_shard_t *shard = _shard_of(res);
+    unique_lock<mutex> guard(shard->latch);
+    lock_t *lock = &shard->table[res];
+    // a conversion only waits for the granted locks and the conversions
+    // queued before it; a new request waits behind everybody.
+    bool free_now = _grantable(lock, target, current);
+    if(current == LOCK_NL)
+        free_now = free_now && lock->waiting == 0;
+    for(auto it = lock->queue.begin(); free_now && it != lock->queue.end() && it->granted; it++)
+        free_now = it->upgrade_to == LOCK_NL;
+    if(!free_now && !wait){
+        if(lock->queue.empty())
+            shard->table.erase(res);
+        return LOCK_ABORTED;
+    }
+    if(current != LOCK_NL){
+        auto req = lock->queue.begin();
+        while(req->txn != txn)
+            req++;
+        if(free_now){
+            lock->granted_count[current]--;
+            lock->granted_count[target]++;
+            req->mode = target;
+        }
+        else{
+            // conversions are served before any new request.
+            req->upgrade_to = target;
+            lock->waiting++;
+            if(_may_wait(lock, req, txn))
+                _wait(guard, shard, req, txn);
+            if(req->upgrade_to != LOCK_NL){
+                // aborted; the lock held so far stays until release_all().
+                req->upgrade_to = LOCK_NL;
+                lock->waiting--;
+                _grant_waiters(lock);
+                return LOCK_ABORTED;
+            }
+        }
+    }
+    else if(free_now){
+        auto pos = lock->queue.begin();
+        while(pos != lock->queue.end() && pos->granted)
+            pos++;
+        lock->queue.insert(pos, {txn, target, true, LOCK_NL});
+        lock->granted_count[target]++;
+    }
+    else{
+        auto req = lock->queue.insert(lock->queue.end(), {txn, target, false, LOCK_NL});
+        lock->waiting++;
+        if(_may_wait(lock, req, txn))
+            _wait(guard, shard, req, txn);
+        if(!req->granted){
+            lock->queue.erase(req);
+            lock->waiting--;
+            if(lock->queue.empty())
+                shard->table.erase(res);
+            else
+                _grant_waiters(lock);
+            return LOCK_ABORTED;
+        }
+    }
+    shard->granted++;
+    guard.unlock();
+    txn->held[res] = target;
+    if(current == LOCK_NL)
+        _count_below(txn, res, 1);
+    return LOCK_GRANTED;
+}
+
+// txn holds a lock on res.
+void LockManager::_release(Transaction *txn, const resource_id_t& res){
+    lock_shard_t *shard = _shard_of(res);
+    unique_lock<mutex> guard(shard->latch);
+    auto node = shard->table.find(res);
+    lock_t *lock = &node->second;
+    auto req = lock->queue.begin();
+    while(req->txn != txn)
+        req++;
+    lock->granted_count[req->mode]--;
+    lock->queue.erase(req);
+    if(lock->queue.empty())
+        shard->table.erase(node);
+    else
+        _grant_waiters(lock);
+    guard.unlock();
+    txn->held.erase(res);
+    _count_below(txn, res, -1);
+}
+
+// txn has just taken a new lock on res. Escalation is tried at
+// the nearest file or page whose count of txn's locks below it has just
+// gone past threshold, 2 * threshold, ...
+void LockManager::_maybe_escalate(Transaction *txn, const resource_id_t& res){
+    for(int level = res.level - 1; level >= LEVEL_FILE; level--){
+        resource_id_t ancestor = res.ancestor((lock_level_t) level);
+        auto count = txn->below.find(ancestor);
+        if(count == txn->below.end() || count->second <= escalation_threshold ||
+           (count->second - escalation_threshold - 1) % escalation_threshold != 0)
+            continue;
+        lock_mode_t held   = txn->held[ancestor];
+        lock_mode_t target = held == LOCK_IS ? LOCK_S : LOCK_X;
+        if(_acquire(txn, ancestor, target, false) != LOCK_GRANTED){
+            escalation_failures.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        // the descendants of ancestor are contiguous in the ordered map.
+        vector<resource_id_t> finer;
+        for(auto it = txn->held.upper_bound(ancestor);
+            it != txn->held.end() && ancestor.is_ancestor_of(it->first); it++)
+            finer.push_back(it->first);
+        for(auto it = finer.rbegin(); it != finer.rend(); it++)
+            _release(txn, *it);
+        escalations.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+}
+
+lock_status_t LockManager::lock(Transaction *txn, const resource_id_t& res, lock_mode_t mode){
+    lock_status_t status = _check(txn, res, mode);
+    if(status != LOCK_GRANTED)
+        return status;
+    bool fresh = txn->held.find(res) == txn->held.end();
+    status = _acquire(txn, res, mode, true);
+    if(status == LOCK_GRANTED && fresh && res.level > LEVEL_FILE)
+        _maybe_escalate(txn, res);
+    return status;
+}
+
+lock_status_t LockManager::lock_path(Transaction *txn, const resource_id_t& res, lock_mode_t mode){
+    lock_mode_t intention = lock_parent_mode(mode);
+    for(int level = LEVEL_DATABASE; level < res.level; level++){
+        lock_status_t status = lock(txn, res.ancestor((lock_level_t) level), intention);
+        if(status != LOCK_GRANTED)
+            return status;
+    }
+    return lock(txn, res, mode);
+}
+
+lock_status_t LockManager::unlock(Transaction *txn, const resource_id_t& res){
+    if(txn->held.find(res) == txn->held.end())
+        return LOCK_ILLEGAL;
+    // children go first, a lock may not be left without its intention lock.
+    if(txn->below.find(res) != txn->below.end())
+        return LOCK_ILLEGAL;
+    txn_phase_t growing = TXN_GROWING;
+    txn->phase.compare_exchange_strong(growing, TXN_SHRINKING);
+    _release(txn, res);
+    return LOCK_GRANTED;
+}
+
+void LockManager::release_all(Transaction *txn){
+    txn_phase_t growing = TXN_GROWING;
+    txn->phase.compare_exchange_strong(growing, TXN_SHRINKING);
+    // descendants sort after their ancestors, so reverse order frees
+    // children before parents.
+    while(!txn->held.empty())
+        _release(txn, prev(txn->held.end())->first);
+    txn->below.clear();
+}
+
+lock_mode_t LockManager::held_mode(Transaction *txn, const resource_id_t& res){
+    auto it = txn->held.find(res);
+    return it == txn->held.end() ? LOCK_NL : it->second;
+}
+
+/*---------------------- Deadlock detection ----------------------------------*/
+
+typedef unordered_map<Transaction*, vector<Transaction*>> waits_for_t;
+
+// depth first; on success `path` holds the cycle.
+static bool find_cycle(const waits_for_t& graph, Transaction *txn,
+                       unordered_map<Transaction*, int>& colour, vector<Transaction*>& path){
+    colour[txn] = 1;
+    path.push_back(txn);
+    auto edges = graph.find(txn);
+    if(edges != graph.end()){
+        for(auto next: edges->second){
+            int c = colour[next];
+            if(c == 1){
+                path.erase(path.begin(), find(path.begin(), path.end(), next));
+                return true;
+            }
+            if(c == 0 && find_cycle(graph, next, colour, path))
+                return true;
+        }
+    }
+    colour[txn] = 2;
+    path.pop_back();
+    return false;
+}
+
+// Latches the shards that have sleepers, in order, and keeps them until
+// done so the graph is consistent; nobody else holds two shard latches.
+// A waiting transaction does not touch its lock set, so held.size() is
+// stable.
+void LockManager::_detect_deadlocks(){
+    vector<unique_lock<mutex>> guards;
+    vector<lock_shard_t*> latched;
+    uint32_t sleepers = 0;
+    for(auto shard: shards){
+        unique_lock<mutex> guard(shard->latch);
+        if(shard->waiters == 0)
+            continue;
+        sleepers += shard->waiters;
+        guards.push_back(move(guard));
+        latched.push_back(shard);
+    }
+    if(sleepers < 2)
+        return;
+    waits_for_t waits_for;
+    for(auto shard: latched){
+        for(auto& node: shard->table){
+            lock_t *lock = &node.second;
+            if(lock->waiting == 0)
+                continue;
+            for(auto req = lock->queue.begin(); req != lock->queue.end(); req++){
+                if((!req->granted || req->upgrade_to != LOCK_NL) && req->txn->phase == TXN_GROWING)
+                    _blockers(lock, req, waits_for[req->txn]);
+            }
+        }
+    }
+    unordered_map<Transaction*, int> colour;
+    vector<Transaction*> cycle;
+    for(;;){
+        colour.clear();
+        cycle.clear();
+        bool found = false;
+        for(auto& node: waits_for){
+            if(colour[node.first] == 0 && find_cycle(waits_for, node.first, colour, cycle)){
+                found = true;
+                break;
+            }
+        }
+        if(!found)
+            return;
+        Transaction *victim = cycle[0];
+        for(auto txn: cycle){
+            bool fewer = deadlock.victim == VICTIM_FEWEST_LOCKS && txn->held.size() != victim->held.size();
+            if(fewer ? txn->held.size() < victim->held.size() : txn->txn_id > victim->txn_id)
+                victim = txn;
+        }
+        if(_abort(victim))
+            deadlocks.fetch_add(1, memory_order_relaxed);
+        // its request leaves the queue once it wakes up.
+        waits_for.erase(victim);
+    }
+}
+
+void LockManager::_run_detector(){
+    unique_lock<mutex> guard(detector_latch);
+    while(!stopping){
+        detector_cond.wait_for(guard, chrono::milliseconds(deadlock.detect_interval_ms));
+        if(stopping)
+            break;
+        guard.unlock();
+        _detect_deadlocks();
+        guard.lock();
+    }
+}
+
+lock_stats_t LockManager::get_stats(){
+    lock_stats_t snapshot = {};
+    for(auto shard: shards){
+        lock_guard<mutex> guard(shard->latch);
+        snapshot.granted    += shard->granted;
+        snapshot.waited     += shard->waited;
+        snapshot.blocked_ns += shard->blocked_ns;
+        snapshot.live_locks += shard->table.size();
+    }
+    snapshot.escalations         = escalations.load(memory_order_relaxed);
+    snapshot.escalation_failures = escalation_failures.load(memory_order_relaxed);
+    snapshot.deadlocks           = deadlocks.load(memory_order_relaxed);
+    snapshot.dies                = dies.load(memory_order_relaxed);
+    snapshot.wounds              = wounds.load(memory_order_relaxed);
+    return snapshot;
+}
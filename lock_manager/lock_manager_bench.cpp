@@ -0,0 +1,74 @@
+/*
+* Lock and unlock throughput of the LockManager as the number of shards and
+* client threads grows.
+*
+* usage: lock_manager_bench [txns_per_thread] [locks_per_txn] [max_shards] [max_threads]
+*
+* Every transaction S locks random tuples of a shared file, X locks tuples of
+* a file of its own thread (one write per four locks) and releases them all.
+* No request ever has to wait, so the numbers show the cost of the lock table
+* itself: the latches, the hash lookups and the intention locks the tuples
+* share. ops/s counts tuple locks plus their releases.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include "lock_manager.h"
+
+using namespace std;
+
+#define BENCH_PAGES             4096
+#define BENCH_TUPLES_PER_PAGE   54
+
+static void bench_worker(LockManager *manager, uint32_t id, uint64_t txns, uint32_t locks_per_txn){
+    mt19937_64 rng(0x9e3779b97f4a7c15ULL * (id + 1));
+    uniform_int_distribution<uint32_t> page(0, BENCH_PAGES - 1);
+    uniform_int_distribution<uint32_t> tuple(0, BENCH_TUPLES_PER_PAGE - 1);
+    for(uint64_t i = 0; i < txns; i++){
+        Transaction txn((uint64_t) id << 40 | i);
+        for(uint32_t l = 0; l < locks_per_txn; l++){
+            if(l % 4 == 3)
+                manager->lock_path(&txn, resource_id_t::tuple_of(1, 2 + id, page(rng), tuple(rng)), LOCK_X);
+            else
+                manager->lock_path(&txn, resource_id_t::tuple_of(1, 1, page(rng), tuple(rng)), LOCK_S);
+        }
+        manager->release_all(&txn);
+    }
+}
+
+static double run_bench(uint32_t shards, uint32_t threads, uint64_t txns, uint32_t locks_per_txn){
+    // escalation would hide the fine grained locks this measures.
+    LockManager manager(locks_per_txn + 1, shards);
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for(uint32_t t = 0; t < threads; t++)
+        workers.emplace_back(bench_worker, &manager, t, txns, locks_per_txn);
+    for(auto& worker: workers)
+        worker.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return 2.0 * threads * txns * locks_per_txn / secs;
+}
+
+int main(int argc, char **argv){
+    uint64_t txns          = (argc > 1) ? strtoull(argv[1], NULL, 10) : 20000;
+    uint32_t locks_per_txn = (argc > 2) ? atoi(argv[2]) : 16;
+    uint32_t max_shards    = (argc > 3) ? atoi(argv[3]) : LOCK_DEFAULT_SHARDS;
+    uint32_t max_threads   = (argc > 4) ? atoi(argv[4]) : thread::hardware_concurrency();
+    if(max_threads == 0)
+        max_threads = 1;
+
+    cout << "txns/thread: " << txns << " locks/txn: " << locks_per_txn << endl;
+    cout << setw(8) << "shards" << setw(9) << "threads" << setw(16) << "ops/s" << endl;
+    for(uint32_t shards = 1; shards <= max_shards; shards *= 8){
+        for(uint32_t threads = 1; threads <= max_threads; threads *= 2){
+            double rate = run_bench(shards, threads, txns, locks_per_txn);
+            cout << setw(8) << shards << setw(9) << threads << fixed << setprecision(0)
+                 << setw(16) << rate << endl;
+        }
+    }
+    return 0;
+}
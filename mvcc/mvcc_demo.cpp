@@ -0,0 +1,190 @@
+/*
+* Dashboards against transfers:
+* writer threads move money between random pairs of accounts, taking X locks
+* through the LockManager and installing new versions in the VersionStore;
+* reader threads sum every balance under a snapshot without taking any
+* lock. Every sum has to come out at the same total. Runs once with the
+* readers going through the lock manager (S locks on every account, the way
+* btree_find() reads would have to) and once with snapshots.
+*
+* usage: mvcc_demo [accounts] [writers] [readers] [seconds]
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include "lock_manager.h"
+#include "version_store.h"
+
+using namespace std;
+
+#define ACCOUNTS_PER_PAGE   54
+#define INITIAL_BALANCE     1000
+
+typedef struct{
+    vector<db_entry_t> base;    // stands in for the b-tree
+}demo_db_t;
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%06u", account);
+}
+
+static int load_account(void *ctx, const char *user_id, db_entry_t *entry){
+    demo_db_t *db = (demo_db_t*) ctx;
+    uint32_t account = atoi(user_id + 4);
+    if(strncmp(user_id, "acct", 4) != 0 || account >= db->base.size())
+        return -1;
+    *entry = db->base[account];
+    return 0;
+}
+
+static resource_id_t account_lock(uint32_t account){
+    return resource_id_t::tuple_of(1, 1, account / ACCOUNTS_PER_PAGE, account % ACCOUNTS_PER_PAGE);
+}
+
+typedef struct{
+    LockManager  *locks;
+    VersionStore *store;
+    demo_db_t    *db;
+    bool          snapshots;
+    atomic<bool>  stop;
+    atomic<uint64_t> next_txn;
+    atomic<uint64_t> transfers;
+    atomic<uint64_t> scans;
+    atomic<uint64_t> bad_scans;
+}demo_t;
+
+static void writer(demo_t *demo, uint32_t id){
+    mt19937_64 rng(id + 1);
+    uniform_int_distribution<uint32_t> pick(0, demo->db->base.size() - 1);
+    mvcc_write_set_t ws;
+    while(!demo->stop.load(memory_order_relaxed)){
+        uint32_t from = pick(rng), to = pick(rng);
+        if(from == to)
+            continue;
+        uint64_t txn_id = demo->next_txn.fetch_add(1);
+        for(;;){
+            Transaction txn(txn_id);
+            db_entry_t a, b;
+            char name[USERID_LENGTH];
+            bool ok = demo->locks->lock_path(&txn, account_lock(from), LOCK_X) == LOCK_GRANTED &&
+                      demo->locks->lock_path(&txn, account_lock(to), LOCK_X) == LOCK_GRANTED;
+            if(ok){
+                account_name(from, name);
+                demo->store->read_latest(name, &a);
+                account_name(to, name);
+                demo->store->read_latest(name, &b);
+                a.balance -= 1;
+                b.balance += 1;
+                demo->store->write(&ws, &a);
+                demo->store->write(&ws, &b);
+                demo->store->commit(&ws);
+                demo->db->base[from] = a;
+                demo->db->base[to]   = b;
+            }
+            demo->locks->release_all(&txn);
+            if(ok)
+                break;
+        }
+        demo->transfers.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+static void reader(demo_t *demo){
+    uint32_t accounts = demo->db->base.size();
+    uint64_t expected = (uint64_t) accounts * INITIAL_BALANCE;
+    char name[USERID_LENGTH];
+    db_entry_t entry;
+    while(!demo->stop.load(memory_order_relaxed)){
+        uint64_t total = 0;
+        if(demo->snapshots){
+            mvcc_snapshot_t snapshot;
+            demo->store->begin_snapshot(&snapshot);
+            for(uint32_t i = 0; i < accounts; i++){
+                account_name(i, name);
+                if(demo->store->read(&snapshot, name, &entry) == 0)
+                    total += entry.balance;
+            }
+            demo->store->end_snapshot(&snapshot);
+        }
+        else{
+            // retried with the same id, so it ages past the writers.
+            uint64_t txn_id = demo->next_txn.fetch_add(1);
+            bool ok = false;
+            while(!ok && !demo->stop.load(memory_order_relaxed)){
+                Transaction txn(txn_id);
+                total = 0;
+                ok = true;
+                for(uint32_t i = 0; i < accounts && ok; i++){
+                    ok = demo->locks->lock_path(&txn, account_lock(i), LOCK_S) == LOCK_GRANTED;
+                    account_name(i, name);
+                    if(ok && demo->store->read_latest(name, &entry) == 0)
+                        total += entry.balance;
+                }
+                demo->locks->release_all(&txn);
+            }
+            if(!ok)
+                break;
+        }
+        if(total != expected)
+            demo->bad_scans.fetch_add(1, memory_order_relaxed);
+        demo->scans.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts = (argc > 1) ? atoi(argv[1]) : 1000;
+    uint32_t writers  = (argc > 2) ? atoi(argv[2]) : 4;
+    uint32_t readers  = (argc > 3) ? atoi(argv[3]) : 2;
+    double   seconds  = (argc > 4) ? atof(argv[4]) : 1.0;
+    if(accounts < 2)
+        accounts = 2;
+
+    int rc = 0;
+    for(int snapshots = 0; snapshots <= 1; snapshots++){
+        demo_db_t db;
+        db.base.resize(accounts);
+        for(uint32_t i = 0; i < accounts; i++){
+            account_name(i, db.base[i].user_id);
+            memset(db.base[i].passwd, 0, PASSWD_LENGTH);
+            db.base[i].balance = INITIAL_BALANCE;
+        }
+        // escalation would turn the readers' S locks into one file lock.
+        LockManager locks(accounts + 1, LOCK_DEFAULT_SHARDS,
+                          {DEADLOCK_WOUND_WAIT, DEADLOCK_DETECT_INTERVAL_MS, VICTIM_YOUNGEST});
+        VersionStore store(load_account, &db);
+        demo_t demo;
+        demo.locks = &locks;
+        demo.store = &store;
+        demo.db = &db;
+        demo.snapshots = snapshots;
+        demo.stop = false;
+        demo.next_txn = 1;
+        demo.transfers = demo.scans = demo.bad_scans = 0;
+
+        vector<thread> threads;
+        for(uint32_t w = 0; w < writers; w++)
+            threads.emplace_back(writer, &demo, w);
+        for(uint32_t r = 0; r < readers; r++)
+            threads.emplace_back(reader, &demo);
+        this_thread::sleep_for(chrono::duration<double>(seconds));
+        demo.stop = true;
+        for(auto& t: threads)
+            t.join();
+
+        store.collect();
+        mvcc_stats_t stats = store.get_stats();
+        printf("%-9s transfers/s %9.0f  scans/s %7.1f  inconsistent scans %lu  "
+               "versions %lu live / %lu created, %lu gc runs\n",
+               snapshots ? "snapshot" : "S locks", demo.transfers / seconds, demo.scans / seconds,
+               demo.bad_scans.load(), stats.versions, stats.created, stats.gc_runs);
+        if(demo.bad_scans != 0 || (snapshots && stats.versions != stats.chains))
+            rc = 1;
+    }
+    return rc;
+}
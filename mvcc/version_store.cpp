@@ -0,0 +1,303 @@
+#include <chrono>
+#include <cstring>
+#include "version_store.h"
+
+using namespace std;
+
+VersionStore::VersionStore(mvcc_loader_t loader, void *loader_ctx, uint32_t gc_interval_ms){
+    this->loader = loader;
+    this->loader_ctx = loader_ctx;
+    for(int i = 0; i < MVCC_SNAPSHOT_SLOTS; i++)
+        slots[i].ts.store(0);
+    clock = 0;
+    last_commit.store(0);
+    live_versions.store(0);
+    created.store(0);
+    horizon = 0;
+    reclaimed = 0;
+    gc_runs = 0;
+    this->gc_interval_ms = gc_interval_ms;
+    stopping = false;
+    if(gc_interval_ms > 0)
+        collector = thread(&VersionStore::_run_collector, this);
+}
+
+VersionStore::~VersionStore(){
+    {
+        lock_guard<mutex> guard(collector_latch);
+        stopping = true;
+    }
+    collector_cond.notify_one();
+    if(collector.joinable())
+        collector.join();
+    for(int s = 0; s < MVCC_SHARDS; s++){
+        for(auto& node: shards[s].chains){
+            mvcc_version_t *v = node.second->load();
+            while(v != NULL){
+                mvcc_version_t *older = v->older.load();
+                delete v;
+                v = older;
+            }
+            delete node.second;
+        }
+    }
+    for(auto& retiree: retired)
+        delete retiree.first;
+}
+
+VersionStore::chain_shard_t* VersionStore::_shard_of(const string& key){
+    return &shards[hash<string>()(key) % MVCC_SHARDS];
+}
+
+mvcc_version_t* VersionStore::_new_version(const db_entry_t *entry, uint64_t commit_ts,
+                                           mvcc_version_t *older, bool deleted){
+    mvcc_version_t *v = new mvcc_version_t;
+    v->entry = *entry;
+    v->commit_ts.store(commit_ts, memory_order_relaxed);
+    v->older.store(older, memory_order_relaxed);
+    v->deleted = deleted;
+    live_versions.fetch_add(1, memory_order_relaxed);
+    created.fetch_add(1, memory_order_relaxed);
+    return v;
+}
+
+// With shard->latch held. A missing chain is seeded from the base store
+// under the latch, so the base is read before any writer of that account
+// can write it back.
+atomic<mvcc_version_t*>* VersionStore::_chain(chain_shard_t *shard, const string& key, bool create){
+    auto it = shard->chains.find(key);
+    if(it != shard->chains.end())
+        return it->second;
+    if(!create)
+        return NULL;
+    atomic<mvcc_version_t*> *chain = new atomic<mvcc_version_t*>(NULL);
+    db_entry_t base;
+    if(loader != NULL && loader(loader_ctx, key.c_str(), &base) == 0)
+        chain->store(_new_version(&base, 0, NULL, false), memory_order_release);
+    shard->chains[key] = chain;
+    return chain;
+}
+
+/*---------------------- Readers ---------------------------------------------*/
+
+// The slot is claimed first and the timestamp read again after: the
+// collector reads last_commit before it scans the slots, so either it sees
+// the claim or the snapshot is no older than its horizon.
+void VersionStore::begin_snapshot(mvcc_snapshot_t *snapshot){
+    static atomic<uint32_t> next_slot(0);
+    static thread_local uint32_t home = next_slot.fetch_add(1) % MVCC_SNAPSHOT_SLOTS;
+    uint32_t i = home;
+    for(uint32_t probes = 1;; probes++){
+        uint64_t expected = 0;
+        if(slots[i].ts.compare_exchange_strong(expected, last_commit.load() + 1))
+            break;
+        i = (i + 1) % MVCC_SNAPSHOT_SLOTS;
+        if(probes % MVCC_SNAPSHOT_SLOTS == 0)
+            this_thread::yield();
+    }
+    uint64_t ts = last_commit.load();
+    slots[i].ts.store(ts + 1);
+    snapshot->ts = ts;
+    snapshot->slot = i;
+}
+
+void VersionStore::end_snapshot(mvcc_snapshot_t *snapshot){
+    slots[snapshot->slot].ts.store(0, memory_order_release);
+}
+
+// Without a chain the account has never been written since start up (or
+// since its chain was dropped), so the base store holds the value every
+// snapshot sees; it is read under the shard latch, which a writer needs to
+// create the chain, and no chain is installed for it.
+int VersionStore::read(const mvcc_snapshot_t *snapshot, const char *user_id, db_entry_t *entry){
+    string key(user_id, strnlen(user_id, USERID_LENGTH));
+    chain_shard_t *shard = _shard_of(key);
+    lock_guard<mutex> guard(shard->latch);
+    atomic<mvcc_version_t*> *chain = _chain(shard, key, false);
+    if(chain == NULL)
+        return (loader != NULL && loader(loader_ctx, key.c_str(), entry) == 0) ? 0 : -1;
+    for(mvcc_version_t *v = chain->load(memory_order_acquire); v != NULL; v = v->older.load(memory_order_acquire)){
+        if(v->commit_ts.load(memory_order_acquire) <= snapshot->ts){
+            if(v->deleted)
+                return -1;
+            *entry = v->entry;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*---------------------- Writers ---------------------------------------------*/
+
+int VersionStore::read_latest(const char *user_id, db_entry_t *entry){
+    string key(user_id, strnlen(user_id, USERID_LENGTH));
+    chain_shard_t *shard = _shard_of(key);
+    lock_guard<mutex> guard(shard->latch);
+    mvcc_version_t *v = _chain(shard, key, true)->load(memory_order_acquire);
+    if(v == NULL || v->deleted)
+        return -1;
+    *entry = v->entry;
+    return 0;
+}
+
+int VersionStore::_stage(mvcc_write_set_t *ws, const char *user_id, const db_entry_t *entry, bool deleted){
+    string key(user_id, strnlen(user_id, USERID_LENGTH));
+    chain_shard_t *shard = _shard_of(key);
+    lock_guard<mutex> guard(shard->latch);
+    atomic<mvcc_version_t*> *chain = _chain(shard, key, true);
+    mvcc_version_t *v = _new_version(entry, MVCC_INFLIGHT, chain->load(memory_order_relaxed), deleted);
+    chain->store(v, memory_order_release);
+    ws->keys.push_back(key);
+    ws->versions.push_back(v);
+    return 0;
+}
+
+int VersionStore::write(mvcc_write_set_t *ws, const db_entry_t *entry){
+    return _stage(ws, entry->user_id, entry, false);
+}
+
+int VersionStore::remove(mvcc_write_set_t *ws, const char *user_id){
+    db_entry_t entry;
+    if(read_latest(user_id, &entry) != 0)
+        return -1;
+    return _stage(ws, user_id, &entry, true);
+}
+
+uint64_t VersionStore::commit(mvcc_write_set_t *ws){
+    if(ws->versions.empty())
+        return last_commit.load();
+    lock_guard<mutex> guard(commit_latch);
+    uint64_t ts = ++clock;
+    for(auto v: ws->versions)
+        v->commit_ts.store(ts, memory_order_release);
+    last_commit.store(ts, memory_order_release);
+    ws->keys.clear();
+    ws->versions.clear();
+    return ts;
+}
+
+// Each version is unlinked under its shard latch, which every reader of
+// the chain holds, and only then stamped for retirement: a snapshot taken
+// after the stamp can no longer reach it. The X lock keeps the chain alive.
+void VersionStore::rollback(mvcc_write_set_t *ws){
+    for(size_t i = ws->versions.size(); i-- > 0;){
+        mvcc_version_t *v = ws->versions[i];
+        chain_shard_t *shard = _shard_of(ws->keys[i]);
+        lock_guard<mutex> guard(shard->latch);
+        v->commit_ts.store(MVCC_ABORTED, memory_order_release);
+        _chain(shard, ws->keys[i], false)->store(v->older.load(memory_order_relaxed), memory_order_release);
+    }
+    uint64_t now = last_commit.load();
+    {
+        lock_guard<mutex> guard(retired_latch);
+        for(auto v: ws->versions)
+            retired.push_back({v, now});
+    }
+    ws->keys.clear();
+    ws->versions.clear();
+}
+
+/*---------------------- Garbage collection ----------------------------------*/
+
+uint64_t VersionStore::_horizon(){
+    uint64_t h = last_commit.load();
+    for(int i = 0; i < MVCC_SNAPSHOT_SLOTS; i++){
+        uint64_t ts = slots[i].ts.load();
+        if(ts != 0 && ts - 1 < h)
+            h = ts - 1;
+    }
+    return h;
+}
+
+// Readers stop at the first version committed at or before their snapshot,
+// and no snapshot is older than the horizon, so nobody ever goes past the
+// newest version committed at or before it.
+// A chain left with nothing but its seeded base version (or with nothing at
+// all: a rolled back write of a missing account) says no more than the base
+// store, and is dropped. Chains are only read under their shard latch, and
+// one whose head is the seed has no writer, so nobody is still using it.
+void VersionStore::collect(){
+    lock_guard<mutex> gc_guard(gc_latch);
+    uint64_t h = _horizon();
+    uint64_t freed = 0;
+    for(int s = 0; s < MVCC_SHARDS; s++){
+        lock_guard<mutex> guard(shards[s].latch);
+        for(auto node = shards[s].chains.begin(); node != shards[s].chains.end();){
+            mvcc_version_t *head = node->second->load(memory_order_acquire);
+            if(head == NULL || (head->commit_ts.load(memory_order_acquire) == 0 && head->older.load() == NULL)){
+                if(head != NULL){
+                    delete head;
+                    freed++;
+                }
+                delete node->second;
+                node = shards[s].chains.erase(node);
+                continue;
+            }
+            mvcc_version_t *v = head;
+            while(v != NULL && v->commit_ts.load(memory_order_acquire) > h)
+                v = v->older.load(memory_order_acquire);
+            if(v == NULL){
+                ++node;
+                continue;
+            }
+            mvcc_version_t *old = v->older.exchange(NULL);
+            while(old != NULL){
+                mvcc_version_t *older = old->older.load(memory_order_relaxed);
+                delete old;
+                freed++;
+                old = older;
+            }
+            ++node;
+        }
+    }
+    {
+        lock_guard<mutex> guard(retired_latch);
+        size_t kept = 0;
+        for(auto& retiree: retired){
+            if(retiree.second < h){
+                delete retiree.first;
+                freed++;
+            }
+            else{
+                retired[kept++] = retiree;
+            }
+        }
+        retired.resize(kept);
+    }
+    live_versions.fetch_sub(freed, memory_order_relaxed);
+    horizon = h;
+    reclaimed += freed;
+    gc_runs++;
+}
+
+void VersionStore::_run_collector(){
+    unique_lock<mutex> guard(collector_latch);
+    while(!stopping){
+        collector_cond.wait_for(guard, chrono::milliseconds(gc_interval_ms));
+        if(stopping)
+            break;
+        guard.unlock();
+        collect();
+        guard.lock();
+    }
+}
+
+mvcc_stats_t VersionStore::get_stats(){
+    mvcc_stats_t stats = {};
+    {
+        lock_guard<mutex> gc_guard(gc_latch);
+        stats.horizon   = horizon;
+        stats.reclaimed = reclaimed;
+        stats.gc_runs   = gc_runs;
+    }
+    for(int s = 0; s < MVCC_SHARDS; s++){
+        lock_guard<mutex> guard(shards[s].latch);
+        stats.chains += shards[s].chains.size();
+    }
+    for(int i = 0; i < MVCC_SNAPSHOT_SLOTS; i++)
+        stats.active_snapshots += slots[i].ts.load(memory_order_relaxed) != 0;
+    stats.last_commit = last_commit.load();
+    stats.versions    = live_versions.load(memory_order_relaxed);
+    stats.created     = created.load(memory_order_relaxed);
+    return stats;
+}
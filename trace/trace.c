@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#define TRACE_RING_MASK     (TRACE_RING_EVENTS - 1)
+
+_Static_assert((TRACE_RING_EVENTS & TRACE_RING_MASK) == 0, "TRACE_RING_EVENTS must be a power of two");
+_Static_assert(sizeof(trace_event_t) == 32, "an event is 32 bytes");
+
+typedef struct trace_ring{
+    uint64_t           head;        // written by the owner only
+    uint64_t           thread_id;
+    uint64_t           since;       // head when the owner took the ring
+    uint32_t           in_use;      // 0 once the owner has exited
+    struct trace_ring *next;
+    trace_event_t      events[TRACE_RING_EVENTS];
+}trace_ring_t;
+
+int trace_runtime_level = TRACE_INFO;
+
+static trace_ring_t *rings;
+static __thread trace_ring_t *my_ring;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+static const char *op_names[TRACE_OP_COUNT] = {
+    "?", "page_load", "page_write", "page_add", "checksum_fail", "io_fail", "find", "insert", "insert_leaf",
+    "new_root", "split", "delete", "delete_entry", "delete_miss", "borrow_left", "borrow_right", "merge",
+    "root_shrink", "search"
+};
+static const char *level_names[] = {"ERROR", "INFO", "DEBUG"};
+
+// the thread is gone; its ring, events and all, goes to the next new one.
+static void release_ring(void *arg){
+    trace_ring_t *ring = arg;
+    my_ring = NULL;
+    __atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void make_ring_key(void){
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// A ring left by a thread that exited is taken over before a new one is
+// allocated, so threads that come and go do not add up. Its head carries
+// on from where it was, and events before `since` are not the new owner's.
+static trace_ring_t *register_ring(void){
+    pthread_once(&ring_once, make_ring_key);
+    trace_ring_t *ring;
+    for(ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next){
+        uint32_t expected = 0;
+        if(__atomic_load_n(&ring->in_use, __ATOMIC_RELAXED) == 0
+           && __atomic_compare_exchange_n(&ring->in_use, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+    if(ring != NULL){
+        __atomic_store_n(&ring->since, ring->head, __ATOMIC_RELAXED);
+        __atomic_store_n(&ring->thread_id, syscall(SYS_gettid), __ATOMIC_RELEASE);
+    }
+    else{
+        // aligned_alloc() wants a multiple of the alignment.
+        if((ring = aligned_alloc(64, (sizeof(trace_ring_t) + 63) & ~(size_t) 63)) == NULL)
+            return NULL;
+        ring->head = 0;
+        ring->thread_id = syscall(SYS_gettid);
+        ring->since = 0;
+        ring->in_use = 1;
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while(!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+uint64_t trace_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+uint64_t trace_key_hash(const char *key, size_t length){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < length && key[i] != '\0'; i++)
+        h = (h ^ (unsigned char) key[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+void trace_emit(trace_level_t level, trace_op_t op, uint32_t page_loc, uint64_t key_hash, uint64_t latency_ns,
+                uint16_t status, uint32_t arg){
+    trace_ring_t *ring = my_ring;
+    if(ring == NULL && (ring = my_ring = register_ring()) == NULL)
+        return;
+    uint64_t head = ring->head;
+    trace_event_t *event = &ring->events[head & TRACE_RING_MASK];
+    event->timestamp_ns = trace_now();
+    event->key_hash     = key_hash;
+    event->page_loc     = page_loc;
+    event->latency_ns   = latency_ns > UINT32_MAX ? UINT32_MAX : (uint32_t) latency_ns;
+    event->op           = op;
+    event->level        = level;
+    event->status       = status;
+    event->arg          = arg;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_level(trace_level_t level){
+    __atomic_store_n(&trace_runtime_level, (int) level, __ATOMIC_RELAXED);
+}
+
+trace_level_t trace_get_level(void){
+    return (trace_level_t) __atomic_load_n(&trace_runtime_level, __ATOMIC_RELAXED);
+}
+
+static int write_all(int fd, const void *data, size_t length){
+    const char *p = data;
+    while(length > 0){
+        ssize_t written = write(fd, p, length);
+        if(written < 0){
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// the events of `ring`'s owner still in it once copied; 0 if none.
+static uint64_t copy_ring(const trace_ring_t *ring, trace_event_t *copy, uint64_t *first){
+    uint64_t since = __atomic_load_n(&ring->since, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t start = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    if(start < since)
+        start = since;
+    for(uint64_t seq = start; seq < head; seq++)
+        copy[seq - start] = ring->events[seq & TRACE_RING_MASK];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    // the owner may have lapped the copy. Event `now` is written before the
+    // head moves past it, into the slot of `now - TRACE_RING_EVENTS`.
+    uint64_t now = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t valid = now + 1 > TRACE_RING_EVENTS ? now + 1 - TRACE_RING_EVENTS : 0;
+    if(valid > start){
+        uint64_t lost = valid - start < head - start ? valid - start : head - start;
+        memmove(copy, copy + lost, (head - start - lost) * sizeof(trace_event_t));
+        start += lost;
+    }
+    *first = start;
+    return head - start;
+}
+
+int trace_dump(const char *path){
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return -1;
+    trace_event_t *copy = malloc(sizeof(trace_event_t) * TRACE_RING_EVENTS);
+    if(copy == NULL){
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    trace_file_header_t header = {TRACE_FILE_MAGIC, 1, sizeof(trace_event_t), 0};
+    for(trace_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+        header.rings++;
+    int retcode = write_all(fd, &header, sizeof(header));
+    uint64_t written = 0;
+    for(trace_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL && retcode == 0 && written < header.rings;
+        ring = ring->next, written++){
+        trace_ring_header_t ring_header;
+        ring_header.thread_id = __atomic_load_n(&ring->thread_id, __ATOMIC_ACQUIRE);
+        ring_header.count = copy_ring(ring, copy, &ring_header.first);
+        retcode = write_all(fd, &ring_header, sizeof(ring_header));
+        if(retcode == 0)
+            retcode = write_all(fd, copy, ring_header.count * sizeof(trace_event_t));
+    }
+    int saved = errno;
+    free(copy);
+    if(close(fd) != 0 && retcode == 0)
+        return -1;
+    errno = saved;
+    return retcode;
+}
+
+void trace_get_stats(trace_stats_t *stats){
+    memset(stats, 0, sizeof(*stats));
+    for(trace_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next){
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        stats->rings++;
+        stats->events += head;
+        stats->overwritten += head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    }
+}
+
+const char *trace_op_name(uint32_t op){
+    return op < TRACE_OP_COUNT ? op_names[op] : "?";
+}
+
+const char *trace_level_name(uint32_t level){
+    return level <= TRACE_DEBUG ? level_names[level] : "?";
+}
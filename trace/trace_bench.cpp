@@ -0,0 +1,163 @@
+/*
+* What tracing costs.
+*
+* usage: trace_bench [accounts] [lookups] [dir]
+*
+* 1. A trace point filtered out at run time, one that is recorded, and the
+*    printf() it replaces (into /dev/null, so no terminal is involved).
+* 2. btree_find() of random accounts with the run time level at ERROR,
+*    INFO (one event per lookup) and DEBUG (every page load and search).
+* 3. Four threads trace while the rings are dumped; the dump is read back
+*    and must hold whole, ordered events of every thread.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+extern "C"{
+#include "b_storage.h"
+}
+#include "trace.h"
+
+using namespace std;
+
+#define THREADS     4
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%08u", account);
+}
+
+static double seconds_since(chrono::steady_clock::time_point start){
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static double trace_point_ns(uint64_t rounds){
+    auto start = chrono::steady_clock::now();
+    for(uint64_t i = 0; i < rounds; i++)
+        TRACE(TRACE_DEBUG, TRACE_SEARCH, (uint32_t) i, i, 0, 0, (uint32_t) i);
+    return seconds_since(start) * 1e9 / rounds;
+}
+
+static double lookup_ns(int db_file, const vector<uint32_t>& sample){
+    char user_id[USERID_LENGTH];
+    tuple_info_t info;
+    auto start = chrono::steady_clock::now();
+    for(uint32_t account: sample){
+        account_name(account, user_id);
+        if(btree_find(db_file, user_id, USERID_LENGTH, &info) == 0)
+            free_page(db_file, info.page, 0);
+    }
+    return seconds_since(start) * 1e9 / sample.size();
+}
+
+// every thread's events must come back in order, with arg counting up.
+static bool check_dump(const char *path, uint64_t *events){
+    FILE *in = fopen(path, "rb");
+    if(in == NULL)
+        return false;
+    trace_file_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 && header.magic == TRACE_FILE_MAGIC;
+    *events = 0;
+    for(uint64_t r = 0; ok && r < header.rings; r++){
+        trace_ring_header_t ring;
+        ok = fread(&ring, sizeof(ring), 1, in) == 1;
+        vector<trace_event_t> ring_events(ring.count);
+        ok = ok && fread(ring_events.data(), sizeof(trace_event_t), ring.count, in) == ring.count;
+        for(uint64_t i = 1; ok && i < ring.count; i++){
+            if(ring_events[i].op == TRACE_SEARCH && ring_events[i - 1].op == TRACE_SEARCH)
+                ok = ring_events[i].arg == ring_events[i - 1].arg + 1
+                     && ring_events[i].timestamp_ns >= ring_events[i - 1].timestamp_ns;
+        }
+        *events += ring.count;
+    }
+    fclose(in);
+    return ok;
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts = (argc > 1) ? atoi(argv[1]) : 100000;
+    uint32_t lookups  = (argc > 2) ? atoi(argv[2]) : 200000;
+    string   dir      = (argc > 3) ? argv[3] : ".";
+    string db_path = dir + "/trace_bench.db";
+    string dump_path = dir + "/trace_bench.trace";
+    if(accounts < 1)
+        accounts = 1;
+    if(lookups < 1)
+        lookups = 1;
+
+    trace_set_level(TRACE_INFO);
+    double filtered = trace_point_ns(10000000);
+    trace_set_level(TRACE_DEBUG);
+    double recorded = trace_point_ns(10000000);
+    FILE *null = fopen("/dev/null", "w");
+    auto start = chrono::steady_clock::now();
+    for(uint32_t i = 0; i < 1000000; i++)
+        fprintf(null, "btree_delete: page_loc: %d, key: %s, first_entry: %s\n", i, "acct00000001", "acct00000000");
+    double printed = seconds_since(start) * 1e9 / 1000000;
+    fclose(null);
+    cout << "trace point filtered out " << fixed << setprecision(1) << filtered << " ns, recorded " << recorded
+         << " ns; printf " << printed << " ns" << endl << endl;
+
+    unlink(db_path.c_str());
+    int db_file = open(db_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0){
+        cerr << "cannot create " << db_path << endl;
+        return 1;
+    }
+    trace_set_level(TRACE_ERROR);
+    db_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, entry.user_id);
+        btree_insert(db_file, PAGE_SIZE, &entry);
+    }
+    mt19937_64 rng(1);
+    uniform_int_distribution<uint32_t> pick(0, accounts - 1);
+    vector<uint32_t> sample(lookups);
+    for(auto& account: sample)
+        account = pick(rng);
+    lookup_ns(db_file, sample);
+    cout << setw(10) << "level" << setw(14) << "ns/lookup" << setw(16) << "events/lookup" << endl;
+    trace_level_t levels[] = {TRACE_ERROR, TRACE_INFO, TRACE_DEBUG};
+    for(trace_level_t level: levels){
+        trace_set_level(level);
+        trace_stats_t before, after;
+        trace_get_stats(&before);
+        double ns = lookup_ns(db_file, sample);
+        trace_get_stats(&after);
+        cout << setw(10) << trace_level_name(level) << setw(14) << setprecision(0) << ns << setw(16) << setprecision(2)
+             << (double) (after.events - before.events) / lookups << endl;
+    }
+    close(db_file);
+    unlink(db_path.c_str());
+
+    // dumped while being written.
+    trace_set_level(TRACE_DEBUG);
+    bool stop = false;
+    vector<thread> threads;
+    for(int t = 0; t < THREADS; t++){
+        threads.emplace_back([&stop](){
+            for(uint32_t i = 0; !__atomic_load_n(&stop, __ATOMIC_RELAXED); i++)
+                TRACE(TRACE_DEBUG, TRACE_SEARCH, 0, 0, 0, 0, i);
+        });
+    }
+    this_thread::sleep_for(chrono::milliseconds(20));
+    int dumped = trace_dump(dump_path.c_str());
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    for(auto& t: threads)
+        t.join();
+    uint64_t events = 0;
+    bool ok = dumped == 0 && check_dump(dump_path.c_str(), &events);
+    trace_stats_t stats;
+    trace_get_stats(&stats);
+    cout << endl << "dump under load: " << events << " events of " << stats.rings << " threads read back whole: "
+         << (ok ? "yes" : "NO") << endl;
+    unlink(dump_path.c_str());
+    return ok ? 0 : 1;
+}
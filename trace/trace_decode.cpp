@@ -0,0 +1,74 @@
+/*
+* Turns a trace_dump() file into text, one event per line, all threads
+* merged by time:
+*
+*   +<ms since the first event> <thread> <level> <op> page=<loc> key=<hash>
+*   lat=<ns> status=<status> arg=<arg>
+*
+* usage: trace_decode <dump> [max level: 0 errors, 1 info, 2 debug]
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <vector>
+#include "trace.h"
+
+using namespace std;
+
+typedef struct{
+    trace_event_t event;
+    uint64_t thread_id;
+}decoded_event_t;
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s <dump> [max level]\n", argv[0]);
+        return 2;
+    }
+    uint32_t max_level = (argc > 2) ? atoi(argv[2]) : TRACE_DEBUG;
+    FILE *in = fopen(argv[1], "rb");
+    if(in == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+    trace_file_header_t header;
+    if(fread(&header, sizeof(header), 1, in) != 1 || header.magic != TRACE_FILE_MAGIC
+       || header.event_size != sizeof(trace_event_t)){
+        fprintf(stderr, "%s is not a trace dump\n", argv[1]);
+        fclose(in);
+        return 1;
+    }
+    vector<decoded_event_t> events;
+    for(uint64_t r = 0; r < header.rings; r++){
+        trace_ring_header_t ring;
+        if(fread(&ring, sizeof(ring), 1, in) != 1){
+            fprintf(stderr, "%s is truncated\n", argv[1]);
+            fclose(in);
+            return 1;
+        }
+        for(uint64_t i = 0; i < ring.count; i++){
+            decoded_event_t decoded;
+            if(fread(&decoded.event, sizeof(trace_event_t), 1, in) != 1){
+                fprintf(stderr, "%s is truncated\n", argv[1]);
+                fclose(in);
+                return 1;
+            }
+            decoded.thread_id = ring.thread_id;
+            if(decoded.event.level <= max_level)
+                events.push_back(decoded);
+        }
+    }
+    fclose(in);
+    stable_sort(events.begin(), events.end(), [](const decoded_event_t& a, const decoded_event_t& b){
+        return a.event.timestamp_ns < b.event.timestamp_ns;
+    });
+    uint64_t origin = events.empty() ? 0 : events.front().event.timestamp_ns;
+    for(auto& decoded: events){
+        const trace_event_t& e = decoded.event;
+        printf("+%.6f %" PRIu64 " %-5s %-13s page=%u key=%016" PRIx64 " lat=%u status=%u arg=%u\n",
+               (e.timestamp_ns - origin) / 1e6, decoded.thread_id, trace_level_name(e.level), trace_op_name(e.op),
+               e.page_loc, e.key_hash, e.latency_ns, e.status, e.arg);
+    }
+    return 0;
+}
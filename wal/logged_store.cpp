@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "logged_store.h"
+
+using namespace std;
+
+LoggedStore::LoggedStore(int db_file, WriteAheadLog *log, size_t max_dirty_pages,
+                         uint32_t checkpoint_interval_ms){
+    this->db_file = db_file;
+    this->log = log;
+    this->max_dirty_pages = max_dirty_pages ? max_dirty_pages : 1;
+    stats = {};
+    last_checkpoint = log->get_checkpoint();
+    this->checkpoint_interval_ms = checkpoint_interval_ms;
+    stopping = false;
+    if(checkpoint_interval_ms > 0)
+        checkpointer = thread(&LoggedStore::_run_checkpointer, this);
+}
+
+LoggedStore::~LoggedStore(){
+    {
+        lock_guard<mutex> guard(checkpointer_latch);
+        stopping = true;
+    }
+    checkpointer_cond.notify_one();
+    if(checkpointer.joinable())
+        checkpointer.join();
+    flush_dirty(SIZE_MAX);
+}
+
+// latch held. The cached copy of the account's page if it is dirty,
+// otherwise the page just read; the caller frees it unless it caches it.
+page_t* LoggedStore::_find(const char *user_id, uint32_t *index, bool *cached){
+    tuple_info_t info;
+    if(btree_find(db_file, user_id, USERID_LENGTH, &info) != 0)
+        return NULL;
+    *index = info.index;
+    auto it = dirty.find(info.page->page_loc);
+    *cached = it != dirty.end();
+    if(!*cached)
+        return info.page;
+    free_page(db_file, info.page, 0);
+    return it->second.page;
+}
+
+// latch held. A compensation is applied whatever the balance, logged as a
+// CLR and not remembered for a later abort.
+int LoggedStore::_update(uint64_t txn_id, const char *user_id, int64_t delta, bool compensate, lsn_t undo_next){
+    uint32_t index;
+    bool cached;
+    page_t *page = _find(user_id, &index, &cached);
+    if(page == NULL)
+        return -1;
+    db_entry_t *entry = page->page_content->db_entries[index];
+    if(!compensate && delta < 0 && entry->balance < (amount_t) -delta){
+        if(!cached)
+            free_page(db_file, page, 0);
+        return -1;
+    }
+    txn_entry_t *txn = &txns[txn_id];
+    wal_update_t record;
+    memset(&record, 0, sizeof(record));
+    strncpy(record.user_id, entry->user_id, WAL_USERID_LENGTH);
+    record.page  = page->page_loc;
+    record.delta = delta;
+    lsn_t lsn;
+    if(compensate){
+        wal_clr_t clr = {record, undo_next};
+        lsn = log->append(txn_id, WAL_CLR, txn->last_lsn, &clr, sizeof(clr));
+        stats.compensations++;
+    }
+    else{
+        lsn = log->append(txn_id, WAL_UPDATE, txn->last_lsn, &record, sizeof(record));
+        txn->updates.push_back({txn->last_lsn, record});
+    }
+    txn->last_lsn = lsn;
+    entry->balance += delta;
+    *(page->page_content->page_lsn) = lsn;
+    stats.updates++;
+    if(!cached){
+        dirty[page->page_loc] = {page, lsn};
+        if(dirty.size() > max_dirty_pages)
+            _flush_dirty(dirty.size() - max_dirty_pages, UINT64_MAX);
+    }
+    return 0;
+}
+
+int LoggedStore::update(uint64_t txn_id, const char *user_id, int64_t delta){
+    lock_guard<mutex> guard(latch);
+    return _update(txn_id, user_id, delta, false, 0);
+}
+
+int LoggedStore::commit(uint64_t txn_id){
+    lsn_t lsn;
+    {
+        lock_guard<mutex> guard(latch);
+        auto txn = txns.find(txn_id);
+        if(txn == txns.end())
+            return 0;
+        lsn = log->append(txn_id, WAL_COMMIT, txn->second.last_lsn, NULL, 0);
+        txns.erase(txn);
+        stats.commits++;
+    }
+    // the group commit: whoever flushes first takes the others along.
+    return log->flush(lsn + 1);
+}
+
+int LoggedStore::abort(uint64_t txn_id){
+    lock_guard<mutex> guard(latch);
+    auto txn = txns.find(txn_id);
+    if(txn == txns.end())
+        return 0;
+    auto& updates = txn->second.updates;
+    for(auto it = updates.rbegin(); it != updates.rend(); it++){
+        if(_update(txn_id, it->second.user_id, -it->second.delta, true, it->first) != 0)
+            return -1;
+    }
+    log->append(txn_id, WAL_ABORT, txn->second.last_lsn, NULL, 0);
+    txns.erase(txn);
+    stats.aborts++;
+    return 0;
+}
+
+int LoggedStore::undo(uint64_t txn_id, lsn_t last_lsn){
+    lock_guard<mutex> guard(latch);
+    txns[txn_id].last_lsn = last_lsn;
+    wal_header_t header;
+    vector<char> payload;
+    lsn_t lsn = last_lsn;
+    while(lsn != 0){
+        if(log->read(lsn, &header, payload) != 0 || header.txn_id != txn_id)
+            return -1;
+        lsn = header.prev_lsn;
+        if(header.type == WAL_UPDATE){
+            wal_update_t update;
+            memcpy(&update, payload.data(), sizeof(update));
+            if(_update(txn_id, update.user_id, -update.delta, true, header.prev_lsn) != 0)
+                return -1;
+        }
+        else if(header.type == WAL_CLR){
+            // its update was undone before the crash.
+            wal_clr_t clr;
+            memcpy(&clr, payload.data(), sizeof(clr));
+            lsn = clr.undo_next;
+        }
+    }
+    log->append(txn_id, WAL_ABORT, txns[txn_id].last_lsn, NULL, 0);
+    txns.erase(txn_id);
+    stats.aborts++;
+    return 0;
+}
+
+int LoggedStore::apply_request(uint64_t txn_id, const request_data_t *request){
+    int64_t delta;
+    if(request->req == DEPOSIT)
+        delta = request->amount;
+    else if(request->req == WITHDRAW)
+        delta = -(int64_t) request->amount;
+    else
+        return -1;
+    if(update(txn_id, request->userid, delta) != 0){
+        abort(txn_id);
+        return -1;
+    }
+    return commit(txn_id);
+}
+
+int LoggedStore::read_balance(const char *user_id, amount_t *balance){
+    lock_guard<mutex> guard(latch);
+    uint32_t index;
+    bool cached;
+    page_t *page = _find(user_id, &index, &cached);
+    if(page == NULL)
+        return -1;
+    *balance = page->page_content->db_entries[index]->balance;
+    if(!cached)
+        free_page(db_file, page, 0);
+    return 0;
+}
+
+// latch held. Only pages first dirtied before `before`.
+int LoggedStore::_flush_dirty(size_t max_pages, lsn_t before){
+    vector<pair<lsn_t, page_ptr_t>> order;
+    order.reserve(dirty.size());
+    for(auto& node: dirty){
+        if(node.second.rec_lsn < before)
+            order.push_back({node.second.rec_lsn, node.first});
+    }
+    sort(order.begin(), order.end());
+    if(order.size() > max_pages)
+        order.resize(max_pages);
+    if(order.empty())
+        return 0;
+    // the WAL rule, for all of them at once.
+    lsn_t newest = 0;
+    for(auto& victim: order)
+        newest = max(newest, *(dirty[victim.second].page->page_content->page_lsn));
+    if(log->flush(newest + 1) != 0)
+        return -1;
+    int written = 0;
+    for(auto& victim: order){
+        if(free_page(db_file, dirty[victim.second].page, 1) != 0)
+            return -1;
+        dirty.erase(victim.second);
+        written++;
+    }
+    stats.page_writes += written;
+    if(fdatasync(db_file) != 0)
+        return -1;
+    return written;
+}
+
+int LoggedStore::flush_dirty(size_t max_pages){
+    lock_guard<mutex> guard(latch);
+    return _flush_dirty(max_pages, UINT64_MAX);
+}
+
+int LoggedStore::checkpoint(){
+    lock_guard<mutex> one(checkpoint_latch);
+    int written;
+    do{
+        lock_guard<mutex> guard(latch);
+        if((written = _flush_dirty(LOGGED_STORE_CHECKPOINT_BATCH, last_checkpoint)) < 0)
+            return -1;
+    }while(written == LOGGED_STORE_CHECKPOINT_BATCH);
+
+    lsn_t begin;
+    vector<char> payload;
+    {
+        lock_guard<mutex> guard(latch);
+        begin = log->append(0, WAL_CHECKPOINT_BEGIN, 0, NULL, 0);
+        wal_checkpoint_t counts = {(uint32_t) dirty.size(), (uint32_t) txns.size()};
+        payload.resize(sizeof(counts) + counts.dirty_pages * sizeof(wal_dirty_page_t) +
+                       counts.active_txns * sizeof(wal_active_txn_t));
+        char *at = payload.data();
+        memcpy(at, &counts, sizeof(counts));
+        at += sizeof(counts);
+        for(auto& node: dirty){
+            wal_dirty_page_t entry = {node.first, 0, node.second.rec_lsn};
+            memcpy(at, &entry, sizeof(entry));
+            at += sizeof(entry);
+        }
+        for(auto& node: txns){
+            wal_active_txn_t entry = {node.first, node.second.last_lsn};
+            memcpy(at, &entry, sizeof(entry));
+            at += sizeof(entry);
+        }
+    }
+    lsn_t end = log->append(0, WAL_CHECKPOINT_END, begin, payload.data(), payload.size());
+    if(log->flush(end + 1) != 0 || log->set_checkpoint(begin) != 0)
+        return -1;
+    last_checkpoint = begin;
+    lock_guard<mutex> guard(latch);
+    stats.checkpoints++;
+    return 0;
+}
+
+void LoggedStore::_run_checkpointer(){
+    unique_lock<mutex> guard(checkpointer_latch);
+    while(!stopping){
+        checkpointer_cond.wait_for(guard, chrono::milliseconds(checkpoint_interval_ms));
+        if(stopping)
+            break;
+        guard.unlock();
+        checkpoint();
+        guard.lock();
+    }
+}
+
+logged_store_stats_t LoggedStore::get_stats(){
+    lock_guard<mutex> guard(latch);
+    logged_store_stats_t snapshot = stats;
+    snapshot.dirty_pages = dirty.size();
+    return snapshot;
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "recovery.h"
+
+using namespace std;
+
+typedef struct{
+    lsn_t checkpoint;
+    unordered_map<page_ptr_t, lsn_t> dirty;     // page to rec_lsn
+    unordered_map<uint64_t, lsn_t> txns;        // loser to last_lsn
+    unordered_set<uint64_t> ended;
+    uint64_t records;
+}analysis_t;
+
+typedef struct{
+    lsn_t lsn;
+    wal_update_t update;
+}redo_record_t;
+
+// one per redo thread: its pages, each with its records in log order.
+typedef struct{
+    map<page_ptr_t, vector<redo_record_t>> pages;
+    uint64_t redone;
+    uint64_t skipped;
+    uint64_t pages_redone;
+    bool failed;
+}redo_partition_t;
+
+typedef struct{
+    analysis_t *analysis;
+    vector<redo_partition_t> *partitions;
+}redo_t;
+
+static bool analyse(void *ctx, const wal_header_t *header, const char *payload){
+    analysis_t *a = (analysis_t*) ctx;
+    a->records++;
+    switch(header->type){
+    case WAL_UPDATE:
+    case WAL_CLR:{
+        // a CLR starts with the update it applies.
+        wal_update_t update;
+        memcpy(&update, payload, sizeof(update));
+        a->txns[header->txn_id] = header->lsn;
+        a->dirty.emplace(update.page, header->lsn);
+        break;
+    }
+    case WAL_COMMIT:
+    case WAL_ABORT:
+        a->txns.erase(header->txn_id);
+        a->ended.insert(header->txn_id);
+        break;
+    case WAL_CHECKPOINT_END:{
+        if(header->prev_lsn != a->checkpoint)
+            break;
+        // the tables as of the BEGIN; what came after it has been seen.
+        wal_checkpoint_t counts;
+        memcpy(&counts, payload, sizeof(counts));
+        const char *at = payload + sizeof(counts);
+        for(uint32_t i = 0; i < counts.dirty_pages; i++, at += sizeof(wal_dirty_page_t)){
+            wal_dirty_page_t entry;
+            memcpy(&entry, at, sizeof(entry));
+            auto known = a->dirty.emplace(entry.page, entry.rec_lsn);
+            if(!known.second)
+                known.first->second = min(known.first->second, entry.rec_lsn);
+        }
+        for(uint32_t i = 0; i < counts.active_txns; i++, at += sizeof(wal_active_txn_t)){
+            wal_active_txn_t entry;
+            memcpy(&entry, at, sizeof(entry));
+            if(a->ended.count(entry.txn_id) == 0)
+                a->txns.emplace(entry.txn_id, entry.last_lsn);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return true;
+}
+
+static bool partition(void *ctx, const wal_header_t *header, const char *payload){
+    redo_t *redo = (redo_t*) ctx;
+    if(header->type != WAL_UPDATE && header->type != WAL_CLR)
+        return true;
+    redo_record_t record;
+    record.lsn = header->lsn;
+    memcpy(&record.update, payload, sizeof(record.update));
+    auto dirty = redo->analysis->dirty.find(record.update.page);
+    if(dirty == redo->analysis->dirty.end() || record.lsn < dirty->second)
+        return true;
+    vector<redo_partition_t>& partitions = *redo->partitions;
+    partitions[(record.update.page / (PAGE_SIZE)) % partitions.size()].pages[record.update.page].push_back(record);
+    return true;
+}
+
+static void redo_pages(int db_file, redo_partition_t *part){
+    for(auto& node: part->pages){
+        page_t *page = load_page(db_file, node.first);
+        if(page == NULL){
+            part->failed = true;
+            return;
+        }
+        page_content_t *content = page->page_content;
+        bool changed = false;
+        for(redo_record_t& record: node.second){
+            if(record.lsn <= *(content->page_lsn)){
+                part->skipped++;
+                continue;
+            }
+            // not there: the account moved off the page after a full write
+            // back, so the change is on disk already.
+            for(uint32_t i = 0; i < *(content->count); i++){
+                if(strncmp(record.update.user_id, content->db_entries[i]->user_id, USERID_LENGTH) == 0){
+                    content->db_entries[i]->balance += record.update.delta;
+                    part->redone++;
+                    break;
+                }
+            }
+            *(content->page_lsn) = record.lsn;
+            changed = true;
+        }
+        if(free_page(db_file, page, changed) != 0){
+            part->failed = true;
+            return;
+        }
+        if(changed)
+            part->pages_redone++;
+    }
+}
+
+static uint64_t elapsed_ns(chrono::steady_clock::time_point start){
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+int wal_recover(int db_file, WriteAheadLog *log, uint32_t redo_threads, recovery_stats_t *stats){
+    recovery_stats_t local;
+    if(stats == NULL)
+        stats = &local;
+    *stats = {};
+    if(redo_threads == 0)
+        redo_threads = 1;
+
+    auto start = chrono::steady_clock::now();
+    analysis_t analysis;
+    analysis.checkpoint = log->get_checkpoint();
+    analysis.records = 0;
+    stats->checkpoint_lsn = analysis.checkpoint;
+    stats->end_lsn = log->scan(analysis.checkpoint, analyse, &analysis);
+    stats->records_analysed = analysis.records;
+    stats->losers = analysis.txns.size();
+    stats->analysis_ns = elapsed_ns(start);
+
+    start = chrono::steady_clock::now();
+    if(!analysis.dirty.empty()){
+        lsn_t redo_lsn = UINT64_MAX;
+        for(auto& node: analysis.dirty)
+            redo_lsn = min(redo_lsn, node.second);
+        stats->redo_lsn = redo_lsn;
+        vector<redo_partition_t> partitions(redo_threads);
+        for(auto& part: partitions){
+            part.redone = part.skipped = part.pages_redone = 0;
+            part.failed = false;
+        }
+        redo_t redo = {&analysis, &partitions};
+        log->scan(redo_lsn, partition, &redo);
+        vector<thread> workers;
+        for(uint32_t t = 1; t < redo_threads; t++)
+            workers.emplace_back(redo_pages, db_file, &partitions[t]);
+        redo_pages(db_file, &partitions[0]);
+        for(auto& worker: workers)
+            worker.join();
+        bool failed = false;
+        for(auto& part: partitions){
+            stats->records_redone += part.redone;
+            stats->records_skipped += part.skipped;
+            stats->pages_redone += part.pages_redone;
+            failed |= part.failed;
+        }
+        if(failed || fdatasync(db_file) != 0)
+            return -1;
+    }
+    stats->redo_ns = elapsed_ns(start);
+
+    start = chrono::steady_clock::now();
+    {
+        LoggedStore store(db_file, log);
+        for(auto& loser: analysis.txns){
+            if(store.undo(loser.first, loser.second) != 0)
+                return -1;
+        }
+        if(store.flush_dirty(SIZE_MAX) < 0 || store.checkpoint() != 0)
+            return -1;
+    }
+    stats->undo_ns = elapsed_ns(start);
+    return 0;
+}
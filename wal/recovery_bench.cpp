@@ -0,0 +1,176 @@
+/*
+* Restart time after a crash, with and without checkpoints, as the number
+* of redo threads grows.
+*
+* usage: recovery_bench [accounts] [seconds] [checkpoint_ms] [max_threads] [dir]
+*
+* A child process moves money between random accounts through LoggedStore
+* (one transfer in sixteen is aborted on purpose) and is killed with SIGKILL
+* after `seconds`: its dirty pages are lost and some transfers are cut off
+* halfway. It runs twice, once without checkpoints and once with one every
+* `checkpoint_ms`. Each crashed database is then copied and recovered with
+* 1, 2, 4, ... redo threads. Recovery has to bring every account back and
+* the money back to its initial total.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <sys/wait.h>
+#include "recovery.h"
+
+using namespace std;
+
+#define INITIAL_BALANCE     1000
+#define WORKERS             4
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%06u", account);
+}
+
+static int build_db(const string& path, uint32_t accounts){
+    unlink(path.c_str());
+    int db_file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0)
+        return -1;
+    db_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.balance = INITIAL_BALANCE;
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, entry.user_id);
+        if(btree_insert(db_file, PAGE_SIZE, &entry) != 0)
+            return -1;
+    }
+    fdatasync(db_file);
+    return db_file;
+}
+
+static bool copy_file(const string& from, const string& to){
+    int in = open(from.c_str(), O_RDONLY);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = in >= 0 && out >= 0;
+    vector<char> buf(1 << 20);
+    ssize_t got;
+    while(ok && (got = read(in, buf.data(), buf.size())) > 0)
+        ok = write(out, buf.data(), got) == got;
+    if(in >= 0)
+        close(in);
+    if(out >= 0)
+        close(out);
+    return ok;
+}
+
+static void transfers(LoggedStore *store, uint32_t accounts, uint32_t id){
+    mt19937_64 rng(id + 1);
+    uniform_int_distribution<uint32_t> pick(0, accounts - 1);
+    char from[USERID_LENGTH], to[USERID_LENGTH];
+    for(uint64_t i = 0;; i++){
+        uint64_t txn_id = (uint64_t) (id + 1) << 40 | i;
+        account_name(pick(rng), from);
+        account_name(pick(rng), to);
+        if(store->update(txn_id, from, -1) != 0 || store->update(txn_id, to, 1) != 0 || i % 16 == 15)
+            store->abort(txn_id);
+        else
+            store->commit(txn_id);
+    }
+}
+
+// never returns: killed by the parent.
+static void crash_child(const string& db_path, const string& log_path, uint32_t accounts,
+                        uint32_t checkpoint_ms){
+    int db_file = open(db_path.c_str(), O_RDWR);
+    WriteAheadLog *log = new WriteAheadLog(log_path.c_str());
+    LoggedStore *store = new LoggedStore(db_file, log, SIZE_MAX, checkpoint_ms);
+    vector<thread> workers;
+    for(uint32_t t = 0; t < WORKERS; t++)
+        workers.emplace_back(transfers, store, accounts, t);
+    for(auto& worker: workers)
+        worker.join();
+}
+
+static bool check_db(int db_file, uint32_t accounts){
+    char name[USERID_LENGTH];
+    tuple_info_t info;
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, name);
+        if(btree_find(db_file, name, USERID_LENGTH, &info) != 0)
+            return false;
+        total += info.page->page_content->db_entries[info.index]->balance;
+        free_page(db_file, info.page, 0);
+    }
+    return total == (uint64_t) accounts * INITIAL_BALANCE;
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts      = (argc > 1) ? atoi(argv[1]) : 20000;
+    double   seconds       = (argc > 2) ? atof(argv[2]) : 2.0;
+    uint32_t checkpoint_ms = (argc > 3) ? atoi(argv[3]) : 100;
+    uint32_t max_threads   = (argc > 4) ? atoi(argv[4]) : 8;
+    string   dir           = (argc > 5) ? argv[5] : ".";
+    string db_path  = dir + "/recovery_bench.db";
+    string log_path = dir + "/recovery_bench.log";
+    string db_copy  = db_path + ".copy";
+    string log_copy = log_path + ".copy";
+    if(accounts < 2)
+        accounts = 2;
+
+    cout << left << setw(12) << "checkpoints" << right << setw(8) << "threads" << setw(12) << "log MiB"
+         << setw(12) << "redo MiB" << setw(10) << "redone" << setw(8) << "pages" << setw(8) << "losers"
+         << setw(13) << "analysis ms" << setw(9) << "redo ms" << setw(9) << "undo ms" << setw(6) << "ok" << endl;
+    int rc = 0;
+    for(uint32_t interval: {0u, checkpoint_ms}){
+        int db_file = build_db(db_path, accounts);
+        if(db_file < 0){
+            cerr << "cannot build " << db_path << endl;
+            return 1;
+        }
+        close(db_file);
+        unlink(log_path.c_str());
+        pid_t child = fork();
+        if(child == 0){
+            crash_child(db_path, log_path, accounts, interval);
+            _exit(0);
+        }
+        this_thread::sleep_for(chrono::duration<double>(seconds));
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+
+        for(uint32_t threads = 1; threads <= max_threads; threads *= 2){
+            if(!copy_file(db_path, db_copy) || !copy_file(log_path, log_copy)){
+                cerr << "cannot copy the crashed database" << endl;
+                return 1;
+            }
+            db_file = open(db_copy.c_str(), O_RDWR);
+            recovery_stats_t stats;
+            bool ok;
+            {
+                WriteAheadLog log(log_copy.c_str());
+                ok = wal_recover(db_file, &log, threads, &stats) == 0;
+            }
+            ok = ok && check_db(db_file, accounts);
+            close(db_file);
+            if(!ok)
+                rc = 1;
+            lsn_t redo_from = stats.redo_lsn ? stats.redo_lsn : stats.end_lsn;
+            cout << left << setw(12) << (interval ? to_string(interval) + " ms" : "none") << right
+                 << setw(8) << threads << fixed << setprecision(1)
+                 << setw(12) << stats.end_lsn / 1048576.0 << setw(12) << (stats.end_lsn - redo_from) / 1048576.0
+                 << setw(10) << stats.records_redone << setw(8) << stats.pages_redone << setw(8) << stats.losers
+                 << setw(13) << stats.analysis_ns / 1e6 << setw(9) << stats.redo_ns / 1e6
+                 << setw(9) << stats.undo_ns / 1e6 << setw(6) << (ok ? "yes" : "NO") << endl;
+        }
+    }
+    unlink(db_path.c_str());
+    unlink(log_path.c_str());
+    unlink(db_copy.c_str());
+    unlink(log_copy.c_str());
+    return rc;
+}
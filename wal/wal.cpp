@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "crc32c.h"
+#include "wal.h"
+
+using namespace std;
+
+#define WAL_MAX_RECORD  (1 << 24)
+
+// the checksum covers a record from its `lsn` field on.
+#define WAL_CHECKSUM_SKIP   (2 * sizeof(uint32_t))
+
+uint32_t wal_checksum(const void *data, size_t length){
+    return crc32c(0, data, length);
+}
+
+static bool pwrite_all(int fd, const char *buf, size_t size, off_t offset){
+    while(size > 0){
+        ssize_t written = pwrite(fd, buf, size, offset);
+        if(written < 0){
+            if(errno == EINTR || errno == EAGAIN)
+                continue;
+            return false;
+        }
+        buf += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+WriteAheadLog::WriteAheadLog(const char *path){
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+        throw WalFailure(string("open ") + path + ": " + strerror(errno));
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        close(fd);
+        throw WalFailure(string("fstat: ") + strerror(errno));
+    }
+    stats = {};
+    checkpoint_lsn = 0;
+    flushing = false;
+    failed = false;
+    wal_file_header_t header;
+    if(st.st_size < WAL_FIRST_LSN){
+        memset(&header, 0, sizeof(header));
+        header.magic = WAL_MAGIC;
+        header.version = 1;
+        if(!pwrite_all(fd, (const char*) &header, sizeof(header), 0) || ftruncate(fd, WAL_FIRST_LSN) != 0 ||
+           fdatasync(fd) != 0){
+            close(fd);
+            throw WalFailure(string("initializing the log: ") + strerror(errno));
+        }
+        end_lsn = WAL_FIRST_LSN;
+    }
+    else{
+        if(pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != WAL_MAGIC){
+            close(fd);
+            throw WalFailure(string(path) + " is not a log");
+        }
+        // everything on disk is up for the scan; a torn tail ends the log.
+        flushed_lsn = st.st_size;
+        end_lsn = scan(WAL_FIRST_LSN, NULL, NULL);
+        if(end_lsn < (lsn_t) st.st_size && (ftruncate(fd, end_lsn) != 0 || fdatasync(fd) != 0)){
+            close(fd);
+            throw WalFailure(string("truncating a torn log tail: ") + strerror(errno));
+        }
+        if(header.checkpoint_lsn < end_lsn)
+            checkpoint_lsn = header.checkpoint_lsn;
+    }
+    tail_lsn = flushed_lsn = end_lsn;
+    tail.reserve(WAL_BUFFER_SIZE);
+    flushing_tail.reserve(WAL_BUFFER_SIZE);
+}
+
+WriteAheadLog::~WriteAheadLog(){
+    flush_all();
+    close(fd);
+}
+
+lsn_t WriteAheadLog::append(uint64_t txn_id, wal_record_type_t type, lsn_t prev_lsn,
+                            const void *payload, uint32_t length){
+    wal_header_t header;
+    header.length   = sizeof(header) + length;
+    header.prev_lsn = prev_lsn;
+    header.txn_id   = txn_id;
+    header.type     = type;
+    header.reserved = 0;
+    lock_guard<mutex> guard(latch);
+    header.lsn = end_lsn;
+    size_t at = tail.size();
+    tail.resize(at + header.length);
+    char *record = &tail[at];
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), payload, length);
+    uint32_t checksum = wal_checksum(record + WAL_CHECKSUM_SKIP, header.length - WAL_CHECKSUM_SKIP);
+    memcpy(record + sizeof(uint32_t), &checksum, sizeof(checksum));
+    end_lsn += header.length;
+    stats.records++;
+    stats.bytes += header.length;
+    return header.lsn;
+}
+
+int WriteAheadLog::flush(lsn_t upto){
+    unique_lock<mutex> guard(latch);
+    if(upto > end_lsn)
+        upto = end_lsn;
+    bool led = false;
+    while(flushed_lsn < upto){
+        if(failed)
+            return -1;
+        if(flushing){
+            flushed.wait(guard);
+            continue;
+        }
+        // lead: take everything appended so far, ours and the others'.
+        flushing = true;
+        led = true;
+        swap(tail, flushing_tail);
+        lsn_t from = tail_lsn, to = end_lsn;
+        tail_lsn = end_lsn;
+        guard.unlock();
+        auto start = chrono::steady_clock::now();
+        bool ok = pwrite_all(fd, flushing_tail.data(), flushing_tail.size(), from) && fdatasync(fd) == 0;
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        guard.lock();
+        flushing_tail.clear();
+        flushing = false;
+        if(ok){
+            flushed_lsn = to;
+            stats.flushes++;
+            stats.flush_ns += ns;
+        }
+        else{
+            failed = true;
+        }
+        flushed.notify_all();
+    }
+    if(!led && upto > WAL_FIRST_LSN)
+        stats.piggybacked++;
+    return failed ? -1 : 0;
+}
+
+// makes buf hold [pos, pos + need); false if that goes past limit.
+static bool wal_window(int fd, vector<char>& buf, lsn_t& buf_lsn, lsn_t pos, size_t need, lsn_t limit){
+    if(pos + need > limit)
+        return false;
+    if(pos >= buf_lsn && pos + need <= buf_lsn + buf.size())
+        return true;
+    size_t size = max(need, (size_t) WAL_BUFFER_SIZE);
+    if(pos + size > limit)
+        size = limit - pos;
+    buf.resize(size);
+    if(pread(fd, buf.data(), size, pos) != (ssize_t) size)
+        return false;
+    buf_lsn = pos;
+    return true;
+}
+
+lsn_t WriteAheadLog::scan(lsn_t from, wal_visitor_t visit, void *ctx){
+    lsn_t limit = get_flushed_lsn();
+    vector<char> buf;
+    lsn_t buf_lsn = 0;
+    lsn_t pos = max(from, (lsn_t) WAL_FIRST_LSN);
+    wal_header_t header;
+    while(wal_window(fd, buf, buf_lsn, pos, sizeof(header), limit)){
+        memcpy(&header, &buf[pos - buf_lsn], sizeof(header));
+        if(header.length < sizeof(header) || header.length > WAL_MAX_RECORD || header.lsn != pos)
+            break;
+        if(!wal_window(fd, buf, buf_lsn, pos, header.length, limit))
+            break;
+        const char *record = &buf[pos - buf_lsn];
+        if(wal_checksum(record + WAL_CHECKSUM_SKIP, header.length - WAL_CHECKSUM_SKIP) != header.checksum)
+            break;
+        pos += header.length;
+        if(visit != NULL && !visit(ctx, &header, record + sizeof(header)))
+            break;
+    }
+    return pos;
+}
+
+int WriteAheadLog::read(lsn_t lsn, wal_header_t *header, vector<char>& payload){
+    if(lsn < WAL_FIRST_LSN || lsn + sizeof(*header) > get_flushed_lsn())
+        return -1;
+    if(pread(fd, header, sizeof(*header), lsn) != sizeof(*header) || header->lsn != lsn ||
+       header->length < sizeof(*header) || header->length > WAL_MAX_RECORD)
+        return -1;
+    vector<char> record(header->length);
+    memcpy(record.data(), header, sizeof(*header));
+    size_t length = header->length - sizeof(*header);
+    if(pread(fd, record.data() + sizeof(*header), length, lsn + sizeof(*header)) != (ssize_t) length ||
+       wal_checksum(record.data() + WAL_CHECKSUM_SKIP, header->length - WAL_CHECKSUM_SKIP) != header->checksum)
+        return -1;
+    payload.assign(record.begin() + sizeof(*header), record.end());
+    return 0;
+}
+
+int WriteAheadLog::set_checkpoint(lsn_t lsn){
+    if(!pwrite_all(fd, (const char*) &lsn, sizeof(lsn), offsetof(wal_file_header_t, checkpoint_lsn)) ||
+       fdatasync(fd) != 0)
+        return -1;
+    lock_guard<mutex> guard(latch);
+    checkpoint_lsn = lsn;
+    return 0;
+}
+
+lsn_t WriteAheadLog::get_checkpoint(){
+    lock_guard<mutex> guard(latch);
+    return checkpoint_lsn;
+}
+
+lsn_t WriteAheadLog::get_end_lsn(){
+    lock_guard<mutex> guard(latch);
+    return end_lsn;
+}
+
+lsn_t WriteAheadLog::get_flushed_lsn(){
+    lock_guard<mutex> guard(latch);
+    return flushed_lsn;
+}
+
+wal_stats_t WriteAheadLog::get_stats(){
+    lock_guard<mutex> guard(latch);
+    wal_stats_t snapshot = stats;
+    snapshot.checkpoint_lsn = checkpoint_lsn;
+    snapshot.end_lsn = end_lsn;
+    snapshot.flushed_lsn = flushed_lsn;
+    return snapshot;
+}
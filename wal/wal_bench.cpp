@@ -0,0 +1,176 @@
+/*
+* Durable DEPOSIT throughput: in place against the write-ahead log.
+*
+* usage: wal_bench [accounts] [deposits_per_thread] [max_threads] [dir]
+*
+* in place: what b_storage does today. Find the account, change the balance,
+*           write the 4 KiB page back and fdatasync() the database file,
+*           one request at a time (b_storage is single threaded).
+* logged:   LoggedStore::apply_request(): one log record per deposit, the
+*           commit waits for a group flush of the log, the pages are
+*           written back once at the end.
+*
+* Every run starts from the same freshly built database and checks every
+* balance afterwards, after the dirty pages were written back.
+*/
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "logged_store.h"
+
+using namespace std;
+
+#define INITIAL_BALANCE     1000
+
+static void account_name(uint32_t account, char *user_id){
+    memset(user_id, 0, USERID_LENGTH);
+    snprintf(user_id, USERID_LENGTH, "acct%06u", account);
+}
+
+static int build_db(const string& path, uint32_t accounts){
+    unlink(path.c_str());
+    int db_file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(db_file < 0 || init_db_storage(db_file, PAGE_SIZE) != 0)
+        return -1;
+    db_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.balance = INITIAL_BALANCE;
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, entry.user_id);
+        if(btree_insert(db_file, PAGE_SIZE, &entry) != 0)
+            return -1;
+    }
+    fdatasync(db_file);
+    return db_file;
+}
+
+static bool check_db(int db_file, uint32_t accounts, const vector<uint64_t>& deposits){
+    char name[USERID_LENGTH];
+    tuple_info_t info;
+    for(uint32_t i = 0; i < accounts; i++){
+        account_name(i, name);
+        if(btree_find(db_file, name, USERID_LENGTH, &info) != 0)
+            return false;
+        amount_t balance = info.page->page_content->db_entries[info.index]->balance;
+        free_page(db_file, info.page, 0);
+        if(balance != INITIAL_BALANCE + deposits[i])
+            return false;
+    }
+    return true;
+}
+
+typedef struct{
+    int db_file;
+    mutex *storage_latch;
+    LoggedStore *store;
+    uint32_t accounts;
+    uint64_t deposits;
+    vector<uint64_t> *credited;
+    mutex *credited_latch;
+}bench_t;
+
+static void in_place_worker(bench_t *bench, uint32_t id){
+    mt19937_64 rng(id + 1);
+    uniform_int_distribution<uint32_t> pick(0, bench->accounts - 1);
+    vector<uint64_t> credited(bench->accounts, 0);
+    char name[USERID_LENGTH];
+    tuple_info_t info;
+    for(uint64_t i = 0; i < bench->deposits; i++){
+        uint32_t account = pick(rng);
+        account_name(account, name);
+        lock_guard<mutex> guard(*bench->storage_latch);
+        if(btree_find(bench->db_file, name, USERID_LENGTH, &info) != 0)
+            continue;
+        info.page->page_content->db_entries[info.index]->balance += 1;
+        if(free_page(bench->db_file, info.page, 1) == 0 && fdatasync(bench->db_file) == 0)
+            credited[account]++;
+    }
+    lock_guard<mutex> guard(*bench->credited_latch);
+    for(uint32_t a = 0; a < bench->accounts; a++)
+        (*bench->credited)[a] += credited[a];
+}
+
+static void logged_worker(bench_t *bench, uint32_t id){
+    mt19937_64 rng(id + 1);
+    uniform_int_distribution<uint32_t> pick(0, bench->accounts - 1);
+    vector<uint64_t> credited(bench->accounts, 0);
+    request_data_t request;
+    memset(&request, 0, sizeof(request));
+    request.req = DEPOSIT;
+    request.amount = 1;
+    for(uint64_t i = 0; i < bench->deposits; i++){
+        uint32_t account = pick(rng);
+        account_name(account, request.userid);
+        if(bench->store->apply_request((uint64_t) id << 40 | i, &request) == 0)
+            credited[account]++;
+    }
+    lock_guard<mutex> guard(*bench->credited_latch);
+    for(uint32_t a = 0; a < bench->accounts; a++)
+        (*bench->credited)[a] += credited[a];
+}
+
+int main(int argc, char **argv){
+    uint32_t accounts    = (argc > 1) ? atoi(argv[1]) : 10000;
+    uint64_t deposits    = (argc > 2) ? atoll(argv[2]) : 500;
+    uint32_t max_threads = (argc > 3) ? atoi(argv[3]) : 16;
+    string   dir         = (argc > 4) ? argv[4] : ".";
+    string db_path  = dir + "/wal_bench.db";
+    string log_path = dir + "/wal_bench.log";
+
+    cout << left << setw(10) << "mode" << right << setw(8) << "threads" << setw(12) << "deposits/s"
+         << setw(16) << "syncs/deposit" << setw(13) << "page writes" << setw(8) << "ok" << endl;
+    int rc = 0;
+    for(uint32_t threads = 1; threads <= max_threads; threads *= 2){
+        for(int logged = 0; logged <= 1; logged++){
+            int db_file = build_db(db_path, accounts);
+            if(db_file < 0){
+                cerr << "cannot build " << db_path << endl;
+                return 1;
+            }
+            unlink(log_path.c_str());
+            mutex storage_latch, credited_latch;
+            vector<uint64_t> credited(accounts, 0);
+            uint64_t syncs, page_writes;
+            double seconds;
+            {
+                WriteAheadLog log(log_path.c_str());
+                LoggedStore store(db_file, &log, SIZE_MAX);
+                bench_t bench = {db_file, &storage_latch, &store, accounts, deposits, &credited, &credited_latch};
+                vector<thread> workers;
+                auto start = chrono::steady_clock::now();
+                for(uint32_t t = 0; t < threads; t++)
+                    workers.emplace_back(logged ? logged_worker : in_place_worker, &bench, t);
+                for(auto& worker: workers)
+                    worker.join();
+                seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                if(logged){
+                    store.flush_dirty(SIZE_MAX);
+                    syncs = log.get_stats().flushes;
+                    page_writes = store.get_stats().page_writes;
+                }
+                else{
+                    syncs = page_writes = threads * deposits;
+                }
+            }
+            bool ok = check_db(db_file, accounts, credited);
+            close(db_file);
+            if(!ok)
+                rc = 1;
+            uint64_t total = threads * deposits;
+            cout << left << setw(10) << (logged ? "logged" : "in place") << right << setw(8) << threads
+                 << setw(12) << fixed << setprecision(0) << total / seconds
+                 << setw(16) << setprecision(3) << (double) syncs / total
+                 << setw(13) << page_writes << setw(8) << (ok ? "yes" : "NO") << endl;
+        }
+    }
+    unlink(db_path.c_str());
+    unlink(log_path.c_str());
+    return rc;
+}